@@ -0,0 +1,290 @@
+//
+//  bench_parallel.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Benchmark for the parallel generation of files that cover every
+// process in procfs_parallel.c. Builds a snapshot of a synthetic process
+// source in the same way as the columns files are built, with each shard
+// of processes filling its own rows and the rows of processes that have
+// exited being squeezed out afterwards, and compares the time taken with
+// different numbers of workers. Examining a synthetic process walks its
+// threads, which are allocated separately, in the same way as getting
+// the task information for a real process visits each of its threads.
+// A few processes with low process ids have many threads, as system
+// daemons do, so the work is not spread evenly over the process ids and
+// an equal division of the shards leaves some threads with more to do.
+//
+// Usage: bench_parallel [seed [processors]]. The processor count
+// defaults to the number of online processors.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "procfs_parallel.h"
+
+OSMallocTag procfs_osmalloc_tag;
+unsigned int processor_count;
+
+// The fraction of processes, in percent, that have many threads and
+// the range of their thread counts.
+#define BENCH_HEAVY_PERCENT         5
+#define BENCH_HEAVY_MIN_THREADS     64
+#define BENCH_HEAVY_MAX_THREADS     512
+
+// The largest thread count of other processes.
+#define BENCH_MAX_THREADS           8
+
+// The fraction of processes, in per mille, that exit before they are examined.
+#define BENCH_EXITED_PER_MILLE      10
+
+// The columns of the snapshot.
+#define BENCH_COLUMN_PID            0
+#define BENCH_COLUMN_THREADS        1
+#define BENCH_COLUMN_UTIME          2
+#define BENCH_COLUMN_STIME          3
+#define BENCH_COLUMN_RSS            4
+#define BENCH_COLUMN_COUNT          5
+
+/*
+ * A synthetic thread, with the fields that the task information
+ * sums over every thread.
+ */
+typedef struct bench_thread {
+    uint64_t    user_time;
+    uint64_t    system_time;
+    uint64_t    resident_pages;
+    char        pad[40];            // The rest of the thread structure.
+} bench_thread_t;
+
+/*
+ * A synthetic process.
+ */
+typedef struct bench_proc {
+    pid_t           pid;
+    int             exited;
+    int             thread_count;
+    bench_thread_t  **threads;
+} bench_proc_t;
+
+/*
+ * The synthetic process source, in order of process id.
+ */
+typedef struct bench_source {
+    int             count;
+    bench_proc_t    *procs;
+} bench_source_t;
+
+/*
+ * A snapshot being built, with one array for each column.
+ */
+typedef struct bench_snapshot {
+    bench_source_t  *source;
+    uint64_t        *columns[BENCH_COLUMN_COUNT];
+    uint8_t         *filled;
+    int             rows;
+} bench_snapshot_t;
+
+static uint64_t
+bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+bench_build_source(bench_source_t *source, int count) {
+    source->count = count;
+    source->procs = calloc(count, sizeof(bench_proc_t));
+    pid_t pid = 0;
+    for (int i = 0; i < count; i++) {
+        bench_proc_t *proc = &source->procs[i];
+        pid += 1 + rand() % 4;
+        proc->pid = pid;
+        proc->exited = rand() % 1000 < BENCH_EXITED_PER_MILLE;
+
+        // Heavy processes are concentrated in the first tenth of the
+        // process ids, where long-running daemons are found.
+        int heavy = i < count/10 && rand() % 100 < BENCH_HEAVY_PERCENT * 10;
+        proc->thread_count = heavy
+                ? BENCH_HEAVY_MIN_THREADS + rand() % (BENCH_HEAVY_MAX_THREADS - BENCH_HEAVY_MIN_THREADS + 1)
+                : 1 + rand() % BENCH_MAX_THREADS;
+        proc->threads = malloc(proc->thread_count * sizeof(bench_thread_t *));
+        for (int j = 0; j < proc->thread_count; j++) {
+            bench_thread_t *thread = calloc(1, sizeof(bench_thread_t));
+            thread->user_time = rand();
+            thread->system_time = rand();
+            thread->resident_pages = rand() % 1024;
+            proc->threads[j] = thread;
+        }
+    }
+}
+
+static void
+bench_free_source(bench_source_t *source) {
+    for (int i = 0; i < source->count; i++) {
+        bench_proc_t *proc = &source->procs[i];
+        for (int j = 0; j < proc->thread_count; j++) {
+            free(proc->threads[j]);
+        }
+        free(proc->threads);
+    }
+    free(source->procs);
+}
+
+/*
+ * Fills the rows for one shard of processes, as procfs_columns_fill_rows()
+ * does for the columns files.
+ */
+static void
+bench_fill_rows(void *arg, int start, int end) {
+    bench_snapshot_t *snapshot = (bench_snapshot_t *)arg;
+    for (int i = start; i < end; i++) {
+        bench_proc_t *proc = &snapshot->source->procs[i];
+        if (proc->exited) {
+            continue;
+        }
+
+        uint64_t user_time = 0;
+        uint64_t system_time = 0;
+        uint64_t resident_pages = 0;
+        for (int j = 0; j < proc->thread_count; j++) {
+            bench_thread_t *thread = proc->threads[j];
+            user_time += thread->user_time;
+            system_time += thread->system_time;
+            resident_pages += thread->resident_pages;
+        }
+        snapshot->columns[BENCH_COLUMN_PID][i] = proc->pid;
+        snapshot->columns[BENCH_COLUMN_THREADS][i] = proc->thread_count;
+        snapshot->columns[BENCH_COLUMN_UTIME][i] = user_time;
+        snapshot->columns[BENCH_COLUMN_STIME][i] = system_time;
+        snapshot->columns[BENCH_COLUMN_RSS][i] = resident_pages * 4096;
+        snapshot->filled[i] = 1;
+    }
+}
+
+/*
+ * Squeezes out the rows of processes that exited, as
+ * procfs_columns_compact() does.
+ */
+static int
+bench_compact(bench_snapshot_t *snapshot) {
+    int row_count = 0;
+    for (int row = 0; row < snapshot->rows; row++) {
+        if (snapshot->filled[row]) {
+            if (row_count != row) {
+                for (int i = 0; i < BENCH_COLUMN_COUNT; i++) {
+                    snapshot->columns[i][row_count] = snapshot->columns[i][row];
+                }
+            }
+            row_count++;
+        }
+    }
+    return row_count;
+}
+
+/*
+ * Builds a snapshot of every process with a given worker limit and
+ * returns the number of rows.
+ */
+static int
+bench_snapshot(bench_snapshot_t *snapshot, int max_workers) {
+    procfs_parallel_max_workers = max_workers;
+    for (int i = 0; i < BENCH_COLUMN_COUNT; i++) {
+        memset(snapshot->columns[i], 0, snapshot->rows * sizeof(uint64_t));
+    }
+    memset(snapshot->filled, 0, snapshot->rows);
+    procfs_parallel_run(snapshot->rows, bench_fill_rows, snapshot);
+    return bench_compact(snapshot);
+}
+
+static void
+bench_alloc_snapshot(bench_snapshot_t *snapshot, bench_source_t *source) {
+    snapshot->source = source;
+    snapshot->rows = source->count;
+    for (int i = 0; i < BENCH_COLUMN_COUNT; i++) {
+        snapshot->columns[i] = malloc(source->count * sizeof(uint64_t));
+    }
+    snapshot->filled = malloc(source->count);
+}
+
+static void
+bench_free_snapshot(bench_snapshot_t *snapshot) {
+    for (int i = 0; i < BENCH_COLUMN_COUNT; i++) {
+        free(snapshot->columns[i]);
+    }
+    free(snapshot->filled);
+}
+
+static void
+bench_run(int process_count, int *worker_counts, int worker_count_count) {
+    bench_source_t source;
+    bench_build_source(&source, process_count);
+
+    // Take a serial snapshot to check the others against.
+    bench_snapshot_t expected;
+    bench_snapshot_t snapshot;
+    bench_alloc_snapshot(&expected, &source);
+    bench_alloc_snapshot(&snapshot, &source);
+    int expected_rows = bench_snapshot(&expected, 0);
+    printf("%d processes, %d still running\n", process_count, expected_rows);
+
+    int iterations = process_count >= 100000 ? 20 : process_count >= 10000 ? 200 : 2000;
+    double serial_ns = 0;
+    for (int w = 0; w < worker_count_count; w++) {
+        int workers = worker_counts[w];
+        int rows = bench_snapshot(&snapshot, workers);
+        for (int i = 0; i < BENCH_COLUMN_COUNT; i++) {
+            if (rows != expected_rows
+                    || memcmp(snapshot.columns[i], expected.columns[i], rows * sizeof(uint64_t)) != 0) {
+                fprintf(stderr, "Snapshot with %d workers does not match the serial snapshot\n", workers);
+                exit(1);
+            }
+        }
+
+        uint64_t start = bench_now_ns();
+        for (int i = 0; i < iterations; i++) {
+            bench_snapshot(&snapshot, workers);
+        }
+        double ns = (double)(bench_now_ns() - start)/iterations;
+        if (workers == 0) {
+            serial_ns = ns;
+        }
+        printf("  %2d workers %12.1f us/snapshot %6.2fx\n", workers, ns/1000, serial_ns/ns);
+    }
+    printf("\n");
+
+    bench_free_snapshot(&expected);
+    bench_free_snapshot(&snapshot);
+    bench_free_source(&source);
+}
+
+int
+main(int argc, char **argv) {
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+    long cpus = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    processor_count = cpus > 0 ? (unsigned int)cpus : 1;
+    procfs_parallel_init();
+
+    // Run with no workers, then double the number of participants up
+    // to one for each processor.
+    int worker_counts[PROCFS_PARALLEL_MAX_WORKERS + 1];
+    int worker_count_count = 0;
+    for (int participants = 1; participants < (int)processor_count; participants *= 2) {
+        worker_counts[worker_count_count++] = participants - 1;
+    }
+    if (processor_count - 1 <= PROCFS_PARALLEL_MAX_WORKERS) {
+        worker_counts[worker_count_count++] = processor_count - 1;
+    }
+    printf("%u processors\n\n", processor_count);
+
+    int sizes[] = { 1000, 10000, 100000 };
+    for (int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+        bench_run(sizes[i], worker_counts, worker_count_count);
+    }
+    return 0;
+}
@@ -0,0 +1,313 @@
+//
+//  bench_pidmap.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Benchmark for the process id bitmaps in procfs_pidmap.c. Builds a
+// synthetic process table with 1,000, 10,000 and 100,000 processes and
+// compares counting and listing the processes that a credential can see
+// by checking each process in turn, as the shared process table is used,
+// against doing the same with the per-user and per-group bitmaps that the
+// process index keeps. Also measures the cost of keeping the bitmaps up to
+// date as processes are created and exit.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "procfs_pidmap.h"
+
+OSMallocTag procfs_osmalloc_tag;
+
+// The number of user ids that own most processes (root and daemons)
+// and the number of other user ids.
+#define BENCH_SYSTEM_UID_COUNT  16
+#define BENCH_USER_UID_COUNT    200
+
+// The user and group id of the credential used for access checks.
+#define BENCH_CRED_UID  501
+#define BENCH_CRED_GID  20
+
+// The number of pids returned by each call in the batched scan,
+// which is the same as the batch size used by readdir.
+#define BENCH_BATCH_SIZE 64
+
+/*
+ * A synthetic process table, held in the same way as the shared
+ * process table in procfs_proctable.h.
+ */
+typedef struct bench_table {
+    int         count;
+    pid_t       *pid;
+    uid_t       *uid;
+    uid_t       *ruid;
+    gid_t       *gid;
+    gid_t       *rgid;
+} bench_table_t;
+
+// Prevents the compiler from discarding results.
+static volatile long bench_sink;
+
+static uint64_t
+bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Same rule as procfs_check_can_access_ids().
+ */
+static int
+bench_can_access(uid_t cred_uid, gid_t cred_gid, uid_t uid, uid_t ruid, gid_t gid, gid_t rgid) {
+    return cred_uid == uid || cred_uid == ruid || cred_gid == gid || cred_gid == rgid;
+}
+
+/*
+ * Chooses a user id. Most processes belong to root or to a small
+ * number of daemon ids and about one in ten belongs to the user
+ * whose credential is used for the access checks.
+ */
+static uid_t
+bench_choose_uid(void) {
+    int r = rand() % 100;
+    if (r < 50) {
+        return 0;
+    } else if (r < 80) {
+        return 200 + rand() % BENCH_SYSTEM_UID_COUNT;
+    } else if (r < 90) {
+        return BENCH_CRED_UID;
+    }
+    return 1000 + rand() % BENCH_USER_UID_COUNT;
+}
+
+/*
+ * Builds a table of a given number of processes with distinct process
+ * ids in increasing order, spread over the whole process id space.
+ */
+static void
+bench_build_table(bench_table_t *table, int count) {
+    pid_t *all_pids = malloc(PROCFS_PIDMAP_PID_LIMIT * sizeof(pid_t));
+    for (int i = 0; i < PROCFS_PIDMAP_PID_LIMIT; i++) {
+        all_pids[i] = i;
+    }
+    for (int i = 0; i < count; i++) {
+        int j = i + rand() % (PROCFS_PIDMAP_PID_LIMIT - i);
+        pid_t t = all_pids[i];
+        all_pids[i] = all_pids[j];
+        all_pids[j] = t;
+    }
+
+    char *chosen = calloc(PROCFS_PIDMAP_PID_LIMIT, 1);
+    for (int i = 0; i < count; i++) {
+        chosen[all_pids[i]] = 1;
+    }
+    free(all_pids);
+
+    table->count = count;
+    table->pid = malloc(count * sizeof(pid_t));
+    table->uid = malloc(count * sizeof(uid_t));
+    table->ruid = malloc(count * sizeof(uid_t));
+    table->gid = malloc(count * sizeof(gid_t));
+    table->rgid = malloc(count * sizeof(gid_t));
+    int n = 0;
+    for (pid_t pid = 0; pid < PROCFS_PIDMAP_PID_LIMIT; pid++) {
+        if (chosen[pid]) {
+            uid_t uid = bench_choose_uid();
+            table->pid[n] = pid;
+            table->uid[n] = uid;
+            table->ruid[n] = rand() % 50 == 0 ? bench_choose_uid() : uid;
+            table->gid[n] = uid == BENCH_CRED_UID ? BENCH_CRED_GID : uid;
+            table->rgid[n] = table->gid[n];
+            n++;
+        }
+    }
+    free(chosen);
+}
+
+static void
+bench_free_table(bench_table_t *table) {
+    free(table->pid);
+    free(table->uid);
+    free(table->ruid);
+    free(table->gid);
+    free(table->rgid);
+}
+
+/*
+ * Adds every process in a table to the bitmaps, in the same way as
+ * the process index does.
+ */
+static void
+bench_map_table(bench_table_t *table, procfs_pidmap_t *all, procfs_pidmaps_t *uids, procfs_pidmaps_t *gids) {
+    for (int i = 0; i < table->count; i++) {
+        pid_t pid = table->pid[i];
+        if (procfs_pidmap_add(all, pid) != 0
+                || procfs_pidmaps_add(uids, table->uid[i], pid) != 0
+                || procfs_pidmaps_add(uids, table->ruid[i], pid) != 0
+                || procfs_pidmaps_add(gids, table->gid[i], pid) != 0
+                || procfs_pidmaps_add(gids, table->rgid[i], pid) != 0) {
+            fprintf(stderr, "Failed to add process %d\n", pid);
+            exit(1);
+        }
+    }
+}
+
+static int
+bench_scan_count(bench_table_t *table) {
+    int count = 0;
+    for (int i = 0; i < table->count; i++) {
+        if (bench_can_access(BENCH_CRED_UID, BENCH_CRED_GID, table->uid[i], table->ruid[i],
+                             table->gid[i], table->rgid[i])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static int
+bench_scan_list(bench_table_t *table, pid_t *pids) {
+    int count = 0;
+    for (int i = 0; i < table->count; i++) {
+        if (bench_can_access(BENCH_CRED_UID, BENCH_CRED_GID, table->uid[i], table->ruid[i],
+                             table->gid[i], table->rgid[i])) {
+            pids[count++] = table->pid[i];
+        }
+    }
+    return count;
+}
+
+static int
+bench_batched_list(const procfs_pidmap_t *map1, const procfs_pidmap_t *map2) {
+    pid_t batch[BENCH_BATCH_SIZE];
+    pid_t next_pid = 0;
+    int total = 0;
+    int count;
+    do {
+        count = procfs_pidmap_get_union(map1, map2, next_pid, batch, BENCH_BATCH_SIZE);
+        if (count > 0) {
+            next_pid = batch[count - 1] + 1;
+            total += count;
+        }
+    } while (count == BENCH_BATCH_SIZE);
+    return total;
+}
+
+static void
+bench_report(const char *name, int iterations, uint64_t elapsed_ns) {
+    printf("  %-36s %10.1f ns/op\n", name, (double)elapsed_ns / iterations);
+}
+
+static void
+bench_run(int process_count) {
+    bench_table_t table;
+    bench_build_table(&table, process_count);
+
+    procfs_pidmap_t all;
+    procfs_pidmaps_t uids;
+    procfs_pidmaps_t gids;
+    memset(&all, 0, sizeof(all));
+    memset(&uids, 0, sizeof(uids));
+    memset(&gids, 0, sizeof(gids));
+    bench_map_table(&table, &all, &uids, &gids);
+
+    pid_t *pids = malloc(process_count * sizeof(pid_t));
+    pid_t *expected = malloc(process_count * sizeof(pid_t));
+    int expected_count = bench_scan_list(&table, expected);
+    const procfs_pidmap_t *uid_map = procfs_pidmaps_find(&uids, BENCH_CRED_UID);
+    const procfs_pidmap_t *gid_map = procfs_pidmaps_find(&gids, BENCH_CRED_GID);
+
+    // Check that both methods agree before timing them.
+    int count = procfs_pidmap_get_union(uid_map, gid_map, 0, pids, process_count);
+    if (count != expected_count || memcmp(pids, expected, count * sizeof(pid_t)) != 0
+            || procfs_pidmap_count_union(uid_map, gid_map) != expected_count
+            || bench_batched_list(uid_map, gid_map) != expected_count
+            || procfs_pidmap_count_union(&all, NULL) != process_count) {
+        fprintf(stderr, "Bitmap results do not match the table scan\n");
+        exit(1);
+    }
+
+    printf("%d processes, %d visible, %d user ids, %d group ids\n",
+           process_count, expected_count, uids.pms_count, gids.pms_count);
+
+    int iterations = process_count >= 100000 ? 200 : 2000;
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        bench_sink += bench_scan_count(&table);
+    }
+    bench_report("count visible, table scan", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        bench_sink += procfs_pidmap_count_union(procfs_pidmaps_find(&uids, BENCH_CRED_UID),
+                                                procfs_pidmaps_find(&gids, BENCH_CRED_GID));
+    }
+    bench_report("count visible, bitmap union", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        bench_sink += procfs_pidmap_count_union(&all, NULL);
+    }
+    bench_report("count all, bitmap", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        bench_sink += bench_scan_list(&table, pids);
+    }
+    bench_report("list visible, table scan", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        bench_sink += procfs_pidmap_get_union(procfs_pidmaps_find(&uids, BENCH_CRED_UID),
+                                              procfs_pidmaps_find(&gids, BENCH_CRED_GID),
+                                              0, pids, process_count);
+    }
+    bench_report("list visible, bitmap union", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        bench_sink += bench_batched_list(uid_map, gid_map);
+    }
+    bench_report("list visible, bitmap batches of 64", iterations, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < iterations; i++) {
+        bench_sink += procfs_pidmap_get_union(&all, NULL, 0, pids, process_count);
+    }
+    bench_report("list all, bitmap", iterations, bench_now_ns() - start);
+
+    // Remove and add back every process, as if each had exited and been
+    // replaced by a new process with the same pid and ids.
+    start = bench_now_ns();
+    for (int i = 0; i < table.count; i++) {
+        pid_t pid = table.pid[i];
+        procfs_pidmap_remove(&all, pid);
+        procfs_pidmaps_remove(&uids, table.uid[i], pid);
+        procfs_pidmaps_remove(&uids, table.ruid[i], pid);
+        procfs_pidmaps_remove(&gids, table.gid[i], pid);
+        procfs_pidmaps_remove(&gids, table.rgid[i], pid);
+        procfs_pidmap_add(&all, pid);
+        procfs_pidmaps_add(&uids, table.uid[i], pid);
+        procfs_pidmaps_add(&uids, table.ruid[i], pid);
+        procfs_pidmaps_add(&gids, table.gid[i], pid);
+        procfs_pidmaps_add(&gids, table.rgid[i], pid);
+    }
+    bench_report("exit and create one process", table.count, bench_now_ns() - start);
+    printf("\n");
+
+    free(pids);
+    free(expected);
+    bench_free_table(&table);
+}
+
+int
+main(int argc, char **argv) {
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+    int sizes[] = { 1000, 10000, 100000 };
+    for (int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+        bench_run(sizes[i]);
+    }
+    return 0;
+}
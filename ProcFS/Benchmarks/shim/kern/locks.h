@@ -0,0 +1,41 @@
+//
+//  locks.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// User-level replacements for the kernel mutex functions.
+//
+
+#ifndef procfs_bench_locks_h
+#define procfs_bench_locks_h
+
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct procfs_bench_lck_grp { int unused; } lck_grp_t;
+typedef pthread_mutex_t lck_mtx_t;
+
+#define LCK_GRP_ATTR_NULL   NULL
+#define LCK_ATTR_NULL       NULL
+
+static inline lck_grp_t *
+lck_grp_alloc_init(const char *name, void *attr) {
+    (void)name;
+    (void)attr;
+    return calloc(1, sizeof(lck_grp_t));
+}
+
+static inline lck_mtx_t *
+lck_mtx_alloc_init(lck_grp_t *grp, void *attr) {
+    (void)grp;
+    (void)attr;
+    lck_mtx_t *mtx = malloc(sizeof(lck_mtx_t));
+    pthread_mutex_init(mtx, NULL);
+    return mtx;
+}
+
+#define lck_mtx_lock(mtx)       pthread_mutex_lock(mtx)
+#define lck_mtx_unlock(mtx)     pthread_mutex_unlock(mtx)
+
+#endif /* procfs_bench_locks_h */
@@ -0,0 +1,59 @@
+//
+//  thread.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// User-level replacements for the kernel thread functions. Kernel
+// threads are run as detached POSIX threads.
+//
+
+#ifndef procfs_bench_thread_h
+#define procfs_bench_thread_h
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#define thread_t            procfs_bench_thread_t
+#define thread_continue_t   procfs_bench_thread_continue_t
+#define wait_result_t       procfs_bench_wait_result_t
+#define kern_return_t       procfs_bench_kern_return_t
+
+typedef pthread_t thread_t;
+typedef int wait_result_t;
+typedef int kern_return_t;
+typedef void (*thread_continue_t)(void *param, wait_result_t wresult);
+
+#ifndef KERN_SUCCESS
+#define KERN_SUCCESS        0
+#define KERN_FAILURE        5
+#endif
+
+struct procfs_bench_thread_start {
+    thread_continue_t   continuation;
+    void                *param;
+};
+
+static void *
+procfs_bench_thread_main(void *arg) {
+    struct procfs_bench_thread_start start = *(struct procfs_bench_thread_start *)arg;
+    free(arg);
+    start.continuation(start.param, 0);
+    return NULL;
+}
+
+static inline kern_return_t
+kernel_thread_start(thread_continue_t continuation, void *param, thread_t *threadp) {
+    struct procfs_bench_thread_start *start = malloc(sizeof(*start));
+    start->continuation = continuation;
+    start->param = param;
+    if (pthread_create(threadp, NULL, procfs_bench_thread_main, start) != 0) {
+        free(start);
+        return KERN_FAILURE;
+    }
+    return KERN_SUCCESS;
+}
+
+#define thread_deallocate(thread)   pthread_detach(thread)
+
+#endif /* procfs_bench_thread_h */
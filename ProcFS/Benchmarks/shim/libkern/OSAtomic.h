@@ -0,0 +1,29 @@
+//
+//  OSAtomic.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// User-level replacements for the kernel atomic operations.
+//
+
+#ifndef procfs_bench_OSAtomic_h
+#define procfs_bench_OSAtomic_h
+
+#include <stdint.h>
+
+#ifdef __APPLE__
+#include <libkern/OSTypes.h>
+#else
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef int64_t SInt64;
+typedef unsigned char Boolean;
+#endif
+
+#define OSCompareAndSwap64(old_value, new_value, address) \
+        __sync_bool_compare_and_swap((address), (old_value), (new_value))
+#define OSIncrementAtomic64(address)    __sync_fetch_and_add((address), 1)
+
+#endif /* procfs_bench_OSAtomic_h */
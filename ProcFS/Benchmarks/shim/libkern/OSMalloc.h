@@ -0,0 +1,18 @@
+//
+//  OSMalloc.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// User-level replacements for the kernel memory allocation functions.
+//
+
+#ifndef procfs_bench_OSMalloc_h
+#define procfs_bench_OSMalloc_h
+
+#include <stdlib.h>
+
+#define OSMalloc(size, tag)         malloc(size)
+#define OSFree(addr, size, tag)     free(addr)
+
+#endif /* procfs_bench_OSMalloc_h */
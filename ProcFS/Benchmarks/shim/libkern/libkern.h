@@ -0,0 +1,16 @@
+//
+//  libkern.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// User-level replacements for the kernel library functions.
+//
+
+#ifndef procfs_bench_libkern_h
+#define procfs_bench_libkern_h
+
+#include <string.h>
+#include <strings.h>
+
+#endif /* procfs_bench_libkern_h */
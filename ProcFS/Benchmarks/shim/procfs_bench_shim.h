@@ -0,0 +1,45 @@
+//
+//  procfs_bench_shim.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Definitions that let the parts of procfs that do not depend on the
+// kernel be built and benchmarked as a user-level program on Linux or
+// macOS. This file is included ahead of every source file by the
+// Makefile. It stands in for procfs.h, whose include guard it defines,
+// so that the real header, which needs the kernel headers, is skipped.
+//
+
+#ifndef procfs_bench_shim_h
+#define procfs_bench_shim_h
+
+#define procfs_h
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// The largest process id, as defined by XNU.
+#ifndef PID_MAX
+#define PID_MAX 99999
+#endif
+
+#ifndef __APPLE__
+typedef int boolean_t;
+#endif
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define STATIC static
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+typedef struct procfs_bench_malloc_tag *OSMallocTag;
+extern OSMallocTag procfs_osmalloc_tag;
+
+#endif /* procfs_bench_shim_h */
@@ -0,0 +1,19 @@
+//
+//  sysctl.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// The benchmarks do not publish sysctls, so the kernel sysctl
+// declarations expand to nothing.
+//
+
+#ifndef procfs_bench_sysctl_h
+#define procfs_bench_sysctl_h
+
+#define SYSCTL_DECL(name)
+#define SYSCTL_NODE(parent, nbr, name, access, handler, descr)
+#define SYSCTL_INT(parent, nbr, name, access, ptr, val, descr)
+#define SYSCTL_QUAD(parent, nbr, name, access, ptr, descr)
+
+#endif /* procfs_bench_sysctl_h */
@@ -0,0 +1,38 @@
+//
+//  systm.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// User-level replacements for the kernel sleep and wakeup functions.
+// Every wakeup() wakes every sleeper, which is allowed because sleepers
+// must always recheck the condition that they are waiting for.
+//
+
+#ifndef procfs_bench_systm_h
+#define procfs_bench_systm_h
+
+#include <pthread.h>
+#include <stdio.h>
+#include "kern/locks.h"
+
+#define PRIBIO  16
+
+static pthread_cond_t procfs_bench_wakeup_cond = PTHREAD_COND_INITIALIZER;
+
+static inline int
+msleep(void *chan, lck_mtx_t *mtx, int pri, const char *wmesg, void *ts) {
+    (void)chan;
+    (void)pri;
+    (void)wmesg;
+    (void)ts;
+    return pthread_cond_wait(&procfs_bench_wakeup_cond, mtx);
+}
+
+static inline void
+wakeup(void *chan) {
+    (void)chan;
+    pthread_cond_broadcast(&procfs_bench_wakeup_cond);
+}
+
+#endif /* procfs_bench_systm_h */
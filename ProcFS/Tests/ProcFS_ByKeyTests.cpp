@@ -0,0 +1,141 @@
+//
+//  ProcFS_ByKeyTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the /proc/bycomm, /proc/byuid and /proc/bypgrp directories.
+//
+#include <copyfile.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+// Checks that the index directories exist and list no keys.
+TEST_F(ProcFSTestFixture, CheckByKeyDirectories) {
+    for (const string &dir : vector<string>({"bycomm", "byuid", "bypgrp"})) {
+        EXPECT_TRUE(check_type_and_permissions(dir, S_IFDIR, 0550)) << dir;
+        EXPECT_EQ(2, count_directory_entries(dir)) << dir;
+    }
+}
+
+// Checks that names that are not valid keys do not exist.
+TEST_F(ProcFSTestFixture, CheckInvalidByKeyNames) {
+    EXPECT_FALSE(check_file_exists("byuid/abc"));
+    EXPECT_FALSE(check_file_exists("byuid/0501"));
+    EXPECT_FALSE(check_file_exists("byuid/4294967296"));
+    EXPECT_FALSE(check_file_exists("bypgrp/100000000"));
+    EXPECT_FALSE(check_file_exists("bycomm/a_very_long_command_name"));
+    EXPECT_TRUE(check_file_exists("byuid/0"));
+    EXPECT_TRUE(check_file_exists("bypgrp/1"));
+    EXPECT_TRUE(check_file_exists("bycomm/no_such_command"));
+}
+
+// Checks that the directories for this process's command name, user id
+// and process group link to this process.
+TEST_F(ProcFSTestFixture, CheckByKeyLinks) {
+    string pid = to_string(getpid());
+    vector<string> dirs({
+        "bycomm/" + string(getprogname()).substr(0, MAXCOMLEN),
+        "byuid/" + to_string(getuid()),
+        "bypgrp/" + to_string(getpgrp())
+    });
+    for (const string &dir : dirs) {
+        EXPECT_TRUE(check_type_and_permissions(dir, S_IFDIR, 0550)) << dir;
+        EXPECT_TRUE(check_directory_contains(dir, vector<string>({pid}), true)) << dir;
+        EXPECT_TRUE(check_type_and_permissions(dir + "/" + pid, S_IFLNK, 0777)) << dir;
+        EXPECT_TRUE(check_symlink_content(dir + "/" + pid, "../../" + pid)) << dir;
+    }
+}
+
+// Checks that a key that no process has gives an empty directory
+// and that a process cannot be looked up in the wrong directory.
+TEST_F(ProcFSTestFixture, CheckByKeyNoMatch) {
+    string pid = to_string(getpid());
+    EXPECT_EQ(2, count_directory_entries("bycomm/no_such_command"));
+    EXPECT_FALSE(check_file_exists("bycomm/no_such_command/" + pid));
+    EXPECT_FALSE(check_file_exists("byuid/" + to_string(getuid() + 1) + "/" + pid));
+    EXPECT_FALSE(check_file_exists("bypgrp/" + to_string(getpgrp() + 1) + "/" + pid));
+}
+
+// Checks that looking up command names that no process has does not
+// leave them in the table of interned names once the directories are
+// no longer in use.
+TEST_F(ProcFSTestFixture, CheckByCommDoesNotInternNames) {
+    int before, after;
+    size_t len = sizeof(before);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.comm_names", &before, &len, NULL, 0));
+    const int lookups = 100;
+    for (int i = 0; i < lookups; i++) {
+        EXPECT_TRUE(check_file_exists("bycomm/no_such_cmd" + to_string(i)));
+    }
+    len = sizeof(after);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.comm_names", &after, &len, NULL, 0));
+    
+    // Other processes may exec while this runs, so allow for a few new names.
+    EXPECT_LT(after - before, lookups);
+}
+
+// Checks that an open directory for a command name keeps its identity
+// when the last process with that name exits, and that a new process
+// with the same name then appears in it.
+TEST_F(ProcFSTestFixture, CheckByCommDirectoryOutlivesProcess) {
+    // Run copies of sleep(1) with a name that no other process has.
+    string name = "pfs_rm" + to_string(getpid());
+    string path = "/tmp/" + name;
+    ASSERT_EQ(0, copyfile("/bin/sleep", path.c_str(), NULL, COPYFILE_ALL)) << "Failed to copy to " << path;
+    auto start_child = [&]() -> pid_t {
+        pid_t child = fork();
+        if (child == 0) {
+            execl(path.c_str(), name.c_str(), "60", (char *)NULL);
+            _exit(1);
+        }
+        
+        // Wait for the child to exec.
+        string child_link = "bycomm/" + name + "/" + to_string(child);
+        for (int i = 0; i < 500 && child > 0 && !check_file_exists(child_link); i++) {
+            usleep(10000);
+        }
+        return child;
+    };
+    
+    pid_t child = start_child();
+    ASSERT_GE(child, 0) << "fork() failed";
+    EXPECT_TRUE(check_file_exists("bycomm/" + name + "/" + to_string(child)));
+    
+    struct stat unknown_stat, live_stat, dead_stat;
+    string dir_path = ROOTPATH + "/bycomm/" + name;
+    ASSERT_EQ(0, stat((ROOTPATH + "/bycomm/no_such_command").c_str(), &unknown_stat));
+    int fd = open(dir_path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << dir_path;
+    EXPECT_EQ(0, fstat(fd, &live_stat));
+    EXPECT_NE(unknown_stat.st_ino, live_stat.st_ino);
+    
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    EXPECT_EQ(0, stat(dir_path.c_str(), &dead_stat));
+    EXPECT_EQ(live_stat.st_ino, dead_stat.st_ino);
+    EXPECT_EQ(2, count_directory_entries("bycomm/" + name));
+    
+    // A new process with the same name is found through the same directory.
+    child = start_child();
+    ASSERT_GE(child, 0) << "fork() failed";
+    EXPECT_TRUE(check_file_exists("bycomm/" + name + "/" + to_string(child)));
+    EXPECT_EQ(0, stat(dir_path.c_str(), &dead_stat));
+    EXPECT_EQ(live_stat.st_ino, dead_stat.st_ino);
+    
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    close(fd);
+    unlink(path.c_str());
+}
@@ -0,0 +1,274 @@
+//
+//  ProcFS_ColumnsTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the /proc/columns directory.
+//
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/proc_info.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <set>
+#include "procfs.h"
+#include "procfs_parallel.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+// Checks that "columns" is a directory.
+TEST_F(ProcFSTestFixture, CheckColumnsType) {
+    EXPECT_TRUE(check_type_and_permissions("columns", S_IFDIR, 0550));
+}
+
+// Checks that file names with unknown or badly-formed column
+// lists do not exist.
+TEST_F(ProcFSTestFixture, CheckInvalidColumnNames) {
+    EXPECT_FALSE(check_file_exists("columns/pid,nosuchcolumn"));
+    EXPECT_FALSE(check_file_exists("columns/pid,"));
+    EXPECT_FALSE(check_file_exists("columns/,pid"));
+}
+
+// Checks the header and column descriptors of a columns file and
+// verifies that the row for the current process is correct.
+TEST_F(ProcFSTestFixture, CheckColumnsFileContent) {
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file("columns/ppid,pid,comm", content)) << "Failed to read columns file";
+    ASSERT_GE(content.size(), sizeof(procfs_columns_header_t)) << "Columns file too short";
+
+    const procfs_columns_header_t *header = reinterpret_cast<const procfs_columns_header_t *>(content.data());
+    ASSERT_EQ(PROCFS_COLUMNS_MAGIC, header->pch_magic) << "Incorrect magic number";
+    ASSERT_EQ(PROCFS_COLUMNS_VERSION, header->pch_version) << "Incorrect version";
+    ASSERT_EQ(3, header->pch_column_count) << "Incorrect column count";
+    ASSERT_EQ(content.size(), header->pch_data_size) << "Incorrect data size";
+    ASSERT_EQ(0, header->pch_header_size % PROCFS_COLUMNS_ALIGN) << "Header not padded";
+    ASSERT_TRUE(header->pch_row_count > 0) << "No rows";
+
+    // Columns must appear in column id order, regardless of the order in the name.
+    const procfs_column_desc_t *descs = reinterpret_cast<const procfs_column_desc_t *>(header + 1);
+    ASSERT_EQ(PROCFS_COLUMN_PID, descs[0].pcd_column_id);
+    ASSERT_EQ(PROCFS_COLUMN_PPID, descs[1].pcd_column_id);
+    ASSERT_EQ(PROCFS_COLUMN_COMM, descs[2].pcd_column_id);
+    for (int i = 0; i < header->pch_column_count; i++) {
+        ASSERT_EQ(0, descs[i].pcd_offset % PROCFS_COLUMNS_ALIGN) << "Column " << i << " not aligned";
+        ASSERT_LE(descs[i].pcd_offset + header->pch_row_count * descs[i].pcd_element_size, content.size())
+                    << "Column " << i << " extends beyond the end of the file";
+    }
+
+    // Find the row for this process and check its parent process id.
+    const int32_t *pids = reinterpret_cast<const int32_t *>(content.data() + descs[0].pcd_offset);
+    const int32_t *ppids = reinterpret_cast<const int32_t *>(content.data() + descs[1].pcd_offset);
+    bool found = false;
+    for (uint32_t row = 0; row < header->pch_row_count; row++) {
+        if (pids[row] == getpid()) {
+            found = true;
+            ASSERT_EQ(getppid(), ppids[row]) << "Incorrect parent process id";
+            break;
+        }
+    }
+    ASSERT_TRUE(found) << "No row for the current process";
+}
+
+// Checks that the resource usage columns for the current process
+// are populated.
+TEST_F(ProcFSTestFixture, CheckColumnsFileRusageContent) {
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file("columns/pid,footprint,energy", content)) << "Failed to read columns file";
+    ASSERT_GE(content.size(), sizeof(procfs_columns_header_t)) << "Columns file too short";
+
+    const procfs_columns_header_t *header = reinterpret_cast<const procfs_columns_header_t *>(content.data());
+    ASSERT_EQ(PROCFS_COLUMNS_MAGIC, header->pch_magic) << "Incorrect magic number";
+    ASSERT_EQ(3, header->pch_column_count) << "Incorrect column count";
+
+    const procfs_column_desc_t *descs = reinterpret_cast<const procfs_column_desc_t *>(header + 1);
+    ASSERT_EQ(PROCFS_COLUMN_PID, descs[0].pcd_column_id);
+    ASSERT_EQ(PROCFS_COLUMN_FOOTPRINT, descs[1].pcd_column_id);
+    ASSERT_EQ(PROCFS_COLUMN_ENERGY, descs[2].pcd_column_id);
+
+    const int32_t *pids = reinterpret_cast<const int32_t *>(content.data() + descs[0].pcd_offset);
+    const uint64_t *footprints = reinterpret_cast<const uint64_t *>(content.data() + descs[1].pcd_offset);
+    bool found = false;
+    for (uint32_t row = 0; row < header->pch_row_count; row++) {
+        if (pids[row] == getpid()) {
+            found = true;
+            EXPECT_GT(footprints[row], 0ULL) << "unlikely footprint value";
+            break;
+        }
+    }
+    ASSERT_TRUE(found) << "No row for the current process";
+}
+
+// Checks that a columns file can be memory mapped and that the
+// mapped content is a valid columns file.
+TEST_F(ProcFSTestFixture, CheckColumnsFileMapping) {
+    string path(ROOTPATH + "/columns/pid,rss");
+    int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+
+    size_t size = file_size("columns/pid,rss");
+    ASSERT_GE(size, sizeof(procfs_columns_header_t)) << "Columns file too short";
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(MAP_FAILED, addr) << "Failed to map " << path << ": " << strerror(errno);
+
+    const procfs_columns_header_t *header = static_cast<const procfs_columns_header_t *>(addr);
+    EXPECT_EQ(PROCFS_COLUMNS_MAGIC, header->pch_magic) << "Incorrect magic number";
+    EXPECT_EQ(2, header->pch_column_count) << "Incorrect column count";
+    munmap(addr, size);
+}
+
+// Checks that a columns file cannot be mapped for writing.
+TEST_F(ProcFSTestFixture, CheckColumnsFileNotWritableMapping) {
+    string path(ROOTPATH + "/columns/pid");
+    int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+
+    void *addr = mmap(NULL, PROCFS_COLUMNS_ALIGN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    EXPECT_EQ(MAP_FAILED, addr) << "Writable mapping should fail";
+}
+
+// Checks that a columns file that is read in small pieces is
+// consistent with the size recorded in its header.
+TEST_F(ProcFSTestFixture, CheckColumnsFileReadInPieces) {
+    string path(ROOTPATH + "/columns/pid,comm");
+    int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+
+    vector<char> content;
+    char buffer[100];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        content.insert(content.end(), buffer, buffer + count);
+    }
+    close(fd);
+    ASSERT_EQ(0, count) << "Read failed: " << strerror(errno);
+    ASSERT_GE(content.size(), sizeof(procfs_columns_header_t)) << "Columns file too short";
+
+    const procfs_columns_header_t *header = reinterpret_cast<const procfs_columns_header_t *>(content.data());
+    EXPECT_EQ(PROCFS_COLUMNS_MAGIC, header->pch_magic) << "Incorrect magic number";
+    EXPECT_EQ(content.size(), header->pch_data_size) << "Content changed between reads";
+}
+
+// Checks that every row of a columns file is in process id order,
+// that there is a row for each of a set of processes and that the
+// rows for another set of processes match their "info" files.
+static void
+check_columns_match_info_files(const set<pid_t> &children, const set<pid_t> &staying) {
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file("columns/pid,ppid,pgid,uid,gid,ruid,rgid,comm", content))
+                << "Failed to read columns file";
+    ASSERT_GE(content.size(), sizeof(procfs_columns_header_t)) << "Columns file too short";
+    const procfs_columns_header_t *header = reinterpret_cast<const procfs_columns_header_t *>(content.data());
+    ASSERT_EQ(PROCFS_COLUMNS_MAGIC, header->pch_magic) << "Incorrect magic number";
+    ASSERT_EQ(8, header->pch_column_count) << "Incorrect column count";
+    ASSERT_EQ(content.size(), header->pch_data_size) << "Incorrect data size";
+    ASSERT_GT(header->pch_row_count, staying.size()) << "Too few rows";
+    
+    const procfs_column_desc_t *descs = reinterpret_cast<const procfs_column_desc_t *>(header + 1);
+    for (int i = 0; i < header->pch_column_count; i++) {
+        ASSERT_LE(descs[i].pcd_offset + header->pch_row_count * descs[i].pcd_element_size, content.size())
+                    << "Column " << i << " extends beyond the end of the file";
+    }
+    const int32_t *pids = reinterpret_cast<const int32_t *>(content.data() + descs[0].pcd_offset);
+    const int32_t *ppids = reinterpret_cast<const int32_t *>(content.data() + descs[1].pcd_offset);
+    const int32_t *pgids = reinterpret_cast<const int32_t *>(content.data() + descs[2].pcd_offset);
+    const uint32_t *uids = reinterpret_cast<const uint32_t *>(content.data() + descs[3].pcd_offset);
+    const uint32_t *gids = reinterpret_cast<const uint32_t *>(content.data() + descs[4].pcd_offset);
+    const uint32_t *ruids = reinterpret_cast<const uint32_t *>(content.data() + descs[5].pcd_offset);
+    const uint32_t *rgids = reinterpret_cast<const uint32_t *>(content.data() + descs[6].pcd_offset);
+    const char *comms = content.data() + descs[7].pcd_offset;
+    
+    // Rows left empty by processes that exited while the file was
+    // being generated must have been removed.
+    set<pid_t> missing(staying);
+    for (uint32_t row = 0; row < header->pch_row_count; row++) {
+        ASSERT_GT(pids[row], row == 0 ? 0 : pids[row - 1]) << "Rows out of order at row " << row;
+        missing.erase(pids[row]);
+        
+        // Processes other than the children may exit, exec or change
+        // their ids at any time, so only the process id is checked.
+        proc_bsdinfo info;
+        if (!read_file_content(to_string(pids[row]) + "/info", &info, sizeof(info))) {
+            EXPECT_EQ(0, staying.count(pids[row])) << "No info file for child " << pids[row];
+            continue;
+        }
+        EXPECT_EQ((uint32_t)pids[row], info.pbi_pid);
+        if (children.count(pids[row]) == 0) {
+            continue;
+        }
+        EXPECT_EQ((uint32_t)ppids[row], info.pbi_ppid) << "pid " << pids[row];
+        EXPECT_EQ((uint32_t)pgids[row], info.pbi_pgid) << "pid " << pids[row];
+        EXPECT_EQ(uids[row], info.pbi_uid) << "pid " << pids[row];
+        EXPECT_EQ(gids[row], info.pbi_gid) << "pid " << pids[row];
+        EXPECT_EQ(ruids[row], info.pbi_ruid) << "pid " << pids[row];
+        EXPECT_EQ(rgids[row], info.pbi_rgid) << "pid " << pids[row];
+        EXPECT_EQ(0, strncmp(comms + row * PROCFS_COLUMN_COMM_SIZE, info.pbi_comm, MAXCOMLEN))
+                    << "pid " << pids[row];
+    }
+    EXPECT_TRUE(missing.empty()) << missing.size() << " children have no row";
+}
+
+// Checks that a columns file that covers many more processes than
+// there are shards for the workers matches the "info" files of the
+// processes, so that shards taken by any thread, including stolen
+// ones, end up in the right rows. Half of the extra processes exit
+// while the file is being read, so that rows for processes that have
+// gone must be compacted out.
+TEST_F(ProcFSTestFixture, CheckColumnsFileMatchesProcessFiles) {
+    int ncpu = 1;
+    size_t len = sizeof(ncpu);
+    ASSERT_EQ(0, sysctlbyname("hw.ncpu", &ncpu, &len, NULL, 0));
+    uint64_t shards = 0;
+    len = sizeof(shards);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.parallel.shards", &shards, &len, NULL, 0));
+    
+    int child_count = min(2 * PROCFS_PARALLEL_SHARD_SIZE * (ncpu + 1), 512);
+    set<pid_t> children;
+    set<pid_t> staying;
+    for (int i = 0; i < child_count; i++) {
+        pid_t child = fork();
+        if (child == 0) {
+            if (i % 2 == 0) {
+                pause();
+            } else {
+                usleep(1000 * (i % 50));
+            }
+            _exit(0);
+        }
+        EXPECT_GE(child, 0) << "fork() failed";
+        if (child < 0) {
+            break;
+        }
+        children.insert(child);
+        if (i % 2 == 0) {
+            staying.insert(child);
+        }
+    }
+    
+    for (int pass = 0; pass < 5 && !HasFatalFailure(); pass++) {
+        check_columns_match_info_files(children, staying);
+    }
+    for (pid_t child : children) {
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+    }
+    
+    // On a system with more than one processor, the file was generated
+    // in shards.
+    if (ncpu > 1) {
+        uint64_t new_shards = 0;
+        len = sizeof(new_shards);
+        ASSERT_EQ(0, sysctlbyname("vfs.procfs.parallel.shards", &new_shards, &len, NULL, 0));
+        EXPECT_GT(new_shards, shards) << "The file was not generated in parallel";
+    }
+}
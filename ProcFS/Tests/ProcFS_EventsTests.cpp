@@ -0,0 +1,131 @@
+//
+//  ProcFS_EventsTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the /proc/events file.
+//
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "procfs.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+// Reads all of the events that are available from a file opened with
+// O_NONBLOCK and determines whether they include a fork event for a
+// given process.
+static bool read_fork_event(int fd, pid_t pid);
+
+// Checks that "events" is a regular file.
+TEST_F(ProcFSTestFixture, CheckEventsType) {
+    EXPECT_TRUE(check_type_and_permissions("events", S_IFREG, 0550));
+}
+
+// Checks that a read with a buffer that is too small for a
+// whole event record fails.
+TEST_F(ProcFSTestFixture, CheckEventsShortRead) {
+    string path(ROOTPATH + "/events");
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+
+    char buffer[sizeof(procfs_event_t) - 1];
+    EXPECT_EQ(-1, read(fd, buffer, sizeof(buffer))) << "Short read should fail";
+    EXPECT_EQ(EINVAL, errno);
+    close(fd);
+}
+
+// Checks that fork and exit events are delivered for a child process.
+TEST_F(ProcFSTestFixture, CheckForkAndExitEvents) {
+    string path(ROOTPATH + "/events");
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+
+    pid_t child = fork();
+    if (child == 0) {
+        _exit(0);
+    }
+    ASSERT_GT(child, 0) << "Fork failed";
+    int status;
+    waitpid(child, &status, 0);
+
+    bool found_fork = false;
+    bool found_exit = false;
+    uint64_t last_sequence = 0;
+    procfs_event_t events[16];
+    ssize_t count;
+    while ((count = read(fd, events, sizeof(events))) > 0) {
+        ASSERT_EQ(0, count % sizeof(procfs_event_t)) << "Partial event record";
+        for (size_t i = 0; i < count/sizeof(procfs_event_t); i++) {
+            procfs_event_t *event = &events[i];
+            EXPECT_GE(event->pe_sequence, last_sequence) << "Events out of order";
+            last_sequence = event->pe_sequence;
+            if (event->pe_pid == child && event->pe_type == PROCFS_EVENT_FORK) {
+                EXPECT_EQ(getpid(), event->pe_ppid) << "Incorrect parent in fork event";
+                found_fork = true;
+            } else if (event->pe_pid == child && event->pe_type == PROCFS_EVENT_EXIT) {
+                EXPECT_TRUE(found_fork) << "Exit event before fork event";
+                found_exit = true;
+            }
+        }
+    }
+    close(fd);
+
+    EXPECT_TRUE(found_fork) << "No fork event for child process";
+    EXPECT_TRUE(found_exit) << "No exit event for child process";
+}
+
+// Checks that the events file cannot be memory mapped.
+TEST_F(ProcFSTestFixture, CheckEventsNotMappable) {
+    string path(ROOTPATH + "/events");
+    int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+
+    void *addr = mmap(NULL, sizeof(procfs_event_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    EXPECT_EQ(MAP_FAILED, addr) << "Mapping of events file should fail";
+}
+
+// Checks that two descriptors for the events file that were opened
+// separately by the same process each see every event.
+TEST_F(ProcFSTestFixture, CheckEventsPerOpenFile) {
+    string path(ROOTPATH + "/events");
+    int fd1 = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    ASSERT_GE(fd1, 0) << "Failed to open " << path;
+    int fd2 = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    ASSERT_GE(fd2, 0) << "Failed to open " << path;
+
+    pid_t child = fork();
+    if (child == 0) {
+        _exit(0);
+    }
+    ASSERT_GT(child, 0) << "Fork failed";
+    waitpid(child, NULL, 0);
+
+    EXPECT_TRUE(read_fork_event(fd1, child)) << "No fork event through first descriptor";
+    EXPECT_TRUE(read_fork_event(fd2, child)) << "No fork event through second descriptor";
+    close(fd1);
+    close(fd2);
+}
+
+static bool
+read_fork_event(int fd, pid_t pid) {
+    bool found = false;
+    procfs_event_t events[16];
+    ssize_t count;
+    while ((count = read(fd, events, sizeof(events))) > 0) {
+        for (size_t i = 0; i < count/sizeof(procfs_event_t); i++) {
+            if (events[i].pe_pid == pid && events[i].pe_type == PROCFS_EVENT_FORK) {
+                found = true;
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,156 @@
+//
+//  ProcFS_FdTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the file descriptor directories (/proc/NNN/fd), the
+//  system-wide socket table (/proc/sockets) and the open file lookup
+//  directory (/proc/openers).
+//
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/proc_info.h>
+#include <sys/sysctl.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "procfs.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+// Gets the value of a 64-bit sysctl.
+static uint64_t
+get_sysctl_quad(const char *name) {
+    uint64_t value = 0;
+    size_t len = sizeof(value);
+    sysctlbyname(name, &value, &len, NULL, 0);
+    return value;
+}
+
+// Checks that the "details" file for an open file reports its path,
+// and that reading it again is satisfied from the path cache.
+TEST_F(ProcFSTestFixture, CheckFdDetailsPath) {
+    char path[] = "/tmp/procfs_fd_test_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0) << "Failed to create temporary file";
+    char real_path[MAXPATHLEN];
+    ASSERT_NE(nullptr, realpath(path, real_path));
+
+    string details_path = current_process_directory_path() + "/fd/" + to_string(fd) + "/details";
+    vnode_fdinfowithpath info;
+    ASSERT_TRUE(read_file_content(details_path, &info, sizeof(info))) << "Failed to read 'details' file";
+    EXPECT_STREQ(real_path, info.pvip.vip_path) << "Incorrect path in 'details' file";
+
+    // Stop cached paths from expiring, so that the second read must
+    // find the path that the first one cached.
+    int epoch_secs;
+    size_t len = sizeof(epoch_secs);
+    int no_limit = 0;
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.pathcache.epoch_secs", &epoch_secs, &len, &no_limit, sizeof(no_limit)));
+    ASSERT_TRUE(read_file_content(details_path, &info, sizeof(info))) << "Failed to read 'details' file";
+    uint64_t hits = get_sysctl_quad("vfs.procfs.pathcache.hits");
+    ASSERT_TRUE(read_file_content(details_path, &info, sizeof(info))) << "Failed to read 'details' file";
+    uint64_t new_hits = get_sysctl_quad("vfs.procfs.pathcache.hits");
+    sysctlbyname("vfs.procfs.pathcache.epoch_secs", NULL, NULL, &epoch_secs, sizeof(epoch_secs));
+    EXPECT_STREQ(real_path, info.pvip.vip_path) << "Incorrect path in 'details' file";
+    EXPECT_GT(new_hits, hits) << "Path was not found in the cache";
+
+    close(fd);
+    unlink(path);
+}
+
+// Checks that the "sockets" file contains a record for a listening
+// TCP socket that belongs to this process.
+TEST_F(ProcFSTestFixture, CheckSocketsFileContent) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(sock, 0) << "Failed to create socket";
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    addr.sin_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, ::bind(sock, (struct sockaddr *)&addr, sizeof(addr))) << "Failed to bind socket";
+    ASSERT_EQ(0, listen(sock, 1)) << "Failed to listen on socket";
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(0, getsockname(sock, (struct sockaddr *)&addr, &addr_len));
+
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file("sockets", content)) << "Failed to read 'sockets' file";
+    ASSERT_EQ(0, content.size() % sizeof(procfs_socket_t)) << "Incorrect 'sockets' file size";
+
+    const procfs_socket_t *records = reinterpret_cast<const procfs_socket_t *>(content.data());
+    size_t count = content.size()/sizeof(procfs_socket_t);
+    bool found = false;
+    for (size_t i = 0; i < count && !found; i++) {
+        const procfs_socket_t *record = &records[i];
+        if (record->pso_pid == getpid() && record->pso_fd == sock) {
+            found = true;
+            EXPECT_EQ(SOCKINFO_TCP, record->pso_info.soi_kind) << "Incorrect socket kind";
+            EXPECT_EQ(IPPROTO_TCP, record->pso_info.soi_protocol) << "Incorrect protocol";
+            EXPECT_EQ(addr.sin_port, record->pso_info.soi_proto.pri_tcp.tcpsi_ini.insi_lport) << "Incorrect local port";
+        }
+    }
+    EXPECT_TRUE(found) << "No record for socket " << sock;
+    close(sock);
+}
+
+// Checks that names in the "openers" directory that are not valid
+// file ids do not exist.
+TEST_F(ProcFSTestFixture, CheckInvalidOpenersNames) {
+    EXPECT_TRUE(check_type_and_permissions("openers", S_IFDIR, 0550));
+    EXPECT_FALSE(check_file_exists("openers/0"));
+    EXPECT_FALSE(check_file_exists("openers/12x"));
+    EXPECT_FALSE(check_file_exists("openers/99999999999999999999999"));
+}
+
+// Checks that the "openers" file for a file that this process has open
+// twice contains a record for each of the file descriptors.
+TEST_F(ProcFSTestFixture, CheckOpenersFileContent) {
+    char path[] = "/tmp/procfs_openers_test_XXXXXX";
+    int fd1 = mkstemp(path);
+    ASSERT_GE(fd1, 0) << "Failed to create temporary file";
+    int fd2 = open(path, O_RDONLY);
+    ASSERT_GE(fd2, 0) << "Failed to open temporary file";
+    struct stat st;
+    ASSERT_EQ(0, fstat(fd1, &st));
+
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file("openers/" + to_string(st.st_ino), content)) << "Failed to read 'openers' file";
+    ASSERT_EQ(0, content.size() % sizeof(procfs_opener_t)) << "Incorrect 'openers' file size";
+
+    // The size is an estimate that allows for one record for each visible process.
+    size_t estimate = file_size("openers/" + to_string(st.st_ino));
+    EXPECT_GT(estimate, 0);
+    EXPECT_EQ(0, estimate % sizeof(procfs_opener_t));
+
+    const procfs_opener_t *records = reinterpret_cast<const procfs_opener_t *>(content.data());
+    size_t count = content.size()/sizeof(procfs_opener_t);
+    bool found1 = false;
+    bool found2 = false;
+    for (size_t i = 0; i < count; i++) {
+        const procfs_opener_t *record = &records[i];
+        EXPECT_EQ(st.st_ino, record->poe_fileid) << "Incorrect file id";
+        if (record->poe_pid == getpid() && record->poe_dev == (uint32_t)st.st_dev) {
+            if (record->poe_fd == fd1) {
+                found1 = true;
+                EXPECT_TRUE(record->poe_flags & FWRITE) << "Incorrect flags for writable descriptor";
+            } else if (record->poe_fd == fd2) {
+                found2 = true;
+                EXPECT_FALSE(record->poe_flags & FWRITE) << "Incorrect flags for read-only descriptor";
+            }
+        }
+    }
+    EXPECT_TRUE(found1) << "No record for descriptor " << fd1;
+    EXPECT_TRUE(found2) << "No record for descriptor " << fd2;
+
+    close(fd2);
+    close(fd1);
+    unlink(path);
+}
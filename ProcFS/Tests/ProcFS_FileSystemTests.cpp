@@ -7,7 +7,9 @@
 //  Procfs file system tests.
 //
 #include <sys/mount.h>
+#include <sys/stat.h>
 #include <gtest/gtest.h>
+#include <unordered_map>
 #include "ProcFS_TestFixture.hpp"
 #include "ProcFS_TestHelpers.hpp"
 
@@ -31,3 +33,45 @@ TEST_F(ProcFSTestFixture, CheckStatFS) {
     ASSERT_EQ(BLOCK_SIZE, fs.f_iosize) << "File system I/O size incorrect: " << fs.f_iosize;
     ASSERT_EQ(PROCFS_FS_ID, fs.f_fsid.val[1]) << "Fle system id incorrect: " << fs.f_fsid.val[1];
 }
+
+// Paths, relative to the current process directory, of nodes whose
+// file ids must be distinct.
+static const vector<string> FILEID_TEST_PATHS = {
+    "", "pid", "ppid", "info", "fd", "fd/0", "fd/1", "fd/2",
+    "fd/0/details", "fd/1/details", "fd/2/details", "threads",
+};
+
+TEST_F(ProcFSTestFixture, CheckFileIdsUnique) {
+    // Check that different nodes, including nodes for different file
+    // descriptors of the same process, have different file ids.
+    unordered_map<ino_t, string> paths_by_fileid;
+    string proc_dir = ROOTPATH + "/" + current_process_directory_path();
+    vector<string> paths = { ROOTPATH };
+    for (const string &path : FILEID_TEST_PATHS) {
+        paths.push_back(proc_dir + "/" + path);
+    }
+    for (const string &path : paths) {
+        struct stat st;
+        ASSERT_EQ(0, lstat(path.c_str(), &st)) << "Failed to lstat() " << path;
+        auto result = paths_by_fileid.insert({st.st_ino, path});
+        EXPECT_TRUE(result.second) << path << " has the same file id as " << result.first->second;
+    }
+}
+
+TEST_F(ProcFSTestFixture, CheckLookupByFileId) {
+    // Check that nodes can be reached from their file ids through /.vol.
+    struct statfs fs;
+    ASSERT_EQ(0, statfs(get_mounted_on_path(), &fs)) << "statfs failed";
+    string proc_dir = ROOTPATH + "/" + current_process_directory_path();
+    for (const string &path : FILEID_TEST_PATHS) {
+        string full_path = proc_dir + "/" + path;
+        struct stat st;
+        ASSERT_EQ(0, lstat(full_path.c_str(), &st)) << "Failed to lstat() " << full_path;
+        
+        string vol_path = "/.vol/" + to_string(fs.f_fsid.val[0]) + "/" + to_string(st.st_ino);
+        struct stat vol_st;
+        ASSERT_EQ(0, lstat(vol_path.c_str(), &vol_st)) << "Failed to lstat() " << vol_path << " for " << full_path;
+        EXPECT_EQ(st.st_ino, vol_st.st_ino) << "Wrong node for " << full_path;
+        EXPECT_EQ(st.st_mode, vol_st.st_mode) << "Wrong node type for " << full_path;
+    }
+}
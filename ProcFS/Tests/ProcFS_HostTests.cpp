@@ -0,0 +1,82 @@
+//
+//  ProcFS_HostTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the /proc/host directory.
+//
+#include <gtest/gtest.h>
+#include <mach/mach.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <stdlib.h>
+#include "procfs.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+// Checks that "host" is a directory with the expected files.
+TEST_F(ProcFSTestFixture, CheckHostDirectory) {
+    EXPECT_TRUE(check_type_and_permissions("host", S_IFDIR, 0550));
+    EXPECT_TRUE(check_directory_contains("host",
+                    vector<string>({"cpuload", "loadavg", "mempressure", "vmstat"}),
+                    false));
+}
+
+// Checks that the "cpuload" file has one entry for each processor
+// and that the tick counts are plausible.
+TEST_F(ProcFSTestFixture, CheckHostCpuLoadContent) {
+    int ncpu;
+    size_t len = sizeof(ncpu);
+    ASSERT_EQ(0, sysctlbyname("hw.ncpu", &ncpu, &len, NULL, 0)) << "Failed to get processor count";
+
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file("host/cpuload", content)) << "Failed to read 'cpuload' file";
+    ASSERT_EQ(ncpu * sizeof(processor_cpu_load_info), content.size()) << "Incorrect 'cpuload' file size";
+
+    const processor_cpu_load_info *loads = reinterpret_cast<const processor_cpu_load_info *>(content.data());
+    for (int cpu = 0; cpu < ncpu; cpu++) {
+        uint64_t total = 0;
+        for (int state = 0; state < CPU_STATE_MAX; state++) {
+            total += loads[cpu].cpu_ticks[state];
+        }
+        EXPECT_GT(total, 0ULL) << "No ticks for processor " << cpu;
+    }
+}
+
+// Checks the content of the "vmstat" file against host_statistics64().
+TEST_F(ProcFSTestFixture, CheckHostVmstatContent) {
+    vm_statistics64 vmstat;
+    ASSERT_TRUE(read_file_content("host/vmstat", &vmstat, sizeof(vmstat))) << "Failed to read 'vmstat' file";
+
+    vm_statistics64 expected;
+    mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+    ASSERT_EQ(KERN_SUCCESS, host_statistics64(mach_host_self(), HOST_VM_INFO64, (host_info64_t)&expected, &count));
+    EXPECT_GT(vmstat.free_count + vmstat.active_count + vmstat.wire_count, 0u) << "unlikely page counts";
+    EXPECT_LE(vmstat.pageins, expected.pageins) << "unlikely pageins value";
+}
+
+// Checks the content of the "loadavg" file against getloadavg().
+TEST_F(ProcFSTestFixture, CheckHostLoadavgContent) {
+    procfs_loadavg_t loadavg;
+    ASSERT_TRUE(read_file_content("host/loadavg", &loadavg, sizeof(loadavg))) << "Failed to read 'loadavg' file";
+    ASSERT_GT(loadavg.pla_scale, 0u) << "Invalid scale";
+
+    double expected[3];
+    ASSERT_EQ(3, getloadavg(expected, 3));
+    for (int i = 0; i < 3; i++) {
+        // The load average is only recalculated every few seconds.
+        EXPECT_NEAR(expected[i], (double)loadavg.pla_load[i] / loadavg.pla_scale, 1.0) << "Load average " << i;
+    }
+}
+
+// Checks the content of the "mempressure" file.
+TEST_F(ProcFSTestFixture, CheckHostMempressureContent) {
+    procfs_mempressure_t pressure;
+    ASSERT_TRUE(read_file_content("host/mempressure", &pressure, sizeof(pressure))) << "Failed to read 'mempressure' file";
+    EXPECT_LE(pressure.pmp_level, (uint32_t)PROCFS_MEMPRESSURE_CRITICAL) << "Invalid pressure level";
+    EXPECT_LE(pressure.pmp_available_percent, 100u) << "Invalid available percentage";
+}
@@ -0,0 +1,97 @@
+//
+//  ProcFS_ImagesTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the /proc/images and /proc/N/images files.
+//
+#include <gtest/gtest.h>
+#include <mach-o/dyld.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "procfs.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+// Parses the content of an images file into its records, checking
+// that the record sizes are consistent.
+static AssertionResult
+parse_images_content(const vector<char> &content, vector<const procfs_image_t *> &images) {
+    images.clear();
+    size_t offset = 0;
+    while (offset < content.size()) {
+        if (content.size() - offset < sizeof(procfs_image_t)) {
+            return AssertionFailure() << "Truncated record at offset " << offset;
+        }
+        const procfs_image_t *image = reinterpret_cast<const procfs_image_t *>(content.data() + offset);
+        if (image->pim_size < sizeof(procfs_image_t) || (image->pim_size & 7) != 0
+                || image->pim_size > content.size() - offset) {
+            return AssertionFailure() << "Invalid record size " << image->pim_size << " at offset " << offset;
+        }
+        if (strnlen(image->pim_path, image->pim_size - sizeof(procfs_image_t))
+                == image->pim_size - sizeof(procfs_image_t)) {
+            return AssertionFailure() << "Unterminated path at offset " << offset;
+        }
+        images.push_back(image);
+        offset += image->pim_size;
+    }
+    return AssertionSuccess();
+}
+
+// Checks that "images" in the root directory is a regular file.
+TEST_F(ProcFSTestFixture, CheckImagesType) {
+    EXPECT_TRUE(check_type_and_permissions("images", S_IFREG, 0550));
+}
+
+// Checks that the size of "images" in the root directory is estimated
+// from the number of visible processes rather than reported as 0.
+TEST_F(ProcFSTestFixture, CheckRootImagesSize) {
+    EXPECT_GT(file_size("images"), 0);
+}
+
+// Checks that the images file for this process lists its main
+// executable with the correct load address and a UUID.
+TEST_F(ProcFSTestFixture, CheckProcessImagesContent) {
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file(current_process_directory_path() + "/images", content)) << "Failed to read 'images' file";
+    vector<const procfs_image_t *> images;
+    ASSERT_TRUE(parse_images_content(content, images));
+    ASSERT_FALSE(images.empty()) << "No images listed";
+
+    uint64_t main_address = reinterpret_cast<uint64_t>(_dyld_get_image_header(0));
+    const uint8_t zero_uuid[PROCFS_IMAGE_UUID_SIZE] = { 0 };
+    bool found = false;
+    for (auto image : images) {
+        EXPECT_EQ(getpid(), image->pim_pid) << "Incorrect pid in record";
+        if (image->pim_load_address == main_address) {
+            EXPECT_STREQ(_dyld_get_image_name(0), image->pim_path) << "Incorrect main executable path";
+            EXPECT_GT(image->pim_text_size, 0ULL) << "Main executable has no __TEXT size";
+            EXPECT_NE(0, memcmp(zero_uuid, image->pim_uuid, sizeof(zero_uuid))) << "Main executable has no UUID";
+            found = true;
+        }
+    }
+    EXPECT_TRUE(found) << "Main executable not listed";
+    EXPECT_GE(images.size(), _dyld_image_count()) << "Too few images listed";
+}
+
+// Checks that the images file in the root directory includes the
+// images of this process.
+TEST_F(ProcFSTestFixture, CheckAllImagesContent) {
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file("images", content)) << "Failed to read 'images' file";
+    vector<const procfs_image_t *> images;
+    ASSERT_TRUE(parse_images_content(content, images));
+
+    uint64_t main_address = reinterpret_cast<uint64_t>(_dyld_get_image_header(0));
+    bool found = false;
+    for (auto image : images) {
+        if (image->pim_pid == getpid() && image->pim_load_address == main_address) {
+            found = true;
+        }
+    }
+    EXPECT_TRUE(found) << "Main executable of this process not listed";
+}
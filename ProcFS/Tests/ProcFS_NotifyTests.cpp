@@ -0,0 +1,108 @@
+//
+//  ProcFS_NotifyTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for select(2) and kqueue notifications on procfs nodes.
+//
+#include <gtest/gtest.h>
+#include <sys/event.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include "procfs.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+static int wait_for_vnode_event(const string& path, unsigned int fflags, pid_t child, bool kill_child);
+
+// Checks that NOTE_WRITE is posted on the root directory when
+// a process is created.
+TEST_F(ProcFSTestFixture, CheckRootNotifiedOnFork) {
+    EXPECT_EQ(NOTE_WRITE, wait_for_vnode_event(ROOTPATH, NOTE_WRITE, 0, false) & NOTE_WRITE)
+                << "No NOTE_WRITE on root directory";
+}
+
+// Checks that NOTE_DELETE is posted on a process directory when
+// the process exits.
+TEST_F(ProcFSTestFixture, CheckProcessDirNotifiedOnExit) {
+    pid_t child = fork();
+    if (child == 0) {
+        pause();
+        _exit(0);
+    }
+    ASSERT_GT(child, 0) << "Fork failed";
+    
+    string path(ROOTPATH + "/" + to_string(child));
+    EXPECT_EQ(NOTE_DELETE, wait_for_vnode_event(path, NOTE_DELETE, child, true) & NOTE_DELETE)
+                << "No NOTE_DELETE on process directory";
+    int status;
+    waitpid(child, &status, 0);
+}
+
+// Checks that select(2) reports the events file as readable
+// when there is an event to read.
+TEST_F(ProcFSTestFixture, CheckEventsSelect) {
+    string path(ROOTPATH + "/events");
+    int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+    
+    pid_t child = fork();
+    if (child == 0) {
+        _exit(0);
+    }
+    ASSERT_GT(child, 0) << "Fork failed";
+    int status;
+    waitpid(child, &status, 0);
+    
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    struct timeval timeout = { 5, 0 };
+    EXPECT_EQ(1, select(fd + 1, &readfds, NULL, NULL, &timeout)) << "Events file not readable";
+    close(fd);
+}
+
+// Registers for EVFILT_VNODE events on a path, then either forks a child
+// that exits immediately or kills a given child, and waits for up to five
+// seconds for an event. Returns the event flags, or 0 if there was no event.
+static int
+wait_for_vnode_event(const string& path, unsigned int fflags, pid_t child, bool kill_child) {
+    int fd = open(path.c_str(), O_EVTONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    int kq = kqueue();
+    struct kevent change;
+    EV_SET(&change, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, fflags, 0, NULL);
+    if (kevent(kq, &change, 1, NULL, 0, NULL) < 0) {
+        close(kq);
+        close(fd);
+        return 0;
+    }
+    
+    if (kill_child) {
+        kill(child, SIGKILL);
+    } else {
+        pid_t new_child = fork();
+        if (new_child == 0) {
+            _exit(0);
+        }
+        int status;
+        waitpid(new_child, &status, 0);
+    }
+    
+    struct kevent event;
+    struct timespec timeout = { 5, 0 };
+    int result = kevent(kq, NULL, 0, &event, 1, &timeout) == 1 ? (int)event.fflags : 0;
+    close(kq);
+    close(fd);
+    return result;
+}
@@ -7,7 +7,13 @@
 //  Tests for process directories (/proc/NNN).
 //
 #include <gtest/gtest.h>
+#include <mach/vm_prot.h>
 #include <sys/proc_info.h>
+#include <sys/resource.h>
+#include <libproc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "procfs.h"
 #include "ProcFS_TestFixture.hpp"
 #include "ProcFS_TestHelpers.hpp"
 
@@ -28,9 +34,9 @@ TEST_F(ProcFSTestFixture, CheckProcessDirectorySize) {
 TEST_F(ProcFSTestFixture, CheckProcessSubdirectories) {
     auto dir_path = current_process_directory_path();
     EXPECT_TRUE(check_directory_contains(dir_path,
-                    vector<string>({"fd", "info", "pgid",
-                                    "pid", "ppid", "sid", "taskinfo",
-                                    "threads", "tty"}),
+                    vector<string>({"children", "descendants", "fd", "images", "info",
+                                    "map", "pgid", "pid", "ppid", "rusage", "sid",
+                                    "taskinfo", "threads", "tty"}),
                     false));
 }
 
@@ -118,3 +124,97 @@ TEST_F(ProcFSTestFixture, CheckTaskInfoFileContent) {
     ASSERT_TRUE(taskinfo.pti_threads_user > 0) << "unlikely pti_threads_user value";
     ASSERT_TRUE(taskinfo.pti_syscalls_unix > 0) << "unlikely pti_syscalls_unix value";
 }
+
+// Verifies the content of the "rusage" file for a process.
+TEST_F(ProcFSTestFixture, CheckRusageFileContent) {
+    auto dir_path = current_process_directory_path();
+    
+    // Check that we get a structure of the correct size.
+    rusage_info_current rusage;
+    ASSERT_TRUE(read_file_content(dir_path + "/rusage", &rusage, sizeof(rusage))) << "Failed to read 'rusage' file content";
+    
+    // Compare with the values from proc_pid_rusage(), which can only have increased.
+    rusage_info_current expected;
+    ASSERT_EQ(0, proc_pid_rusage(getpid(), RUSAGE_INFO_CURRENT, (rusage_info_t *)&expected)) << "proc_pid_rusage() failed";
+    EXPECT_EQ(0, memcmp(rusage.ri_uuid, expected.ri_uuid, sizeof(rusage.ri_uuid))) << "Incorrect UUID";
+    EXPECT_LE(rusage.ri_user_time, expected.ri_user_time) << "unlikely ri_user_time value";
+    EXPECT_LE(rusage.ri_diskio_bytesread, expected.ri_diskio_bytesread) << "unlikely ri_diskio_bytesread value";
+    EXPECT_TRUE(rusage.ri_phys_footprint > 0) << "unlikely ri_phys_footprint value";
+    EXPECT_EQ(expected.ri_proc_start_abstime, rusage.ri_proc_start_abstime) << "Incorrect start time";
+}
+
+// Parses the content of a "map" file into its records, checking
+// that the record sizes are consistent and that the regions are in
+// order of increasing address.
+static AssertionResult
+parse_map_content(const vector<char> &content, vector<const procfs_map_region_t *> &regions) {
+    regions.clear();
+    size_t offset = 0;
+    uint64_t last_end = 0;
+    while (offset < content.size()) {
+        if (content.size() - offset < sizeof(procfs_map_region_t)) {
+            return AssertionFailure() << "Truncated record at offset " << offset;
+        }
+        const procfs_map_region_t *region = reinterpret_cast<const procfs_map_region_t *>(content.data() + offset);
+        if (region->pmr_size < sizeof(procfs_map_region_t) || (region->pmr_size & 7) != 0
+                || region->pmr_size > content.size() - offset) {
+            return AssertionFailure() << "Invalid record size " << region->pmr_size << " at offset " << offset;
+        }
+        if (strnlen(region->pmr_path, region->pmr_size - sizeof(procfs_map_region_t))
+                == region->pmr_size - sizeof(procfs_map_region_t)) {
+            return AssertionFailure() << "Unterminated path at offset " << offset;
+        }
+        if (region->pmr_start < last_end || region->pmr_end <= region->pmr_start) {
+            return AssertionFailure() << "Invalid region address range at offset " << offset;
+        }
+        last_end = region->pmr_end;
+        regions.push_back(region);
+        offset += region->pmr_size;
+    }
+    return AssertionSuccess();
+}
+
+// Verifies the content of the "map" file for a process.
+TEST_F(ProcFSTestFixture, CheckMapFileContent) {
+    auto dir_path = current_process_directory_path();
+
+    vector<char> content;
+    ASSERT_TRUE(read_binary_file(dir_path + "/map", content)) << "Failed to read 'map' file content";
+    vector<const procfs_map_region_t *> regions;
+    ASSERT_TRUE(parse_map_content(content, regions));
+    ASSERT_FALSE(regions.empty()) << "No regions in 'map' file";
+
+    // The code of this function must be in a readable, executable
+    // region that is backed by a file.
+    uint64_t code_address = reinterpret_cast<uint64_t>(&parse_map_content);
+    bool found = false;
+    for (auto region : regions) {
+        if (code_address >= region->pmr_start && code_address < region->pmr_end) {
+            EXPECT_TRUE((region->pmr_protection & VM_PROT_EXECUTE) != 0) << "Code region is not executable";
+            EXPECT_NE(0, strlen(region->pmr_path)) << "Code region has no path";
+            found = true;
+        }
+    }
+    EXPECT_TRUE(found) << "No region contains the test code";
+}
+
+// Checks that the "map" file is complete and consistent when it is
+// read in pieces that are smaller than a record.
+TEST_F(ProcFSTestFixture, CheckMapFileReadInPieces) {
+    string path(ROOTPATH + "/" + current_process_directory_path() + "/map");
+    int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+
+    vector<char> content;
+    char buffer[20];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        content.insert(content.end(), buffer, buffer + count);
+    }
+    close(fd);
+    ASSERT_EQ(0, count) << "Read failed: " << strerror(errno);
+
+    vector<const procfs_map_region_t *> regions;
+    ASSERT_TRUE(parse_map_content(content, regions));
+    EXPECT_FALSE(regions.empty()) << "No regions in 'map' file";
+}
@@ -0,0 +1,115 @@
+//
+//  ProcFS_ProcessTreeTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the "children" directory and the "descendants" file
+//  in each process directory.
+//
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "procfs.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+// Creates a child process that creates a grandchild process, both of
+// which wait until they are killed, and returns their process ids.
+static bool create_process_tree(pid_t *childp, pid_t *grandchildp);
+static void destroy_process_tree(pid_t child, pid_t grandchild);
+
+// Checks the types of the process tree nodes.
+TEST_F(ProcFSTestFixture, CheckProcessTreeNodeTypes) {
+    auto dir_path = current_process_directory_path();
+    EXPECT_TRUE(check_type_and_permissions(dir_path + "/children", S_IFDIR, 0550));
+    EXPECT_TRUE(check_type_and_permissions(dir_path + "/descendants", S_IFREG, 0550));
+}
+
+// Checks that the "children" directory links only to the
+// children of a process.
+TEST_F(ProcFSTestFixture, CheckChildrenDirectory) {
+    pid_t child, grandchild;
+    ASSERT_TRUE(create_process_tree(&child, &grandchild));
+
+    string children_path = current_process_directory_path() + "/children";
+    string child_name = to_string(child);
+    string grandchild_name = to_string(grandchild);
+    EXPECT_TRUE(check_directory_contains(children_path, vector<string>({child_name}), false));
+    EXPECT_TRUE(check_type_and_permissions(children_path + "/" + child_name, S_IFLNK, 0777));
+    EXPECT_TRUE(check_symlink_content(children_path + "/" + child_name, "../../" + child_name));
+    EXPECT_FALSE(check_file_exists(children_path + "/" + grandchild_name));
+    EXPECT_TRUE(check_directory_contains(child_name + "/children", vector<string>({grandchild_name}), false));
+    EXPECT_EQ(2, count_directory_entries(grandchild_name + "/children"));
+
+    destroy_process_tree(child, grandchild);
+    EXPECT_FALSE(check_file_exists(children_path + "/" + child_name));
+}
+
+// Checks that the "descendants" file lists the whole subtree
+// below a process, breadth first.
+TEST_F(ProcFSTestFixture, CheckDescendantsFile) {
+    pid_t child, grandchild;
+    ASSERT_TRUE(create_process_tree(&child, &grandchild));
+
+    vector<char> content;
+    string path = current_process_directory_path() + "/descendants";
+    EXPECT_TRUE(read_binary_file(path, content)) << "Failed to read " << path;
+    destroy_process_tree(child, grandchild);
+    ASSERT_EQ(2 * sizeof(procfs_descendant_t), content.size());
+
+    const procfs_descendant_t *records = reinterpret_cast<const procfs_descendant_t *>(content.data());
+    EXPECT_EQ(child, records[0].pde_pid);
+    EXPECT_EQ(getpid(), records[0].pde_ppid);
+    EXPECT_EQ(1, records[0].pde_depth);
+    EXPECT_EQ(grandchild, records[1].pde_pid);
+    EXPECT_EQ(child, records[1].pde_ppid);
+    EXPECT_EQ(2, records[1].pde_depth);
+    EXPECT_NE(records[0].pde_uniqueid, records[1].pde_uniqueid);
+}
+
+static bool
+create_process_tree(pid_t *childp, pid_t *grandchildp) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        return false;
+    }
+    if (child == 0) {
+        pid_t grandchild = fork();
+        if (grandchild == 0) {
+            pause();
+            _exit(0);
+        }
+        write(fds[1], &grandchild, sizeof(grandchild));
+        pause();
+        _exit(0);
+    }
+    close(fds[1]);
+    pid_t grandchild = -1;
+    bool ok = read(fds[0], &grandchild, sizeof(grandchild)) == sizeof(grandchild) && grandchild > 0;
+    close(fds[0]);
+    *childp = child;
+    *grandchildp = grandchild;
+    if (!ok) {
+        destroy_process_tree(child, grandchild);
+    }
+    return ok;
+}
+
+static void
+destroy_process_tree(pid_t child, pid_t grandchild) {
+    if (grandchild > 0) {
+        kill(grandchild, SIGKILL);
+    }
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+}
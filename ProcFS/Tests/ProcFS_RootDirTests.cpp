@@ -6,8 +6,19 @@
 //
 //  Procfs root directory tests.
 //
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <gtest/gtest.h>
+#include <signal.h>
+#include <sys/fsctl.h>
+#include <sys/ioctl.h>
+#include <sys/param.h>
+#include <sys/sysctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "procfs.h"
 #include "Procfs_TestFixture.hpp"
 #include "ProcFS_TestHelpers.hpp"
 
@@ -56,6 +67,217 @@ TEST_F(ProcFSTestFixture, CheckRootFileProperties) {
     EXPECT_TRUE(check_proc_files_properties_are_valid());
 }
 
+TEST_F(ProcFSTestFixture, CheckRootDirTracksProcesses) {
+    // Check that a new process appears in the root directory as soon
+    // as it is created and disappears as soon as it has been reaped,
+    // even if the directory was listed just before each change.
+    EXPECT_TRUE(check_directory_contains("/", vector<string>({"curproc"}), true));
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0) << "fork() failed";
+    if (pid == 0) {
+        pause();
+        _exit(0);
+    }
+    string name = to_string(pid);
+    EXPECT_TRUE(check_directory_contains("/", vector<string>({name}), true));
+    
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    EXPECT_FALSE(check_directory_contains("/", vector<string>({name}), true));
+}
+
+TEST_F(ProcFSTestFixture, CheckRootDirInPidOrder) {
+    // Check that the processes in the root directory are listed
+    // in increasing order of process id.
+    string dir_path(ROOTPATH + "/");
+    DIR *dir = opendir(dir_path.c_str());
+    ASSERT_TRUE(dir != NULL) << "Failed to open directory " << dir_path;
+    long last_pid = -1;
+    int pid_count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!non_process_directory_entry(entry->d_name)) {
+            long pid = strtol(entry->d_name, NULL, 10);
+            EXPECT_GT(pid, last_pid) << "Process " << pid << " is out of order";
+            last_pid = pid;
+            pid_count++;
+        }
+    }
+    closedir(dir);
+    EXPECT_GT(pid_count, 0);
+}
+
+TEST_F(ProcFSTestFixture, CheckPidListReuse) {
+    // Check that reading a file that covers every process repeatedly
+    // reuses process id lists instead of allocating new ones. Listing
+    // the root directory does not use process id lists, because it
+    // takes process ids from the process index in fixed-size batches.
+    uint64_t reuses = 0;
+    size_t len = sizeof(reuses);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.pidlist.reuses", &reuses, &len, NULL, 0));
+    for (int i = 0; i < 3; i++) {
+        vector<char> content;
+        EXPECT_TRUE(read_binary_file("sockets", content));
+    }
+    uint64_t new_reuses = 0;
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.pidlist.reuses", &new_reuses, &len, NULL, 0));
+    EXPECT_GT(new_reuses, reuses) << "Process id lists were not reused";
+    
+    // Lists that fill up because processes were created while they were
+    // being built are counted.
+    uint64_t overflows = 0;
+    EXPECT_EQ(0, sysctlbyname("vfs.procfs.pidlist.overflows", &overflows, &len, NULL, 0));
+}
+
+TEST_F(ProcFSTestFixture, CheckProcessTableShared) {
+    // Check that listing the byname directory is served from the
+    // shared process table.
+    uint64_t before = 0;
+    uint64_t after = 0;
+    size_t len = sizeof(uint64_t);
+    uint64_t value;
+    for (const char *name : {"vfs.procfs.proctable.rebuilds", "vfs.procfs.proctable.reuses",
+                             "vfs.procfs.proctable.coalesced"}) {
+        ASSERT_EQ(0, sysctlbyname(name, &value, &len, NULL, 0)) << "Failed to get " << name;
+        before += value;
+    }
+    EXPECT_GT(count_directory_entries("byname"), 0);
+    for (const char *name : {"vfs.procfs.proctable.rebuilds", "vfs.procfs.proctable.reuses",
+                             "vfs.procfs.proctable.coalesced"}) {
+        ASSERT_EQ(0, sysctlbyname(name, &value, &len, NULL, 0)) << "Failed to get " << name;
+        after += value;
+    }
+    EXPECT_GT(after, before) << "Process table was not used";
+}
+
+TEST_F(ProcFSTestFixture, CheckProcessIndexTracksProcesses) {
+    // Check that the process index is in use and that a new process
+    // can be looked up as soon as it is created and not after it
+    // has been reaped.
+    int valid = 0;
+    size_t len = sizeof(valid);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.procindex.valid", &valid, &len, NULL, 0));
+    EXPECT_EQ(1, valid) << "Process index is not in use";
+    
+    int entries = 0;
+    len = sizeof(entries);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.procindex.entries", &entries, &len, NULL, 0));
+    EXPECT_GT(entries, 0);
+    
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0) << "fork() failed";
+    if (pid == 0) {
+        pause();
+        _exit(0);
+    }
+    string name = to_string(pid);
+    EXPECT_TRUE(check_file_exists(name));
+    
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    EXPECT_FALSE(check_file_exists(name));
+}
+
+TEST_F(ProcFSTestFixture, CheckProcessIndexRebuilt) {
+    // Check that the process index is rebuilt by the next listing after
+    // it has been marked unusable and that it then tracks processes again.
+    uint64_t rebuilds = 0;
+    size_t len = sizeof(rebuilds);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.procindex.rebuilds", &rebuilds, &len, NULL, 0));
+    
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0) << "fork() failed";
+    if (pid == 0) {
+        pause();
+        _exit(0);
+    }
+    
+    int invalidate = 1;
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.procindex.invalidate", NULL, NULL, &invalidate, sizeof(invalidate)));
+    int valid = 1;
+    len = sizeof(valid);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.procindex.valid", &valid, &len, NULL, 0));
+    EXPECT_EQ(0, valid) << "Process index was not invalidated";
+    
+    // Listing the root directory counts the processes from the index.
+    EXPECT_TRUE(check_directory_contains("/", vector<string>({to_string(getpid()), to_string(pid)}), true));
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.procindex.valid", &valid, &len, NULL, 0));
+    EXPECT_EQ(1, valid) << "Process index was not rebuilt";
+    uint64_t new_rebuilds = 0;
+    len = sizeof(new_rebuilds);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.procindex.rebuilds", &new_rebuilds, &len, NULL, 0));
+    EXPECT_GT(new_rebuilds, rebuilds);
+    
+    // The rebuilt index has the processes that existed before it was
+    // invalidated and loses them when they exit.
+    string bycomm = "bycomm/" + string(getprogname()).substr(0, MAXCOMLEN);
+    EXPECT_TRUE(check_directory_contains(bycomm, vector<string>({to_string(getpid()), to_string(pid)}), true));
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    EXPECT_FALSE(check_file_exists(to_string(pid)));
+    EXPECT_FALSE(check_file_exists(bycomm + "/" + to_string(pid)));
+}
+
+TEST_F(ProcFSTestFixture, CheckBatchQuery) {
+    // Check that a batch query returns information for the current
+    // process and reports a process that does not exist.
+    int fd = open(ROOTPATH.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << ROOTPATH;
+    
+    pid_t pids[] = { getpid(), -1 };
+    procfs_batch_record_t records[2];
+    procfs_batch_query_t query;
+    memset(&query, 0, sizeof(query));
+    query.pbq_pids = (uint64_t)(uintptr_t)pids;
+    query.pbq_records = (uint64_t)(uintptr_t)records;
+    query.pbq_pid_count = 2;
+    query.pbq_flavors = PROCFS_BATCH_ALL;
+    ASSERT_EQ(0, ffsctl(fd, PROCFS_IOC_BATCH_QUERY, &query, 0)) << "ffsctl() failed: " << strerror(errno);
+    EXPECT_EQ(1, query.pbq_found_count);
+    
+    EXPECT_EQ(getpid(), records[0].pbr_pid);
+    EXPECT_EQ(0, records[0].pbr_status);
+    EXPECT_EQ(PROCFS_BATCH_ALL, records[0].pbr_flavors);
+    EXPECT_EQ(getpid(), records[0].pbr_bsdinfo.pbi_pid);
+    EXPECT_EQ(getppid(), records[0].pbr_bsdinfo.pbi_ppid);
+    EXPECT_GT(records[0].pbr_taskinfo.pti_resident_size, 0);
+    EXPECT_EQ(records[0].pbr_taskinfo.pti_threadnum, records[0].pbr_thread_count);
+    EXPECT_GT(records[0].pbr_thread_count, 0);
+    EXPECT_GE(records[0].pbr_fd_count, 1);  // At least the descriptor for the root directory.
+    EXPECT_GT(records[0].pbr_rusage.ri_user_time + records[0].pbr_rusage.ri_system_time, 0);
+    
+    EXPECT_EQ(-1, records[1].pbr_pid);
+    EXPECT_EQ(ESRCH, records[1].pbr_status);
+    EXPECT_EQ(0, records[1].pbr_flavors);
+    
+    // Too many process ids and unknown flavors are rejected.
+    query.pbq_pid_count = PROCFS_BATCH_MAX_PIDS + 1;
+    EXPECT_EQ(-1, ffsctl(fd, PROCFS_IOC_BATCH_QUERY, &query, 0));
+    EXPECT_EQ(EINVAL, errno);
+    query.pbq_pid_count = 2;
+    query.pbq_flavors = ~0U;
+    EXPECT_EQ(-1, ffsctl(fd, PROCFS_IOC_BATCH_QUERY, &query, 0));
+    EXPECT_EQ(EINVAL, errno);
+    
+    // ioctl() is not passed on for directories.
+    query.pbq_flavors = PROCFS_BATCH_BSDINFO;
+    EXPECT_EQ(-1, ioctl(fd, PROCFS_IOC_BATCH_QUERY, &query));
+    EXPECT_EQ(ENOTTY, errno);
+    close(fd);
+    
+    // The request can also be made by path.
+    ASSERT_EQ(0, fsctl(ROOTPATH.c_str(), PROCFS_IOC_BATCH_QUERY, &query, 0)) << "fsctl() failed: " << strerror(errno);
+    EXPECT_EQ(1, query.pbq_found_count);
+    
+    // The request is only valid on the root directory.
+    string path(ROOTPATH + "/curproc");
+    fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << "Failed to open " << path;
+    EXPECT_EQ(-1, ffsctl(fd, PROCFS_IOC_BATCH_QUERY, &query, 0));
+    EXPECT_EQ(ENOTTY, errno);
+    close(fd);
+}
+
 // Vallidates a file from the root directory. If it's not one of the special
 // cases, its name mustbe numeric.
 static AssertionResult
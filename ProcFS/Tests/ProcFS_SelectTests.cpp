@@ -0,0 +1,125 @@
+//
+//  ProcFS_SelectTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the /proc/select directory.
+//
+#include <gtest/gtest.h>
+#include <sys/param.h>
+#include <sys/proc_info.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <unistd.h>
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+static AssertionResult read_select_info(const string &filter, vector<struct proc_bsdinfo> &infos);
+
+// Checks that "select" is a directory that lists no filters.
+TEST_F(ProcFSTestFixture, CheckSelectDirectory) {
+    EXPECT_TRUE(check_type_and_permissions("select", S_IFDIR, 0550));
+    EXPECT_EQ(2, count_directory_entries("select"));
+}
+
+// Checks that names that are not valid filters do not exist.
+TEST_F(ProcFSTestFixture, CheckInvalidSelectNames) {
+    EXPECT_FALSE(check_file_exists("select/uid"));
+    EXPECT_FALSE(check_file_exists("select/=501"));
+    EXPECT_FALSE(check_file_exists("select/name=launchd"));
+    EXPECT_FALSE(check_file_exists("select/uid="));
+    EXPECT_FALSE(check_file_exists("select/uid=abc"));
+    EXPECT_FALSE(check_file_exists("select/uid=0501"));
+    EXPECT_FALSE(check_file_exists("select/uid=4294967296"));
+    EXPECT_FALSE(check_file_exists("select/ppid=100000000"));
+    EXPECT_FALSE(check_file_exists("select/comm="));
+    EXPECT_FALSE(check_file_exists("select/comm=a_very_long_command_name"));
+    EXPECT_TRUE(check_file_exists("select/uid=0"));
+    EXPECT_TRUE(check_file_exists("select/comm=no_such_command"));
+}
+
+// Checks that looking up command names that no process has does not
+// leave them in the table of interned names once the directories are
+// no longer in use.
+TEST_F(ProcFSTestFixture, CheckSelectDoesNotInternNames) {
+    int before, after;
+    size_t len = sizeof(before);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.comm_names", &before, &len, NULL, 0));
+    const int lookups = 100;
+    for (int i = 0; i < lookups; i++) {
+        EXPECT_TRUE(check_file_exists("select/comm=no_such_cmd" + to_string(i)));
+    }
+    len = sizeof(after);
+    ASSERT_EQ(0, sysctlbyname("vfs.procfs.comm_names", &after, &len, NULL, 0));
+    
+    // Other processes may exec while this runs, so allow for a few new names.
+    EXPECT_LT(after - before, lookups);
+}
+
+// Checks that the directory for the current user links to this process
+// and that its info file lists only processes with that user id.
+TEST_F(ProcFSTestFixture, CheckSelectByUid) {
+    string filter = "uid=" + to_string(getuid());
+    string pid = to_string(getpid());
+    EXPECT_TRUE(check_type_and_permissions("select/" + filter, S_IFDIR, 0550));
+    EXPECT_TRUE(check_directory_contains("select/" + filter, vector<string>({"info", pid}), true));
+    EXPECT_TRUE(check_type_and_permissions("select/" + filter + "/" + pid, S_IFLNK, 0777));
+    EXPECT_TRUE(check_symlink_content("select/" + filter + "/" + pid, "../../" + pid));
+
+    vector<struct proc_bsdinfo> infos;
+    ASSERT_TRUE(read_select_info(filter, infos));
+    bool found = false;
+    for (const struct proc_bsdinfo &info : infos) {
+        EXPECT_EQ(getuid(), info.pbi_uid) << "Process " << info.pbi_pid;
+        found |= info.pbi_pid == (uint32_t)getpid();
+    }
+    EXPECT_TRUE(found) << "Process " << pid << " not found";
+}
+
+// Checks that the directories for this process's command name and parent
+// process id link to this process.
+TEST_F(ProcFSTestFixture, CheckSelectByCommAndPpid) {
+    string comm = string(getprogname()).substr(0, MAXCOMLEN);
+    string pid = to_string(getpid());
+    EXPECT_TRUE(check_directory_contains("select/comm=" + comm, vector<string>({"info", pid}), true));
+    EXPECT_TRUE(check_directory_contains("select/ppid=" + to_string(getppid()), vector<string>({"info", pid}), true));
+    EXPECT_TRUE(check_directory_contains("select/pgid=" + to_string(getpgrp()), vector<string>({"info", pid}), true));
+
+    vector<struct proc_bsdinfo> infos;
+    ASSERT_TRUE(read_select_info("comm=" + comm, infos));
+    for (const struct proc_bsdinfo &info : infos) {
+        EXPECT_EQ(comm, info.pbi_comm) << "Process " << info.pbi_pid;
+    }
+
+    // A filter that matches nothing gives an empty directory.
+    EXPECT_TRUE(check_directory_contains("select/comm=no_such_command", vector<string>({"info"}), false));
+    EXPECT_TRUE(check_file_empty("select/comm=no_such_command/info"));
+    EXPECT_FALSE(check_file_exists("select/comm=no_such_command/" + pid));
+}
+
+// Reads the info file for a filter and checks that its records are
+// in order of increasing process id.
+static AssertionResult
+read_select_info(const string &filter, vector<struct proc_bsdinfo> &infos) {
+    vector<char> content;
+    string path = "select/" + filter + "/info";
+    if (!read_binary_file(path, content)) {
+        return AssertionFailure() << "Failed to read " << path;
+    }
+    if (content.size() % sizeof(struct proc_bsdinfo) != 0) {
+        return AssertionFailure() << "Invalid size for " << path << ": " << content.size();
+    }
+
+    const struct proc_bsdinfo *records = reinterpret_cast<const struct proc_bsdinfo *>(content.data());
+    infos.assign(records, records + content.size()/sizeof(struct proc_bsdinfo));
+    for (size_t i = 1; i < infos.size(); i++) {
+        if (infos[i - 1].pbi_pid >= infos[i].pbi_pid) {
+            return AssertionFailure() << "Records " << i - 1 << " and " << i << " of " << path << " are out of order";
+        }
+    }
+    return AssertionSuccess();
+}
@@ -166,11 +166,18 @@ iterate_all_files(const string &rel_dir_path, const iterator_fn fn) {
 }
 
 // Checks whether a name represents a non-process entry in a process directory
-// (i.e, ".", "..", "byname" and "curproc")
+// (i.e, ".", "..", "byname", "bycomm", "bypgrp", "byuid", "columns", "curproc", "events", "host", "images",
+// "openers", "select", "sockets", "top" and "totals")
 bool
 non_process_directory_entry(const char *name) {
     return strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, "byname") == 0
-            || strcmp(name, "curproc") == 0;
+            || strcmp(name, "columns") == 0 || strcmp(name, "curproc") == 0
+            || strcmp(name, "events") == 0 || strcmp(name, "images") == 0
+            || strcmp(name, "host") == 0 || strcmp(name, "sockets") == 0
+            || strcmp(name, "openers") == 0 || strcmp(name, "top") == 0
+            || strcmp(name, "totals") == 0 || strcmp(name, "select") == 0
+            || strcmp(name, "bycomm") == 0 || strcmp(name, "byuid") == 0
+            || strcmp(name, "bypgrp") == 0;
 }
 
 // Checks whether a name represents a special entry in a directory
@@ -282,6 +289,27 @@ read_file(const std::string &rel_file_path, bool &error) {
     return result;
 }
 
+// Reads the entire content of a binary file of unknown size. Returns
+// false if the file could not be opened or read.
+bool
+read_binary_file(const std::string &rel_file_path, vector<char> &content) {
+    string file_path(ROOTPATH + "/" + rel_file_path);
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    content.clear();
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        content.insert(content.end(), buffer, buffer + n);
+    }
+    close(fd);
+    
+    return n == 0;
+}
+
 // Checks whether a file is empty by reading its content.
 bool
 check_file_empty(const std::string &rel_file_path) {
@@ -41,7 +41,8 @@ testing::AssertionResult check_type_and_permissions(const std::string &path, int
 testing::AssertionResult iterate_all_files(const std::string &rel_dir_path, const iterator_fn fn);
 
 // Checks whether a name represents a non-process entry in a process directory
-// (i.e, ".", "..", "byname" and "curproc").
+// (i.e, ".", "..", "byname", "bycomm", "bypgrp", "byuid", "columns", "curproc", "events",
+// "host", "images", "openers", "select", "sockets", "top" and "totals").
 bool non_process_directory_entry(const char *name);
 
 // Checks whether a name represents a special entry in a directory
@@ -69,6 +70,10 @@ bool read_file_content(const std::string &rel_file_path, void *buffer, size_t si
 // empty string is returned and error is set to true.
 std::string read_file(const std::string &rel_file_path, bool &error);
 
+// Reads the entire content of a binary file of unknown size. Returns
+// false if the file could not be opened or read.
+bool read_binary_file(const std::string &rel_file_path, std::vector<char> &content);
+
 // Checks whether a file is empty by reading its content.
 bool check_file_empty(const std::string &rel_file_path);
 
@@ -0,0 +1,100 @@
+//
+//  ProcFS_TopTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the /proc/top directory.
+//
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "procfs.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+static AssertionResult check_top_file(const string &rel_path, size_t max_count, vector<procfs_top_entry_t> &entries);
+
+// Checks that "top" is a directory with the expected subdirectories.
+TEST_F(ProcFSTestFixture, CheckTopDirectory) {
+    EXPECT_TRUE(check_type_and_permissions("top", S_IFDIR, 0550));
+    EXPECT_TRUE(check_directory_contains("top", vector<string>({"cpu", "io", "rss"}), false));
+}
+
+// Checks that file names that are not valid process counts do not exist.
+TEST_F(ProcFSTestFixture, CheckInvalidTopNames) {
+    EXPECT_FALSE(check_file_exists("top/cpu/0"));
+    EXPECT_FALSE(check_file_exists("top/cpu/020"));
+    EXPECT_FALSE(check_file_exists("top/cpu/abc"));
+    EXPECT_FALSE(check_file_exists("top/rss/" + to_string(PROCFS_TOP_MAX_COUNT + 1)));
+    EXPECT_TRUE(check_file_exists("top/io/" + to_string(PROCFS_TOP_MAX_COUNT)));
+}
+
+// Checks that each top file returns at most the requested number of
+// records, in order of decreasing value.
+TEST_F(ProcFSTestFixture, CheckTopFileContent) {
+    vector<procfs_top_entry_t> entries;
+    EXPECT_TRUE(check_top_file("top/cpu/5", 5, entries));
+    for (const procfs_top_entry_t &entry : entries) {
+        EXPECT_EQ(entry.pte_cpu_time, entry.pte_value) << "Process " << entry.pte_pid;
+    }
+    EXPECT_TRUE(check_top_file("top/rss/20", 20, entries));
+    for (const procfs_top_entry_t &entry : entries) {
+        EXPECT_EQ(entry.pte_resident_size, entry.pte_value) << "Process " << entry.pte_pid;
+        EXPECT_GT(entry.pte_threads, 0) << "Process " << entry.pte_pid;
+    }
+    EXPECT_TRUE(check_top_file("top/io/1", 1, entries));
+}
+
+// Checks that the current process is listed when more processes are
+// requested than are visible.
+TEST_F(ProcFSTestFixture, CheckTopIncludesCurrentProcess) {
+    vector<procfs_top_entry_t> entries;
+    ASSERT_TRUE(check_top_file("top/rss/" + to_string(PROCFS_TOP_MAX_COUNT), PROCFS_TOP_MAX_COUNT, entries));
+    if (entries.size() == PROCFS_TOP_MAX_COUNT) {
+        // Too many processes to be sure that this one is included.
+        return;
+    }
+    
+    bool found = false;
+    for (const procfs_top_entry_t &entry : entries) {
+        if (entry.pte_pid == getpid()) {
+            EXPECT_EQ(getppid(), entry.pte_ppid);
+            EXPECT_EQ(getuid(), entry.pte_uid);
+            EXPECT_GT(entry.pte_resident_size, 0);
+            found = true;
+        }
+    }
+    EXPECT_TRUE(found) << "Current process not listed";
+}
+
+// Reads a top file and checks that it has no more than a given number
+// of records and that they are in order of decreasing value and, for
+// equal values, increasing process id.
+static AssertionResult
+check_top_file(const string &rel_path, size_t max_count, vector<procfs_top_entry_t> &entries) {
+    vector<char> content;
+    if (!read_binary_file(rel_path, content)) {
+        return AssertionFailure() << "Failed to read " << rel_path;
+    }
+    if (content.size() % sizeof(procfs_top_entry_t) != 0) {
+        return AssertionFailure() << "Size of " << rel_path << " is not a multiple of the record size";
+    }
+    
+    size_t count = content.size()/sizeof(procfs_top_entry_t);
+    if (count == 0 || count > max_count) {
+        return AssertionFailure() << rel_path << " has " << count << " records";
+    }
+    const procfs_top_entry_t *records = reinterpret_cast<const procfs_top_entry_t *>(content.data());
+    entries.assign(records, records + count);
+    for (size_t i = 1; i < count; i++) {
+        if (entries[i].pte_value > entries[i - 1].pte_value
+                || (entries[i].pte_value == entries[i - 1].pte_value && entries[i].pte_pid <= entries[i - 1].pte_pid)) {
+            return AssertionFailure() << "Records " << i - 1 << " and " << i << " of " << rel_path << " are out of order";
+        }
+    }
+    return AssertionSuccess();
+}
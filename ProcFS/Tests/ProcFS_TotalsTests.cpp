@@ -0,0 +1,123 @@
+//
+//  ProcFS_TotalsTests.cpp
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//  Tests for the /proc/totals directory.
+//
+#include <gtest/gtest.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "procfs.h"
+#include "ProcFS_TestFixture.hpp"
+#include "ProcFS_TestHelpers.hpp"
+
+using namespace std;
+using namespace testing;
+
+static AssertionResult read_totals_file(const string &rel_path, bool by_comm, vector<procfs_totals_t> &totals);
+
+// Checks that "totals" is a directory with the expected files, whose
+// sizes are upper bounds on their content.
+TEST_F(ProcFSTestFixture, CheckTotalsDirectory) {
+    EXPECT_TRUE(check_type_and_permissions("totals", S_IFDIR, 0550));
+    EXPECT_TRUE(check_directory_contains("totals", vector<string>({"comm", "pgrp", "uid"}), false));
+    for (const string &name : vector<string>({"comm", "pgrp", "uid"})) {
+        size_t size = file_size("totals/" + name);
+        EXPECT_EQ(0, size % sizeof(procfs_totals_t)) << name;
+        vector<procfs_totals_t> totals;
+        ASSERT_TRUE(read_totals_file("totals/" + name, name == "comm", totals));
+        EXPECT_GE(size, totals.size() * sizeof(procfs_totals_t)) << name;
+    }
+}
+
+// Checks that the current user has a group in the "uid" file that
+// includes this process and its thread and resource usage.
+TEST_F(ProcFSTestFixture, CheckTotalsByUid) {
+    vector<procfs_totals_t> totals;
+    ASSERT_TRUE(read_totals_file("totals/uid", false, totals));
+    
+    bool found = false;
+    for (const procfs_totals_t &group : totals) {
+        if (group.pto_id == getuid()) {
+            EXPECT_GE(group.pto_process_count, 1u);
+            EXPECT_GE(group.pto_thread_count, group.pto_process_count);
+            EXPECT_GT(group.pto_resident_size, 0ULL);
+            EXPECT_GT(group.pto_cpu_time, 0ULL);
+            EXPECT_EQ(0, group.pto_comm[0]);
+            found = true;
+        }
+    }
+    EXPECT_TRUE(found) << "No group for user " << getuid();
+}
+
+// Checks that this process's command name and process group each have
+// a group and that the same processes are counted in every file.
+TEST_F(ProcFSTestFixture, CheckTotalsByCommAndPgrp) {
+    vector<procfs_totals_t> by_uid;
+    vector<procfs_totals_t> by_comm;
+    vector<procfs_totals_t> by_pgrp;
+    ASSERT_TRUE(read_totals_file("totals/uid", false, by_uid));
+    ASSERT_TRUE(read_totals_file("totals/comm", true, by_comm));
+    ASSERT_TRUE(read_totals_file("totals/pgrp", false, by_pgrp));
+    
+    string comm = string(getprogname()).substr(0, MAXCOMLEN);
+    bool found_comm = false;
+    for (const procfs_totals_t &group : by_comm) {
+        found_comm |= comm == group.pto_comm;
+    }
+    EXPECT_TRUE(found_comm) << "No group for command " << comm;
+    
+    bool found_pgrp = false;
+    for (const procfs_totals_t &group : by_pgrp) {
+        found_pgrp |= group.pto_id == (uint32_t)getpgrp();
+    }
+    EXPECT_TRUE(found_pgrp) << "No group for process group " << getpgrp();
+    
+    // Processes may be created or exit between reads, so the totals may differ a little.
+    uint32_t uid_processes = 0;
+    uint32_t comm_processes = 0;
+    uint32_t pgrp_processes = 0;
+    for (const procfs_totals_t &group : by_uid) {
+        uid_processes += group.pto_process_count;
+    }
+    for (const procfs_totals_t &group : by_comm) {
+        comm_processes += group.pto_process_count;
+    }
+    for (const procfs_totals_t &group : by_pgrp) {
+        pgrp_processes += group.pto_process_count;
+    }
+    EXPECT_NEAR(uid_processes, comm_processes, 10);
+    EXPECT_NEAR(uid_processes, pgrp_processes, 10);
+}
+
+// Reads a totals file and checks that its records are in order of
+// increasing id, or of command name if "by_comm" is true.
+static AssertionResult
+read_totals_file(const string &rel_path, bool by_comm, vector<procfs_totals_t> &totals) {
+    vector<char> content;
+    if (!read_binary_file(rel_path, content)) {
+        return AssertionFailure() << "Failed to read " << rel_path;
+    }
+    if (content.size() == 0 || content.size() % sizeof(procfs_totals_t) != 0) {
+        return AssertionFailure() << "Invalid size for " << rel_path << ": " << content.size();
+    }
+    
+    const procfs_totals_t *records = reinterpret_cast<const procfs_totals_t *>(content.data());
+    totals.assign(records, records + content.size()/sizeof(procfs_totals_t));
+    for (size_t i = 0; i < totals.size(); i++) {
+        if (totals[i].pto_process_count == 0) {
+            return AssertionFailure() << "Empty group " << i << " in " << rel_path;
+        }
+        if (i > 0) {
+            bool ordered = by_comm ? strcmp(totals[i - 1].pto_comm, totals[i].pto_comm) < 0
+                                   : totals[i - 1].pto_id < totals[i].pto_id;
+            if (!ordered) {
+                return AssertionFailure() << "Records " << i - 1 << " and " << i << " of " << rel_path << " are out of order";
+            }
+        }
+    }
+    return AssertionSuccess();
+}
@@ -11,7 +11,10 @@
 // in the mounted file system have access permissions that allow
 // any process to read them. This, of course, is a huge security
 // loophole, so it should only be used for testing. The default is
-// "procperms" (which is secure).
+// "procperms" (which is secure). The option "snapinterval=N" sets
+// the minimum interval, in milliseconds, between rebuilds of the
+// kernel's shared snapshot of the process table, up to
+// PROCFS_MAX_SNAPSHOT_INTERVAL_MS.
 //
 
 #include <sys/mount.h>
@@ -41,6 +44,7 @@ static struct mntopt mopts[] = {
     
     // procfs mount options.
     { "procperms", 1, PROCFS_MOPT_NOPROCPERMS, 0}, // Inverse: if omitted, this option is enabled.
+    { "snapinterval", 0, 0, 0},                     // Takes a value, handled separately.
     
     // End marker
     { NULL }
@@ -54,6 +58,7 @@ int main(int argc, char *argv[]) {
     // using the -o option.
     int generic_options = MNT_NOEXEC | MNT_NOSUID;
     int procfs_options = 0;
+    uint32_t snapshot_interval_ms = 0;
     
     opterr = 0;  // Silence default messages from getopt()
     int option;
@@ -71,6 +76,17 @@ int main(int argc, char *argv[]) {
                 
         case 'o': {
             mntoptparse_t mntops = getmntopts(optarg, mopts, &generic_options, &procfs_options);
+            const char *interval = getmntoptstr(mntops, "snapinterval");
+            if (interval != NULL) {
+                char *end;
+                long value = strtol(interval, &end, 10);
+                if (*interval == '\0' || *end != '\0' || value < 0 || value > PROCFS_MAX_SNAPSHOT_INTERVAL_MS) {
+                    fprintf(stderr, "%s: invalid snapinterval value: %s\n", prog_name, interval);
+                    usage(prog_name);
+                    /*NOTREACHED*/
+                }
+                snapshot_interval_ms = (uint32_t)value;
+            }
             freemntopts(mntops);
             break;
         }
@@ -91,7 +107,8 @@ int main(int argc, char *argv[]) {
 
     /* -- Mount the file system -- */
     procfs_mount_args_t mount_args;
-    mount_args.mnt_options = procfs_options;
+    mount_args.mnt_options = procfs_options | PROCFS_MOPT_EXTENDED_ARGS;
+    mount_args.mnt_snapshot_interval_ms = snapshot_interval_ms;
 
     char *mntdir = argv[1];
     if (verbose) {
@@ -123,6 +140,8 @@ usage(char *name) {
     fprintf(stderr, "Options are:\n");
     fprintf(stderr, "     procperms\t\tConfigures process nodes so that only process owner can view process info. On by default.\n");
     fprintf(stderr, "     noprocperms\tDisables procperms. Use with extreme caution - this is a security risk.\n");
+    fprintf(stderr, "     snapinterval=N\tReuses the process table snapshot for at least N milliseconds, up to %d. Default 0.\n",
+            PROCFS_MAX_SNAPSHOT_INTERVAL_MS);
     fprintf(stderr, "     -v\t\t\tEnables verbose logging of mount operation to syslog.\n");
     fprintf(stderr, "     -?, -h\t\tPrints this usage message and exits.\n");
     fprintf(stderr, "Example: mount -t %s -o procperms,-v %s /proc\n", PROCFS_FSNAME, PROCFS_FSNAME);
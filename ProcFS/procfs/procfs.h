@@ -11,10 +11,14 @@
 #ifndef procfs_h
 #define procfs_h
 
+#include <sys/ioccom.h>
 #include <sys/mount.h>
+#include <sys/proc_info.h>
+#include <sys/resource.h>
 
 #ifdef KERNEL
 #include <libkern/OSMalloc.h>
+#include <sys/sysctl.h>
 #endif /* KERNEL */
 
 #pragma mark -
@@ -26,15 +30,370 @@
 // Mount option flags.
 // Do not apply process permissions to the pid entries in /proc.
 #define PROCFS_MOPT_NOPROCPERMS (1 << 0)
+// The mount structure has the fields that follow mnt_options. Older
+// versions of mount_procfs pass only mnt_options and do not set this.
+#define PROCFS_MOPT_EXTENDED_ARGS (1 << 30)
+
+// The largest minimum interval between process table rebuilds
+// that a mount can ask for, in milliseconds.
+#define PROCFS_MAX_SNAPSHOT_INTERVAL_MS 1000
 
 /*
  * The procfs mount structure, created by mount_procfs
  * and passed to the kernel by the mount(2) system call.
+ * Fields after mnt_options are only valid if mnt_options
+ * includes PROCFS_MOPT_EXTENDED_ARGS.
  */
 typedef struct procfs_mount_args {
-    int mnt_options;      // The procfs mount options.
+    int         mnt_options;                // The procfs mount options.
+    uint32_t    mnt_snapshot_interval_ms;   // Minimum interval between process table rebuilds, or 0.
 } procfs_mount_args_t;
 
+#pragma mark -
+#pragma mark Columnar Process Snapshots
+
+/*
+ * Layout of the files in the /proc/columns directory. The name of
+ * each file is a comma-separated list of column names, such as
+ * "pid,ppid,rss", which selects the fields that are included.
+ * The file starts with a procfs_columns_header_t, followed by one
+ * procfs_column_desc_t for each selected column, in order of
+ * increasing column id (so "ppid,pid" and "pid,ppid" are the same
+ * file). Each column's data is a contiguous array of pch_row_count
+ * elements starting at the offset given in its descriptor. The
+ * header and every column array start on a PROCFS_COLUMNS_ALIGN
+ * byte boundary.
+ */
+#define PROCFS_COLUMNS_MAGIC    0x50434f4c  // "PCOL"
+#define PROCFS_COLUMNS_VERSION  1
+#define PROCFS_COLUMNS_ALIGN    64
+
+// Size of an element in the "comm" column. The value is
+// null-terminated and zero-padded.
+#define PROCFS_COLUMN_COMM_SIZE 32
+
+// Column identifiers. The bit for a column in the file's
+// selection mask is (1 << column id).
+typedef enum {
+    PROCFS_COLUMN_PID = 0,      // "pid"     - int32_t process id.
+    PROCFS_COLUMN_PPID,         // "ppid"    - int32_t parent process id.
+    PROCFS_COLUMN_PGID,         // "pgid"    - int32_t process group id.
+    PROCFS_COLUMN_UID,          // "uid"     - uint32_t effective user id.
+    PROCFS_COLUMN_GID,          // "gid"     - uint32_t effective group id.
+    PROCFS_COLUMN_RUID,         // "ruid"    - uint32_t real user id.
+    PROCFS_COLUMN_RGID,         // "rgid"    - uint32_t real group id.
+    PROCFS_COLUMN_START,        // "start"   - uint64_t start time, microseconds since the epoch.
+    PROCFS_COLUMN_THREADS,      // "threads" - int32_t number of threads.
+    PROCFS_COLUMN_RSS,          // "rss"     - uint64_t resident size in bytes.
+    PROCFS_COLUMN_VSIZE,        // "vsize"   - uint64_t virtual size in bytes.
+    PROCFS_COLUMN_UTIME,        // "utime"   - uint64_t user CPU time, nanoseconds.
+    PROCFS_COLUMN_STIME,        // "stime"   - uint64_t system CPU time, nanoseconds.
+    PROCFS_COLUMN_COMM,         // "comm"    - char[PROCFS_COLUMN_COMM_SIZE] command name.
+    PROCFS_COLUMN_DISKREAD,     // "diskread"    - uint64_t bytes read from disk.
+    PROCFS_COLUMN_DISKWRITE,    // "diskwrite"   - uint64_t bytes written to disk.
+    PROCFS_COLUMN_IDLEWAKEUPS,  // "idlewakeups" - uint64_t package idle wakeups.
+    PROCFS_COLUMN_INTWAKEUPS,   // "intwakeups"  - uint64_t interrupt wakeups.
+    PROCFS_COLUMN_FOOTPRINT,    // "footprint"   - uint64_t physical footprint in bytes.
+    PROCFS_COLUMN_ENERGY,       // "energy"      - uint64_t billed energy, nanojoules.
+    PROCFS_COLUMN_COUNT         // Number of columns - must be last.
+} procfs_column_id_t;
+
+// Header at the start of a columns file.
+typedef struct procfs_columns_header {
+    uint32_t    pch_magic;          // PROCFS_COLUMNS_MAGIC
+    uint16_t    pch_version;        // PROCFS_COLUMNS_VERSION
+    uint16_t    pch_column_count;   // Number of procfs_column_desc_t entries that follow.
+    uint32_t    pch_row_count;      // Number of valid elements in each column.
+    uint32_t    pch_header_size;    // Size of the header and descriptors, including padding.
+    uint64_t    pch_data_size;      // Total size of the file content.
+    uint64_t    pch_column_mask;    // Selected columns, one bit per procfs_column_id_t.
+} procfs_columns_header_t;
+
+// Descriptor for one column in a columns file.
+typedef struct procfs_column_desc {
+    uint32_t    pcd_column_id;      // A procfs_column_id_t value.
+    uint32_t    pcd_element_size;   // Size of each element in bytes.
+    uint64_t    pcd_offset;         // Offset of the column data from the start of the file.
+} procfs_column_desc_t;
+
+#pragma mark -
+#pragma mark Process Event Stream
+
+/*
+ * Records read from the /proc/events file. Each read returns as many
+ * whole records as fit in the caller's buffer, so the buffer must be
+ * at least sizeof(procfs_event_t) bytes long. A read blocks until at
+ * least one event is available, unless the file was opened with
+ * O_NONBLOCK, in which case it fails with EAGAIN. A reader only sees
+ * events for processes that it would be able to see in /proc. If a
+ * reader falls so far behind that events are discarded before it reads
+ * them, the next record that it reads has type PROCFS_EVENT_OVERRUN.
+ */
+#define PROCFS_EVENT_COMM_SIZE  32
+
+// Event types.
+typedef enum {
+    PROCFS_EVENT_FORK = 1,      // A process was created. pe_ppid is its parent.
+    PROCFS_EVENT_EXEC,          // A process executed a new program. pe_comm is the new command name.
+    PROCFS_EVENT_EXIT,          // A process exited.
+    PROCFS_EVENT_OVERRUN,       // Events were lost. pe_sequence is the first lost event.
+} procfs_event_type_t;
+
+typedef struct procfs_event {
+    uint64_t    pe_sequence;    // Sequence number. Increases by one for each event.
+    uint64_t    pe_timestamp;   // Time of the event, microseconds since the epoch.
+    uint64_t    pe_overruns;    // Total number of events that this reader has lost.
+    uint32_t    pe_type;        // A procfs_event_type_t value.
+    int32_t     pe_pid;         // Process id.
+    int32_t     pe_ppid;        // Parent process id.
+    uint32_t    pe_uid;         // Effective user id.
+    char        pe_comm[PROCFS_EVENT_COMM_SIZE];   // Command name, null-terminated.
+} procfs_event_t;
+
+#pragma mark -
+#pragma mark Process Memory Map
+
+/*
+ * Records read from the /proc/N/map file, one for each VM region of
+ * the process in order of increasing address. Each record is followed
+ * by the null-terminated path of the file that backs the region, which
+ * is empty if there is no such file, and is padded so that the next
+ * record starts on an 8-byte boundary. Use pmr_size to step from one
+ * record to the next.
+ */
+typedef struct procfs_map_region {
+    uint32_t    pmr_size;               // Size of the record, including the path and padding.
+    uint32_t    pmr_protection;         // Current protection (VM_PROT_XXX).
+    uint32_t    pmr_max_protection;     // Maximum protection (VM_PROT_XXX).
+    uint32_t    pmr_share_mode;         // Share mode (SM_XXX in <mach/vm_region.h>).
+    uint64_t    pmr_start;              // Start address.
+    uint64_t    pmr_end;                // End address (exclusive).
+    uint64_t    pmr_offset;             // Offset of the region in its backing object.
+    uint32_t    pmr_resident_pages;     // Number of resident pages.
+    uint32_t    pmr_dirty_pages;        // Number of dirty pages.
+    uint32_t    pmr_user_tag;           // The user tag (VM_MEMORY_XXX).
+    uint32_t    pmr_reserved;
+    char        pmr_path[];             // Path of the backing file, null-terminated.
+} procfs_map_region_t;
+
+#pragma mark -
+#pragma mark Loaded Images
+
+/*
+ * Records read from the /proc/N/images file, one for each Mach-O
+ * image (the main executable, shared libraries, bundles and dyld
+ * itself) that is loaded in the process, as reported by dyld. The
+ * /proc/images file contains the records for every process that is
+ * visible to the reader, grouped by process. Like the map file, each
+ * record is followed by the null-terminated path of the image and is
+ * padded so that the next record starts on an 8-byte boundary. Use
+ * pim_size to step from one record to the next.
+ */
+#define PROCFS_IMAGE_UUID_SIZE  16
+
+typedef struct procfs_image {
+    uint32_t    pim_size;               // Size of the record, including the path and padding.
+    int32_t     pim_pid;                // Id of the process that has loaded the image.
+    uint64_t    pim_load_address;       // Address of the image's Mach-O header.
+    uint64_t    pim_text_size;          // Size of the image's __TEXT segment.
+    uint8_t     pim_uuid[PROCFS_IMAGE_UUID_SIZE];   // From LC_UUID, or all zero if there is none.
+    char        pim_path[];             // Path of the image, null-terminated.
+} procfs_image_t;
+
+#pragma mark -
+#pragma mark Socket Table
+
+/*
+ * Records read from the /proc/sockets file, one for each file
+ * descriptor that refers to a socket in every process that is visible
+ * to the reader. The socket_info structure (see <sys/proc_info.h>)
+ * gives the socket's protocol and, for Internet and UNIX domain
+ * sockets, its local and remote addresses, as reported for a single
+ * descriptor by the /proc/N/fd/M/socket file.
+ */
+typedef struct procfs_socket {
+    int32_t             pso_pid;        // Process id.
+    int32_t             pso_fd;         // File descriptor.
+    struct socket_info  pso_info;       // Socket details.
+} procfs_socket_t;
+
+#pragma mark -
+#pragma mark Open File Lookup
+
+/*
+ * Records read from a file in the /proc/openers directory. The name of
+ * the file is the decimal file id (inode number) of a file, as returned
+ * in the st_ino field by stat(2). There is one record for each file
+ * descriptor in every visible process that refers to a file with that
+ * id. File ids are only unique within a file system, so callers should
+ * match the poe_dev field against the file's st_dev.
+ */
+typedef struct procfs_opener {
+    int32_t     poe_pid;        // Process id.
+    int32_t     poe_fd;         // File descriptor.
+    uint32_t    poe_dev;        // Device of the file system containing the file.
+    uint32_t    poe_flags;      // Open flags for the descriptor (FREAD, FWRITE, etc.)
+    uint64_t    poe_fileid;     // File id.
+} procfs_opener_t;
+
+#pragma mark -
+#pragma mark Top Processes
+
+/*
+ * Records read from a file in one of the directories below /proc/top.
+ * The directory selects the value by which the visible processes are
+ * ranked: "cpu" for total CPU time, "rss" for resident size and "io"
+ * for the number of bytes read from and written to disk. The name of the
+ * file is the number of processes to return, from 1 to PROCFS_TOP_MAX_COUNT,
+ * so reading /proc/top/rss/20 returns the 20 visible processes with the
+ * largest resident size. Records are in order of decreasing value, with
+ * ties in order of increasing process id. CPU time and disk I/O are totals
+ * for the life of the process.
+ */
+#define PROCFS_TOP_MAX_COUNT    1024
+#define PROCFS_TOP_COMM_SIZE    32
+
+typedef struct procfs_top_entry {
+    uint64_t    pte_value;          // The value by which the process was ranked.
+    uint64_t    pte_cpu_time;       // Total user and system time, as in proc_taskinfo.
+    uint64_t    pte_resident_size;  // Resident size in bytes.
+    uint64_t    pte_diskio_bytes;   // Bytes read from and written to disk.
+    int32_t     pte_pid;            // Process id.
+    int32_t     pte_ppid;           // Parent process id.
+    uint32_t    pte_uid;            // Effective user id.
+    int32_t     pte_threads;        // Number of threads.
+    char        pte_comm[PROCFS_TOP_COMM_SIZE];    // Command name, null-terminated.
+} procfs_top_entry_t;
+
+#pragma mark -
+#pragma mark Process Totals
+
+/*
+ * Records read from the files in the /proc/totals directory, each of
+ * which groups the visible processes by a different key: "uid" by
+ * effective user id, "comm" by command name and "pgrp" by process group
+ * id. There is one record for each group, giving the number of processes
+ * and threads in the group and the sums of their resident sizes and CPU
+ * times. Records are in order of increasing user or process group id, or
+ * of command name.
+ */
+#define PROCFS_TOTALS_COMM_SIZE 32
+
+typedef struct procfs_totals {
+    uint64_t    pto_resident_size;  // Total resident size in bytes.
+    uint64_t    pto_cpu_time;       // Total user and system time, as in proc_taskinfo.
+    uint32_t    pto_process_count;  // Number of processes.
+    uint32_t    pto_thread_count;   // Total number of threads.
+    uint32_t    pto_id;             // User or process group id. Zero for command name groups.
+    uint32_t    pto_reserved;       // Reserved, always zero.
+    char        pto_comm[PROCFS_TOTALS_COMM_SIZE];  // Command name for command name groups, otherwise empty.
+} procfs_totals_t;
+
+#pragma mark -
+#pragma mark Process Descendants
+
+/*
+ * Records read from the "descendants" file in a process directory. There
+ * is one record for each visible descendant of the process, in breadth-first
+ * order, so a process always comes after its parent. The descendants of a
+ * process that is not visible are still included if they are visible. The
+ * pde_depth field is 1 for a child, 2 for a grandchild and so on.
+ */
+typedef struct procfs_descendant {
+    uint64_t    pde_uniqueid;   // Unique id of the process, never reused.
+    int32_t     pde_pid;        // Process id.
+    int32_t     pde_ppid;       // Parent process id.
+    uint32_t    pde_depth;      // Depth below the process that the file belongs to.
+    uint32_t    pde_reserved;   // Reserved, always zero.
+} procfs_descendant_t;
+
+#pragma mark -
+#pragma mark Host Statistics
+
+/*
+ * Layouts of the files in the /proc/host directory. The "cpuload" file
+ * is an array of struct processor_cpu_load_info (see <mach/processor_info.h>),
+ * one for each processor, and the "vmstat" file is a struct vm_statistics64
+ * (see <mach/vm_statistics.h>), as returned by host_statistics64() with the
+ * HOST_VM_INFO64 flavor. The "loadavg" and "mempressure" files contain the
+ * structures below.
+ */
+
+// Content of the "loadavg" file. Divide each value by pla_scale to
+// get the 1, 5 and 15 minute load averages.
+typedef struct procfs_loadavg {
+    uint32_t    pla_load[3];            // Load averages, scaled by pla_scale.
+    uint32_t    pla_scale;              // Scale factor.
+} procfs_loadavg_t;
+
+// Memory pressure levels.
+typedef enum {
+    PROCFS_MEMPRESSURE_NORMAL = 0,
+    PROCFS_MEMPRESSURE_WARNING,
+    PROCFS_MEMPRESSURE_URGENT,
+    PROCFS_MEMPRESSURE_CRITICAL,
+} procfs_mempressure_level_t;
+
+// Content of the "mempressure" file.
+typedef struct procfs_mempressure {
+    uint32_t    pmp_level;              // A procfs_mempressure_level_t value.
+    uint32_t    pmp_available_percent;  // Percentage of memory that is available.
+} procfs_mempressure_t;
+
+#pragma mark -
+#pragma mark Batch Process Query
+
+/*
+ * Gets information for a list of processes in a single system call, by
+ * applying the PROCFS_IOC_BATCH_QUERY command to the procfs root directory
+ * with fsctl(2) or ffsctl(2). ioctl(2) cannot be used, because the kernel
+ * does not pass it on for directories. The caller supplies an array of process
+ * ids and a set of PROCFS_BATCH_* flavor flags and the kernel fills one
+ * procfs_batch_record_t for each process id, in the same order. The
+ * status of each record is 0 if the requested information was returned,
+ * or ESRCH if the process does not exist or is not visible to the caller.
+ * Flavors that could not be obtained for a process that does exist are
+ * omitted from pbr_flavors.
+ */
+#define PROCFS_BATCH_BSDINFO        (1 << 0)    // Fill pbr_bsdinfo.
+#define PROCFS_BATCH_TASKINFO       (1 << 1)    // Fill pbr_taskinfo.
+#define PROCFS_BATCH_RUSAGE         (1 << 2)    // Fill pbr_rusage.
+#define PROCFS_BATCH_THREAD_COUNT   (1 << 3)    // Fill pbr_thread_count.
+#define PROCFS_BATCH_FD_COUNT       (1 << 4)    // Fill pbr_fd_count.
+#define PROCFS_BATCH_ALL            (PROCFS_BATCH_BSDINFO | PROCFS_BATCH_TASKINFO | PROCFS_BATCH_RUSAGE \
+                                        | PROCFS_BATCH_THREAD_COUNT | PROCFS_BATCH_FD_COUNT)
+
+// The largest number of process ids in one request.
+#define PROCFS_BATCH_MAX_PIDS       4096
+
+// The result for one process.
+typedef struct procfs_batch_record {
+    int32_t                 pbr_pid;            // Process id, copied from the request.
+    int32_t                 pbr_status;         // 0 or an errno value.
+    uint32_t                pbr_flavors;        // The flavors that were filled.
+    int32_t                 pbr_thread_count;   // Number of threads.
+    int32_t                 pbr_fd_count;       // Number of open file descriptors.
+    int32_t                 pbr_reserved;       // Reserved, always zero.
+    struct proc_bsdinfo     pbr_bsdinfo;        // As returned by proc_pidinfo(PROC_PIDTBSDINFO).
+    struct proc_taskinfo    pbr_taskinfo;       // As returned by proc_pidinfo(PROC_PIDTASKINFO).
+    rusage_info_current     pbr_rusage;         // As returned by proc_pid_rusage(RUSAGE_INFO_CURRENT).
+} procfs_batch_record_t;
+
+// The command argument. The pbq_pids and pbq_records fields hold
+// user addresses, so that the layout is the same for 32-bit and
+// 64-bit callers. The pbq_records array must have room for
+// pbq_pid_count records.
+typedef struct procfs_batch_query {
+    uint64_t    pbq_pids;           // Address of the array of process ids.
+    uint64_t    pbq_records;        // Address of the array of records.
+    uint32_t    pbq_pid_count;      // Number of process ids, at most PROCFS_BATCH_MAX_PIDS.
+    uint32_t    pbq_flavors;        // PROCFS_BATCH_* flags.
+    uint32_t    pbq_found_count;    // Returned: number of records with status 0.
+    uint32_t    pbq_reserved;       // Reserved, must be zero.
+} procfs_batch_query_t;
+
+#define PROCFS_IOC_BATCH_QUERY      _IOWR('P', 1, procfs_batch_query_t)
+
 #pragma mark -
 #pragma mark Internel Definitions - Kernel Only
 
@@ -45,6 +404,9 @@ typedef struct procfs_mount_args {
 // Tag used for memory allocation.
 extern OSMallocTag procfs_osmalloc_tag;
 
+// The vfs.procfs sysctl node, under which statistics and tunables are published.
+SYSCTL_DECL(_vfs_procfs);
+
 /* -- Macros and data. -- */
 
 // Make STATIC do nothing in debug mode, so that all static
@@ -65,6 +427,7 @@ typedef struct procfs_mount {
     int             pmnt_flags;         // Flags, set from the mount command (PROCFS_MOPT_XXX).
     struct mount    *pmnt_mp;           // VFS-level mount structure.
     struct timespec pmnt_mount_time;    // Time at which the file system was mounted.
+    uint32_t        pmnt_snapshot_interval_ms; // Minimum interval between process table rebuilds.
 } procfs_mount_t;
 
 // Convert from procfs mount pointer to VFS mount structure
@@ -0,0 +1,145 @@
+//
+//  procfs_batch.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Implements the PROCFS_IOC_BATCH_QUERY command on the procfs root
+// directory, which is made with fsctl(2) or ffsctl(2) and which returns information for a list of processes in a
+// single system call instead of the several opens, reads and closes
+// per process that reading the same data from the /proc/N directories
+// would take. See procfs.h for the request and record layouts.
+//
+
+#include <libkern/libkern.h>
+#include <sys/proc_info.h>
+#include <sys/proc_internal.h>
+#include <sys/resource.h>
+#include "procfs.h"
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The number of process ids copied in from the caller at a time.
+#define PROCFS_BATCH_PID_CHUNK_SIZE 64
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC void procfs_batch_fill_record(pid_t pid, uint32_t flavors, kauth_cred_t creds, procfs_batch_record_t *record);
+
+#pragma mark -
+#pragma mark External References
+
+extern int proc_pidbsdinfo(proc_t p, struct proc_bsdinfo *pinfo, int zombie);
+extern int proc_pidtaskinfo(proc_t p, struct proc_taskinfo *tinfo);
+extern void gather_rusage_info(proc_t p, rusage_info_current *ru, int flavor);
+
+#pragma mark -
+#pragma mark Batch Query
+
+/*
+ * Performs a batch query. The query structure has already been copied
+ * in by the fsctl code and is copied back out when we return, which
+ * returns the found count to the caller. The process ids are copied in
+ * in chunks and each record is copied out as soon as it is filled, so
+ * the amount of kernel memory used does not depend on the size of the
+ * request. Processes that are not visible to the caller are reported
+ * as not existing.
+ */
+int
+procfs_batch_query(procfsnode_t *pnp, procfs_batch_query_t *query, vfs_context_t ctx) {
+    uint32_t pid_count = query->pbq_pid_count;
+    uint32_t flavors = query->pbq_flavors;
+    if (pid_count > PROCFS_BATCH_MAX_PIDS || (flavors & ~PROCFS_BATCH_ALL) != 0 || query->pbq_reserved != 0) {
+        return EINVAL;
+    }
+    query->pbq_found_count = 0;
+
+    procfs_batch_record_t *record = (procfs_batch_record_t *)OSMalloc(sizeof(procfs_batch_record_t), procfs_osmalloc_tag);
+    if (record == NULL) {
+        return ENOMEM;
+    }
+
+    kauth_cred_t creds = procfs_get_access_check_creds(pnp, ctx);
+    user_addr_t pids_addr = CAST_USER_ADDR_T(query->pbq_pids);
+    user_addr_t records_addr = CAST_USER_ADDR_T(query->pbq_records);
+    pid_t pids[PROCFS_BATCH_PID_CHUNK_SIZE];
+    uint32_t index = 0;
+    int error = 0;
+    while (error == 0 && index < pid_count) {
+        uint32_t chunk_size = MIN(pid_count - index, PROCFS_BATCH_PID_CHUNK_SIZE);
+        error = copyin(pids_addr + index * sizeof(pid_t), pids, chunk_size * sizeof(pid_t));
+        for (uint32_t i = 0; error == 0 && i < chunk_size; i++) {
+            procfs_batch_fill_record(pids[i], flavors, creds, record);
+            if (record->pbr_status == 0) {
+                query->pbq_found_count++;
+            }
+            error = copyout(record, records_addr + (index + i) * sizeof(procfs_batch_record_t),
+                            sizeof(procfs_batch_record_t));
+        }
+        index += chunk_size;
+    }
+    OSFree(record, sizeof(procfs_batch_record_t), procfs_osmalloc_tag);
+
+    return error;
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Fills the record for one process with the requested flavors of
+ * information. If the process does not exist or "creds" is not NULL
+ * and does not give access to it, only the process id and status are
+ * set. The thread count comes from the task information, which is
+ * only returned to the caller if it was requested.
+ */
+STATIC void
+procfs_batch_fill_record(pid_t pid, uint32_t flavors, kauth_cred_t creds, procfs_batch_record_t *record) {
+    bzero(record, sizeof(procfs_batch_record_t));
+    record->pbr_pid = pid;
+
+    proc_t p = proc_find(pid);
+    if (p == NULL) {
+        record->pbr_status = ESRCH;
+        return;
+    }
+    if (creds != NULL && procfs_check_can_access_process(creds, p) != 0) {
+        record->pbr_status = ESRCH;
+        proc_rele(p);
+        return;
+    }
+
+    if ((flavors & PROCFS_BATCH_BSDINFO) && proc_pidbsdinfo(p, &record->pbr_bsdinfo, FALSE) == 0) {
+        record->pbr_flavors |= PROCFS_BATCH_BSDINFO;
+    }
+
+    if ((flavors & (PROCFS_BATCH_TASKINFO | PROCFS_BATCH_THREAD_COUNT))
+            && proc_pidtaskinfo(p, &record->pbr_taskinfo) == 0) {
+        if (flavors & PROCFS_BATCH_THREAD_COUNT) {
+            record->pbr_thread_count = record->pbr_taskinfo.pti_threadnum;
+            record->pbr_flavors |= PROCFS_BATCH_THREAD_COUNT;
+        }
+        if (flavors & PROCFS_BATCH_TASKINFO) {
+            record->pbr_flavors |= PROCFS_BATCH_TASKINFO;
+        } else {
+            bzero(&record->pbr_taskinfo, sizeof(record->pbr_taskinfo));
+        }
+    }
+
+    if (flavors & PROCFS_BATCH_RUSAGE) {
+        gather_rusage_info(p, &record->pbr_rusage, RUSAGE_INFO_CURRENT);
+        record->pbr_flavors |= PROCFS_BATCH_RUSAGE;
+    }
+
+    if (flavors & PROCFS_BATCH_FD_COUNT) {
+        record->pbr_fd_count = procfs_get_process_fd_count(p);
+        record->pbr_flavors |= PROCFS_BATCH_FD_COUNT;
+    }
+
+    proc_rele(p);
+}
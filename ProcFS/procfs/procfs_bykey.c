@@ -0,0 +1,366 @@
+//
+//  procfs_bykey.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Implements the index directories "bycomm", "byuid" and "bypgrp". The
+// name of each directory below them is a key (a command name, an effective
+// user id or a process group id) and the directory holds a link to each
+// visible process that has that key, such as "bycomm/launchd/1".
+//
+// Unlike the filters in the "select" directory, the processes for a key
+// are not found by walking the process list. Those for a command name or
+// a user id come from the maps that the process index keeps for them (see
+// procfs_procindex.c) and those for a process group come from the kernel's
+// own process group table, which lists the members of each group. Process
+// groups are not in the process index because a process can change its
+// group without passing through any of the hooks that maintain the index.
+// If the process index cannot be used, the process list is walked instead.
+//
+// The key is held in the object id of the key directory and the nodes below
+// it. A command name does not fit, so its object id is the name's id in the
+// interned name table (see procfs_comm.c). Looking up a name interns it and
+// each node below "bycomm" holds a reference to its name, so the id keeps
+// referring to the same name for as long as the node exists, even if every
+// process with that name exits and another one starts later. The nodes are
+// reclaimed when they are no longer in use, which releases the name. The
+// processes for a name are found by walking the process list whenever the
+// process index cannot say which processes have it.
+//
+
+#include <libkern/libkern.h>
+#include <sys/proc_internal.h>
+#include "procfsnode.h"
+#include "procfs_comm.h"
+#include "procfs_data.h"
+#include "procfs_procindex.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The kinds of key.
+typedef enum {
+    PROCFS_BYKEY_COMM,      // Command name.
+    PROCFS_BYKEY_UID,       // Effective user id.
+    PROCFS_BYKEY_PGRP,      // Process group id.
+} procfs_bykey_kind_t;
+
+// Extra space allowed for processes that are created between counting
+// and listing the processes for a key.
+#define PROCFS_BYKEY_SLACK 32
+
+// The number of members of a process group to allow for at first.
+#define PROCFS_BYKEY_PGRP_CAPACITY 64
+
+// A key, decoded from an object id.
+typedef struct procfs_bykey {
+    procfs_bykey_kind_t pbk_kind;                   // The kind of key.
+    uint32_t            pbk_value;                  // The value, or the interned id of a command name.
+    char                pbk_comm[MAXCOMLEN + 1];    // The command name for PROCFS_BYKEY_COMM.
+} procfs_bykey_t;
+
+// State for a walk of the process list or of a process group that
+// collects the ids of the processes with a key.
+typedef struct procfs_bykey_collect {
+    kauth_cred_t        pbc_creds;      // Credentials for the access check, NULL for none.
+    pid_t               *pbc_pids;      // Where to store process ids.
+    int                 pbc_count;      // Number of ids stored.
+    int                 pbc_capacity;   // Number of ids for which there is space.
+    boolean_t           pbc_overflow;   // Whether there was not enough space.
+} procfs_bykey_collect_t;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_bykey_get_key(procfs_bykey_kind_t kind, uint64_t objectid, procfs_bykey_t *key);
+STATIC boolean_t procfs_bykey_matches(procfs_bykey_t *key, proc_t p);
+STATIC void procfs_bykey_list_pids(procfs_bykey_kind_t kind, procfsnode_t *dir_pnp, kauth_cred_t creds,
+                                   pid_t **pidpp, int *pid_count, uint32_t *sizep);
+STATIC int procfs_bykey_index_pids(procfs_bykey_t *key, kauth_cred_t creds,
+                                   pid_t **pidpp, int *pid_count, uint32_t *sizep);
+STATIC void procfs_bykey_walk_pids(procfs_bykey_t *key, kauth_cred_t creds,
+                                   pid_t **pidpp, int *pid_count, uint32_t *sizep);
+STATIC int procfs_bykey_filter_proc(proc_t p, void *arg);
+STATIC int procfs_bykey_collect_proc(proc_t p, void *arg);
+
+#pragma mark -
+#pragma mark Key Name Parsing
+
+/*
+ * Parses the name of a directory in the bycomm directory, which must
+ * be a command name. The object id is set to the name's interned id,
+ * with a reference that is released with procfs_bycomm_hold_objectid().
+ * Returns ENOSPC or ENOMEM if the name could not be interned.
+ */
+int
+procfs_parse_bycomm_name(const char *name, uint64_t *objectidp) {
+    uint32_t id;
+    int error = procfs_comm_intern(name, &id);
+    if (error == EINVAL) {
+        return ENOENT;
+    } else if (error == 0) {
+        *objectidp = id;
+    }
+    return error;
+}
+
+/*
+ * Takes or releases a reference to the command name whose interned
+ * id is the object id of a node below the bycomm directory.
+ */
+boolean_t
+procfs_bycomm_hold_objectid(uint64_t objectid, boolean_t hold) {
+    if (hold) {
+        return procfs_comm_retain((uint32_t)objectid) == 0;
+    }
+    procfs_comm_release((uint32_t)objectid);
+    return FALSE;
+}
+
+/*
+ * Parses the name of a directory in the byuid directory, which must
+ * be a user id.
+ */
+int
+procfs_parse_byuid_name(const char *name, uint64_t *objectidp) {
+    return procfs_parse_decimal(name, UINT_MAX, objectidp);
+}
+
+/*
+ * Parses the name of a directory in the bypgrp directory, which must
+ * be a process group id.
+ */
+int
+procfs_parse_bypgrp_name(const char *name, uint64_t *objectidp) {
+    return procfs_parse_decimal(name, PID_MAX, objectidp);
+}
+
+#pragma mark -
+#pragma mark Process Links
+
+/*
+ * Gets the ids of the visible processes with the command name of
+ * a bycomm directory, in order of process id.
+ */
+void
+procfs_bycomm_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                        pid_t **pidpp, int *pid_count, uint32_t *sizep) {
+    procfs_bykey_list_pids(PROCFS_BYKEY_COMM, dir_pnp, creds, pidpp, pid_count, sizep);
+}
+
+/*
+ * Gets the ids of the visible processes with the effective user id
+ * of a byuid directory, in order of process id.
+ */
+void
+procfs_byuid_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                       pid_t **pidpp, int *pid_count, uint32_t *sizep) {
+    procfs_bykey_list_pids(PROCFS_BYKEY_UID, dir_pnp, creds, pidpp, pid_count, sizep);
+}
+
+/*
+ * Gets the ids of the visible processes in the process group of
+ * a bypgrp directory, in order of process id.
+ */
+void
+procfs_bypgrp_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                        pid_t **pidpp, int *pid_count, uint32_t *sizep) {
+    procfs_bykey_list_pids(PROCFS_BYKEY_PGRP, dir_pnp, creds, pidpp, pid_count, sizep);
+}
+
+/*
+ * Determines whether a process has the command name of a bycomm directory.
+ */
+boolean_t
+procfs_bycomm_match_proc(procfsnode_t *dir_pnp, proc_t p) {
+    procfs_bykey_t key;
+    return procfs_bykey_get_key(PROCFS_BYKEY_COMM, dir_pnp->node_id.nodeid_objectid, &key) == 0
+            && procfs_bykey_matches(&key, p);
+}
+
+/*
+ * Determines whether a process has the effective user id of a byuid directory.
+ */
+boolean_t
+procfs_byuid_match_proc(procfsnode_t *dir_pnp, proc_t p) {
+    procfs_bykey_t key;
+    return procfs_bykey_get_key(PROCFS_BYKEY_UID, dir_pnp->node_id.nodeid_objectid, &key) == 0
+            && procfs_bykey_matches(&key, p);
+}
+
+/*
+ * Determines whether a process is in the process group of a bypgrp directory.
+ */
+boolean_t
+procfs_bypgrp_match_proc(procfsnode_t *dir_pnp, proc_t p) {
+    procfs_bykey_t key;
+    return procfs_bykey_get_key(PROCFS_BYKEY_PGRP, dir_pnp->node_id.nodeid_objectid, &key) == 0
+            && procfs_bykey_matches(&key, p);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Decodes a key of a given kind from the object id of a key directory.
+ * Returns 0 on success or ENOENT if the object id is not valid.
+ */
+STATIC int
+procfs_bykey_get_key(procfs_bykey_kind_t kind, uint64_t objectid, procfs_bykey_t *key) {
+    key->pbk_kind = kind;
+    key->pbk_value = (uint32_t)objectid;
+    key->pbk_comm[0] = (char)0;
+    if (kind == PROCFS_BYKEY_COMM) {
+        return procfs_comm_name(key->pbk_value, key->pbk_comm);
+    }
+    return 0;
+}
+
+/*
+ * Determines whether a process has a key. This only reads fields of the
+ * proc structure, so it can be called with the process list locked.
+ */
+STATIC boolean_t
+procfs_bykey_matches(procfs_bykey_t *key, proc_t p) {
+    switch (key->pbk_kind) {
+    case PROCFS_BYKEY_COMM:
+        return strncmp(p->p_comm, key->pbk_comm, MAXCOMLEN + 1) == 0;
+
+    case PROCFS_BYKEY_UID:
+        return p->p_uid == key->pbk_value;
+
+    case PROCFS_BYKEY_PGRP:
+        return p->p_pgrpid == (pid_t)key->pbk_value;
+    }
+    return FALSE;
+}
+
+/*
+ * Gets the ids of the visible processes that have the key of a key
+ * directory, in order of process id. The list is allocated with
+ * procfs_alloc_pids() and must be released with procfs_release_pids().
+ */
+STATIC void
+procfs_bykey_list_pids(procfs_bykey_kind_t kind, procfsnode_t *dir_pnp, kauth_cred_t creds,
+                       pid_t **pidpp, int *pid_count, uint32_t *sizep) {
+    *pidpp = NULL;
+    *pid_count = 0;
+    *sizep = 0;
+
+    procfs_bykey_t key;
+    if (procfs_bykey_get_key(kind, dir_pnp->node_id.nodeid_objectid, &key) != 0) {
+        return;
+    }
+    if (kind == PROCFS_BYKEY_PGRP || procfs_bykey_index_pids(&key, creds, pidpp, pid_count, sizep) != 0) {
+        procfs_bykey_walk_pids(&key, creds, pidpp, pid_count, sizep);
+    }
+}
+
+/*
+ * Gets the ids of the visible processes that have a command name or
+ * user id key from the process index. Returns 0 on success or ENOTSUP
+ * if the index cannot be used, in which case nothing is returned.
+ */
+STATIC int
+procfs_bykey_index_pids(procfs_bykey_t *key, kauth_cred_t creds,
+                        pid_t **pidpp, int *pid_count, uint32_t *sizep) {
+    procfs_procindex_key_t index_key = key->pbk_kind == PROCFS_BYKEY_COMM ? PROCFS_PROCINDEX_KEY_COMM : PROCFS_PROCINDEX_KEY_UID;
+    int capacity = procfs_procindex_key_count(index_key, key->pbk_value);
+    if (capacity < 0) {
+        return ENOTSUP;
+    }
+
+    uint32_t size;
+    pid_t *pids = procfs_alloc_pids(capacity + PROCFS_BYKEY_SLACK, &size);
+    if (pids == NULL) {
+        return 0;
+    }
+    int count = procfs_procindex_key_pids(index_key, key->pbk_value, creds, pids, (int)(size/sizeof(pid_t)));
+    if (count < 0) {
+        procfs_release_pids(pids, size);
+        return ENOTSUP;
+    }
+    *pidpp = pids;
+    *pid_count = count;
+    *sizep = size;
+    return 0;
+}
+
+/*
+ * Gets the ids of the visible processes that have a key by walking the
+ * members of the process group for a process group key, or the whole
+ * process list otherwise, starting again with more space if the list
+ * fills up.
+ */
+STATIC void
+procfs_bykey_walk_pids(procfs_bykey_t *key, kauth_cred_t creds,
+                       pid_t **pidpp, int *pid_count, uint32_t *sizep) {
+    int capacity;
+    if (key->pbk_kind == PROCFS_BYKEY_PGRP) {
+        capacity = PROCFS_BYKEY_PGRP_CAPACITY;
+    } else {
+        int index_count = procfs_procindex_count();
+        capacity = (index_count >= 0 ? index_count : nprocs) + PROCFS_BYKEY_SLACK;
+    }
+    for (;;) {
+        uint32_t size;
+        pid_t *pids = procfs_alloc_pids(capacity, &size);
+        if (pids == NULL) {
+            return;
+        }
+
+        procfs_bykey_collect_t collect;
+        bzero(&collect, sizeof(collect));
+        collect.pbc_creds = creds;
+        collect.pbc_pids = pids;
+        collect.pbc_capacity = (int)(size/sizeof(pid_t));
+        if (key->pbk_kind == PROCFS_BYKEY_PGRP) {
+            struct pgrp *pgrp = pgfind((pid_t)key->pbk_value);
+            if (pgrp != PGRP_NULL) {
+                pgrp_iterate(pgrp, 0, procfs_bykey_collect_proc, &collect, procfs_bykey_filter_proc, key);
+                pg_rele(pgrp);
+            }
+        } else {
+            proc_iterate(PROC_ALLPROCLIST, procfs_bykey_collect_proc, &collect, procfs_bykey_filter_proc, key);
+        }
+        if (!collect.pbc_overflow) {
+            qsort(pids, collect.pbc_count, sizeof(pid_t), procfs_compare_pids);
+            *pidpp = pids;
+            *pid_count = collect.pbc_count;
+            *sizep = size;
+            return;
+        }
+        procfs_release_pids(pids, size);
+        capacity *= 2;
+    }
+}
+
+/*
+ * Filter function for proc_iterate() and pgrp_iterate(). Called with
+ * the process list locked, so it must not block.
+ */
+STATIC int
+procfs_bykey_filter_proc(proc_t p, void *arg) {
+    return procfs_bykey_matches((procfs_bykey_t *)arg, p);
+}
+
+/*
+ * Function used to iterate the process list or a process group to store
+ * the id of each visible process. Stops the iteration if there is no
+ * more space.
+ */
+STATIC int
+procfs_bykey_collect_proc(proc_t p, void *arg) {
+    procfs_bykey_collect_t *collect = (procfs_bykey_collect_t *)arg;
+    if (collect->pbc_creds != NULL && procfs_check_can_access_process(collect->pbc_creds, p) != 0) {
+        return PROC_RETURNED;
+    }
+    if (collect->pbc_count == collect->pbc_capacity) {
+        collect->pbc_overflow = TRUE;
+        return PROC_RETURNED_DONE;
+    }
+    collect->pbc_pids[collect->pbc_count++] = p->p_pid;
+    return PROC_RETURNED;
+}
@@ -0,0 +1,439 @@
+//
+//  procfs_columns.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Generates the content of the files in the /proc/columns directory.
+// Each file is a snapshot of all of the processes that are visible to
+// the caller, containing only the fields selected by the file name.
+// The data is laid out in columns rather than rows, so that a consumer
+// can scan a field for every process without parsing per-process
+// structures. See procfs.h for a description of the layout.
+//
+// Rows are filled in shards of processes that may run on several
+// processors at once (see procfs_parallel.c). Each process is written to
+// the row with the same index as its process id in the process list, and
+// the rows of processes that have exited are then squeezed out, so the
+// rows are always in process id order.
+//
+
+#include <libkern/libkern.h>
+#include <sys/proc_info.h>
+#include <sys/proc_internal.h>
+#include <sys/resource.h>
+#include <sys/uio_internal.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_parallel.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+/*
+ * Static description of a column that can be selected.
+ */
+typedef struct {
+    const char  *pci_name;              // Name used in the file name.
+    uint32_t    pci_element_size;       // Size of each element.
+    boolean_t   pci_needs_taskinfo;     // Whether the value comes from the process's task.
+    boolean_t   pci_needs_rusage;       // Whether the value comes from the process's resource usage.
+} procfs_column_info_t;
+
+// The available columns, indexed by procfs_column_id_t.
+STATIC const procfs_column_info_t procfs_column_info[PROCFS_COLUMN_COUNT] = {
+    [PROCFS_COLUMN_PID]         = { "pid",         sizeof(int32_t),          FALSE, FALSE },
+    [PROCFS_COLUMN_PPID]        = { "ppid",        sizeof(int32_t),          FALSE, FALSE },
+    [PROCFS_COLUMN_PGID]        = { "pgid",        sizeof(int32_t),          FALSE, FALSE },
+    [PROCFS_COLUMN_UID]         = { "uid",         sizeof(uint32_t),         FALSE, FALSE },
+    [PROCFS_COLUMN_GID]         = { "gid",         sizeof(uint32_t),         FALSE, FALSE },
+    [PROCFS_COLUMN_RUID]        = { "ruid",        sizeof(uint32_t),         FALSE, FALSE },
+    [PROCFS_COLUMN_RGID]        = { "rgid",        sizeof(uint32_t),         FALSE, FALSE },
+    [PROCFS_COLUMN_START]       = { "start",       sizeof(uint64_t),         FALSE, FALSE },
+    [PROCFS_COLUMN_THREADS]     = { "threads",     sizeof(int32_t),          TRUE,  FALSE },
+    [PROCFS_COLUMN_RSS]         = { "rss",         sizeof(uint64_t),         TRUE,  FALSE },
+    [PROCFS_COLUMN_VSIZE]       = { "vsize",       sizeof(uint64_t),         TRUE,  FALSE },
+    [PROCFS_COLUMN_UTIME]       = { "utime",       sizeof(uint64_t),         TRUE,  FALSE },
+    [PROCFS_COLUMN_STIME]       = { "stime",       sizeof(uint64_t),         TRUE,  FALSE },
+    [PROCFS_COLUMN_COMM]        = { "comm",        PROCFS_COLUMN_COMM_SIZE,  FALSE, FALSE },
+    [PROCFS_COLUMN_DISKREAD]    = { "diskread",    sizeof(uint64_t),         FALSE, TRUE },
+    [PROCFS_COLUMN_DISKWRITE]   = { "diskwrite",   sizeof(uint64_t),         FALSE, TRUE },
+    [PROCFS_COLUMN_IDLEWAKEUPS] = { "idlewakeups", sizeof(uint64_t),         FALSE, TRUE },
+    [PROCFS_COLUMN_INTWAKEUPS]  = { "intwakeups",  sizeof(uint64_t),         FALSE, TRUE },
+    [PROCFS_COLUMN_FOOTPRINT]   = { "footprint",   sizeof(uint64_t),         FALSE, TRUE },
+    [PROCFS_COLUMN_ENERGY]      = { "energy",      sizeof(uint64_t),         FALSE, TRUE },
+};
+
+/*
+ * Arguments for procfs_columns_fill_rows(), which are the same
+ * for every shard of processes.
+ */
+typedef struct procfs_columns_fill_args {
+    pid_t                   *pcf_pids;              // The process ids, one for each row.
+    char                    *pcf_data;              // The file data.
+    procfs_column_desc_t    *pcf_descs;             // The selected columns.
+    int                     pcf_column_count;       // The number of selected columns.
+    boolean_t               pcf_needs_taskinfo;     // Whether any column needs the task info.
+    boolean_t               pcf_needs_rusage;       // Whether any column needs the resource usage.
+    uint8_t                 *pcf_filled;            // Set for each row that was filled.
+} procfs_columns_fill_args_t;
+
+// Rounds a size up to the column alignment.
+#define PROCFS_COLUMNS_ROUND(size) (((size) + PROCFS_COLUMNS_ALIGN - 1) & ~((size_t)PROCFS_COLUMNS_ALIGN - 1))
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC size_t procfs_columns_layout(uint64_t mask, int rows, procfs_column_desc_t *descs, int *column_countp, uint32_t *header_sizep);
+STATIC void procfs_columns_fill_rows(void *arg, int start, int end);
+STATIC int procfs_columns_compact(char *data, procfs_column_desc_t *descs, int column_count,
+                                  const uint8_t *filled, int rows);
+STATIC void procfs_columns_fill_row(proc_t p, struct proc_taskinfo *taskinfo, rusage_info_current *rusage,
+                                    char *data, procfs_column_desc_t *descs, int column_count, int row);
+
+#pragma mark -
+#pragma mark External References
+
+extern int proc_pidtaskinfo(proc_t p, struct proc_taskinfo *tinfo);
+extern void gather_rusage_info(proc_t p, rusage_info_current *ru, int flavor);
+
+#pragma mark -
+#pragma mark Columns File Name Parsing
+
+/*
+ * Parses the name of a file in the columns directory, which must be
+ * a comma-separated list of one or more column names. On success, the
+ * object id is set to a mask with one bit set for each selected column.
+ */
+int
+procfs_parse_columns_name(const char *name, uint64_t *objectidp) {
+    uint64_t mask = 0;
+    const char *next = name;
+
+    while (*next != (char)0) {
+        // Find the end of the next column name.
+        const char *end = next;
+        while (*end != (char)0 && *end != ',') {
+            end++;
+        }
+
+        size_t len = end - next;
+        int column;
+        for (column = 0; column < PROCFS_COLUMN_COUNT; column++) {
+            const char *column_name = procfs_column_info[column].pci_name;
+            if (strlen(column_name) == len && strncmp(column_name, next, len) == 0) {
+                break;
+            }
+        }
+        if (column == PROCFS_COLUMN_COUNT) {
+            // Unknown or empty column name.
+            return ENOENT;
+        }
+        mask |= 1ULL << column;
+
+        // Skip the separator, but do not allow a trailing comma.
+        next = end;
+        if (*next == ',') {
+            next++;
+            if (*next == (char)0) {
+                return ENOENT;
+            }
+        }
+    }
+
+    if (mask == 0) {
+        return ENOENT;
+    }
+    *objectidp = mask;
+    return 0;
+}
+
+#pragma mark -
+#pragma mark Columns File Data
+
+/*
+ * Reads the content of a columns file. The set of columns comes from
+ * the node's object id. One row is written for each process that is
+ * visible to the caller.
+ */
+int
+procfs_read_columns_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    uint64_t mask = pnp->node_id.nodeid_objectid;
+
+    int pid_count;
+    uint32_t pid_list_size;
+    pid_t *pid_list;
+    procfs_get_pids(&pid_list, &pid_count, &pid_list_size, procfs_get_access_check_creds(pnp, ctx));
+
+    // Lay out the file for the number of processes that we found. If
+    // some of them exit before we get to them, the row count will be
+    // smaller than the space allocated for each column.
+    procfs_column_desc_t descs[PROCFS_COLUMN_COUNT];
+    int column_count;
+    uint32_t header_size;
+    size_t data_size = procfs_columns_layout(mask, pid_count, descs, &column_count, &header_size);
+
+    int error = 0;
+    char *data = (char *)OSMalloc((uint32_t)data_size, procfs_osmalloc_tag);
+    uint8_t *filled = pid_count > 0 ? (uint8_t *)OSMalloc(pid_count, procfs_osmalloc_tag) : NULL;
+    if (data == NULL || (pid_count > 0 && filled == NULL)) {
+        if (data != NULL) {
+            OSFree(data, (uint32_t)data_size, procfs_osmalloc_tag);
+        }
+        if (filled != NULL) {
+            OSFree(filled, pid_count, procfs_osmalloc_tag);
+        }
+        procfs_release_pids(pid_list, pid_list_size);
+        return ENOMEM;
+    }
+    bzero(data, data_size);
+    if (filled != NULL) {
+        bzero(filled, pid_count);
+    }
+
+    // Only get the task info and resource usage if a column that needs them was selected.
+    procfs_columns_fill_args_t args;
+    args.pcf_pids = pid_list;
+    args.pcf_data = data;
+    args.pcf_descs = descs;
+    args.pcf_column_count = column_count;
+    args.pcf_needs_taskinfo = FALSE;
+    args.pcf_needs_rusage = FALSE;
+    args.pcf_filled = filled;
+    for (int i = 0; i < column_count; i++) {
+        args.pcf_needs_taskinfo |= procfs_column_info[descs[i].pcd_column_id].pci_needs_taskinfo;
+        args.pcf_needs_rusage |= procfs_column_info[descs[i].pcd_column_id].pci_needs_rusage;
+    }
+
+    procfs_parallel_run(pid_count, procfs_columns_fill_rows, &args);
+    int row = procfs_columns_compact(data, descs, column_count, filled, pid_count);
+    procfs_release_pids(pid_list, pid_list_size);
+    if (filled != NULL) {
+        OSFree(filled, pid_count, procfs_osmalloc_tag);
+    }
+
+    // Construct the header and the column descriptors.
+    procfs_columns_header_t *header = (procfs_columns_header_t *)data;
+    header->pch_magic = PROCFS_COLUMNS_MAGIC;
+    header->pch_version = PROCFS_COLUMNS_VERSION;
+    header->pch_column_count = column_count;
+    header->pch_row_count = row;
+    header->pch_header_size = header_size;
+    header->pch_data_size = data_size;
+    header->pch_column_mask = mask;
+    bcopy(descs, data + sizeof(procfs_columns_header_t), column_count * sizeof(procfs_column_desc_t));
+
+    error = procfs_copy_data(data, (int)data_size, uio);
+    OSFree(data, (uint32_t)data_size, procfs_osmalloc_tag);
+
+    return error;
+}
+
+/*
+ * Gets the size of a columns file, based on the number of processes
+ * that are currently visible. The processes are counted with the same
+ * access check as the read path uses.
+ */
+size_t
+procfs_columns_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    procfs_column_desc_t descs[PROCFS_COLUMN_COUNT];
+    int column_count;
+    uint32_t header_size;
+    return procfs_columns_layout(pnp->node_id.nodeid_objectid,
+                                 procfs_get_process_count(procfs_get_size_check_creds(pnp, creds)),
+                                 descs, &column_count, &header_size);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Calculates the layout of a columns file with a given set of
+ * columns and space for a given number of rows. The column
+ * descriptors are stored in "descs" and the number of columns
+ * in *column_countp. Returns the total size of the file.
+ */
+STATIC size_t
+procfs_columns_layout(uint64_t mask, int rows, procfs_column_desc_t *descs, int *column_countp, uint32_t *header_sizep) {
+    int column_count = 0;
+    for (int column = 0; column < PROCFS_COLUMN_COUNT; column++) {
+        if (mask & (1ULL << column)) {
+            descs[column_count].pcd_column_id = column;
+            descs[column_count].pcd_element_size = procfs_column_info[column].pci_element_size;
+            column_count++;
+        }
+    }
+
+    // The column arrays start after the header and descriptors and
+    // each of them starts on an aligned boundary.
+    size_t offset = PROCFS_COLUMNS_ROUND(sizeof(procfs_columns_header_t) + column_count * sizeof(procfs_column_desc_t));
+    *header_sizep = (uint32_t)offset;
+    for (int i = 0; i < column_count; i++) {
+        descs[i].pcd_offset = offset;
+        offset += PROCFS_COLUMNS_ROUND((size_t)rows * descs[i].pcd_element_size);
+    }
+    *column_countp = column_count;
+
+    return offset;
+}
+
+/*
+ * Fills the rows for the processes in one shard. Rows for processes
+ * that have exited, or whose task information cannot be fetched
+ * because they are exiting, are left empty.
+ */
+STATIC void
+procfs_columns_fill_rows(void *arg, int start, int end) {
+    procfs_columns_fill_args_t *args = (procfs_columns_fill_args_t *)arg;
+    for (int i = start; i < end; i++) {
+        proc_t p = proc_find(args->pcf_pids[i]);
+        if (p == NULL) {
+            // Process disappeared.
+            continue;
+        }
+
+        struct proc_taskinfo taskinfo;
+        bzero(&taskinfo, sizeof(taskinfo));
+        if (args->pcf_needs_taskinfo && proc_pidtaskinfo(p, &taskinfo) != 0) {
+            proc_rele(p);
+            continue;
+        }
+
+        rusage_info_current rusage;
+        bzero(&rusage, sizeof(rusage));
+        if (args->pcf_needs_rusage) {
+            gather_rusage_info(p, &rusage, RUSAGE_INFO_CURRENT);
+        }
+        procfs_columns_fill_row(p, &taskinfo, &rusage, args->pcf_data, args->pcf_descs, args->pcf_column_count, i);
+        args->pcf_filled[i] = 1;
+        proc_rele(p);
+    }
+}
+
+/*
+ * Moves the filled rows of every column down over the empty rows
+ * left by processes that exited, keeping them in order, and clears
+ * the rows that are no longer used. Returns the number of filled rows.
+ */
+STATIC int
+procfs_columns_compact(char *data, procfs_column_desc_t *descs, int column_count, const uint8_t *filled, int rows) {
+    int row_count = 0;
+    for (int row = 0; row < rows; row++) {
+        if (filled[row]) {
+            if (row_count != row) {
+                for (int i = 0; i < column_count; i++) {
+                    char *column = data + descs[i].pcd_offset;
+                    uint32_t size = descs[i].pcd_element_size;
+                    bcopy(column + (size_t)row * size, column + (size_t)row_count * size, size);
+                }
+            }
+            row_count++;
+        }
+    }
+    if (row_count < rows) {
+        for (int i = 0; i < column_count; i++) {
+            uint32_t size = descs[i].pcd_element_size;
+            bzero(data + descs[i].pcd_offset + (size_t)row_count * size, (size_t)(rows - row_count) * size);
+        }
+    }
+    return row_count;
+}
+
+/*
+ * Stores the values for one process in a given row of each
+ * of the selected columns.
+ */
+STATIC void
+procfs_columns_fill_row(proc_t p, struct proc_taskinfo *taskinfo, rusage_info_current *rusage,
+                        char *data, procfs_column_desc_t *descs, int column_count, int row) {
+    for (int i = 0; i < column_count; i++) {
+        procfs_column_desc_t *desc = &descs[i];
+        void *elem = data + desc->pcd_offset + (size_t)row * desc->pcd_element_size;
+
+        switch ((procfs_column_id_t)desc->pcd_column_id) {
+        case PROCFS_COLUMN_PID:
+            *(int32_t *)elem = p->p_pid;
+            break;
+
+        case PROCFS_COLUMN_PPID:
+            *(int32_t *)elem = p->p_ppid;
+            break;
+
+        case PROCFS_COLUMN_PGID:
+            *(int32_t *)elem = p->p_pgrpid;
+            break;
+
+        case PROCFS_COLUMN_UID:
+            *(uint32_t *)elem = p->p_uid;
+            break;
+
+        case PROCFS_COLUMN_GID:
+            *(uint32_t *)elem = p->p_gid;
+            break;
+
+        case PROCFS_COLUMN_RUID:
+            *(uint32_t *)elem = p->p_ruid;
+            break;
+
+        case PROCFS_COLUMN_RGID:
+            *(uint32_t *)elem = p->p_rgid;
+            break;
+
+        case PROCFS_COLUMN_START:
+            *(uint64_t *)elem = (uint64_t)p->p_start.tv_sec * USEC_PER_SEC + p->p_start.tv_usec;
+            break;
+
+        case PROCFS_COLUMN_THREADS:
+            *(int32_t *)elem = taskinfo->pti_threadnum;
+            break;
+
+        case PROCFS_COLUMN_RSS:
+            *(uint64_t *)elem = taskinfo->pti_resident_size;
+            break;
+
+        case PROCFS_COLUMN_VSIZE:
+            *(uint64_t *)elem = taskinfo->pti_virtual_size;
+            break;
+
+        case PROCFS_COLUMN_UTIME:
+            *(uint64_t *)elem = taskinfo->pti_total_user;
+            break;
+
+        case PROCFS_COLUMN_STIME:
+            *(uint64_t *)elem = taskinfo->pti_total_system;
+            break;
+
+        case PROCFS_COLUMN_COMM:
+            strlcpy((char *)elem, p->p_comm, PROCFS_COLUMN_COMM_SIZE);
+            break;
+
+        case PROCFS_COLUMN_DISKREAD:
+            *(uint64_t *)elem = rusage->ri_diskio_bytesread;
+            break;
+
+        case PROCFS_COLUMN_DISKWRITE:
+            *(uint64_t *)elem = rusage->ri_diskio_byteswritten;
+            break;
+
+        case PROCFS_COLUMN_IDLEWAKEUPS:
+            *(uint64_t *)elem = rusage->ri_pkg_idle_wkups;
+            break;
+
+        case PROCFS_COLUMN_INTWAKEUPS:
+            *(uint64_t *)elem = rusage->ri_interrupt_wkups;
+            break;
+
+        case PROCFS_COLUMN_FOOTPRINT:
+            *(uint64_t *)elem = rusage->ri_phys_footprint;
+            break;
+
+        case PROCFS_COLUMN_ENERGY:
+            *(uint64_t *)elem = rusage->ri_billed_energy;
+            break;
+
+        case PROCFS_COLUMN_COUNT:
+            break;
+        }
+    }
+}
@@ -0,0 +1,313 @@
+//
+//  procfs_comm.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// A table of interned command names. Nodes whose names contain a command
+// name, such as "bycomm/launchd", need an object id that identifies the
+// name, but a command name does not fit in an object id. Instead, each
+// distinct name is given a small integer id while it is in the table. The
+// names are held in an array of slots, with a second array of slot indices
+// sorted by name for binary search.
+//
+// Names are interned by the process index (see procfs_procindex.c) and by
+// lookups of nodes whose names contain a command name. Each call to
+// procfs_comm_intern() takes a reference to the name, which is released
+// with procfs_comm_release(), and procfs_comm_retain() takes another
+// reference to a name that is already in the table. Every index entry and
+// every node whose object id holds the id of a name has a reference, so a
+// name is in the table only while at least one indexed process or one node
+// has it, and the id of a name does not change while a node is using it.
+// When a name is removed, its slot is reused for
+// the next new name. An id holds both the slot index and a generation
+// number that changes each time the slot is freed, so the id of a removed
+// name does not refer to the name that next uses its slot. The generation
+// wraps, so this only holds until a slot has been reused 65536 times.
+//
+// The number of names that can be in the table at once is limited to
+// PROCFS_COMM_MAX_IDS. Once the table is full, names that are not already
+// in it cannot be interned.
+//
+
+#include <kern/locks.h>
+#include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
+#include <sys/errno.h>
+#include <sys/sysctl.h>
+#include "procfsnode.h"
+#include "procfs_comm.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The initial capacity of the table.
+#define PROCFS_COMM_INITIAL_CAPACITY 256
+
+// The number of bits of an id that hold the slot index. The rest hold the
+// slot's generation. The slot index in an id is one more than the index of
+// the slot, so that no id is 0.
+#define PROCFS_COMM_SLOT_BITS 16
+#define PROCFS_COMM_SLOT_MASK ((1U << PROCFS_COMM_SLOT_BITS) - 1)
+#define PROCFS_COMM_MAKE_ID(slot, generation) (((uint32_t)(generation) << PROCFS_COMM_SLOT_BITS) | ((slot) + 1))
+#define PROCFS_COMM_ID_SLOT(id) ((int)((id) & PROCFS_COMM_SLOT_MASK) - 1)
+#define PROCFS_COMM_ID_GENERATION(id) ((uint16_t)((id) >> PROCFS_COMM_SLOT_BITS))
+
+// A slot in the table. A slot whose reference count is 0 is free and
+// is on the free list.
+typedef struct procfs_comm_slot {
+    char        pcs_name[MAXCOMLEN + 1];    // The name.
+    uint32_t    pcs_refs;                   // Number of references to the name.
+    uint16_t    pcs_generation;             // Changed each time the slot is freed.
+    int         pcs_next_free;              // Index of the next free slot, or -1.
+} procfs_comm_slot_t;
+
+#pragma mark -
+#pragma mark Local Data
+
+// The slots, the indices of the slots that are in use in order of name,
+// the number of names in the table, the number of slots that have ever been
+// used, the number of slots for which there is space and the first free slot.
+STATIC procfs_comm_slot_t *procfs_comm_slots;
+STATIC int *procfs_comm_sorted_slots;
+STATIC int procfs_comm_count;
+STATIC int procfs_comm_slots_used;
+STATIC int procfs_comm_capacity;
+STATIC int procfs_comm_free_slot = -1;
+
+// Lock that protects all of the above.
+STATIC lck_grp_t *procfs_comm_lck_grp;
+STATIC lck_mtx_t *procfs_comm_mutex;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_comm_search(const char *comm, boolean_t *found);
+STATIC int procfs_comm_alloc_slot(int *slotp);
+STATIC int procfs_comm_grow(void);
+
+#pragma mark -
+#pragma mark Statistics
+
+SYSCTL_INT(_vfs_procfs, OID_AUTO, comm_names, CTLFLAG_RD | CTLFLAG_LOCKED,
+           &procfs_comm_count, 0, "number of interned command names");
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the lock for the table. The table itself is allocated
+ * when the first name is interned. Called once when the file system
+ * is initialized.
+ */
+void
+procfs_comm_init(void) {
+    procfs_comm_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.comm_locks", LCK_GRP_ATTR_NULL);
+    procfs_comm_mutex = lck_mtx_alloc_init(procfs_comm_lck_grp, LCK_ATTR_NULL);
+}
+
+#pragma mark -
+#pragma mark Interning and Lookup
+
+/*
+ * Gets the id of a command name, adding the name to the table if it is
+ * not already there, and takes a reference to it, which the caller must
+ * release with procfs_comm_release(). Returns 0 on success, EINVAL if the
+ * name is empty or too long to be a command name, ENOSPC if the table is
+ * full and ENOMEM if memory could not be allocated.
+ */
+int
+procfs_comm_intern(const char *comm, uint32_t *idp) {
+    size_t len = strnlen(comm, MAXCOMLEN + 1);
+    if (len == 0 || len > MAXCOMLEN) {
+        return EINVAL;
+    }
+
+    int error = 0;
+    lck_mtx_lock(procfs_comm_mutex);
+    boolean_t found;
+    int index = procfs_comm_search(comm, &found);
+    int slot;
+    if (found) {
+        slot = procfs_comm_sorted_slots[index];
+        procfs_comm_slots[slot].pcs_refs++;
+        *idp = PROCFS_COMM_MAKE_ID(slot, procfs_comm_slots[slot].pcs_generation);
+    } else if ((error = procfs_comm_alloc_slot(&slot)) == 0) {
+        procfs_comm_slot_t *slotp = &procfs_comm_slots[slot];
+        strlcpy(slotp->pcs_name, comm, sizeof(slotp->pcs_name));
+        slotp->pcs_refs = 1;
+        int move_count = procfs_comm_count - index;
+        if (move_count > 0) {
+            memmove(&procfs_comm_sorted_slots[index + 1], &procfs_comm_sorted_slots[index],
+                    move_count * sizeof(int));
+        }
+        procfs_comm_sorted_slots[index] = slot;
+        procfs_comm_count++;
+        *idp = PROCFS_COMM_MAKE_ID(slot, slotp->pcs_generation);
+    }
+    lck_mtx_unlock(procfs_comm_mutex);
+    return error;
+}
+
+/*
+ * Takes another reference to the command name with a given id, which
+ * the caller must release with procfs_comm_release(). Returns 0 on
+ * success or ENOENT if there is no name with that id.
+ */
+int
+procfs_comm_retain(uint32_t id) {
+    int error = ENOENT;
+    lck_mtx_lock(procfs_comm_mutex);
+    int slot = PROCFS_COMM_ID_SLOT(id);
+    if (slot >= 0 && slot < procfs_comm_slots_used) {
+        procfs_comm_slot_t *slotp = &procfs_comm_slots[slot];
+        if (slotp->pcs_refs > 0 && slotp->pcs_generation == PROCFS_COMM_ID_GENERATION(id)) {
+            slotp->pcs_refs++;
+            error = 0;
+        }
+    }
+    lck_mtx_unlock(procfs_comm_mutex);
+    return error;
+}
+
+/*
+ * Releases a reference to a command name that was taken by
+ * procfs_comm_intern() or procfs_comm_retain(). The name is removed
+ * from the table when the last reference is released.
+ */
+void
+procfs_comm_release(uint32_t id) {
+    lck_mtx_lock(procfs_comm_mutex);
+    int slot = PROCFS_COMM_ID_SLOT(id);
+    if (slot >= 0 && slot < procfs_comm_slots_used) {
+        procfs_comm_slot_t *slotp = &procfs_comm_slots[slot];
+        if (slotp->pcs_refs > 0 && slotp->pcs_generation == PROCFS_COMM_ID_GENERATION(id)
+                && --slotp->pcs_refs == 0) {
+            boolean_t found;
+            int index = procfs_comm_search(slotp->pcs_name, &found);
+            int move_count = procfs_comm_count - index - 1;
+            if (move_count > 0) {
+                memmove(&procfs_comm_sorted_slots[index], &procfs_comm_sorted_slots[index + 1],
+                        move_count * sizeof(int));
+            }
+            procfs_comm_count--;
+            slotp->pcs_generation++;
+            slotp->pcs_next_free = procfs_comm_free_slot;
+            procfs_comm_free_slot = slot;
+        }
+    }
+    lck_mtx_unlock(procfs_comm_mutex);
+}
+
+/*
+ * Copies the command name with a given id to a buffer, which must have
+ * space for MAXCOMLEN + 1 characters. Returns 0 on success or ENOENT if
+ * there is no name with that id, which is the case if the name has been
+ * removed from the table.
+ */
+int
+procfs_comm_name(uint32_t id, char *buffer) {
+    int error = ENOENT;
+    lck_mtx_lock(procfs_comm_mutex);
+    int slot = PROCFS_COMM_ID_SLOT(id);
+    if (slot >= 0 && slot < procfs_comm_slots_used) {
+        procfs_comm_slot_t *slotp = &procfs_comm_slots[slot];
+        if (slotp->pcs_refs > 0 && slotp->pcs_generation == PROCFS_COMM_ID_GENERATION(id)) {
+            strlcpy(buffer, slotp->pcs_name, sizeof(slotp->pcs_name));
+            error = 0;
+        }
+    }
+    lck_mtx_unlock(procfs_comm_mutex);
+    return error;
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Finds the position of a name in the sorted slot array. If the name is
+ * present, sets *found to TRUE and returns its index. Otherwise, sets
+ * *found to FALSE and returns the index at which it would be inserted.
+ * Must be called with the table lock held.
+ */
+STATIC int
+procfs_comm_search(const char *comm, boolean_t *found) {
+    int low = 0;
+    int high = procfs_comm_count;
+    while (low < high) {
+        int mid = low + (high - low)/2;
+        int result = strncmp(procfs_comm_slots[procfs_comm_sorted_slots[mid]].pcs_name, comm, MAXCOMLEN + 1);
+        if (result == 0) {
+            *found = TRUE;
+            return mid;
+        } else if (result < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *found = FALSE;
+    return low;
+}
+
+/*
+ * Gets a slot for a new name, reusing a free slot if there is one and
+ * growing the table if there is not. Returns 0 on success, ENOSPC if the
+ * table is full or ENOMEM if memory could not be allocated. Must be called
+ * with the table lock held.
+ */
+STATIC int
+procfs_comm_alloc_slot(int *slotp) {
+    if (procfs_comm_free_slot >= 0) {
+        *slotp = procfs_comm_free_slot;
+        procfs_comm_free_slot = procfs_comm_slots[*slotp].pcs_next_free;
+        return 0;
+    }
+    if (procfs_comm_slots_used == PROCFS_COMM_MAX_IDS) {
+        return ENOSPC;
+    }
+    if (procfs_comm_slots_used == procfs_comm_capacity) {
+        int error = procfs_comm_grow();
+        if (error != 0) {
+            return error;
+        }
+    }
+    *slotp = procfs_comm_slots_used++;
+    procfs_comm_slots[*slotp].pcs_generation = 0;
+    procfs_comm_slots[*slotp].pcs_next_free = -1;
+    return 0;
+}
+
+/*
+ * Doubles the capacity of the table, or allocates it if it does not
+ * yet exist. Returns 0 on success or ENOMEM if memory could not be
+ * allocated. Must be called with the table lock held.
+ */
+STATIC int
+procfs_comm_grow(void) {
+    int new_capacity = procfs_comm_capacity == 0 ? PROCFS_COMM_INITIAL_CAPACITY : 2 * procfs_comm_capacity;
+    uint32_t slots_size = new_capacity * (uint32_t)sizeof(procfs_comm_slot_t);
+    uint32_t sorted_size = new_capacity * (uint32_t)sizeof(int);
+    procfs_comm_slot_t *new_slots = (procfs_comm_slot_t *)OSMalloc(slots_size, procfs_osmalloc_tag);
+    int *new_sorted = (int *)OSMalloc(sorted_size, procfs_osmalloc_tag);
+    if (new_slots == NULL || new_sorted == NULL) {
+        if (new_slots != NULL) {
+            OSFree(new_slots, slots_size, procfs_osmalloc_tag);
+        }
+        if (new_sorted != NULL) {
+            OSFree(new_sorted, sorted_size, procfs_osmalloc_tag);
+        }
+        return ENOMEM;
+    }
+
+    if (procfs_comm_capacity > 0) {
+        bcopy(procfs_comm_slots, new_slots, procfs_comm_slots_used * sizeof(procfs_comm_slot_t));
+        bcopy(procfs_comm_sorted_slots, new_sorted, procfs_comm_count * sizeof(int));
+        OSFree(procfs_comm_slots, procfs_comm_capacity * (uint32_t)sizeof(procfs_comm_slot_t), procfs_osmalloc_tag);
+        OSFree(procfs_comm_sorted_slots, procfs_comm_capacity * (uint32_t)sizeof(int), procfs_osmalloc_tag);
+    }
+    procfs_comm_slots = new_slots;
+    procfs_comm_sorted_slots = new_sorted;
+    procfs_comm_capacity = new_capacity;
+    return 0;
+}
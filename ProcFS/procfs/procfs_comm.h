@@ -0,0 +1,24 @@
+//
+//  procfs_comm.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_comm_h
+#define procfs_comm_h
+
+#include <sys/param.h>
+#include <sys/types.h>
+
+// The largest number of distinct command names that can be interned at once.
+#define PROCFS_COMM_MAX_IDS 16384
+
+extern void procfs_comm_init(void);
+extern int procfs_comm_intern(const char *comm, uint32_t *idp);
+extern int procfs_comm_retain(uint32_t id);
+extern void procfs_comm_release(uint32_t id);
+extern int procfs_comm_name(uint32_t id, char *buffer);
+
+#endif /* procfs_comm_h */
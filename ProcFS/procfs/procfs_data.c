@@ -16,23 +16,21 @@
 #include <sys/file_internal.h>
 #include <sys/proc_info.h>
 #include <sys/proc_internal.h>
+#include <sys/resource.h>
 #include <sys/uio_internal.h>
 #include <sys/vnode_internal.h>
 #include "procfsnode.h"
 #include "procfsstructure.h"
 #include "procfs_data.h"
+#include "procfs_pathcache.h"
 #include "procfs_subr.h"
 
-#pragma mark -
-#pragma mark Local Function Prototypes
-
-STATIC int procfs_copy_data(char *data, int data_len, uio_t uio);
-
 #pragma mark -
 #pragma mark External References
 
 extern int proc_pidbsdinfo(proc_t p, struct proc_bsdinfo *pinfo, int zombie);
 extern int proc_pidtaskinfo(proc_t p, struct proc_taskinfo *tinfo);
+extern void gather_rusage_info(proc_t p, rusage_info_current *ru, int flavor);
 extern int proc_pidthreadinfo(proc_t p, uint64_t threadid,  int thuniqueid, struct proc_threadinfo *info);
 extern int fill_vnodeinfo(vnode_t vp, struct vnode_info *vinfo);
 extern void  fill_fileinfo(struct fileproc * fp, proc_t proc, int fd, struct proc_fileinfo * finfo);
@@ -203,6 +201,29 @@ procfs_read_task_info(procfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx)
     return error;
 }
 
+/*
+ * Reads the resource usage of a process, including its disk I/O,
+ * wakeups, physical footprint and energy use. Populates an instance
+ * of the current rusage_info structure and copies it to the area
+ * described by a uio structure.
+ */
+int
+procfs_read_rusage_data(procfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx) {
+    int error = 0;
+    proc_t p = proc_find(pnp->node_id.nodeid_pid);
+    if (p != NULL) {
+        rusage_info_current info;
+        
+        bzero(&info, sizeof(info));
+        gather_rusage_info(p, &info, RUSAGE_INFO_CURRENT);
+        error = procfs_copy_data((char *)&info, sizeof(info), uio);
+        proc_rele(p);
+    } else {
+        error = ESRCH;
+    }
+    return error;
+}
+
 /*
  * Reads basic info for a thread. Populates an instance of a proc_threadinfo 
  * structure and copies it to tthe area described by a uio structure.
@@ -268,7 +289,7 @@ procfs_read_fd_data(procfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx) {
                 // out to user space.
                 if (error == 0) {
                     int count = MAXPATHLEN;
-                    vn_getpath(vp, info.pvip.vip_path, &count);
+                    procfs_pathcache_getpath(vp, vid, info.pvip.vip_path, &count);
                     info.pvip.vip_path[MAXPATHLEN-1] = 0;
                     error = procfs_copy_data((char *)&info, sizeof(info), uio);
                 }
@@ -365,8 +386,19 @@ procfs_get_node_size_attr(procfsnode_t *pnp, kauth_cred_t creds) {
         // Directory
         procfs_structure_node_t *next_snode;
         TAILQ_FOREACH(next_snode, &snode->psn_children, psn_next) {
+            // Query nodes do not have directory entries.
+            if (next_snode->psn_node_type == PROCFS_QUERY_FILE || next_snode->psn_node_type == PROCFS_QUERY_DIR) {
+                continue;
+            }
+            
+            // A file is always one entry. Its size function, if it
+            // has one, returns the size of its content.
             procfs_node_size_fn node_size_fn = next_snode->psn_getsize_fn;
-            size += node_size_fn == NULL ? 1 : node_size_fn(pnp, creds);
+            if (node_size_fn == NULL || next_snode->psn_node_type == PROCFS_FILE) {
+                size++;
+            } else {
+                size += node_size_fn(pnp, creds);
+            }
         }
     } else {
         // File or symlink
@@ -386,6 +418,27 @@ procfs_process_node_size(__unused procfsnode_t *pnp, kauth_cred_t creds) {
     return procfs_get_process_count(creds);
 }
 
+/*
+ * Gets the size for a node that stands for the process links in a
+ * directory. The node itself has no size. A directory that has such
+ * a node as its last child gets a size of 1 for each process that
+ * it links to and that is visible with the given credentials.
+ */
+size_t
+procfs_proclink_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    procfs_structure_node_t *last_child = TAILQ_LAST(&pnp->node_structure_node->psn_children, procfs_structure_children);
+    if (last_child == NULL || last_child->psn_node_type != PROCFS_PROCLINK) {
+        return 0;
+    }
+    
+    pid_t *pid_list;
+    int pid_count;
+    uint32_t pid_list_size;
+    last_child->psn_list_pids_fn(pnp, procfs_get_size_check_creds(pnp, creds), &pid_list, &pid_count, &pid_list_size);
+    procfs_release_pids(pid_list, pid_list_size);
+    return pid_count;
+}
+
 /*
  * Gets the size for a node that represents a thread.
  */
@@ -419,15 +472,7 @@ procfs_fd_node_size(procfsnode_t *pnp, __unused kauth_cred_t creds) {
     proc_t p = proc_find(pid);
     if (p != NULL) {
         // Count the open files in this process.
-        struct filedesc *fdp = p->p_fd;
-        proc_fdlock_spin(p);
-        for (int i = 0; i < fdp->fd_nfiles; i++) {
-            struct fileproc *fp = fdp->fd_ofiles[i];
-            if (fp != NULL && !(fdp->fd_ofileflags[i] & UF_RESERVED)) {
-                size++;
-            }
-        }
-        proc_fdunlock(p);
+        size = procfs_get_process_fd_count(p);
         proc_rele(p);
     }
     return size;
@@ -444,7 +489,7 @@ procfs_fd_node_size(procfsnode_t *pnp, __unused kauth_cred_t creds) {
  * uio_offset set to N, the first byte of data that will be copied
  * is at data[N].
  */
-STATIC int
+int
 procfs_copy_data(char *data, int data_len, uio_t uio) {
     int error = 0;
     off_t start_offset = uio->uio_offset;
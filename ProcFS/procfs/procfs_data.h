@@ -10,6 +10,8 @@
 #define procfs_data_h
 
 typedef struct procfsnode procfsnode_t;
+struct fileglob;
+struct procfs_batch_query;
 
 // Functions that copy procfsnode_t data to a buffer described by a uio_t structure.
 extern int procfs_read_pid_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
@@ -19,14 +21,83 @@ extern int procfs_read_sid_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx)
 extern int procfs_read_tty_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_read_proc_info(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_read_task_info(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_rusage_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_read_thread_info(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_read_fd_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 extern int procfs_read_socket_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_columns_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_images_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_descendants_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_cpuload_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_vmstat_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_loadavg_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_mempressure_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_sockets_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_openers_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_top_cpu_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_top_rss_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_top_io_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_totals_uid_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_totals_comm_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_totals_pgrp_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+extern int procfs_read_select_info_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
+
+// Functions that copy procfsnode_t data that is generated as it is read.
+extern void procfs_map_init(void);
+extern int procfs_read_map_data(procfsnode_t *pnp, struct fileglob *fg, uio_t uio, int ioflag, vfs_context_t ctx);
+extern void procfs_map_close(procfsnode_t *pnp, struct fileglob *fg);
 
 // Functions that return the data size for a node.
 extern size_t procfs_get_node_size_attr(procfsnode_t *pnp, kauth_cred_t creds);
 extern size_t procfs_process_node_size(procfsnode_t *pnp, kauth_cred_t creds);
 extern size_t procfs_thread_node_size(procfsnode_t *pnp, kauth_cred_t creds);
 extern size_t procfs_fd_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_columns_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_images_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_descendants_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_cpuload_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_sockets_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_openers_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_top_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_totals_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_select_info_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+extern size_t procfs_proclink_node_size(procfsnode_t *pnp, kauth_cred_t creds);
+
+// Functions that parse the names of query nodes.
+extern int procfs_parse_columns_name(const char *name, uint64_t *objectidp);
+extern int procfs_parse_openers_name(const char *name, uint64_t *objectidp);
+extern int procfs_parse_top_name(const char *name, uint64_t *objectidp);
+extern int procfs_parse_select_name(const char *name, uint64_t *objectidp);
+extern int procfs_parse_bycomm_name(const char *name, uint64_t *objectidp);
+extern int procfs_parse_byuid_name(const char *name, uint64_t *objectidp);
+extern int procfs_parse_bypgrp_name(const char *name, uint64_t *objectidp);
+
+// Functions that hold the object ids of query directories.
+extern boolean_t procfs_select_hold_objectid(uint64_t objectid, boolean_t hold);
+extern boolean_t procfs_bycomm_hold_objectid(uint64_t objectid, boolean_t hold);
+
+// Functions that list and match the processes that a directory links to.
+extern void procfs_select_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                                    pid_t **pidpp, int *pid_count, uint32_t *sizep);
+extern boolean_t procfs_select_match_proc(procfsnode_t *dir_pnp, proc_t p);
+extern void procfs_bycomm_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                                    pid_t **pidpp, int *pid_count, uint32_t *sizep);
+extern boolean_t procfs_bycomm_match_proc(procfsnode_t *dir_pnp, proc_t p);
+extern void procfs_byuid_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                                   pid_t **pidpp, int *pid_count, uint32_t *sizep);
+extern boolean_t procfs_byuid_match_proc(procfsnode_t *dir_pnp, proc_t p);
+extern void procfs_bypgrp_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                                    pid_t **pidpp, int *pid_count, uint32_t *sizep);
+extern boolean_t procfs_bypgrp_match_proc(procfsnode_t *dir_pnp, proc_t p);
+extern void procfs_children_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                                      pid_t **pidpp, int *pid_count, uint32_t *sizep);
+extern boolean_t procfs_children_match_proc(procfsnode_t *dir_pnp, proc_t p);
+
+// Performs a batch process query for the PROCFS_IOC_BATCH_QUERY command.
+extern int procfs_batch_query(procfsnode_t *pnp, struct procfs_batch_query *query, vfs_context_t ctx);
+
+// Copies data from a buffer to the area described by a uio_t structure,
+// starting at the offset given by the uio_t.
+extern int procfs_copy_data(char *data, int data_len, uio_t uio);
 
 #endif /* procfs_data_h */
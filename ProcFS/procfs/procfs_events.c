@@ -0,0 +1,500 @@
+//
+//  procfs_events.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Implementation of the /proc/events file, which delivers a record
+// for each process fork, exec and exit. The records are written to a
+// fixed-size ring buffer by hooks that are called from the kernel's
+// process lifecycle code. Each open file through which the file is read
+// has its own cursor into the ring, so descriptors that were opened
+// separately see every event even when they belong to the same process.
+// A reader that falls more than the size of the ring behind loses the
+// oldest events and is told how many it lost.
+//
+// The open file is passed down by the kernel's vnode file operations
+// (see procfs_fileops.h), but VNOP_OPEN is called before the open file
+// is connected to the vnode, so it cannot say which open file it is for.
+// Instead, open creates a cursor for the process that is not yet attached
+// to an open file and the first read, select or close through an open file
+// of that process claims it. This means that the file sees every event
+// from the time that it was opened, not just from the time of its first
+// read.
+//
+
+#include <kern/locks.h>
+#include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
+#include <sys/errno.h>
+#include <sys/proc_internal.h>
+#include <sys/queue.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/vnode.h>
+#include "procfsnode.h"
+#include "procfs_events.h"
+#include "procfs_notify.h"
+#include "procfs_procindex.h"
+#include "procfs_proctable.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// Number of events held in the ring buffer. Must be a power of 2.
+#define PROCFS_EVENTS_RING_SIZE 1024
+
+/*
+ * An entry in the event ring. The ids that are used to decide
+ * whether a reader can see the event are kept alongside the
+ * record that is returned to the reader, because the process
+ * may have gone by the time the event is read.
+ */
+typedef struct {
+    procfs_event_t  pevr_event;     // The record returned to readers.
+    uid_t           pevr_ruid;      // Real user id of the process.
+    gid_t           pevr_gid;       // Effective group id of the process.
+    gid_t           pevr_rgid;      // Real group id of the process.
+} procfs_event_record_t;
+
+/*
+ * The state of an open file through which an events node is being read.
+ */
+typedef struct procfs_event_reader {
+    LIST_ENTRY(procfs_event_reader) pevd_link;     // Link in the list of readers.
+    procfsnode_t                    *pevd_node;     // The node being read.
+    struct fileglob                 *pevd_fglob;    // The open file, or NULL if not yet claimed. Used only as a key.
+    pid_t                           pevd_pid;       // The process that opened the file. Used to claim the reader.
+    uint64_t                        pevd_cursor;    // Sequence number of the next event to read.
+    uint64_t                        pevd_overruns;  // Number of events that this reader has lost.
+} procfs_event_reader_t;
+
+#pragma mark -
+#pragma mark Local Data
+
+// Lock that protects all of the data below.
+STATIC lck_grp_t *procfs_events_lck_grp;
+STATIC lck_mtx_t *procfs_events_mutex;
+
+// The event ring. Event N is stored at index (N % PROCFS_EVENTS_RING_SIZE).
+STATIC procfs_event_record_t *procfs_events_ring;
+
+// Sequence number of the next event to be written. This is also
+// the channel used to wake up readers that are waiting for events.
+STATIC uint64_t procfs_events_next_seq;
+
+// Number of readers that are waiting for events.
+STATIC int procfs_events_waiters;
+
+// Record of the threads that are waiting in select(2) for events, and
+// whether there are any.
+STATIC struct selinfo procfs_events_selinfo;
+STATIC boolean_t procfs_events_selecting;
+
+// All readers of all events nodes.
+STATIC LIST_HEAD(, procfs_event_reader) procfs_event_readers;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC void procfs_events_record(proc_t p, procfs_event_type_t type);
+STATIC procfs_event_reader_t *procfs_events_find_reader(procfsnode_t *pnp, struct fileglob *fg, pid_t pid);
+STATIC procfs_event_reader_t *procfs_events_lookup_reader(procfsnode_t *pnp, struct fileglob *fg, pid_t pid);
+STATIC procfs_event_reader_t *procfs_events_get_reader(procfsnode_t *pnp, struct fileglob *fg, pid_t pid);
+STATIC boolean_t procfs_events_next(procfs_event_reader_t *reader, kauth_cred_t creds, procfs_event_t *eventp);
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the event ring and the lock that protects it. Called
+ * once when the file system is initialized. Events that occur before
+ * this function is called are not recorded.
+ */
+void
+procfs_events_init(void) {
+    procfs_events_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.events_locks", LCK_GRP_ATTR_NULL);
+    procfs_events_mutex = lck_mtx_alloc_init(procfs_events_lck_grp, LCK_ATTR_NULL);
+    LIST_INIT(&procfs_event_readers);
+
+    size_t size = PROCFS_EVENTS_RING_SIZE * sizeof(procfs_event_record_t);
+    procfs_event_record_t *ring = (procfs_event_record_t *)OSMalloc((uint32_t)size, procfs_osmalloc_tag);
+    if (ring != NULL) {
+        bzero(ring, size);
+        procfs_events_ring = ring;
+    }
+}
+
+#pragma mark -
+#pragma mark Process Lifecycle Hooks
+
+// Called when a process has been created. "p" is the new process.
+void
+procfs_event_fork(proc_t p) {
+    procfs_procindex_add(p);
+    procfs_proctable_invalidate(FALSE);
+    procfs_events_record(p, PROCFS_EVENT_FORK);
+}
+
+// Called when a process has executed a new program.
+void
+procfs_event_exec(proc_t p) {
+    procfs_procindex_update(p);
+    procfs_proctable_invalidate(TRUE);
+    procfs_events_record(p, PROCFS_EVENT_EXEC);
+}
+
+// Called when a process is exiting.
+void
+procfs_event_exit(proc_t p) {
+    procfs_procindex_remove(p);
+    procfs_proctable_invalidate(FALSE);
+    procfs_events_record(p, PROCFS_EVENT_EXIT);
+}
+
+// Called when the user or group ids of a process have changed. This
+// does not generate an event.
+void
+procfs_event_setugid(proc_t p) {
+    procfs_procindex_update(p);
+    procfs_proctable_invalidate(TRUE);
+}
+
+#pragma mark -
+#pragma mark Events File Operations
+
+/*
+ * Creates a cursor for a file that is being opened on an events node,
+ * so that it sees all events that occur from now on. The cursor is
+ * attached to the open file when it is first read.
+ */
+void
+procfs_events_open(procfsnode_t *pnp, vfs_context_t ctx) {
+    pid_t pid = vfs_context_pid(ctx);
+    procfs_event_reader_t *new_reader = (procfs_event_reader_t *)OSMalloc(sizeof(procfs_event_reader_t), procfs_osmalloc_tag);
+    if (new_reader != NULL) {
+        bzero(new_reader, sizeof(procfs_event_reader_t));
+        new_reader->pevd_node = pnp;
+        new_reader->pevd_pid = pid;
+        lck_mtx_lock(procfs_events_mutex);
+        new_reader->pevd_cursor = procfs_events_next_seq;
+        LIST_INSERT_HEAD(&procfs_event_readers, new_reader, pevd_link);
+        lck_mtx_unlock(procfs_events_mutex);
+    }
+}
+
+/*
+ * Reads as many whole event records as will fit in the caller's
+ * buffer. If no events are available, waits until one is, unless
+ * IO_NDELAY is set, in which case EAGAIN is returned. The caller's
+ * buffer must be large enough for at least one record.
+ */
+int
+procfs_events_read(procfsnode_t *pnp, struct fileglob *fg, uio_t uio, int ioflag, vfs_context_t ctx) {
+    if (uio_resid(uio) < (user_ssize_t)sizeof(procfs_event_t)) {
+        return EINVAL;
+    }
+    if (procfs_events_ring == NULL) {
+        return ENXIO;
+    }
+
+    kauth_cred_t creds = procfs_get_access_check_creds(pnp, ctx);
+    pid_t pid = vfs_context_pid(ctx);
+    boolean_t copied = FALSE;
+    int error = 0;
+
+    lck_mtx_lock(procfs_events_mutex);
+    while (error == 0 && uio_resid(uio) >= (user_ssize_t)sizeof(procfs_event_t)) {
+        // Look up the reader each time around the loop, because it
+        // may have been freed while we did not hold the lock.
+        procfs_event_reader_t *reader = procfs_events_get_reader(pnp, fg, pid);
+        if (reader == NULL) {
+            error = ENOMEM;
+            break;
+        }
+
+        procfs_event_t event;
+        if (procfs_events_next(reader, creds, &event)) {
+            // Copy out without holding the lock, since it may fault.
+            lck_mtx_unlock(procfs_events_mutex);
+            error = uiomove((const char *)&event, sizeof(event), uio);
+            copied = TRUE;
+            lck_mtx_lock(procfs_events_mutex);
+        } else if (copied) {
+            // Return what we have rather than waiting for more.
+            break;
+        } else if (ioflag & IO_NDELAY) {
+            error = EAGAIN;
+        } else {
+            procfs_events_waiters++;
+            error = msleep(&procfs_events_next_seq, procfs_events_mutex, PCATCH | PRIBIO, "procfs_events", NULL);
+            procfs_events_waiters--;
+        }
+    }
+    lck_mtx_unlock(procfs_events_mutex);
+
+    return error;
+}
+
+/*
+ * Implements select(2) for an open file "fg" of an events node. Returns
+ * 1 if there is an event that the caller can read through the file.
+ * Otherwise, records the calling thread so that it will be woken when
+ * the next event arrives and returns 0.
+ */
+int
+procfs_events_select(procfsnode_t *pnp, struct fileglob *fg, void *wql, vfs_context_t ctx) {
+    kauth_cred_t creds = procfs_get_access_check_creds(pnp, ctx);
+    pid_t pid = vfs_context_pid(ctx);
+    int ready = 0;
+
+    lck_mtx_lock(procfs_events_mutex);
+    procfs_event_reader_t *reader = procfs_events_lookup_reader(pnp, fg, pid);
+    if (reader == NULL) {
+        // Let the caller find out about the problem when it reads.
+        ready = 1;
+    } else {
+        // Look ahead using a copy of the reader, so that we
+        // don't consume anything.
+        procfs_event_reader_t lookahead = *reader;
+        procfs_event_t event;
+        if (procfs_events_next(&lookahead, creds, &event)) {
+            ready = 1;
+        } else {
+            selrecord(vfs_context_proc(ctx), &procfs_events_selinfo, wql);
+            procfs_events_selecting = TRUE;
+        }
+    }
+    lck_mtx_unlock(procfs_events_mutex);
+
+    return ready;
+}
+
+/*
+ * Gets the next event after a given position in the ring, for use by
+ * consumers of events within procfs, which see every event. *cursorp
+ * is the sequence number of the next event to be returned and is
+ * updated. Events that have been overwritten are skipped. Returns FALSE
+ * if there are no more events.
+ */
+boolean_t
+procfs_events_next_internal(uint64_t *cursorp, procfs_event_t *eventp) {
+    boolean_t found = FALSE;
+    if (procfs_events_ring != NULL) {
+        procfs_event_reader_t reader;
+        bzero(&reader, sizeof(reader));
+        reader.pevd_cursor = *cursorp;
+
+        lck_mtx_lock(procfs_events_mutex);
+        found = procfs_events_next(&reader, NULL, eventp);
+        if (found && eventp->pe_type == PROCFS_EVENT_OVERRUN) {
+            // Return the oldest event that we still have instead.
+            found = procfs_events_next(&reader, NULL, eventp);
+        }
+        lck_mtx_unlock(procfs_events_mutex);
+        *cursorp = reader.pevd_cursor;
+    }
+    return found;
+}
+
+/*
+ * Releases the cursor of an open file "fg" that is being closed. If the
+ * file was never read, this is the closing process's unclaimed cursor.
+ */
+void
+procfs_events_close(procfsnode_t *pnp, struct fileglob *fg, vfs_context_t ctx) {
+    lck_mtx_lock(procfs_events_mutex);
+    procfs_event_reader_t *reader = procfs_events_lookup_reader(pnp, fg, vfs_context_pid(ctx));
+    if (reader != NULL) {
+        LIST_REMOVE(reader, pevd_link);
+    }
+    lck_mtx_unlock(procfs_events_mutex);
+
+    // Free outside the lock, because freeing memory may block.
+    if (reader != NULL) {
+        OSFree(reader, sizeof(procfs_event_reader_t), procfs_osmalloc_tag);
+    }
+}
+
+/*
+ * Releases all of the cursors for an events node. Called when the
+ * node is no longer in use.
+ */
+void
+procfs_events_release_readers(procfsnode_t *pnp) {
+    procfs_event_reader_t *reader;
+
+    lck_mtx_lock(procfs_events_mutex);
+    while ((reader = procfs_events_find_reader(pnp, NULL, PRNODE_NO_PID)) != NULL) {
+        LIST_REMOVE(reader, pevd_link);
+
+        // Free outside the lock, because freeing memory may block.
+        lck_mtx_unlock(procfs_events_mutex);
+        OSFree(reader, sizeof(procfs_event_reader_t), procfs_osmalloc_tag);
+        lck_mtx_lock(procfs_events_mutex);
+    }
+    lck_mtx_unlock(procfs_events_mutex);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Adds an event for a given process to the ring and wakes up any
+ * waiting readers. If the ring is full, the oldest event is lost.
+ */
+STATIC void
+procfs_events_record(proc_t p, procfs_event_type_t type) {
+    if (procfs_events_ring == NULL) {
+        // Not initialized yet.
+        return;
+    }
+
+    // Build the record before taking the lock.
+    procfs_event_record_t record;
+    bzero(&record, sizeof(record));
+
+    struct timeval now;
+    microtime(&now);
+    record.pevr_event.pe_timestamp = (uint64_t)now.tv_sec * USEC_PER_SEC + now.tv_usec;
+    record.pevr_event.pe_type = type;
+    record.pevr_event.pe_pid = p->p_pid;
+    record.pevr_event.pe_ppid = p->p_ppid;
+    record.pevr_event.pe_uid = p->p_uid;
+    strlcpy(record.pevr_event.pe_comm, p->p_comm, sizeof(record.pevr_event.pe_comm));
+    record.pevr_ruid = p->p_ruid;
+    record.pevr_gid = p->p_gid;
+    record.pevr_rgid = p->p_rgid;
+
+    lck_mtx_lock(procfs_events_mutex);
+    record.pevr_event.pe_sequence = procfs_events_next_seq;
+    procfs_events_ring[procfs_events_next_seq % PROCFS_EVENTS_RING_SIZE] = record;
+    procfs_events_next_seq++;
+    boolean_t waiters = procfs_events_waiters > 0;
+    if (procfs_events_selecting) {
+        procfs_events_selecting = FALSE;
+        selwakeup(&procfs_events_selinfo);
+    }
+    lck_mtx_unlock(procfs_events_mutex);
+
+    if (waiters) {
+        wakeup(&procfs_events_next_seq);
+    }
+
+    // Let anyone who is watching procfs nodes know what happened.
+    procfs_notify_process_event();
+}
+
+/*
+ * Finds the reader for a given open file of a given node. If "fg" is
+ * NULL, finds the reader for "pid" that has not yet been claimed by an
+ * open file or, if "pid" is PRNODE_NO_PID, any reader of the node. Must
+ * be called with the events lock held.
+ */
+STATIC procfs_event_reader_t *
+procfs_events_find_reader(procfsnode_t *pnp, struct fileglob *fg, pid_t pid) {
+    procfs_event_reader_t *reader;
+    LIST_FOREACH(reader, &procfs_event_readers, pevd_link) {
+        if (reader->pevd_node == pnp) {
+            if (fg == NULL ? pid == PRNODE_NO_PID || (reader->pevd_fglob == NULL && reader->pevd_pid == pid)
+                           : reader->pevd_fglob == fg) {
+                return reader;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Finds the reader for a given open file of a given node. If the open
+ * file does not have a reader yet, claims the unclaimed reader that was
+ * created when the reading process opened the node, if there is one.
+ * Must be called with the events lock held.
+ */
+STATIC procfs_event_reader_t *
+procfs_events_lookup_reader(procfsnode_t *pnp, struct fileglob *fg, pid_t pid) {
+    procfs_event_reader_t *reader = procfs_events_find_reader(pnp, fg, pid);
+    if (reader == NULL && fg != NULL) {
+        reader = procfs_events_find_reader(pnp, NULL, pid);
+        if (reader != NULL) {
+            reader->pevd_fglob = fg;
+        }
+    }
+    return reader;
+}
+
+/*
+ * Gets the reader for a given open file of a given node, creating it if
+ * it does not exist. A read that is not made through an open file uses
+ * the process's unclaimed reader. A new reader starts with the next event
+ * to be recorded. Must be called with the events lock held, but the lock
+ * may be dropped and reacquired. Returns NULL if memory is not available.
+ */
+STATIC procfs_event_reader_t *
+procfs_events_get_reader(procfsnode_t *pnp, struct fileglob *fg, pid_t pid) {
+    procfs_event_reader_t *reader = procfs_events_lookup_reader(pnp, fg, pid);
+    if (reader == NULL) {
+        // Allocate without holding the lock, then check again
+        // in case another thread added the reader meanwhile.
+        lck_mtx_unlock(procfs_events_mutex);
+        procfs_event_reader_t *new_reader = (procfs_event_reader_t *)OSMalloc(sizeof(procfs_event_reader_t), procfs_osmalloc_tag);
+        lck_mtx_lock(procfs_events_mutex);
+
+        reader = procfs_events_lookup_reader(pnp, fg, pid);
+        if (reader == NULL && new_reader != NULL) {
+            new_reader->pevd_node = pnp;
+            new_reader->pevd_fglob = fg;
+            new_reader->pevd_pid = pid;
+            new_reader->pevd_cursor = procfs_events_next_seq;
+            new_reader->pevd_overruns = 0;
+            LIST_INSERT_HEAD(&procfs_event_readers, new_reader, pevd_link);
+            reader = new_reader;
+        } else if (new_reader != NULL) {
+            lck_mtx_unlock(procfs_events_mutex);
+            OSFree(new_reader, sizeof(procfs_event_reader_t), procfs_osmalloc_tag);
+            lck_mtx_lock(procfs_events_mutex);
+
+            // The reader may have gone again while the lock was dropped.
+            reader = procfs_events_lookup_reader(pnp, fg, pid);
+        }
+    }
+    return reader;
+}
+
+/*
+ * Gets the next event that a reader can see and advances its cursor.
+ * If events that the reader has not seen have been overwritten, an
+ * overrun record is returned first and the cursor moves to the oldest
+ * event in the ring. Returns FALSE if there are no more events for the
+ * reader. Must be called with the events lock held.
+ */
+STATIC boolean_t
+procfs_events_next(procfs_event_reader_t *reader, kauth_cred_t creds, procfs_event_t *eventp) {
+    uint64_t oldest = procfs_events_next_seq > PROCFS_EVENTS_RING_SIZE
+                            ? procfs_events_next_seq - PROCFS_EVENTS_RING_SIZE : 0;
+    if (reader->pevd_cursor < oldest) {
+        bzero(eventp, sizeof(procfs_event_t));
+        eventp->pe_type = PROCFS_EVENT_OVERRUN;
+        eventp->pe_sequence = reader->pevd_cursor;
+        reader->pevd_overruns += oldest - reader->pevd_cursor;
+        eventp->pe_overruns = reader->pevd_overruns;
+        reader->pevd_cursor = oldest;
+        return TRUE;
+    }
+
+    while (reader->pevd_cursor < procfs_events_next_seq) {
+        procfs_event_record_t *record = &procfs_events_ring[reader->pevd_cursor % PROCFS_EVENTS_RING_SIZE];
+        reader->pevd_cursor++;
+
+        procfs_event_t *event = &record->pevr_event;
+        if (creds == NULL || procfs_check_can_access_ids(creds, event->pe_uid, record->pevr_ruid,
+                                                          record->pevr_gid, record->pevr_rgid) == 0) {
+            *eventp = *event;
+            eventp->pe_overruns = reader->pevd_overruns;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
@@ -0,0 +1,37 @@
+//
+//  procfs_events.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_events_h
+#define procfs_events_h
+
+#include <sys/kernel_types.h>
+#include "procfs.h"
+
+typedef struct procfsnode procfsnode_t;
+struct fileglob;
+
+// Process lifecycle hooks. These are called from the kernel's fork,
+// exec, exit and credential code (see README.md), so they must be cheap
+// and must not be called with any procfs lock held.
+extern void procfs_event_fork(proc_t p);
+extern void procfs_event_exec(proc_t p);
+extern void procfs_event_exit(proc_t p);
+extern void procfs_event_setugid(proc_t p);
+
+// Support for the /proc/events file.
+extern void procfs_events_init(void);
+extern void procfs_events_open(procfsnode_t *pnp, vfs_context_t ctx);
+extern int procfs_events_read(procfsnode_t *pnp, struct fileglob *fg, uio_t uio, int ioflag, vfs_context_t ctx);
+extern int procfs_events_select(procfsnode_t *pnp, struct fileglob *fg, void *wql, vfs_context_t ctx);
+extern void procfs_events_close(procfsnode_t *pnp, struct fileglob *fg, vfs_context_t ctx);
+extern void procfs_events_release_readers(procfsnode_t *pnp);
+
+// Support for consumers of events within procfs.
+extern boolean_t procfs_events_next_internal(uint64_t *cursorp, procfs_event_t *eventp);
+
+#endif /* procfs_events_h */
@@ -0,0 +1,25 @@
+//
+//  procfs_fileops.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_fileops_h
+#define procfs_fileops_h
+
+#include <sys/kernel_types.h>
+
+struct fileglob;
+
+// Open file hooks. The vnode operations are not told which open file
+// they are being called for, so the kernel's vnode file operations
+// (see README.md) call these instead for procfs vnodes. The vnode must
+// have an iocount.
+extern boolean_t procfs_file_is_procfs(vnode_t vp);
+extern int procfs_file_read(vnode_t vp, struct fileglob *fg, uio_t uio, int ioflag, vfs_context_t ctx);
+extern int procfs_file_select(vnode_t vp, struct fileglob *fg, int which, void *wql, vfs_context_t ctx);
+extern void procfs_file_close(vnode_t vp, struct fileglob *fg, vfs_context_t ctx);
+
+#endif /* procfs_fileops_h */
@@ -0,0 +1,140 @@
+//
+//  procfs_host.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Generates the content of the files in the /proc/host directory, which
+// report system-wide statistics. Each file has a fixed binary layout that
+// is described in procfs.h and is filled from the kernel's own counters,
+// so that a monitoring agent can collect host and process statistics
+// from the same file system.
+//
+
+#include <kern/host.h>
+#include <libkern/libkern.h>
+#include <mach/host_info.h>
+#include <mach/processor_info.h>
+#include <sys/kernel.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <vm/vm_pageout.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+
+#pragma mark -
+#pragma mark External References
+
+extern unsigned int processor_count;
+extern processor_t cpu_to_processor(int cpu);
+extern kern_return_t processor_info(processor_t processor, processor_flavor_t flavor, host_t *host,
+                                    processor_info_t info, mach_msg_type_number_t *count);
+extern kern_return_t host_statistics64(host_t host, host_flavor_t flavor, host_info64_t info, mach_msg_type_number_t *count);
+extern struct loadavg averunnable;
+extern unsigned int memorystatus_level;
+extern vm_pressure_level_t memorystatus_vm_pressure_level;
+
+#pragma mark -
+#pragma mark Host Statistics File Data
+
+/*
+ * Reads the data for the "cpuload" node. The data is the
+ * CPU tick counts for each processor. The entry for a processor
+ * whose counts cannot be read is all zeroes, so that the entry
+ * for each processor is always at the same offset.
+ */
+int
+procfs_read_cpuload_data(__unused procfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx) {
+    unsigned int count = processor_count;
+    size_t size = count * sizeof(struct processor_cpu_load_info);
+    struct processor_cpu_load_info *loads = (struct processor_cpu_load_info *)OSMalloc((uint32_t)size, procfs_osmalloc_tag);
+    if (loads == NULL) {
+        return ENOMEM;
+    }
+    bzero(loads, size);
+
+    for (unsigned int cpu = 0; cpu < count; cpu++) {
+        processor_t processor = cpu_to_processor(cpu);
+        if (processor != PROCESSOR_NULL) {
+            host_t host;
+            mach_msg_type_number_t info_count = PROCESSOR_CPU_LOAD_INFO_COUNT;
+            if (processor_info(processor, PROCESSOR_CPU_LOAD_INFO, &host, (processor_info_t)&loads[cpu], &info_count) != KERN_SUCCESS) {
+                bzero(&loads[cpu], sizeof(struct processor_cpu_load_info));
+            }
+        }
+    }
+
+    int error = procfs_copy_data((char *)loads, (int)size, uio);
+    OSFree(loads, (uint32_t)size, procfs_osmalloc_tag);
+    return error;
+}
+
+/*
+ * Reads the data for the "vmstat" node. The data is the
+ * host's virtual memory statistics.
+ */
+int
+procfs_read_vmstat_data(__unused procfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx) {
+    struct vm_statistics64 vmstat;
+    mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+
+    bzero(&vmstat, sizeof(vmstat));
+    if (host_statistics64(host_self(), HOST_VM_INFO64, (host_info64_t)&vmstat, &count) != KERN_SUCCESS) {
+        return EIO;
+    }
+    return procfs_copy_data((char *)&vmstat, sizeof(vmstat), uio);
+}
+
+/*
+ * Reads the data for the "loadavg" node. The data is the
+ * 1, 5 and 15 minute load averages.
+ */
+int
+procfs_read_loadavg_data(__unused procfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx) {
+    procfs_loadavg_t loadavg;
+
+    for (int i = 0; i < 3; i++) {
+        loadavg.pla_load[i] = averunnable.ldavg[i];
+    }
+    loadavg.pla_scale = (uint32_t)averunnable.fscale;
+    return procfs_copy_data((char *)&loadavg, sizeof(loadavg), uio);
+}
+
+/*
+ * Reads the data for the "mempressure" node. The data is the
+ * current memory pressure level and the percentage of memory
+ * that is available.
+ */
+int
+procfs_read_mempressure_data(__unused procfsnode_t *pnp, uio_t uio, __unused vfs_context_t ctx) {
+    procfs_mempressure_t pressure;
+
+    switch (memorystatus_vm_pressure_level) {
+    case kVMPressureWarning:
+        pressure.pmp_level = PROCFS_MEMPRESSURE_WARNING;
+        break;
+
+    case kVMPressureUrgent:
+        pressure.pmp_level = PROCFS_MEMPRESSURE_URGENT;
+        break;
+
+    case kVMPressureCritical:
+        pressure.pmp_level = PROCFS_MEMPRESSURE_CRITICAL;
+        break;
+
+    default:
+        pressure.pmp_level = PROCFS_MEMPRESSURE_NORMAL;
+        break;
+    }
+    pressure.pmp_available_percent = memorystatus_level;
+    return procfs_copy_data((char *)&pressure, sizeof(pressure), uio);
+}
+
+/*
+ * Gets the size of the "cpuload" node, which depends on the
+ * number of processors.
+ */
+size_t
+procfs_cpuload_node_size(__unused procfsnode_t *pnp, __unused kauth_cred_t creds) {
+    return processor_count * sizeof(struct processor_cpu_load_info);
+}
@@ -0,0 +1,513 @@
+//
+//  procfs_images.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Generates the content of the /proc/N/images file, which lists the
+// Mach-O images that a process has loaded, and of the /proc/images
+// file, which does the same for every visible process. The list of
+// images is maintained by dyld in the process's own address space, in
+// a dyld_all_image_infos structure whose address is recorded in the
+// task. The structure, the image paths and the Mach-O headers of the
+// images are all read from the process's memory.
+//
+
+#include <kern/clock.h>
+#include <libkern/libkern.h>
+#include <mach/mach_types.h>
+#include <mach/task_info.h>
+#include <mach/vm_param.h>
+#include <mach-o/loader.h>
+#include <sys/param.h>
+#include <sys/proc_info.h>
+#include <sys/proc_internal.h>
+#include <sys/uio.h>
+#include <sys/vnode.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// Rounds a record size up to the record alignment.
+#define PROCFS_IMAGES_ROUND(size) (((size) + 7) & ~(size_t)7)
+
+// Size of the buffer needed for the largest record.
+#define PROCFS_IMAGES_MAX_RECORD_SIZE PROCFS_IMAGES_ROUND(sizeof(procfs_image_t) + MAXPATHLEN)
+
+// Path length assumed for each image when estimating the size of a file.
+#define PROCFS_IMAGES_ESTIMATED_PATH_LEN 96
+
+// Number of images assumed for each process when estimating the size
+// of the file in the root directory.
+#define PROCFS_IMAGES_TYPICAL_COUNT 256
+
+// Estimated size of the record for one image.
+#define PROCFS_IMAGES_ESTIMATED_RECORD_SIZE PROCFS_IMAGES_ROUND(sizeof(procfs_image_t) + PROCFS_IMAGES_ESTIMATED_PATH_LEN)
+
+// Upper limits on the number of images and the size of the load
+// commands that are read, in case dyld's data is corrupt.
+#define PROCFS_IMAGES_MAX_COUNT 16384
+#define PROCFS_IMAGES_MAX_LOAD_COMMANDS_SIZE (64 * 1024)
+
+// Number of entries of the image info array that are read at once.
+#define PROCFS_IMAGES_BATCH_COUNT 64
+
+// dyld sets the image info array pointer to NULL while it is updating
+// the array. How many times to retry, and how long to wait in between.
+#define PROCFS_IMAGES_RETRY_COUNT 5
+#define PROCFS_IMAGES_RETRY_DELAY_USEC 100
+
+/*
+ * The leading fields of dyld's dyld_all_image_infos and dyld_image_info
+ * structures (see <mach-o/dyld_images.h>) in the 32- and 64-bit layouts.
+ */
+typedef struct {
+    uint32_t    version;
+    uint32_t    infoArrayCount;
+    uint32_t    infoArray;
+    uint32_t    notification;
+    uint8_t     processDetachedFromSharedRegion;
+    uint8_t     libSystemInitialized;
+    uint32_t    dyldImageLoadAddress;       // Version 2 and later.
+} procfs_dyld_all_image_infos_32_t;
+
+typedef struct {
+    uint32_t    version;
+    uint32_t    infoArrayCount;
+    uint64_t    infoArray;
+    uint64_t    notification;
+    uint8_t     processDetachedFromSharedRegion;
+    uint8_t     libSystemInitialized;
+    uint64_t    dyldImageLoadAddress;       // Version 2 and later.
+} procfs_dyld_all_image_infos_64_t;
+
+typedef struct {
+    uint32_t    imageLoadAddress;
+    uint32_t    imageFilePath;
+    uint32_t    imageFileModDate;
+} procfs_dyld_image_info_32_t;
+
+typedef struct {
+    uint64_t    imageLoadAddress;
+    uint64_t    imageFilePath;
+    uint64_t    imageFileModDate;
+} procfs_dyld_image_info_64_t;
+
+/*
+ * State for reading the images of one process.
+ */
+typedef struct {
+    task_t      pit_task;               // The process's task.
+    vm_map_t    pit_map;                // A reference to the task's VM map.
+    boolean_t   pit_is64;               // Whether dyld's structures use the 64-bit layout.
+    uint32_t    pit_count;              // Number of entries in the image info array.
+    uint64_t    pit_info_array;         // Address of the image info array.
+    uint64_t    pit_dyld_address;       // Load address of dyld, or 0 if not known.
+} procfs_images_task_t;
+
+/*
+ * State for writing records to a uio.
+ */
+typedef struct {
+    uio_t                   piw_uio;        // Destination.
+    off_t                   piw_offset;     // File offset of the next record.
+    procfs_image_t          *piw_record;    // Buffer for one record.
+    char                    *piw_commands;  // Buffer for load commands.
+} procfs_images_writer_t;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_images_open_task(proc_t p, procfs_images_task_t *itp);
+STATIC void procfs_images_close_task(procfs_images_task_t *itp);
+STATIC int procfs_images_write_process(proc_t p, procfs_images_writer_t *writer);
+STATIC int procfs_images_write_image(procfs_images_task_t *itp, pid_t pid, uint64_t load_address,
+                                     uint64_t path_address, procfs_images_writer_t *writer);
+STATIC void procfs_images_read_header(procfs_images_task_t *itp, uint64_t load_address,
+                                      char *commands, procfs_image_t *record);
+STATIC size_t procfs_images_read_string(vm_map_t map, uint64_t address, char *buffer, size_t size);
+STATIC size_t procfs_images_region_path(task_t task, uint64_t address, char *buffer, size_t size);
+STATIC int procfs_images_estimated_count(proc_t p);
+
+#pragma mark -
+#pragma mark External References
+
+extern kern_return_t task_info(task_t task, task_flavor_t flavor, task_info_t task_info_out, mach_msg_type_number_t *task_info_count);
+extern vm_map_t get_task_map_reference(task_t task);
+extern void vm_map_deallocate(vm_map_t map);
+extern kern_return_t vm_map_read_user(vm_map_t map, vm_map_address_t src_addr, void *dst_p, vm_size_t size);
+extern int fill_procregioninfo(task_t t, uint64_t arg, struct proc_regioninfo_internal *pinfo, uintptr_t *vp, uint32_t *vid);
+
+#pragma mark -
+#pragma mark Images File Data
+
+/*
+ * Reads the content of an images file. For the file in a process
+ * directory, the content is the images of that process. For the file
+ * in the root directory, it is the images of every process that is
+ * visible to the caller.
+ */
+int
+procfs_read_images_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    procfs_images_writer_t writer;
+    writer.piw_uio = uio;
+    writer.piw_offset = 0;
+    writer.piw_record = (procfs_image_t *)OSMalloc(PROCFS_IMAGES_MAX_RECORD_SIZE, procfs_osmalloc_tag);
+    writer.piw_commands = (char *)OSMalloc(PROCFS_IMAGES_MAX_LOAD_COMMANDS_SIZE, procfs_osmalloc_tag);
+
+    int error = 0;
+    if (writer.piw_record == NULL || writer.piw_commands == NULL) {
+        error = ENOMEM;
+    } else if (pnp->node_id.nodeid_pid != PRNODE_NO_PID) {
+        proc_t p = proc_find(pnp->node_id.nodeid_pid);
+        if (p != NULL) {
+            error = procfs_images_write_process(p, &writer);
+            proc_rele(p);
+        } else {
+            error = ESRCH;
+        }
+    } else {
+        int pid_count;
+        uint32_t pid_list_size;
+        pid_t *pid_list;
+        procfs_get_pids(&pid_list, &pid_count, &pid_list_size, procfs_get_access_check_creds(pnp, ctx));
+
+        for (int i = 0; i < pid_count && error == 0 && uio_resid(uio) > 0; i++) {
+            proc_t p = proc_find(pid_list[i]);
+            if (p == NULL) {
+                // Process disappeared.
+                continue;
+            }
+            error = procfs_images_write_process(p, &writer);
+            proc_rele(p);
+
+            // Skip processes whose images cannot be read or
+            // are being changed.
+            if (error == ESRCH || error == EAGAIN) {
+                error = 0;
+            }
+        }
+        procfs_release_pids(pid_list, pid_list_size);
+    }
+
+    if (writer.piw_record != NULL) {
+        OSFree(writer.piw_record, PROCFS_IMAGES_MAX_RECORD_SIZE, procfs_osmalloc_tag);
+    }
+    if (writer.piw_commands != NULL) {
+        OSFree(writer.piw_commands, PROCFS_IMAGES_MAX_LOAD_COMMANDS_SIZE, procfs_osmalloc_tag);
+    }
+    return error;
+}
+
+/*
+ * Gets the size of an images file. Reading every image header would
+ * cost nearly as much as generating the content, so the size of a
+ * process's file is an estimate based on the number of images that it
+ * has loaded. Examining every process for the file in the root directory
+ * would be too slow, so its size assumes PROCFS_IMAGES_TYPICAL_COUNT images
+ * for each visible process. The size is also the initial size of the buffer
+ * for a snapshot, so it should not be far too small, or the content would
+ * be generated several times over as the buffer grows.
+ */
+size_t
+procfs_images_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    size_t image_count = 0;
+    if (pnp->node_id.nodeid_pid == PRNODE_NO_PID) {
+        image_count = (size_t)procfs_get_process_count(procfs_get_size_check_creds(pnp, creds)) * PROCFS_IMAGES_TYPICAL_COUNT;
+    } else {
+        proc_t p = proc_find(pnp->node_id.nodeid_pid);
+        if (p != NULL) {
+            image_count = procfs_images_estimated_count(p);
+            proc_rele(p);
+        }
+    }
+    return image_count * PROCFS_IMAGES_ESTIMATED_RECORD_SIZE;
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Locates dyld's image information for a process and takes a reference
+ * on the process's VM map. Returns ENOENT if dyld has not registered its
+ * image information, or EAGAIN if dyld is updating the image list. On
+ * success, the caller must call procfs_images_close_task() when done.
+ */
+STATIC int
+procfs_images_open_task(proc_t p, procfs_images_task_t *itp) {
+    task_t task = proc_task(p);
+    if (task == NULL) {
+        return ESRCH;
+    }
+
+    struct task_dyld_info dyld_info;
+    mach_msg_type_number_t count = TASK_DYLD_INFO_COUNT;
+    if (task_info(task, TASK_DYLD_INFO, (task_info_t)&dyld_info, &count) != KERN_SUCCESS) {
+        return ESRCH;
+    }
+    if (dyld_info.all_image_info_addr == 0) {
+        return ENOENT;
+    }
+
+    vm_map_t map = get_task_map_reference(task);
+    if (map == NULL) {
+        return ESRCH;
+    }
+
+    bzero(itp, sizeof(procfs_images_task_t));
+    itp->pit_task = task;
+    itp->pit_map = map;
+    itp->pit_is64 = dyld_info.all_image_info_format == TASK_DYLD_ALL_IMAGE_INFO_64;
+
+    int error = EAGAIN;
+    for (int attempt = 0; attempt < PROCFS_IMAGES_RETRY_COUNT; attempt++) {
+        uint32_t version;
+        if (itp->pit_is64) {
+            procfs_dyld_all_image_infos_64_t infos;
+            if (vm_map_read_user(map, dyld_info.all_image_info_addr, &infos, sizeof(infos)) != KERN_SUCCESS) {
+                error = ESRCH;
+                break;
+            }
+            version = infos.version;
+            itp->pit_count = infos.infoArrayCount;
+            itp->pit_info_array = infos.infoArray;
+            itp->pit_dyld_address = infos.dyldImageLoadAddress;
+        } else {
+            procfs_dyld_all_image_infos_32_t infos;
+            if (vm_map_read_user(map, dyld_info.all_image_info_addr, &infos, sizeof(infos)) != KERN_SUCCESS) {
+                error = ESRCH;
+                break;
+            }
+            version = infos.version;
+            itp->pit_count = infos.infoArrayCount;
+            itp->pit_info_array = infos.infoArray;
+            itp->pit_dyld_address = infos.dyldImageLoadAddress;
+        }
+        if (version < 2) {
+            itp->pit_dyld_address = 0;
+        }
+
+        if (itp->pit_info_array != 0 || itp->pit_count == 0) {
+            itp->pit_count = min(itp->pit_count, PROCFS_IMAGES_MAX_COUNT);
+            error = 0;
+            break;
+        }
+        delay(PROCFS_IMAGES_RETRY_DELAY_USEC);
+    }
+
+    if (error != 0) {
+        vm_map_deallocate(map);
+    }
+    return error;
+}
+
+/*
+ * Releases the VM map reference taken by procfs_images_open_task().
+ */
+STATIC void
+procfs_images_close_task(procfs_images_task_t *itp) {
+    vm_map_deallocate(itp->pit_map);
+}
+
+/*
+ * Writes the records for all of the images of a process. A process
+ * for which dyld has not registered any images has no records.
+ */
+STATIC int
+procfs_images_write_process(proc_t p, procfs_images_writer_t *writer) {
+    procfs_images_task_t images_task;
+    int error = procfs_images_open_task(p, &images_task);
+    if (error != 0) {
+        return error == ENOENT ? 0 : error;
+    }
+
+    pid_t pid = proc_pid(p);
+    size_t entry_size = images_task.pit_is64 ? sizeof(procfs_dyld_image_info_64_t) : sizeof(procfs_dyld_image_info_32_t);
+    char entries[PROCFS_IMAGES_BATCH_COUNT * sizeof(procfs_dyld_image_info_64_t)];
+    for (uint32_t index = 0; index < images_task.pit_count && error == 0; index += PROCFS_IMAGES_BATCH_COUNT) {
+        uint32_t batch_count = min(images_task.pit_count - index, PROCFS_IMAGES_BATCH_COUNT);
+        if (vm_map_read_user(images_task.pit_map, images_task.pit_info_array + index * entry_size,
+                             entries, batch_count * entry_size) != KERN_SUCCESS) {
+            error = EAGAIN;
+            break;
+        }
+
+        for (uint32_t i = 0; i < batch_count && error == 0; i++) {
+            uint64_t load_address;
+            uint64_t path_address;
+            if (images_task.pit_is64) {
+                procfs_dyld_image_info_64_t *entry = &((procfs_dyld_image_info_64_t *)entries)[i];
+                load_address = entry->imageLoadAddress;
+                path_address = entry->imageFilePath;
+            } else {
+                procfs_dyld_image_info_32_t *entry = &((procfs_dyld_image_info_32_t *)entries)[i];
+                load_address = entry->imageLoadAddress;
+                path_address = entry->imageFilePath;
+            }
+            error = procfs_images_write_image(&images_task, pid, load_address, path_address, writer);
+        }
+    }
+
+    // dyld does not list itself in the image info array. Its path
+    // is obtained from the file that backs its mapping.
+    if (error == 0 && images_task.pit_dyld_address != 0) {
+        error = procfs_images_write_image(&images_task, pid, images_task.pit_dyld_address, 0, writer);
+    }
+
+    procfs_images_close_task(&images_task);
+    return error;
+}
+
+/*
+ * Writes the record for one image, given its load address and the
+ * address of its path in the process's memory. If the path address
+ * is 0, the path of the file that backs the image's mapping is used.
+ * Only the part of the record that is at or after the uio's offset
+ * is copied out.
+ */
+STATIC int
+procfs_images_write_image(procfs_images_task_t *itp, pid_t pid, uint64_t load_address,
+                          uint64_t path_address, procfs_images_writer_t *writer) {
+    uio_t uio = writer->piw_uio;
+    if (uio_resid(uio) <= 0) {
+        return 0;
+    }
+
+    procfs_image_t *record = writer->piw_record;
+    bzero(record, sizeof(procfs_image_t));
+    record->pim_pid = pid;
+    record->pim_load_address = load_address;
+    procfs_images_read_header(itp, load_address, writer->piw_commands, record);
+
+    // The path length includes the terminating null. Clear the padding.
+    size_t path_len = path_address != 0
+            ? procfs_images_read_string(itp->pit_map, path_address, record->pim_path, MAXPATHLEN)
+            : procfs_images_region_path(itp->pit_task, load_address, record->pim_path, MAXPATHLEN);
+    size_t size = PROCFS_IMAGES_ROUND(sizeof(procfs_image_t) + path_len);
+    bzero(record->pim_path + path_len, size - sizeof(procfs_image_t) - path_len);
+    record->pim_size = (uint32_t)size;
+
+    return procfs_copyout_record(record, size, &writer->piw_offset, uio);
+}
+
+/*
+ * Reads the Mach-O header and load commands of an image and sets the
+ * size of its __TEXT segment and its UUID in a record. If the header
+ * cannot be read or is not valid, those fields are left as zero.
+ */
+STATIC void
+procfs_images_read_header(procfs_images_task_t *itp, uint64_t load_address,
+                          char *commands, procfs_image_t *record) {
+    struct mach_header_64 header;
+    if (vm_map_read_user(itp->pit_map, load_address, &header, sizeof(header)) != KERN_SUCCESS) {
+        return;
+    }
+
+    size_t header_size;
+    if (header.magic == MH_MAGIC_64) {
+        header_size = sizeof(struct mach_header_64);
+    } else if (header.magic == MH_MAGIC) {
+        header_size = sizeof(struct mach_header);
+    } else {
+        return;
+    }
+    if (header.sizeofcmds > PROCFS_IMAGES_MAX_LOAD_COMMANDS_SIZE
+            || vm_map_read_user(itp->pit_map, load_address + header_size, commands, header.sizeofcmds) != KERN_SUCCESS) {
+        return;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < header.ncmds && offset + sizeof(struct load_command) <= header.sizeofcmds; i++) {
+        struct load_command *lc = (struct load_command *)(commands + offset);
+        if (lc->cmdsize < sizeof(struct load_command) || lc->cmdsize > header.sizeofcmds - offset) {
+            break;
+        }
+
+        if (lc->cmd == LC_UUID && lc->cmdsize >= sizeof(struct uuid_command)) {
+            bcopy(((struct uuid_command *)lc)->uuid, record->pim_uuid, PROCFS_IMAGE_UUID_SIZE);
+        } else if (lc->cmd == LC_SEGMENT_64 && lc->cmdsize >= sizeof(struct segment_command_64)) {
+            struct segment_command_64 *seg = (struct segment_command_64 *)lc;
+            if (strncmp(seg->segname, SEG_TEXT, sizeof(seg->segname)) == 0) {
+                record->pim_text_size = seg->vmsize;
+            }
+        } else if (lc->cmd == LC_SEGMENT && lc->cmdsize >= sizeof(struct segment_command)) {
+            struct segment_command *seg = (struct segment_command *)lc;
+            if (strncmp(seg->segname, SEG_TEXT, sizeof(seg->segname)) == 0) {
+                record->pim_text_size = seg->vmsize;
+            }
+        }
+        offset += lc->cmdsize;
+    }
+}
+
+/*
+ * Reads a null-terminated string from a process's memory into a buffer.
+ * The string is read a page at a time so that a string near the end of
+ * a mapping can be read. Returns the length of the string, including
+ * the terminating null, which is always 1 or more. If the string cannot
+ * be read, it is returned as empty.
+ */
+STATIC size_t
+procfs_images_read_string(vm_map_t map, uint64_t address, char *buffer, size_t size) {
+    size_t len = 0;
+    while (len < size - 1) {
+        size_t chunk = min(size - 1 - len, PAGE_SIZE - ((address + len) & PAGE_MASK));
+        if (vm_map_read_user(map, address + len, buffer + len, chunk) != KERN_SUCCESS) {
+            break;
+        }
+        size_t chunk_len = strnlen(buffer + len, chunk);
+        len += chunk_len;
+        if (chunk_len < chunk) {
+            break;
+        }
+    }
+    buffer[len] = (char)0;
+    return len + 1;
+}
+
+/*
+ * Gets the path of the file that backs the VM region that contains a
+ * given address. Returns the length of the path, including the
+ * terminating null. If there is no backing file, the path is empty.
+ */
+STATIC size_t
+procfs_images_region_path(task_t task, uint64_t address, char *buffer, size_t size) {
+    struct proc_regioninfo_internal info;
+    uintptr_t vnodeaddr = 0;
+    uint32_t vid = 0;
+    int len = 0;
+
+    if (fill_procregioninfo(task, address, &info, &vnodeaddr, &vid) != 0 && vnodeaddr != 0) {
+        vnode_t vp = (vnode_t)vnodeaddr;
+        if (vnode_getwithvid(vp, vid) == 0) {
+            len = (int)size;
+            if (vn_getpath(vp, buffer, &len) != 0) {
+                len = 0;
+            }
+            vnode_put(vp);
+        }
+    }
+    if (len == 0) {
+        buffer[0] = (char)0;
+        len = 1;
+    }
+    return (size_t)len;
+}
+
+/*
+ * Gets the number of images that dyld has registered for a process,
+ * plus one for dyld itself. Returns 0 if it cannot be determined.
+ */
+STATIC int
+procfs_images_estimated_count(proc_t p) {
+    procfs_images_task_t images_task;
+    if (procfs_images_open_task(p, &images_task) != 0) {
+        return 0;
+    }
+    int count = images_task.pit_count + (images_task.pit_dyld_address != 0 ? 1 : 0);
+    procfs_images_close_task(&images_task);
+    return count;
+}
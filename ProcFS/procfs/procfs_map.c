@@ -0,0 +1,295 @@
+//
+//  procfs_map.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Generates the content of the /proc/N/map file, which has one record
+// for each VM region of a process. A process can have a very large
+// number of regions, so the content is not held in memory. Instead,
+// records are generated from the task's VM map as they are read. To
+// avoid walking the map from the start on every read, the position
+// reached by each read through an open file is remembered in a small
+// cache of cursors, so that a read that continues where the previous
+// one left off resumes from the region at which it stopped. A read at
+// any other offset, or from within the kernel, starts from the
+// beginning of the map. A file's cursor is dropped when it is closed.
+//
+
+#include <kern/locks.h>
+#include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
+#include <sys/param.h>
+#include <sys/proc_info.h>
+#include <sys/proc_internal.h>
+#include <sys/uio.h>
+#include <sys/vnode.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// Number of cursors that are cached.
+#define PROCFS_MAP_CURSOR_COUNT 16
+
+// Rounds a record size up to the record alignment.
+#define PROCFS_MAP_ROUND(size) (((size) + 7) & ~(size_t)7)
+
+// Size of the buffer needed for the largest record.
+#define PROCFS_MAP_MAX_RECORD_SIZE PROCFS_MAP_ROUND(sizeof(procfs_map_region_t) + MAXPATHLEN)
+
+/*
+ * A position in the map file of a process, as reached by a read of
+ * that file through a given open file. pmc_record_offset is the file
+ * offset of the record for the region that starts at pmc_address, which
+ * is the first record that the previous read did not completely return.
+ */
+typedef struct {
+    int32_t             pmc_mnt_id;         // The mount...
+    procfsnode_id_t     pmc_node_id;        // ...and node that was read.
+    struct fileglob     *pmc_fglob;         // The open file. Used only as a key.
+    off_t               pmc_record_offset;  // File offset of the next record.
+    uint64_t            pmc_address;        // Start address of the region for that record.
+    uint64_t            pmc_last_used;      // Value of procfs_map_cursor_clock when last used.
+} procfs_map_cursor_t;
+
+#pragma mark -
+#pragma mark Local Data
+
+// Lock that protects the cursor cache.
+STATIC lck_grp_t *procfs_map_lck_grp;
+STATIC lck_mtx_t *procfs_map_mutex;
+
+// The cursor cache. An entry with pmc_last_used == 0 is not in use.
+STATIC procfs_map_cursor_t procfs_map_cursors[PROCFS_MAP_CURSOR_COUNT];
+
+// Counter used to find the least recently used cursor.
+STATIC uint64_t procfs_map_cursor_clock;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC boolean_t procfs_map_cursor_matches(procfs_map_cursor_t *cursor, procfsnode_t *pnp, struct fileglob *fg);
+STATIC void procfs_map_get_cursor(procfsnode_t *pnp, struct fileglob *fg, off_t offset,
+                                  off_t *record_offsetp, uint64_t *addressp);
+STATIC void procfs_map_save_cursor(procfsnode_t *pnp, struct fileglob *fg, off_t record_offset, uint64_t address);
+STATIC size_t procfs_map_fill_record(task_t task, uint64_t address, procfs_map_region_t *record, uint64_t *next_addressp);
+
+#pragma mark -
+#pragma mark External References
+
+extern int fill_procregioninfo(task_t t, uint64_t arg, struct proc_regioninfo_internal *pinfo, uintptr_t *vp, uint32_t *vid);
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the lock for the cursor cache. Called once when
+ * the file system is initialized.
+ */
+void
+procfs_map_init(void) {
+    procfs_map_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.map_locks", LCK_GRP_ATTR_NULL);
+    procfs_map_mutex = lck_mtx_alloc_init(procfs_map_lck_grp, LCK_ATTR_NULL);
+}
+
+#pragma mark -
+#pragma mark Map File Data
+
+/*
+ * Reads the content of a process's map file, starting at the offset in
+ * the uio. Records are generated one at a time, starting either from the
+ * cached cursor for the open file or from the start of the map, and
+ * records that end before the requested offset are skipped.
+ */
+int
+procfs_read_map_data(procfsnode_t *pnp, struct fileglob *fg, uio_t uio, __unused int ioflag, __unused vfs_context_t ctx) {
+    proc_t p = proc_find(pnp->node_id.nodeid_pid);
+    if (p == NULL) {
+        return ESRCH;
+    }
+    task_t task = proc_task(p);
+
+    procfs_map_region_t *record = (procfs_map_region_t *)OSMalloc(PROCFS_MAP_MAX_RECORD_SIZE, procfs_osmalloc_tag);
+    if (record == NULL) {
+        proc_rele(p);
+        return ENOMEM;
+    }
+
+    off_t offset = uio_offset(uio);
+    off_t record_offset;
+    uint64_t address;
+    procfs_map_get_cursor(pnp, fg, offset, &record_offset, &address);
+
+    int error = 0;
+    while (error == 0 && uio_resid(uio) > 0) {
+        uint64_t next_address;
+        size_t size = task == NULL ? 0 : procfs_map_fill_record(task, address, record, &next_address);
+        if (size == 0) {
+            // No more regions.
+            break;
+        }
+
+        off_t next_record_offset = record_offset;
+        error = procfs_copyout_record(record, size, &next_record_offset, uio);
+        if (uio_offset(uio) < next_record_offset) {
+            // The record did not fit. The next read starts with it.
+            break;
+        }
+        record_offset = next_record_offset;
+        address = next_address;
+    }
+
+    if (fg != NULL) {
+        procfs_map_save_cursor(pnp, fg, record_offset, address);
+    }
+    OSFree(record, PROCFS_MAP_MAX_RECORD_SIZE, procfs_osmalloc_tag);
+    proc_rele(p);
+
+    return error;
+}
+
+/*
+ * Drops the cursor of an open file of a map node that is being closed,
+ * or of every open file of the node if "fg" is NULL.
+ */
+void
+procfs_map_close(procfsnode_t *pnp, struct fileglob *fg) {
+    lck_mtx_lock(procfs_map_mutex);
+    for (int i = 0; i < PROCFS_MAP_CURSOR_COUNT; i++) {
+        procfs_map_cursor_t *cursor = &procfs_map_cursors[i];
+        if (procfs_map_cursor_matches(cursor, pnp, fg)) {
+            cursor->pmc_last_used = 0;
+        }
+    }
+    lck_mtx_unlock(procfs_map_mutex);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Determines whether a cursor is in use for a given node and open file.
+ * A NULL "fg" matches any open file. Must be called with the cursor
+ * cache lock held.
+ */
+STATIC boolean_t
+procfs_map_cursor_matches(procfs_map_cursor_t *cursor, procfsnode_t *pnp, struct fileglob *fg) {
+    return cursor->pmc_last_used != 0 && cursor->pmc_mnt_id == pnp->node_mnt_id
+                && (fg == NULL || cursor->pmc_fglob == fg)
+                && cursor->pmc_node_id.nodeid_pid == pnp->node_id.nodeid_pid
+                && cursor->pmc_node_id.nodeid_base_id == pnp->node_id.nodeid_base_id;
+}
+
+/*
+ * Gets the position from which to start generating records to satisfy
+ * a read at a given offset. This is the cached cursor for the node and
+ * open file, if there is one that is not beyond the offset. Otherwise,
+ * it is the start of the file.
+ */
+STATIC void
+procfs_map_get_cursor(procfsnode_t *pnp, struct fileglob *fg, off_t offset,
+                      off_t *record_offsetp, uint64_t *addressp) {
+    *record_offsetp = 0;
+    *addressp = 0;
+    if (offset == 0 || fg == NULL) {
+        return;
+    }
+
+    lck_mtx_lock(procfs_map_mutex);
+    for (int i = 0; i < PROCFS_MAP_CURSOR_COUNT; i++) {
+        procfs_map_cursor_t *cursor = &procfs_map_cursors[i];
+        if (procfs_map_cursor_matches(cursor, pnp, fg) && cursor->pmc_record_offset <= offset) {
+            *record_offsetp = cursor->pmc_record_offset;
+            *addressp = cursor->pmc_address;
+            cursor->pmc_last_used = ++procfs_map_cursor_clock;
+            break;
+        }
+    }
+    lck_mtx_unlock(procfs_map_mutex);
+}
+
+/*
+ * Saves the position reached by a read, replacing any existing cursor for
+ * the same node and open file or, if there is none, the least recently
+ * used one.
+ */
+STATIC void
+procfs_map_save_cursor(procfsnode_t *pnp, struct fileglob *fg, off_t record_offset, uint64_t address) {
+    lck_mtx_lock(procfs_map_mutex);
+    procfs_map_cursor_t *target = &procfs_map_cursors[0];
+    for (int i = 0; i < PROCFS_MAP_CURSOR_COUNT; i++) {
+        procfs_map_cursor_t *cursor = &procfs_map_cursors[i];
+        if (procfs_map_cursor_matches(cursor, pnp, fg)) {
+            target = cursor;
+            break;
+        }
+        if (cursor->pmc_last_used < target->pmc_last_used) {
+            target = cursor;
+        }
+    }
+
+    target->pmc_mnt_id = pnp->node_mnt_id;
+    target->pmc_node_id = pnp->node_id;
+    target->pmc_fglob = fg;
+    target->pmc_record_offset = record_offset;
+    target->pmc_address = address;
+    target->pmc_last_used = ++procfs_map_cursor_clock;
+    lck_mtx_unlock(procfs_map_mutex);
+}
+
+/*
+ * Fills a record for the first VM region of a task that ends after
+ * a given address and gets the address from which to look for the
+ * next region. Returns the size of the record, or 0 if there are no
+ * more regions.
+ */
+STATIC size_t
+procfs_map_fill_record(task_t task, uint64_t address, procfs_map_region_t *record, uint64_t *next_addressp) {
+    struct proc_regioninfo_internal info;
+    uintptr_t vnodeaddr = 0;
+    uint32_t vid = 0;
+
+    if (fill_procregioninfo(task, address, &info, &vnodeaddr, &vid) == 0) {
+        return 0;
+    }
+
+    bzero(record, sizeof(procfs_map_region_t));
+    record->pmr_protection = info.pri_protection;
+    record->pmr_max_protection = info.pri_max_protection;
+    record->pmr_share_mode = info.pri_share_mode;
+    record->pmr_start = info.pri_address;
+    record->pmr_end = info.pri_address + info.pri_size;
+    record->pmr_offset = info.pri_offset;
+    record->pmr_resident_pages = info.pri_pages_resident;
+    record->pmr_dirty_pages = info.pri_pages_dirtied;
+    record->pmr_user_tag = info.pri_user_tag;
+
+    // Get the path of the backing file, if there is one.
+    int path_len = 0;
+    if (vnodeaddr != 0) {
+        vnode_t vp = (vnode_t)vnodeaddr;
+        if (vnode_getwithvid(vp, vid) == 0) {
+            path_len = MAXPATHLEN;
+            if (vn_getpath(vp, record->pmr_path, &path_len) != 0) {
+                path_len = 0;
+            }
+            vnode_put(vp);
+        }
+    }
+    if (path_len == 0) {
+        // Empty path.
+        path_len = 1;
+    }
+
+    // The path length includes the terminating null. Clear the padding.
+    size_t size = PROCFS_MAP_ROUND(sizeof(procfs_map_region_t) + path_len);
+    bzero(record->pmr_path + path_len, size - sizeof(procfs_map_region_t) - path_len);
+    record->pmr_path[path_len - 1] = (char)0;
+    record->pmr_size = (uint32_t)size;
+
+    *next_addressp = record->pmr_end;
+    return size;
+}
@@ -0,0 +1,385 @@
+//
+//  procfs_notify.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Delivery of kqueue EVFILT_VNODE notifications for procfs nodes.
+// Nothing is done unless at least one node is being monitored. When
+// a process is created or exits, the directories that list processes,
+// such as the root and "byname" directories, and the events file get
+// NOTE_WRITE and NOTE_EXTEND. When a process
+// exits, all of its vnodes get NOTE_DELETE and are recycled, so that
+// their monitors are also revoked. This work is done on a thread call
+// that consumes the process event ring, so that it is never done in
+// the context of the process that is forking or exiting. There are no
+// hooks for thread creation or for opening and closing files, so the
+// "threads" and "fd" directories that are being monitored are polled
+// for changes at a fixed interval.
+//
+
+#include <kern/clock.h>
+#include <kern/locks.h>
+#include <kern/thread_call.h>
+#include <libkern/OSAtomic.h>
+#include <sys/file_internal.h>
+#include <sys/filedesc.h>
+#include <sys/proc_internal.h>
+#include <sys/vnode.h>
+#include "procfsnode.h"
+#include "procfs_events.h"
+#include "procfs_notify.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// Interval at which monitored "threads" and "fd" directories are
+// checked for changes.
+#define PROCFS_NOTIFY_POLL_INTERVAL_MS 1000
+
+// The dynamic content of a directory, as determined by the
+// type of its last structure child.
+typedef enum {
+    PROCFS_DIR_CONTENT_NONE = 0,    // Not a directory, or no dynamic content.
+    PROCFS_DIR_CONTENT_PROCESSES,   // One entry per process.
+    PROCFS_DIR_CONTENT_THREADS,     // One entry per thread of a process.
+    PROCFS_DIR_CONTENT_FILES,       // One entry per open file of a process.
+} procfs_dir_content_t;
+
+#pragma mark -
+#pragma mark Local Data
+
+// Lock that serializes the thread calls and protects the
+// procfs_notify_cursor and node_content_signature fields.
+STATIC lck_grp_t *procfs_notify_lck_grp;
+STATIC lck_mtx_t *procfs_notify_mutex;
+
+// Thread calls that handle process events and poll directories.
+STATIC thread_call_t procfs_notify_event_call;
+STATIC thread_call_t procfs_notify_poll_call;
+
+// Total number of monitors on all nodes, and the number of those
+// that are on directories that have to be polled.
+STATIC SInt32 procfs_notify_monitor_count;
+STATIC SInt32 procfs_notify_poll_count;
+
+// Sequence number of the next process event to be handled.
+STATIC uint64_t procfs_notify_cursor;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC void procfs_notify_event_call_fn(thread_call_param_t param0, thread_call_param_t param1);
+STATIC void procfs_notify_poll_call_fn(thread_call_param_t param0, thread_call_param_t param1);
+STATIC void procfs_notify_schedule_poll(void);
+STATIC boolean_t procfs_notify_release_monitor(procfsnode_t *pnp);
+STATIC boolean_t procfs_notify_pid_reused(procfs_event_t *event);
+STATIC procfs_dir_content_t procfs_notify_dir_content(procfs_structure_node_t *snode);
+STATIC uint64_t procfs_notify_content_signature(procfsnode_t *pnp);
+STATIC boolean_t procfs_notify_match_pid(procfsnode_t *pnp, void *arg);
+STATIC boolean_t procfs_notify_match_changed(procfsnode_t *pnp, void *arg);
+STATIC boolean_t procfs_notify_match_polled(procfsnode_t *pnp, void *arg);
+STATIC void procfs_notify_exited(vnode_t vp, void *arg);
+STATIC void procfs_notify_changed(vnode_t vp, void *arg);
+STATIC void procfs_notify_poll(vnode_t vp, void *arg);
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the lock and thread calls. Called once when the
+ * file system is initialized.
+ */
+void
+procfs_notify_init(void) {
+    procfs_notify_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.notify_locks", LCK_GRP_ATTR_NULL);
+    procfs_notify_mutex = lck_mtx_alloc_init(procfs_notify_lck_grp, LCK_ATTR_NULL);
+    procfs_notify_event_call = thread_call_allocate(procfs_notify_event_call_fn, NULL);
+    procfs_notify_poll_call = thread_call_allocate(procfs_notify_poll_call_fn, NULL);
+}
+
+#pragma mark -
+#pragma mark Monitoring
+
+/*
+ * Records the start or end of monitoring of a node by a kqueue filter.
+ * Called from VNOP_MONITOR and when a monitored node is reclaimed.
+ */
+void
+procfs_notify_monitor(procfsnode_t *pnp, boolean_t begin) {
+    boolean_t polled = procfs_notify_dir_content(pnp->node_structure_node) == PROCFS_DIR_CONTENT_THREADS
+                    || procfs_notify_dir_content(pnp->node_structure_node) == PROCFS_DIR_CONTENT_FILES;
+
+    if (begin) {
+        OSIncrementAtomic(&pnp->node_monitor_count);
+        if (OSIncrementAtomic(&procfs_notify_monitor_count) == 0) {
+            // Nothing was being monitored, so skip any events that
+            // happened before now.
+            procfs_event_t event;
+            lck_mtx_lock(procfs_notify_mutex);
+            while (procfs_events_next_internal(&procfs_notify_cursor, &event)) {
+                continue;
+            }
+            lck_mtx_unlock(procfs_notify_mutex);
+        }
+        if (polled) {
+            lck_mtx_lock(procfs_notify_mutex);
+            pnp->node_content_signature = procfs_notify_content_signature(pnp);
+            lck_mtx_unlock(procfs_notify_mutex);
+            if (OSIncrementAtomic(&procfs_notify_poll_count) == 0) {
+                procfs_notify_schedule_poll();
+            }
+        }
+    } else if (procfs_notify_release_monitor(pnp)) {
+        // The poll thread call stops rescheduling itself when the poll
+        // count reaches zero.
+        OSDecrementAtomic(&procfs_notify_monitor_count);
+        if (polled) {
+            OSDecrementAtomic(&procfs_notify_poll_count);
+        }
+    }
+}
+
+/*
+ * Decrements the monitor count of a node unless it is already zero.
+ * VNOP_MONITOR and the reclaim of the node can race to release the
+ * last monitor, so the test and the decrement must be one atomic step.
+ * Returns TRUE if the count was decremented.
+ */
+STATIC boolean_t
+procfs_notify_release_monitor(procfsnode_t *pnp) {
+    SInt32 count;
+    do {
+        count = pnp->node_monitor_count;
+        if (count <= 0) {
+            return FALSE;
+        }
+    } while (!OSCompareAndSwap((UInt32)count, (UInt32)(count - 1), (volatile UInt32 *)&pnp->node_monitor_count));
+    return TRUE;
+}
+
+/*
+ * Releases all of the monitors on a node that is being reclaimed.
+ * The filters are detached after the vnode has been reclaimed, so
+ * we will not see VNOP_MONITOR calls for them.
+ */
+void
+procfs_notify_reclaim(procfsnode_t *pnp) {
+    while (pnp->node_monitor_count > 0) {
+        procfs_notify_monitor(pnp, FALSE);
+    }
+}
+
+/*
+ * Called after a process event has been recorded. If anything is
+ * being monitored, schedules the thread call that posts notifications.
+ */
+void
+procfs_notify_process_event(void) {
+    if (procfs_notify_monitor_count > 0) {
+        thread_call_enter(procfs_notify_event_call);
+    }
+}
+
+#pragma mark -
+#pragma mark Thread Calls
+
+/*
+ * Handles the process events that have been recorded since the
+ * last call.
+ */
+STATIC void
+procfs_notify_event_call_fn(__unused thread_call_param_t param0, __unused thread_call_param_t param1) {
+    boolean_t any_event = FALSE;
+    boolean_t process_list_changed = FALSE;
+    procfs_event_t event;
+
+    lck_mtx_lock(procfs_notify_mutex);
+    while (procfs_events_next_internal(&procfs_notify_cursor, &event)) {
+        any_event = TRUE;
+        if (event.pe_type == PROCFS_EVENT_FORK || event.pe_type == PROCFS_EVENT_EXIT) {
+            process_list_changed = TRUE;
+        }
+        if (event.pe_type == PROCFS_EVENT_EXIT && !procfs_notify_pid_reused(&event)) {
+            pid_t pid = event.pe_pid;
+            procfsnode_iterate(procfs_notify_match_pid, procfs_notify_exited, &pid);
+        }
+    }
+    lck_mtx_unlock(procfs_notify_mutex);
+
+    if (any_event) {
+        procfsnode_iterate(procfs_notify_match_changed, procfs_notify_changed, &process_list_changed);
+    }
+}
+
+/*
+ * Checks whether the content of any monitored "threads" or "fd"
+ * directory has changed and reschedules itself if any are still
+ * being monitored.
+ */
+STATIC void
+procfs_notify_poll_call_fn(__unused thread_call_param_t param0, __unused thread_call_param_t param1) {
+    lck_mtx_lock(procfs_notify_mutex);
+    procfsnode_iterate(procfs_notify_match_polled, procfs_notify_poll, NULL);
+    lck_mtx_unlock(procfs_notify_mutex);
+
+    if (procfs_notify_poll_count > 0) {
+        procfs_notify_schedule_poll();
+    }
+}
+
+#pragma mark -
+#pragma mark Node Matching and Notification
+
+// Matches all nodes that belong to a given process.
+STATIC boolean_t
+procfs_notify_match_pid(procfsnode_t *pnp, void *arg) {
+    return pnp->node_id.nodeid_pid == *(pid_t *)arg;
+}
+
+// Matches monitored nodes whose content changes when process events
+// occur: the events file and, if "arg" points to TRUE because a process
+// was created or exited, the directories that list processes.
+STATIC boolean_t
+procfs_notify_match_changed(procfsnode_t *pnp, void *arg) {
+    procfs_structure_node_t *snode = pnp->node_structure_node;
+    boolean_t process_list_changed = *(boolean_t *)arg;
+    return pnp->node_monitor_count > 0
+            && ((snode->psn_flags & PSN_FLAG_STREAM) != 0
+                || (process_list_changed && procfs_notify_dir_content(snode) == PROCFS_DIR_CONTENT_PROCESSES));
+}
+
+// Matches monitored directories whose content has to be polled.
+STATIC boolean_t
+procfs_notify_match_polled(procfsnode_t *pnp, __unused void *arg) {
+    procfs_dir_content_t content = procfs_notify_dir_content(pnp->node_structure_node);
+    return pnp->node_monitor_count > 0
+            && (content == PROCFS_DIR_CONTENT_THREADS || content == PROCFS_DIR_CONTENT_FILES);
+}
+
+// Notifies watchers that the process for a vnode has gone and
+// recycles the vnode, which revokes any remaining monitors.
+STATIC void
+procfs_notify_exited(vnode_t vp, __unused void *arg) {
+    vnode_notify(vp, VNODE_EVENT_DELETE, NULL);
+    vnode_recycle(vp);
+}
+
+// Notifies watchers that the content of a vnode has changed.
+STATIC void
+procfs_notify_changed(vnode_t vp, __unused void *arg) {
+    vnode_notify(vp, VNODE_EVENT_WRITE | VNODE_EVENT_EXTEND, NULL);
+}
+
+// Checks whether the content of a polled directory has changed
+// and notifies watchers if it has. Called with the notify lock held.
+STATIC void
+procfs_notify_poll(vnode_t vp, __unused void *arg) {
+    procfsnode_t *pnp = vnode_to_procfsnode(vp);
+    uint64_t signature = procfs_notify_content_signature(pnp);
+    if (signature != pnp->node_content_signature) {
+        pnp->node_content_signature = signature;
+        procfs_notify_changed(vp, NULL);
+    }
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+// Schedules the next poll of monitored directories.
+STATIC void
+procfs_notify_schedule_poll(void) {
+    uint64_t deadline;
+    clock_interval_to_deadline(PROCFS_NOTIFY_POLL_INTERVAL_MS, kMillisecondScale, &deadline);
+    thread_call_enter_delayed(procfs_notify_poll_call, deadline);
+}
+
+/*
+ * Determines whether the process id from an exit event has already
+ * been reused by a new process, in which case the nodes for that
+ * process id belong to the new process and must be left alone.
+ */
+STATIC boolean_t
+procfs_notify_pid_reused(procfs_event_t *event) {
+    boolean_t reused = FALSE;
+    proc_t p = proc_find(event->pe_pid);
+    if (p != NULL) {
+        uint64_t start_time = (uint64_t)p->p_start.tv_sec * USEC_PER_SEC + p->p_start.tv_usec;
+        reused = start_time > event->pe_timestamp;
+        proc_rele(p);
+    }
+    return reused;
+}
+
+/*
+ * Gets the type of dynamic content of a directory node. The entries
+ * that expand to dynamic content are always the last child of their
+ * parent directory.
+ */
+STATIC procfs_dir_content_t
+procfs_notify_dir_content(procfs_structure_node_t *snode) {
+    procfs_structure_node_t *last_child = TAILQ_LAST(&snode->psn_children, procfs_structure_children);
+    if (last_child != NULL) {
+        switch (last_child->psn_node_type) {
+        case PROCFS_PROCDIR:        // FALLTHRU
+        case PROCFS_PROCNAME_DIR:   // FALLTHRU
+        case PROCFS_PROCLINK:
+            return PROCFS_DIR_CONTENT_PROCESSES;
+
+        case PROCFS_THREADDIR:
+            return PROCFS_DIR_CONTENT_THREADS;
+
+        case PROCFS_FD_DIR:
+            return PROCFS_DIR_CONTENT_FILES;
+
+        default:
+            break;
+        }
+    }
+    return PROCFS_DIR_CONTENT_NONE;
+}
+
+/*
+ * Gets a value that changes when the set of entries in a "threads"
+ * or "fd" directory changes. Returns 0 if the process has gone.
+ */
+STATIC uint64_t
+procfs_notify_content_signature(procfsnode_t *pnp) {
+    uint64_t signature = 0;
+    proc_t p = proc_find(pnp->node_id.nodeid_pid);
+    if (p != NULL) {
+        switch (procfs_notify_dir_content(pnp->node_structure_node)) {
+        case PROCFS_DIR_CONTENT_THREADS: {
+            uint64_t *thread_ids;
+            int thread_count;
+            task_t task = proc_task(p);
+            if (task != NULL && procfs_get_thread_ids_for_task(task, &thread_ids, &thread_count) == 0) {
+                for (int i = 0; i < thread_count; i++) {
+                    signature = signature * 31 + thread_ids[i];
+                }
+                procfs_release_thread_ids(thread_ids, thread_count);
+            }
+            break;
+        }
+
+        case PROCFS_DIR_CONTENT_FILES: {
+            struct filedesc *fdp = p->p_fd;
+            proc_fdlock_spin(p);
+            for (int i = 0; i < fdp->fd_nfiles; i++) {
+                struct fileproc *fp = fdp->fd_ofiles[i];
+                if (fp != NULL && !(fdp->fd_ofileflags[i] & UF_RESERVED)) {
+                    signature = signature * 31 + i + 1;
+                }
+            }
+            proc_fdunlock(p);
+            break;
+        }
+
+        default:
+            break;
+        }
+        proc_rele(p);
+    }
+    return signature;
+}
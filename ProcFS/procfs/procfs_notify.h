@@ -0,0 +1,21 @@
+//
+//  procfs_notify.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_notify_h
+#define procfs_notify_h
+
+#include <sys/kernel_types.h>
+
+typedef struct procfsnode procfsnode_t;
+
+extern void procfs_notify_init(void);
+extern void procfs_notify_monitor(procfsnode_t *pnp, boolean_t begin);
+extern void procfs_notify_reclaim(procfsnode_t *pnp);
+extern void procfs_notify_process_event(void);
+
+#endif /* procfs_notify_h */
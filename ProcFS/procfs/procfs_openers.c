@@ -0,0 +1,217 @@
+//
+//  procfs_openers.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Generates the content of the files in the /proc/openers directory.
+// The name of each file is the file id of a vnode and its content is a
+// list of the process ids and file descriptors that refer to files with
+// that id. The list is built in a single pass over the file tables of
+// the processes that are visible to the caller, which is much cheaper
+// than reading the "details" file for every open file descriptor.
+// Finding the matching descriptors costs as much as reading the file, so
+// the size of a file is an estimate that allows for one descriptor in
+// each visible process.
+//
+
+#include <libkern/libkern.h>
+#include <sys/file_internal.h>
+#include <sys/proc_internal.h>
+#include <sys/uio_internal.h>
+#include <sys/vnode.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The number of entries in the cache of vnodes that have already been
+// examined during a single read. This *MUST* be a power of two.
+#define PROCFS_OPENERS_VNODE_CACHE_SIZE 64
+
+// Gets the cache slot for a vnode.
+#define PROCFS_OPENERS_VNODE_SLOT(vp) ((((uintptr_t)(vp)) >> 6) & (PROCFS_OPENERS_VNODE_CACHE_SIZE - 1))
+
+/*
+ * Records whether a vnode has the file id that is being searched for.
+ * Many descriptors refer to the same few vnodes, so this saves fetching
+ * the attributes of those vnodes over and over again.
+ */
+typedef struct procfs_openers_vnode {
+    vnode_t     pov_vnode;      // The vnode, or NULL if the slot is empty.
+    uint32_t    pov_vid;        // The vnode's id.
+    uint32_t    pov_dev;        // The file system device, if it matched.
+    boolean_t   pov_match;      // Whether the vnode's file id matched.
+} procfs_openers_vnode_t;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC boolean_t procfs_openers_is_vnode(proc_t p, int fd);
+STATIC boolean_t procfs_openers_check_vnode(vnode_t vp, uint32_t vid, uint64_t fileid,
+                        procfs_openers_vnode_t *cache, uint32_t *devp, vfs_context_t ctx);
+
+#pragma mark -
+#pragma mark Openers File Name Parsing
+
+/*
+ * Parses the name of a file in the openers directory, which must be a
+ * non-zero decimal file id with no leading zeros. On success, the object
+ * id is set to the file id.
+ */
+int
+procfs_parse_openers_name(const char *name, uint64_t *objectidp) {
+    uint64_t fileid;
+    if (procfs_parse_decimal(name, UINT64_MAX, &fileid) != 0 || fileid == 0) {
+        return ENOENT;
+    }
+    *objectidp = fileid;
+    return 0;
+}
+
+#pragma mark -
+#pragma mark Openers File Data
+
+/*
+ * Reads the content of an openers file. The file id comes from the
+ * node's object id. One record is written for each file descriptor of
+ * each visible process that refers to a vnode with that file id.
+ */
+int
+procfs_read_openers_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    uint64_t fileid = pnp->node_id.nodeid_objectid;
+    int pid_count;
+    uint32_t pid_list_size;
+    pid_t *pid_list;
+    procfs_get_pids(&pid_list, &pid_count, &pid_list_size, procfs_get_access_check_creds(pnp, ctx));
+
+    size_t cache_size = PROCFS_OPENERS_VNODE_CACHE_SIZE * sizeof(procfs_openers_vnode_t);
+    procfs_openers_vnode_t *cache = (procfs_openers_vnode_t *)OSMalloc((uint32_t)cache_size, procfs_osmalloc_tag);
+    if (cache == NULL) {
+        procfs_release_pids(pid_list, pid_list_size);
+        return ENOMEM;
+    }
+    bzero(cache, cache_size);
+
+    int error = 0;
+    off_t offset = 0;
+    for (int i = 0; i < pid_count && error == 0 && uio_resid(uio) > 0; i++) {
+        proc_t p = proc_find(pid_list[i]);
+        if (p == NULL) {
+            // Process disappeared.
+            continue;
+        }
+
+        struct filedesc *fdp = p->p_fd;
+        for (int fd = 0; fd < fdp->fd_nfiles && error == 0 && uio_resid(uio) > 0; fd++) {
+            if (!procfs_openers_is_vnode(p, fd)) {
+                continue;
+            }
+
+            // Get the vnode, vnode id and fileproc structure for the file.
+            // This fails if the descriptor was closed or reused since we
+            // checked it.
+            struct fileproc *fp;
+            vnode_t vp;
+            uint32_t vid;
+            if (fp_getfvpandvid(p, fd, &fp, &vp, &vid) != 0) {
+                continue;
+            }
+
+            uint32_t dev;
+            boolean_t match = procfs_openers_check_vnode(vp, vid, fileid, cache, &dev, ctx);
+            if (match) {
+                procfs_opener_t record;
+                bzero(&record, sizeof(record));
+                record.poe_pid = pid_list[i];
+                record.poe_fd = fd;
+                record.poe_dev = dev;
+                record.poe_flags = (uint32_t)fp->f_fglob->fg_flag;
+                record.poe_fileid = fileid;
+                error = procfs_copyout_record(&record, sizeof(record), &offset, uio);
+            }
+            fp_drop(p, fd, fp, FALSE);
+        }
+        proc_rele(p);
+    }
+
+    OSFree(cache, (uint32_t)cache_size, procfs_osmalloc_tag);
+    procfs_release_pids(pid_list, pid_list_size);
+    return error;
+}
+
+/*
+ * Gets the size of an openers file, which is estimated from the number
+ * of visible processes. The size is also the initial size of the buffer
+ * for a snapshot, so an estimate that is too small would cause the file
+ * tables to be scanned again each time the buffer grows.
+ */
+size_t
+procfs_openers_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    return procfs_get_process_count(procfs_get_size_check_creds(pnp, creds)) * sizeof(procfs_opener_t);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Determines whether a file descriptor of a process refers to a vnode.
+ * This is a cheap check that allows descriptors of other types to be
+ * skipped without taking a reference on them.
+ */
+STATIC boolean_t
+procfs_openers_is_vnode(proc_t p, int fd) {
+    struct filedesc *fdp = p->p_fd;
+    boolean_t is_vnode = FALSE;
+    proc_fdlock_spin(p);
+    if (fd < fdp->fd_nfiles) {
+        struct fileproc *fp = fdp->fd_ofiles[fd];
+        is_vnode = fp != NULL && !(fdp->fd_ofileflags[fd] & UF_RESERVED)
+                && FILEGLOB_DTYPE(fp->f_fglob) == DTYPE_VNODE;
+    }
+    proc_fdunlock(p);
+    return is_vnode;
+}
+
+/*
+ * Determines whether a vnode has a given file id. If it does, the
+ * device of its file system is stored through devp. The result is
+ * taken from the cache if the vnode has already been checked during
+ * this read. Otherwise, the vnode's attributes are fetched and the
+ * result is added to the cache.
+ */
+STATIC boolean_t
+procfs_openers_check_vnode(vnode_t vp, uint32_t vid, uint64_t fileid,
+                           procfs_openers_vnode_t *cache, uint32_t *devp, vfs_context_t ctx) {
+    procfs_openers_vnode_t *slot = &cache[PROCFS_OPENERS_VNODE_SLOT(vp)];
+    if (slot->pov_vnode == vp && slot->pov_vid == vid) {
+        *devp = slot->pov_dev;
+        return slot->pov_match;
+    }
+
+    // Get a hold on the vnode, checking that it did not change id,
+    // and fetch its file id and file system device.
+    boolean_t match = FALSE;
+    uint32_t dev = 0;
+    if (vnode_getwithvid(vp, vid) != 0) {
+        return FALSE;
+    }
+    struct vnode_attr va;
+    VATTR_INIT(&va);
+    VATTR_WANTED(&va, va_fileid);
+    VATTR_WANTED(&va, va_fsid);
+    if (vnode_getattr(vp, &va, ctx) == 0 && VATTR_IS_SUPPORTED(&va, va_fileid)) {
+        match = va.va_fileid == fileid;
+        dev = (uint32_t)va.va_fsid;
+    }
+    vnode_put(vp);
+
+    slot->pov_vnode = vp;
+    slot->pov_vid = vid;
+    slot->pov_dev = dev;
+    slot->pov_match = match;
+    *devp = dev;
+    return match;
+}
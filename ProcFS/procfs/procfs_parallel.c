@@ -0,0 +1,352 @@
+//
+//  procfs_parallel.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Spreads the generation of files that cover every process over several
+// processors. The caller's items, which are usually process ids, are
+// divided into shards of PROCFS_PARALLEL_SHARD_SIZE items that are
+// processed by the calling thread together with a pool of kernel worker
+// threads, one fewer than the number of processors. The workers are
+// started when the first job is run.
+//
+// Each participant in a job starts with an equal, contiguous range of
+// shards and takes shards from the front of its own range. When its
+// range is empty, it steals the back half of the largest range that
+// another participant has left. A worker that is slow to wake up, or that
+// gets processes that are expensive to examine, therefore does not hold up
+// the job. Each shard writes its results to locations that depend only on
+// the item indices, so the caller finds them in item order whichever
+// thread processed them.
+//
+// Only one job uses the workers at a time. If another job is running or
+// there are too few items to be worth sharing, the caller processes all
+// of the items itself.
+//
+// The number of workers that a job may use is set by the
+// vfs.procfs.parallel.max_workers sysctl. Setting it to 0 disables
+// parallel generation. Counts of jobs, shards and steals are published
+// under vfs.procfs.parallel.
+//
+
+#include <kern/locks.h>
+#include <kern/thread.h>
+#include <libkern/libkern.h>
+#include <libkern/OSAtomic.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/sysctl.h>
+#include "procfs.h"
+#include "procfs_parallel.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The smallest number of shards for which the workers are used.
+#define PROCFS_PARALLEL_MIN_SHARDS  4
+
+// The size of a cache line, used to keep the shard ranges of
+// different participants apart.
+#define PROCFS_PARALLEL_CACHE_LINE_SIZE 64
+
+// A range of shard indices, from a head index up to but not including
+// a tail index, packed into 64 bits so that it can be updated with a
+// single compare-and-swap.
+#define PROCFS_PARALLEL_RANGE(head, tail)   (((UInt64)(head) << 32) | (UInt32)(tail))
+#define PROCFS_PARALLEL_RANGE_HEAD(range)   ((int)((range) >> 32))
+#define PROCFS_PARALLEL_RANGE_TAIL(range)   ((int)(UInt32)(range))
+
+/*
+ * The shards that remain for one participant. The owner takes shards
+ * from the head and other participants steal from the tail.
+ */
+typedef struct procfs_parallel_range {
+    volatile UInt64 ppr_range;
+    char            ppr_pad[PROCFS_PARALLEL_CACHE_LINE_SIZE - sizeof(UInt64)];
+} procfs_parallel_range_t;
+
+/*
+ * The job that is being run. Participant 0 is the calling thread and
+ * participant N is worker N.
+ */
+typedef struct procfs_parallel_job {
+    procfs_parallel_fn      ppj_fn;                 // Function that processes the items.
+    void                    *ppj_arg;               // Argument for ppj_fn.
+    int                     ppj_item_count;         // Number of items.
+    int                     ppj_participants;       // Number of participants, including the caller.
+    int                     ppj_active_workers;     // Number of workers processing the job.
+    procfs_parallel_range_t ppj_ranges[PROCFS_PARALLEL_MAX_WORKERS + 1]; // Shards left for each participant.
+} procfs_parallel_job_t;
+
+#pragma mark -
+#pragma mark Local Data
+
+// The current job. Only valid while procfs_parallel_busy is set.
+STATIC procfs_parallel_job_t procfs_parallel_job;
+
+// Whether a job is running.
+STATIC boolean_t procfs_parallel_busy;
+
+// Incremented when a job starts. Also the channel on which the
+// workers wait for a job.
+STATIC uint64_t procfs_parallel_generation;
+
+// The number of workers that were started and whether they
+// have been started.
+STATIC int procfs_parallel_worker_count;
+STATIC boolean_t procfs_parallel_started;
+
+// Lock that protects all of the above, except for the shard
+// ranges, which are updated atomically.
+STATIC lck_grp_t *procfs_parallel_lck_grp;
+STATIC lck_mtx_t *procfs_parallel_mutex;
+
+// The largest number of workers that a job may use.
+int procfs_parallel_max_workers = PROCFS_PARALLEL_MAX_WORKERS;
+
+// Statistics.
+STATIC uint64_t procfs_parallel_jobs;
+STATIC uint64_t procfs_parallel_serial_jobs;
+STATIC uint64_t procfs_parallel_shards;
+STATIC uint64_t procfs_parallel_steals;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC void procfs_parallel_start_workers(void);
+STATIC void procfs_parallel_worker(void *param, wait_result_t wresult);
+STATIC void procfs_parallel_participate(procfs_parallel_job_t *job, int index);
+STATIC int procfs_parallel_take(procfs_parallel_job_t *job, int index);
+STATIC int procfs_parallel_steal(procfs_parallel_job_t *job, int index);
+
+#pragma mark -
+#pragma mark External References
+
+extern unsigned int processor_count;
+
+#pragma mark -
+#pragma mark Statistics
+
+SYSCTL_NODE(_vfs_procfs, OID_AUTO, parallel, CTLFLAG_RW | CTLFLAG_LOCKED, 0, "parallel file generation");
+SYSCTL_INT(_vfs_procfs_parallel, OID_AUTO, max_workers, CTLFLAG_RW | CTLFLAG_LOCKED,
+           &procfs_parallel_max_workers, 0, "largest number of workers used by a job");
+SYSCTL_INT(_vfs_procfs_parallel, OID_AUTO, workers, CTLFLAG_RD | CTLFLAG_LOCKED,
+           &procfs_parallel_worker_count, 0, "worker threads started");
+SYSCTL_QUAD(_vfs_procfs_parallel, OID_AUTO, jobs, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_parallel_jobs, "jobs shared with the workers");
+SYSCTL_QUAD(_vfs_procfs_parallel, OID_AUTO, serial_jobs, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_parallel_serial_jobs, "jobs run by the caller alone");
+SYSCTL_QUAD(_vfs_procfs_parallel, OID_AUTO, shards, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_parallel_shards, "shards processed in shared jobs");
+SYSCTL_QUAD(_vfs_procfs_parallel, OID_AUTO, steals, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_parallel_steals, "ranges of shards stolen from another participant");
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the lock for parallel jobs. Called once when the file
+ * system is initialized. The workers are started later, when all of
+ * the processors are known.
+ */
+void
+procfs_parallel_init(void) {
+    procfs_parallel_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.parallel_locks", LCK_GRP_ATTR_NULL);
+    procfs_parallel_mutex = lck_mtx_alloc_init(procfs_parallel_lck_grp, LCK_ATTR_NULL);
+}
+
+#pragma mark -
+#pragma mark Running Jobs
+
+/*
+ * Calls "fn" for every item from 0 up to but not including "item_count",
+ * in shards that may be processed by several threads at once. Returns
+ * when every item has been processed.
+ */
+void
+procfs_parallel_run(int item_count, procfs_parallel_fn fn, void *arg) {
+    int shard_count = (item_count + PROCFS_PARALLEL_SHARD_SIZE - 1)/PROCFS_PARALLEL_SHARD_SIZE;
+    boolean_t parallel = FALSE;
+    int workers = 0;
+    if (shard_count >= PROCFS_PARALLEL_MIN_SHARDS && procfs_parallel_max_workers > 0) {
+        lck_mtx_lock(procfs_parallel_mutex);
+        if (!procfs_parallel_started) {
+            procfs_parallel_start_workers();
+        }
+        workers = MIN(MIN(procfs_parallel_worker_count, procfs_parallel_max_workers), shard_count - 1);
+        if (workers > 0 && !procfs_parallel_busy) {
+            procfs_parallel_busy = TRUE;
+            parallel = TRUE;
+        } else {
+            lck_mtx_unlock(procfs_parallel_mutex);
+        }
+    }
+    
+    if (!parallel) {
+        OSIncrementAtomic64((volatile SInt64 *)&procfs_parallel_serial_jobs);
+        if (item_count > 0) {
+            fn(arg, 0, item_count);
+        }
+        return;
+    }
+    
+    // Give each participant an equal share of the shards, then wake
+    // the workers. We still hold the lock.
+    procfs_parallel_job_t *job = &procfs_parallel_job;
+    job->ppj_fn = fn;
+    job->ppj_arg = arg;
+    job->ppj_item_count = item_count;
+    job->ppj_participants = workers + 1;
+    job->ppj_active_workers = 0;
+    for (int i = 0; i < job->ppj_participants; i++) {
+        int head = (int)((int64_t)shard_count * i/job->ppj_participants);
+        int tail = (int)((int64_t)shard_count * (i + 1)/job->ppj_participants);
+        job->ppj_ranges[i].ppr_range = PROCFS_PARALLEL_RANGE(head, tail);
+    }
+    procfs_parallel_generation++;
+    procfs_parallel_jobs++;
+    wakeup(&procfs_parallel_generation);
+    lck_mtx_unlock(procfs_parallel_mutex);
+    
+    procfs_parallel_participate(job, 0);
+    
+    // There are no more shards to take, but workers may still be
+    // processing the last of them. Workers that have not yet seen
+    // the job will not join it once it is no longer busy.
+    lck_mtx_lock(procfs_parallel_mutex);
+    procfs_parallel_busy = FALSE;
+    while (job->ppj_active_workers > 0) {
+        msleep(&job->ppj_active_workers, procfs_parallel_mutex, PRIBIO, "procfs_parallel_done", NULL);
+    }
+    lck_mtx_unlock(procfs_parallel_mutex);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Starts the worker threads, one fewer than the number of processors,
+ * since the caller also processes shards. Called with the lock held.
+ */
+STATIC void
+procfs_parallel_start_workers(void) {
+    int count = MIN((int)processor_count - 1, PROCFS_PARALLEL_MAX_WORKERS);
+    for (int i = 1; i <= count; i++) {
+        thread_t thread;
+        if (kernel_thread_start(procfs_parallel_worker, (void *)(uintptr_t)i, &thread) != KERN_SUCCESS) {
+            printf("procfs: started %d of %d parallel workers\n", i - 1, count);
+            break;
+        }
+        thread_deallocate(thread);
+        procfs_parallel_worker_count++;
+    }
+    procfs_parallel_started = TRUE;
+}
+
+/*
+ * Body of a worker thread. Waits for a job to start and processes
+ * shards until none are left, then waits for the next job. Workers
+ * beyond the number that the job uses skip it.
+ */
+STATIC void
+procfs_parallel_worker(void *param, __unused wait_result_t wresult) {
+    int index = (int)(uintptr_t)param;
+    uint64_t last_generation = 0;
+    
+    lck_mtx_lock(procfs_parallel_mutex);
+    for (;;) {
+        while (!procfs_parallel_busy || procfs_parallel_generation == last_generation) {
+            msleep(&procfs_parallel_generation, procfs_parallel_mutex, PRIBIO, "procfs_parallel", NULL);
+        }
+        last_generation = procfs_parallel_generation;
+        
+        procfs_parallel_job_t *job = &procfs_parallel_job;
+        if (index < job->ppj_participants) {
+            job->ppj_active_workers++;
+            lck_mtx_unlock(procfs_parallel_mutex);
+            
+            procfs_parallel_participate(job, index);
+            
+            lck_mtx_lock(procfs_parallel_mutex);
+            if (--job->ppj_active_workers == 0) {
+                wakeup(&job->ppj_active_workers);
+            }
+        }
+    }
+}
+
+/*
+ * Processes shards of a job, first from the participant's own range
+ * and then from those of other participants, until there are none left.
+ */
+STATIC void
+procfs_parallel_participate(procfs_parallel_job_t *job, int index) {
+    int shard;
+    while ((shard = procfs_parallel_take(job, index)) >= 0 || (shard = procfs_parallel_steal(job, index)) >= 0) {
+        int start = shard * PROCFS_PARALLEL_SHARD_SIZE;
+        int end = MIN(start + PROCFS_PARALLEL_SHARD_SIZE, job->ppj_item_count);
+        job->ppj_fn(job->ppj_arg, start, end);
+        OSIncrementAtomic64((volatile SInt64 *)&procfs_parallel_shards);
+    }
+}
+
+/*
+ * Takes the shard at the head of a participant's own range. Returns
+ * the index of the shard, or -1 if the range is empty.
+ */
+STATIC int
+procfs_parallel_take(procfs_parallel_job_t *job, int index) {
+    volatile UInt64 *rangep = &job->ppj_ranges[index].ppr_range;
+    for (;;) {
+        UInt64 range = *rangep;
+        int head = PROCFS_PARALLEL_RANGE_HEAD(range);
+        int tail = PROCFS_PARALLEL_RANGE_TAIL(range);
+        if (head >= tail) {
+            return -1;
+        }
+        if (OSCompareAndSwap64(range, PROCFS_PARALLEL_RANGE(head + 1, tail), rangep)) {
+            return head;
+        }
+    }
+}
+
+/*
+ * Steals the back half of the largest range held by another participant.
+ * The first stolen shard is returned and the rest become the thief's own
+ * range. Returns -1 if every other range is empty. The thief's own range
+ * is empty, so no other participant will try to change it and it can be
+ * replaced without a compare-and-swap. A range that has been emptied can
+ * never be refilled with the same value, because shards are only taken
+ * once, so a compare-and-swap on a stale value always fails.
+ */
+STATIC int
+procfs_parallel_steal(procfs_parallel_job_t *job, int index) {
+    for (;;) {
+        int victim = -1;
+        int largest = 0;
+        UInt64 victim_range = 0;
+        for (int i = 0; i < job->ppj_participants; i++) {
+            UInt64 range = job->ppj_ranges[i].ppr_range;
+            int remaining = PROCFS_PARALLEL_RANGE_TAIL(range) - PROCFS_PARALLEL_RANGE_HEAD(range);
+            if (i != index && remaining > largest) {
+                victim = i;
+                largest = remaining;
+                victim_range = range;
+            }
+        }
+        if (victim < 0) {
+            return -1;
+        }
+        
+        int head = PROCFS_PARALLEL_RANGE_HEAD(victim_range);
+        int tail = PROCFS_PARALLEL_RANGE_TAIL(victim_range);
+        int split = tail - (tail - head + 1)/2;
+        if (OSCompareAndSwap64(victim_range, PROCFS_PARALLEL_RANGE(head, split),
+                               &job->ppj_ranges[victim].ppr_range)) {
+            job->ppj_ranges[index].ppr_range = PROCFS_PARALLEL_RANGE(split + 1, tail);
+            OSIncrementAtomic64((volatile SInt64 *)&procfs_parallel_steals);
+            return split;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+//
+//  procfs_parallel.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_parallel_h
+#define procfs_parallel_h
+
+// The number of items in each shard of a parallel job.
+#define PROCFS_PARALLEL_SHARD_SIZE  32
+
+// The largest number of worker threads.
+#define PROCFS_PARALLEL_MAX_WORKERS 63
+
+/*
+ * Function called to process the items with indices from "start"
+ * up to but not including "end". It may be called on any thread and
+ * at the same time as other calls for the same job, so it must only
+ * write results to locations that depend on the item indices.
+ */
+typedef void (*procfs_parallel_fn)(void *arg, int start, int end);
+
+// The largest number of workers that a job may use, as set by
+// the vfs.procfs.parallel.max_workers sysctl.
+extern int procfs_parallel_max_workers;
+
+extern void procfs_parallel_init(void);
+extern void procfs_parallel_run(int item_count, procfs_parallel_fn fn, void *arg);
+
+#endif /* procfs_parallel_h */
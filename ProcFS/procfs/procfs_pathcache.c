@@ -0,0 +1,277 @@
+//
+//  procfs_pathcache.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// A cache of the full paths of vnodes, used when reporting the files
+// that processes have open. Many processes often have the same files
+// open, so a sweep of every fd directory would otherwise rebuild the
+// same paths over and over again with vn_getpath().
+//
+// Entries are keyed by the vnode's address and its vid. A vnode that is
+// recycled gets a new vid, so an entry can never return the path of a
+// different file. However, a file can be renamed without changing its
+// vid, so each entry also records the cache generation in which it was
+// created and is only used during that generation. The generation
+// advances every vfs.procfs.pathcache.epoch_secs seconds, which limits
+// how long a stale path can be reported, and when the cache is explicitly
+// invalidated. Setting the sysctl to 0 stops the generation advancing
+// with time, which is useful for testing.
+//
+// Hit and miss counts are published under vfs.procfs.pathcache.
+//
+
+#include <kern/clock.h>
+#include <kern/locks.h>
+#include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
+#include <sys/malloc.h>
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/sysctl.h>
+#include <sys/vnode.h>
+#include "procfs.h"
+#include "procfs_pathcache.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The number of hash buckets. This *MUST* be a power of two.
+#define PROCFS_PATHCACHE_BUCKET_COUNT (1 << 8)
+
+// The maximum number of cached paths.
+#define PROCFS_PATHCACHE_MAX_ENTRIES 2048
+
+// The default lifetime of a cache generation, in seconds.
+#define PROCFS_PATHCACHE_DEFAULT_EPOCH_SECS 1
+
+// Gets the hash value for a vnode and vid.
+#define PROCFS_PATHCACHE_HASH(vp, vid) ((u_long)(((uintptr_t)(vp) >> 6) ^ (vid)))
+
+/*
+ * A cached path.
+ */
+typedef struct procfs_pathcache_entry {
+    LIST_ENTRY(procfs_pathcache_entry)  pce_hash;       // Link in the hash bucket.
+    TAILQ_ENTRY(procfs_pathcache_entry) pce_lru;        // Link in the LRU list.
+    vnode_t                             pce_vnode;      // The vnode. No reference is held.
+    uint32_t                            pce_vid;        // The vnode's id.
+    uint32_t                            pce_generation; // Generation in which the entry was created.
+    int                                 pce_path_len;   // Length of the path, including the null.
+    char                                *pce_path;      // The path.
+} procfs_pathcache_entry_t;
+
+#pragma mark -
+#pragma mark Local Data
+
+// The hash buckets and the mask used to get the bucket number from a hash.
+STATIC LIST_HEAD(procfs_pathcache_head, procfs_pathcache_entry) *procfs_pathcache_buckets;
+STATIC u_long procfs_pathcache_bucket_mask;
+
+// All entries, most recently used first.
+STATIC TAILQ_HEAD(procfs_pathcache_lru_head, procfs_pathcache_entry) procfs_pathcache_lru;
+STATIC int procfs_pathcache_entry_count;
+
+// The current generation, and the epoch in which it started.
+STATIC uint32_t procfs_pathcache_generation;
+STATIC uint64_t procfs_pathcache_epoch;
+
+// The lifetime of a cache generation, in seconds, or 0 if generations
+// only end when the cache is explicitly invalidated.
+STATIC int procfs_pathcache_epoch_secs = PROCFS_PATHCACHE_DEFAULT_EPOCH_SECS;
+
+// Lock that protects all of the above.
+STATIC lck_grp_t *procfs_pathcache_lck_grp;
+STATIC lck_mtx_t *procfs_pathcache_mutex;
+
+// Statistics.
+STATIC uint64_t procfs_pathcache_hits;
+STATIC uint64_t procfs_pathcache_misses;
+STATIC uint64_t procfs_pathcache_evictions;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC uint32_t procfs_pathcache_current_generation(void);
+STATIC void procfs_pathcache_remove(procfs_pathcache_entry_t *entry);
+STATIC int procfs_pathcache_sysctl_hitrate SYSCTL_HANDLER_ARGS;
+
+#pragma mark -
+#pragma mark Statistics
+
+SYSCTL_NODE(_vfs_procfs, OID_AUTO, pathcache, CTLFLAG_RW | CTLFLAG_LOCKED, 0, "vnode path cache");
+SYSCTL_QUAD(_vfs_procfs_pathcache, OID_AUTO, hits, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_pathcache_hits, "paths found in the cache");
+SYSCTL_QUAD(_vfs_procfs_pathcache, OID_AUTO, misses, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_pathcache_misses, "paths not found in the cache");
+SYSCTL_QUAD(_vfs_procfs_pathcache, OID_AUTO, evictions, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_pathcache_evictions, "entries discarded to make space");
+SYSCTL_INT(_vfs_procfs_pathcache, OID_AUTO, entries, CTLFLAG_RD | CTLFLAG_LOCKED,
+           &procfs_pathcache_entry_count, 0, "number of cached paths");
+SYSCTL_INT(_vfs_procfs_pathcache, OID_AUTO, epoch_secs, CTLFLAG_RW | CTLFLAG_LOCKED,
+           &procfs_pathcache_epoch_secs, 0, "seconds for which a cached path is used, 0 for no limit");
+SYSCTL_PROC(_vfs_procfs_pathcache, OID_AUTO, hitrate, CTLTYPE_INT | CTLFLAG_RD | CTLFLAG_LOCKED,
+            0, 0, procfs_pathcache_sysctl_hitrate, "I", "percentage of lookups found in the cache");
+
+/*
+ * Handler for the vfs.procfs.pathcache.hitrate sysctl.
+ */
+STATIC int
+procfs_pathcache_sysctl_hitrate SYSCTL_HANDLER_ARGS {
+#pragma unused(oidp, arg1, arg2)
+    uint64_t hits = procfs_pathcache_hits;
+    uint64_t total = hits + procfs_pathcache_misses;
+    int hitrate = total == 0 ? 0 : (int)((hits * 100) / total);
+    return SYSCTL_OUT(req, &hitrate, sizeof(hitrate));
+}
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the hash table and lock for the cache. Called once
+ * when the file system is initialized.
+ */
+void
+procfs_pathcache_init(void) {
+    procfs_pathcache_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.pathcache_locks", LCK_GRP_ATTR_NULL);
+    procfs_pathcache_mutex = lck_mtx_alloc_init(procfs_pathcache_lck_grp, LCK_ATTR_NULL);
+    procfs_pathcache_buckets = hashinit(PROCFS_PATHCACHE_BUCKET_COUNT, M_CACHE, &procfs_pathcache_bucket_mask);
+    TAILQ_INIT(&procfs_pathcache_lru);
+}
+
+#pragma mark -
+#pragma mark Path Lookup
+
+/*
+ * Gets the path of a vnode, which must have an iocount, into a buffer.
+ * Has the same semantics as vn_getpath(): on entry, *len is the size of
+ * the buffer and on successful return, it is the length of the path,
+ * including the terminating null. The path is taken from the cache if
+ * there is a current entry for the vnode and vid. Otherwise, it is
+ * obtained from vn_getpath() and added to the cache.
+ */
+int
+procfs_pathcache_getpath(vnode_t vp, uint32_t vid, char *buf, int *len) {
+    u_long hash = PROCFS_PATHCACHE_HASH(vp, vid);
+    procfs_pathcache_entry_t *entry;
+
+    lck_mtx_lock(procfs_pathcache_mutex);
+    uint32_t generation = procfs_pathcache_current_generation();
+    LIST_FOREACH(entry, &procfs_pathcache_buckets[hash & procfs_pathcache_bucket_mask], pce_hash) {
+        if (entry->pce_vnode == vp && entry->pce_vid == vid) {
+            break;
+        }
+    }
+    if (entry != NULL && entry->pce_generation == generation && entry->pce_path_len <= *len) {
+        // Cache hit. Move the entry to the front of the LRU list.
+        bcopy(entry->pce_path, buf, entry->pce_path_len);
+        *len = entry->pce_path_len;
+        TAILQ_REMOVE(&procfs_pathcache_lru, entry, pce_lru);
+        TAILQ_INSERT_HEAD(&procfs_pathcache_lru, entry, pce_lru);
+        procfs_pathcache_hits++;
+        lck_mtx_unlock(procfs_pathcache_mutex);
+        return 0;
+    }
+    procfs_pathcache_misses++;
+    lck_mtx_unlock(procfs_pathcache_mutex);
+
+    // Cache miss, or the entry is stale. Get the path from the vnode,
+    // without holding the lock.
+    int error = vn_getpath(vp, buf, len);
+    if (error != 0) {
+        return error;
+    }
+
+    procfs_pathcache_entry_t *new_entry = (procfs_pathcache_entry_t *)OSMalloc(sizeof(procfs_pathcache_entry_t), procfs_osmalloc_tag);
+    char *path = (char *)OSMalloc(*len, procfs_osmalloc_tag);
+    if (new_entry == NULL || path == NULL) {
+        // Just don't cache the path.
+        if (new_entry != NULL) {
+            OSFree(new_entry, sizeof(procfs_pathcache_entry_t), procfs_osmalloc_tag);
+        }
+        if (path != NULL) {
+            OSFree(path, *len, procfs_osmalloc_tag);
+        }
+        return 0;
+    }
+    bcopy(buf, path, *len);
+    new_entry->pce_vnode = vp;
+    new_entry->pce_vid = vid;
+    new_entry->pce_generation = generation;
+    new_entry->pce_path_len = *len;
+    new_entry->pce_path = path;
+
+    // Replace any existing entry for this vnode, which may have been
+    // added by another thread while the lock was released, and make
+    // space for the new one if the cache is full.
+    lck_mtx_lock(procfs_pathcache_mutex);
+    LIST_FOREACH(entry, &procfs_pathcache_buckets[hash & procfs_pathcache_bucket_mask], pce_hash) {
+        if (entry->pce_vnode == vp && entry->pce_vid == vid) {
+            procfs_pathcache_remove(entry);
+            break;
+        }
+    }
+    if (procfs_pathcache_entry_count >= PROCFS_PATHCACHE_MAX_ENTRIES) {
+        procfs_pathcache_remove(TAILQ_LAST(&procfs_pathcache_lru, procfs_pathcache_lru_head));
+        procfs_pathcache_evictions++;
+    }
+    LIST_INSERT_HEAD(&procfs_pathcache_buckets[hash & procfs_pathcache_bucket_mask], new_entry, pce_hash);
+    TAILQ_INSERT_HEAD(&procfs_pathcache_lru, new_entry, pce_lru);
+    procfs_pathcache_entry_count++;
+    lck_mtx_unlock(procfs_pathcache_mutex);
+
+    return 0;
+}
+
+/*
+ * Invalidates every entry in the cache by advancing the generation.
+ * Stale entries are replaced as they are looked up, or evicted.
+ */
+void
+procfs_pathcache_invalidate(void) {
+    lck_mtx_lock(procfs_pathcache_mutex);
+    procfs_pathcache_generation++;
+    lck_mtx_unlock(procfs_pathcache_mutex);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Gets the current cache generation, advancing it if a new epoch has
+ * started since it was last advanced. Must be called with the cache
+ * lock held.
+ */
+STATIC uint32_t
+procfs_pathcache_current_generation(void) {
+    int epoch_secs = procfs_pathcache_epoch_secs;
+    if (epoch_secs <= 0) {
+        return procfs_pathcache_generation;
+    }
+
+    clock_sec_t secs;
+    clock_usec_t usecs;
+    clock_get_system_microtime(&secs, &usecs);
+
+    uint64_t epoch = (uint64_t)secs / epoch_secs;
+    if (epoch != procfs_pathcache_epoch) {
+        procfs_pathcache_epoch = epoch;
+        procfs_pathcache_generation++;
+    }
+    return procfs_pathcache_generation;
+}
+
+/*
+ * Removes an entry from the cache and frees it. Must be called
+ * with the cache lock held.
+ */
+STATIC void
+procfs_pathcache_remove(procfs_pathcache_entry_t *entry) {
+    LIST_REMOVE(entry, pce_hash);
+    TAILQ_REMOVE(&procfs_pathcache_lru, entry, pce_lru);
+    procfs_pathcache_entry_count--;
+    OSFree(entry->pce_path, entry->pce_path_len, procfs_osmalloc_tag);
+    OSFree(entry, sizeof(procfs_pathcache_entry_t), procfs_osmalloc_tag);
+}
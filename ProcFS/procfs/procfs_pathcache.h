@@ -0,0 +1,18 @@
+//
+//  procfs_pathcache.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_pathcache_h
+#define procfs_pathcache_h
+
+#include <sys/kernel_types.h>
+
+extern void procfs_pathcache_init(void);
+extern int procfs_pathcache_getpath(vnode_t vp, uint32_t vid, char *buf, int *len);
+extern void procfs_pathcache_invalidate(void);
+
+#endif /* procfs_pathcache_h */
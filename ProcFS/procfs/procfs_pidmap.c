@@ -0,0 +1,345 @@
+//
+//  procfs_pidmap.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Bitmaps over the process id space, used by the process index to count
+// and list the processes that a caller can see without examining each
+// process in turn. The index keeps one map of every live process and,
+// for each user id and group id, a map of the processes that have that
+// id. Counting the processes visible to a credential is then a population
+// count over the union of two maps, and listing them is a scan for set
+// bits in process id order, which can resume from any process id.
+//
+// Each map is split into chunks of PROCFS_PIDMAP_CHUNK_BITS bits that are
+// only allocated when needed, because most user and group ids own only a
+// handful of processes. Unions are computed a 64-bit word at a time.
+//
+// None of these functions take a lock. The caller must serialize access.
+//
+
+#include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
+#include "procfs.h"
+#include "procfs_pidmap.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The size of a chunk, in bytes.
+#define PROCFS_PIDMAP_CHUNK_SIZE    (PROCFS_PIDMAP_CHUNK_WORDS * sizeof(uint64_t))
+
+// The number of entries initially allocated for a collection of maps.
+#define PROCFS_PIDMAPS_INITIAL_CAPACITY 16
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_pidmap_count_chunk(const uint64_t *chunk1, const uint64_t *chunk2);
+STATIC procfs_pidmap_t *procfs_pidmap_alloc(void);
+STATIC void procfs_pidmap_free(procfs_pidmap_t *map);
+STATIC int procfs_pidmaps_search(procfs_pidmaps_t *maps, uint32_t id, boolean_t *found);
+
+#pragma mark -
+#pragma mark Process Id Maps
+
+/*
+ * Adds a process id to a map, allocating the chunk that holds it if
+ * necessary. Returns 0 on success, EINVAL if the process id is out of
+ * range and ENOMEM if memory for the chunk could not be allocated.
+ */
+int
+procfs_pidmap_add(procfs_pidmap_t *map, pid_t pid) {
+    if (pid < 0 || pid >= PROCFS_PIDMAP_PID_LIMIT) {
+        return EINVAL;
+    }
+
+    int chunk_index = pid/PROCFS_PIDMAP_CHUNK_BITS;
+    uint64_t *chunk = map->ppm_chunks[chunk_index];
+    if (chunk == NULL) {
+        chunk = (uint64_t *)OSMalloc((uint32_t)PROCFS_PIDMAP_CHUNK_SIZE, procfs_osmalloc_tag);
+        if (chunk == NULL) {
+            return ENOMEM;
+        }
+        bzero(chunk, PROCFS_PIDMAP_CHUNK_SIZE);
+        map->ppm_chunks[chunk_index] = chunk;
+    }
+
+    int bit = pid % PROCFS_PIDMAP_CHUNK_BITS;
+    uint64_t mask = 1ULL << (bit % 64);
+    if ((chunk[bit/64] & mask) == 0) {
+        chunk[bit/64] |= mask;
+        map->ppm_count++;
+    }
+    return 0;
+}
+
+/*
+ * Removes a process id from a map. Does nothing if the process id is
+ * not in the map. Chunks are kept when they become empty, since it is
+ * likely that the process id space will be reused.
+ */
+void
+procfs_pidmap_remove(procfs_pidmap_t *map, pid_t pid) {
+    if (pid < 0 || pid >= PROCFS_PIDMAP_PID_LIMIT) {
+        return;
+    }
+
+    uint64_t *chunk = map->ppm_chunks[pid/PROCFS_PIDMAP_CHUNK_BITS];
+    if (chunk != NULL) {
+        int bit = pid % PROCFS_PIDMAP_CHUNK_BITS;
+        uint64_t mask = 1ULL << (bit % 64);
+        if ((chunk[bit/64] & mask) != 0) {
+            chunk[bit/64] &= ~mask;
+            map->ppm_count--;
+        }
+    }
+}
+
+/*
+ * Removes every process id from a map. As with procfs_pidmap_remove(),
+ * the chunks are kept.
+ */
+void
+procfs_pidmap_clear(procfs_pidmap_t *map) {
+    for (int i = 0; i < PROCFS_PIDMAP_CHUNK_COUNT; i++) {
+        if (map->ppm_chunks[i] != NULL) {
+            bzero(map->ppm_chunks[i], PROCFS_PIDMAP_CHUNK_SIZE);
+        }
+    }
+    map->ppm_count = 0;
+}
+
+/*
+ * Gets the number of process ids that are in either of two maps.
+ * Either map may be NULL, in which case it is treated as empty.
+ */
+int
+procfs_pidmap_count_union(const procfs_pidmap_t *map1, const procfs_pidmap_t *map2) {
+    if (map1 == NULL || map2 == NULL) {
+        const procfs_pidmap_t *map = map1 == NULL ? map2 : map1;
+        return map == NULL ? 0 : map->ppm_count;
+    }
+
+    int count = 0;
+    for (int i = 0; i < PROCFS_PIDMAP_CHUNK_COUNT; i++) {
+        count += procfs_pidmap_count_chunk(map1->ppm_chunks[i], map2->ppm_chunks[i]);
+    }
+    return count;
+}
+
+/*
+ * Gets the process ids that are in either of two maps, starting from a
+ * given process id, in increasing order. Either map may be NULL, in which
+ * case it is treated as empty. At most capacity process ids are stored in
+ * the pids array. Returns the number of process ids that were stored. If
+ * that is equal to capacity, there may be more, and the caller should call
+ * again with a start_pid that is one more than the last process id returned.
+ */
+int
+procfs_pidmap_get_union(const procfs_pidmap_t *map1, const procfs_pidmap_t *map2,
+                        pid_t start_pid, pid_t *pids, int capacity) {
+    int count = 0;
+    if (start_pid < 0) {
+        start_pid = 0;
+    }
+
+    for (int i = start_pid/PROCFS_PIDMAP_CHUNK_BITS; i < PROCFS_PIDMAP_CHUNK_COUNT && count < capacity; i++) {
+        const uint64_t *chunk1 = map1 == NULL ? NULL : map1->ppm_chunks[i];
+        const uint64_t *chunk2 = map2 == NULL ? NULL : map2->ppm_chunks[i];
+        if (chunk1 == NULL && chunk2 == NULL) {
+            continue;
+        }
+
+        pid_t chunk_base = i * PROCFS_PIDMAP_CHUNK_BITS;
+        for (int word = 0; word < PROCFS_PIDMAP_CHUNK_WORDS && count < capacity; word++) {
+            uint64_t bits = (chunk1 == NULL ? 0 : chunk1[word]) | (chunk2 == NULL ? 0 : chunk2[word]);
+            pid_t word_base = chunk_base + word * 64;
+            if (word_base + 64 <= start_pid) {
+                continue;
+            }
+            if (word_base < start_pid) {
+                // Ignore the bits for process ids below the start point.
+                bits &= ~0ULL << (start_pid - word_base);
+            }
+            while (bits != 0 && count < capacity) {
+                pids[count++] = word_base + __builtin_ctzll(bits);
+                bits &= bits - 1;
+            }
+        }
+    }
+    return count;
+}
+
+#pragma mark -
+#pragma mark Process Id Maps by User or Group Id
+
+/*
+ * Gets the map for a given id from a collection of maps. Returns
+ * NULL if there are no processes with that id.
+ */
+procfs_pidmap_t *
+procfs_pidmaps_find(procfs_pidmaps_t *maps, uint32_t id) {
+    boolean_t found;
+    int index = procfs_pidmaps_search(maps, id, &found);
+    return found ? maps->pms_entries[index].pme_map : NULL;
+}
+
+/*
+ * Adds a process id to the map for a given id in a collection of maps,
+ * creating the map if there is not already one for the id. Returns 0
+ * on success and ENOMEM if memory could not be allocated.
+ */
+int
+procfs_pidmaps_add(procfs_pidmaps_t *maps, uint32_t id, pid_t pid) {
+    boolean_t found;
+    int index = procfs_pidmaps_search(maps, id, &found);
+    if (!found) {
+        // Grow the collection if it is full.
+        if (maps->pms_count == maps->pms_capacity) {
+            int new_capacity = maps->pms_capacity == 0 ? PROCFS_PIDMAPS_INITIAL_CAPACITY : 2 * maps->pms_capacity;
+            uint32_t old_size = (uint32_t)(maps->pms_capacity * sizeof(procfs_pidmaps_entry_t));
+            uint32_t new_size = (uint32_t)(new_capacity * sizeof(procfs_pidmaps_entry_t));
+            procfs_pidmaps_entry_t *new_entries = (procfs_pidmaps_entry_t *)OSMalloc(new_size, procfs_osmalloc_tag);
+            if (new_entries == NULL) {
+                return ENOMEM;
+            }
+            if (maps->pms_entries != NULL) {
+                bcopy(maps->pms_entries, new_entries, old_size);
+                OSFree(maps->pms_entries, old_size, procfs_osmalloc_tag);
+            }
+            maps->pms_entries = new_entries;
+            maps->pms_capacity = new_capacity;
+        }
+
+        procfs_pidmap_t *map = procfs_pidmap_alloc();
+        if (map == NULL) {
+            return ENOMEM;
+        }
+        int move_count = maps->pms_count - index;
+        if (move_count > 0) {
+            memmove(&maps->pms_entries[index + 1], &maps->pms_entries[index],
+                    move_count * sizeof(procfs_pidmaps_entry_t));
+        }
+        maps->pms_entries[index].pme_id = id;
+        maps->pms_entries[index].pme_map = map;
+        maps->pms_count++;
+    }
+
+    procfs_pidmap_t *map = maps->pms_entries[index].pme_map;
+    int error = procfs_pidmap_add(map, pid);
+    if (error != 0 && map->ppm_count == 0) {
+        // Don't leave behind an empty map.
+        procfs_pidmaps_remove(maps, id, pid);
+    }
+    return error;
+}
+
+/*
+ * Removes a process id from the map for a given id in a collection of
+ * maps. The map is freed if it no longer has any processes.
+ */
+void
+procfs_pidmaps_remove(procfs_pidmaps_t *maps, uint32_t id, pid_t pid) {
+    boolean_t found;
+    int index = procfs_pidmaps_search(maps, id, &found);
+    if (found) {
+        procfs_pidmap_t *map = maps->pms_entries[index].pme_map;
+        procfs_pidmap_remove(map, pid);
+        if (map->ppm_count == 0) {
+            procfs_pidmap_free(map);
+            int move_count = maps->pms_count - index - 1;
+            if (move_count > 0) {
+                memmove(&maps->pms_entries[index], &maps->pms_entries[index + 1],
+                        move_count * sizeof(procfs_pidmaps_entry_t));
+            }
+            maps->pms_count--;
+        }
+    }
+}
+
+/*
+ * Removes and frees every map in a collection of maps.
+ */
+void
+procfs_pidmaps_clear(procfs_pidmaps_t *maps) {
+    for (int i = 0; i < maps->pms_count; i++) {
+        procfs_pidmap_free(maps->pms_entries[i].pme_map);
+    }
+    maps->pms_count = 0;
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Gets the number of process ids that are in either of two chunks.
+ * Either chunk may be NULL.
+ */
+STATIC int
+procfs_pidmap_count_chunk(const uint64_t *chunk1, const uint64_t *chunk2) {
+    int count = 0;
+    if (chunk1 != NULL && chunk2 != NULL) {
+        for (int i = 0; i < PROCFS_PIDMAP_CHUNK_WORDS; i++) {
+            count += __builtin_popcountll(chunk1[i] | chunk2[i]);
+        }
+    } else if (chunk1 != NULL || chunk2 != NULL) {
+        const uint64_t *chunk = chunk1 == NULL ? chunk2 : chunk1;
+        for (int i = 0; i < PROCFS_PIDMAP_CHUNK_WORDS; i++) {
+            count += __builtin_popcountll(chunk[i]);
+        }
+    }
+    return count;
+}
+
+/*
+ * Allocates an empty map. Returns NULL if memory is not available.
+ */
+STATIC procfs_pidmap_t *
+procfs_pidmap_alloc(void) {
+    procfs_pidmap_t *map = (procfs_pidmap_t *)OSMalloc((uint32_t)sizeof(procfs_pidmap_t), procfs_osmalloc_tag);
+    if (map != NULL) {
+        bzero(map, sizeof(procfs_pidmap_t));
+    }
+    return map;
+}
+
+/*
+ * Frees a map and all of its chunks.
+ */
+STATIC void
+procfs_pidmap_free(procfs_pidmap_t *map) {
+    for (int i = 0; i < PROCFS_PIDMAP_CHUNK_COUNT; i++) {
+        if (map->ppm_chunks[i] != NULL) {
+            OSFree(map->ppm_chunks[i], (uint32_t)PROCFS_PIDMAP_CHUNK_SIZE, procfs_osmalloc_tag);
+        }
+    }
+    OSFree(map, (uint32_t)sizeof(procfs_pidmap_t), procfs_osmalloc_tag);
+}
+
+/*
+ * Finds the position of an id in a collection of maps, which is kept
+ * sorted by id. If it is present, sets *found to TRUE and returns its
+ * index. Otherwise, sets *found to FALSE and returns the index at which
+ * it would be inserted.
+ */
+STATIC int
+procfs_pidmaps_search(procfs_pidmaps_t *maps, uint32_t id, boolean_t *found) {
+    int low = 0;
+    int high = maps->pms_count;
+    while (low < high) {
+        int mid = low + (high - low)/2;
+        uint32_t mid_id = maps->pms_entries[mid].pme_id;
+        if (mid_id == id) {
+            *found = TRUE;
+            return mid;
+        } else if (mid_id < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *found = FALSE;
+    return low;
+}
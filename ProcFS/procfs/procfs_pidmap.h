@@ -0,0 +1,68 @@
+//
+//  procfs_pidmap.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_pidmap_h
+#define procfs_pidmap_h
+
+#include <sys/param.h>
+#include <sys/types.h>
+
+// The number of process ids that a map can hold. Process ids are
+// always less than this value.
+#define PROCFS_PIDMAP_PID_LIMIT     (PID_MAX + 1)
+
+// The number of process ids covered by each chunk of a map, the
+// number of 64-bit words in a chunk and the number of chunks in a map.
+#define PROCFS_PIDMAP_CHUNK_BITS    1024
+#define PROCFS_PIDMAP_CHUNK_WORDS   (PROCFS_PIDMAP_CHUNK_BITS/64)
+#define PROCFS_PIDMAP_CHUNK_COUNT   \
+        ((PROCFS_PIDMAP_PID_LIMIT + PROCFS_PIDMAP_CHUNK_BITS - 1)/PROCFS_PIDMAP_CHUNK_BITS)
+
+/*
+ * A set of process ids, held as a bitmap with one bit for each
+ * possible process id. The bitmap is divided into chunks, which are
+ * only allocated when they contain at least one process id, so a set
+ * with a few members is small. A zero-filled structure is an empty set.
+ */
+typedef struct procfs_pidmap {
+    int         ppm_count;                              // Number of process ids in the set.
+    uint64_t    *ppm_chunks[PROCFS_PIDMAP_CHUNK_COUNT]; // The chunks, NULL if not allocated.
+} procfs_pidmap_t;
+
+/*
+ * A process id set for a given user or group id.
+ */
+typedef struct procfs_pidmaps_entry {
+    uint32_t        pme_id;     // The user or group id.
+    procfs_pidmap_t *pme_map;   // The processes for that id.
+} procfs_pidmaps_entry_t;
+
+/*
+ * A collection of process id sets, keyed by user or group id. Only
+ * ids that have at least one process have a set. A zero-filled
+ * structure is an empty collection.
+ */
+typedef struct procfs_pidmaps {
+    int                     pms_count;      // Number of entries in use.
+    int                     pms_capacity;   // Number of entries allocated.
+    procfs_pidmaps_entry_t  *pms_entries;   // The entries.
+} procfs_pidmaps_t;
+
+extern int procfs_pidmap_add(procfs_pidmap_t *map, pid_t pid);
+extern void procfs_pidmap_remove(procfs_pidmap_t *map, pid_t pid);
+extern void procfs_pidmap_clear(procfs_pidmap_t *map);
+extern int procfs_pidmap_count_union(const procfs_pidmap_t *map1, const procfs_pidmap_t *map2);
+extern int procfs_pidmap_get_union(const procfs_pidmap_t *map1, const procfs_pidmap_t *map2,
+                                   pid_t start_pid, pid_t *pids, int capacity);
+
+extern procfs_pidmap_t *procfs_pidmaps_find(procfs_pidmaps_t *maps, uint32_t id);
+extern int procfs_pidmaps_add(procfs_pidmaps_t *maps, uint32_t id, pid_t pid);
+extern void procfs_pidmaps_remove(procfs_pidmaps_t *maps, uint32_t id, pid_t pid);
+extern void procfs_pidmaps_clear(procfs_pidmaps_t *maps);
+
+#endif /* procfs_pidmap_h */
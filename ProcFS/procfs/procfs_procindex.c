@@ -0,0 +1,681 @@
+//
+//  procfs_procindex.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// An index of the live processes, sorted by process id, that procfs
+// maintains for itself so that it does not have to walk the kernel's
+// process list (and take the process list lock) to enumerate processes
+// or to check whether a process exists and whether the caller can see
+// it. The index is seeded from the process list when the file system is
+// initialized and is then kept up to date by the process lifecycle hooks
+// (see procfs_events.c), which call procfs_procindex_add() when a process
+// forks, procfs_procindex_update() when it execs or changes its ids and
+// procfs_procindex_remove() when it exits.
+//
+// Lookups by process id use a binary search. Adding and removing a
+// process moves the entries that follow it, which is cheap for the
+// number of processes that a system can have.
+//
+// Alongside the entries, the index keeps bitmaps of the live process ids
+// (see procfs_pidmap.c): one of every process and one for each user id and
+// group id. A process appears in the maps for both its effective and real
+// user ids and both its effective and real group ids, so the processes that
+// a credential can see are the union of the map for its user id and the map
+// for its group id. This is the same rule as procfs_check_can_access_ids()
+// and the two must be kept in step. There is also a map for each command
+// name, keyed by the id that the name is given by procfs_comm_intern(), so
+// that the processes with a given name can be found without a scan. A
+// process whose name cannot be interned because the table of names is full
+// is not in any of these maps, so while there is such a process, the maps
+// are not used and callers look for processes by name in the process list
+// instead. Each entry holds a reference to its interned name, which is
+// released when the entry is removed or replaced, so names that no indexed
+// process has are removed from the table.
+//
+// If memory for the index cannot be allocated, the index is marked as
+// unusable and callers fall back to the process list. The next query
+// that finds the index unusable rebuilds it from the process list, so a
+// transient shortage of memory does not disable the index for good.
+//
+
+#include <kern/locks.h>
+#include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
+#include <sys/kauth.h>
+#include <sys/proc_internal.h>
+#include <sys/sysctl.h>
+#include "procfsnode.h"
+#include "procfs_comm.h"
+#include "procfs_pidmap.h"
+#include "procfs_procindex.h"
+#include "procfs_proctable.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The initial capacity of the index.
+#define PROCFS_PROCINDEX_INITIAL_CAPACITY 1024
+
+#pragma mark -
+#pragma mark Local Data
+
+// The index entries, sorted by process id, the number of entries and
+// the number of entries for which there is space.
+STATIC procfs_procindex_entry_t *procfs_procindex_entries;
+STATIC int procfs_procindex_entry_count;
+STATIC int procfs_procindex_capacity;
+
+// The ids of all indexed processes, and of the processes for each
+// effective or real user id and each effective or real group id.
+STATIC procfs_pidmap_t procfs_procindex_all_pids;
+STATIC procfs_pidmaps_t procfs_procindex_uid_pids;
+STATIC procfs_pidmaps_t procfs_procindex_gid_pids;
+
+// The ids of the indexed processes for each interned command name, and
+// the number of indexed processes that have a command name that could
+// not be interned.
+STATIC procfs_pidmaps_t procfs_procindex_comm_pids;
+STATIC int procfs_procindex_uninterned_count;
+
+// Whether the index is complete and can be used, and the number of
+// times that it has been rebuilt after becoming unusable.
+STATIC int procfs_procindex_valid;
+STATIC uint64_t procfs_procindex_rebuilds;
+
+// Lock that protects all of the above.
+STATIC lck_grp_t *procfs_procindex_lck_grp;
+STATIC lck_mtx_t *procfs_procindex_mutex;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_procindex_sysctl_invalidate SYSCTL_HANDLER_ARGS;
+STATIC boolean_t procfs_procindex_usable_locked(void);
+STATIC void procfs_procindex_seed_locked(void);
+STATIC int procfs_procindex_seed_proc(proc_t p, void *arg);
+STATIC void procfs_procindex_insert_locked(proc_t p, boolean_t add);
+STATIC int procfs_procindex_search(pid_t pid, boolean_t *found);
+STATIC void procfs_procindex_fill_entry(proc_t p, procfs_procindex_entry_t *entry);
+STATIC void procfs_procindex_release_comm(procfs_procindex_entry_t *entry);
+STATIC int procfs_procindex_map_ids(procfs_procindex_entry_t *entry);
+STATIC void procfs_procindex_unmap_ids(procfs_procindex_entry_t *entry);
+STATIC boolean_t procfs_procindex_entry_has_key(const procfs_procindex_entry_t *entry,
+                                                procfs_procindex_key_t key, uint32_t id);
+STATIC procfs_pidmap_t *procfs_procindex_key_map(procfs_procindex_key_t key, uint32_t id);
+STATIC void procfs_procindex_visible_maps(kauth_cred_t creds, const procfs_pidmap_t **map1p,
+                                          const procfs_pidmap_t **map2p);
+
+#pragma mark -
+#pragma mark Statistics
+
+SYSCTL_NODE(_vfs_procfs, OID_AUTO, procindex, CTLFLAG_RW | CTLFLAG_LOCKED, 0, "process index");
+SYSCTL_INT(_vfs_procfs_procindex, OID_AUTO, entries, CTLFLAG_RD | CTLFLAG_LOCKED,
+           &procfs_procindex_entry_count, 0, "number of indexed processes");
+SYSCTL_INT(_vfs_procfs_procindex, OID_AUTO, valid, CTLFLAG_RD | CTLFLAG_LOCKED,
+           &procfs_procindex_valid, 0, "whether the index is in use");
+SYSCTL_QUAD(_vfs_procfs_procindex, OID_AUTO, rebuilds, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_procindex_rebuilds, "times the index was rebuilt after becoming unusable");
+SYSCTL_PROC(_vfs_procfs_procindex, OID_AUTO, invalidate, CTLTYPE_INT | CTLFLAG_WR | CTLFLAG_LOCKED,
+            0, 0, procfs_procindex_sysctl_invalidate, "I", "write 1 to mark the index unusable");
+
+/*
+ * Handler for the vfs.procfs.procindex.invalidate sysctl, which marks the
+ * index unusable as a failure to allocate memory would, so that rebuilding
+ * it can be tested.
+ */
+STATIC int
+procfs_procindex_sysctl_invalidate SYSCTL_HANDLER_ARGS {
+#pragma unused(oidp, arg1, arg2)
+    int value = 0;
+    int error = SYSCTL_IN(req, &value, sizeof(value));
+    if (error == 0 && value != 0 && procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        procfs_procindex_valid = 0;
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+    return error;
+}
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the lock for the index and seeds the index with every
+ * existing process. Called once when the file system is initialized.
+ */
+void
+procfs_procindex_init(void) {
+    procfs_procindex_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.procindex_locks", LCK_GRP_ATTR_NULL);
+    procfs_procindex_mutex = lck_mtx_alloc_init(procfs_procindex_lck_grp, LCK_ATTR_NULL);
+
+    lck_mtx_lock(procfs_procindex_mutex);
+    procfs_procindex_seed_locked();
+    lck_mtx_unlock(procfs_procindex_mutex);
+}
+
+#pragma mark -
+#pragma mark Index Maintenance
+
+/*
+ * Adds a new process to the index. Called from the fork hook.
+ */
+void
+procfs_procindex_add(proc_t p) {
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        procfs_procindex_insert_locked(p, TRUE);
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+}
+
+/*
+ * Updates the entry for a process whose command name or ids may have
+ * changed. Called from the exec and setugid hooks.
+ */
+void
+procfs_procindex_update(proc_t p) {
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        procfs_procindex_insert_locked(p, FALSE);
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+}
+
+/*
+ * Removes a process from the index. Called from the exit hook.
+ */
+void
+procfs_procindex_remove(proc_t p) {
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        boolean_t found;
+        int index = procfs_procindex_search(p->p_pid, &found);
+        if (found && procfs_procindex_entries[index].ppi_uniqueid == p->p_uniqueid) {
+            procfs_pidmap_remove(&procfs_procindex_all_pids, p->p_pid);
+            procfs_procindex_unmap_ids(&procfs_procindex_entries[index]);
+            procfs_procindex_release_comm(&procfs_procindex_entries[index]);
+            int move_count = procfs_procindex_entry_count - index - 1;
+            if (move_count > 0) {
+                memmove(&procfs_procindex_entries[index], &procfs_procindex_entries[index + 1],
+                        move_count * sizeof(procfs_procindex_entry_t));
+            }
+            procfs_procindex_entry_count--;
+        }
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+}
+
+#pragma mark -
+#pragma mark Index Queries
+
+/*
+ * Gets the index entry for a process. Returns 0 if the process was
+ * found, ESRCH if it does not exist and ENOTSUP if the index cannot be
+ * used, in which case the caller must consult the process list instead.
+ */
+int
+procfs_procindex_lookup(pid_t pid, procfs_procindex_entry_t *entryp) {
+    int error = ENOTSUP;
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        if (procfs_procindex_usable_locked()) {
+            boolean_t found;
+            int index = procfs_procindex_search(pid, &found);
+            if (found) {
+                *entryp = procfs_procindex_entries[index];
+                error = 0;
+            } else {
+                error = ESRCH;
+            }
+        }
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+    return error;
+}
+
+/*
+ * Gets the number of processes in the index, or -1 if the
+ * index cannot be used.
+ */
+int
+procfs_procindex_count(void) {
+    int count = -1;
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        if (procfs_procindex_usable_locked()) {
+            count = procfs_procindex_entry_count;
+        }
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+    return count;
+}
+
+/*
+ * Gets the number of processes that are visible to a caller with given
+ * credentials, using the same rule as procfs_check_can_access_ids(). If
+ * creds is NULL, all processes are counted. Returns -1 if the index
+ * cannot be used.
+ */
+int
+procfs_procindex_visible_count(kauth_cred_t creds) {
+    int count = -1;
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        if (procfs_procindex_usable_locked()) {
+            const procfs_pidmap_t *map1;
+            const procfs_pidmap_t *map2;
+            procfs_procindex_visible_maps(creds, &map1, &map2);
+            count = procfs_pidmap_count_union(map1, map2);
+        }
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+    return count;
+}
+
+/*
+ * Gets the ids of the processes that are visible to a caller with given
+ * credentials, in increasing order, starting from a given process id.
+ * If creds is NULL, all processes are included. At most capacity ids are
+ * stored in the pids array. Returns the number of ids stored, which is
+ * equal to capacity if there may be more, or -1 if the index cannot be
+ * used. To get the next batch, call again with start_pid one more than the
+ * last process id returned.
+ */
+int
+procfs_procindex_visible_pids(kauth_cred_t creds, pid_t start_pid, pid_t *pids, int capacity) {
+    int count = -1;
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        if (procfs_procindex_usable_locked()) {
+            const procfs_pidmap_t *map1;
+            const procfs_pidmap_t *map2;
+            procfs_procindex_visible_maps(creds, &map1, &map2);
+            count = procfs_pidmap_get_union(map1, map2, start_pid, pids, capacity);
+        }
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+    return count;
+}
+
+/*
+ * Copies the index into a process table that has space for a given
+ * number of processes. The processes are in order of process id.
+ * Returns 0 on success, ENOSPC if the table is too small and ENOTSUP
+ * if the index cannot be used.
+ */
+int
+procfs_procindex_fill_table(procfs_proctable_t *table, int capacity) {
+    int error = ENOTSUP;
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        if (!procfs_procindex_usable_locked()) {
+            error = ENOTSUP;
+        } else if (procfs_procindex_entry_count > capacity) {
+            error = ENOSPC;
+        } else {
+            int count = procfs_procindex_entry_count;
+            for (int i = 0; i < count; i++) {
+                procfs_procindex_entry_t *entry = &procfs_procindex_entries[i];
+                table->ppt_pid[i] = entry->ppi_pid;
+                table->ppt_ppid[i] = entry->ppi_ppid;
+                table->ppt_uid[i] = entry->ppi_uid;
+                table->ppt_ruid[i] = entry->ppi_ruid;
+                table->ppt_gid[i] = entry->ppi_gid;
+                table->ppt_rgid[i] = entry->ppi_rgid;
+                bcopy(entry->ppi_comm, table->ppt_comm[i], MAXCOMLEN + 1);
+            }
+            table->ppt_count = count;
+            error = 0;
+        }
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+    return error;
+}
+
+/*
+ * Gets an upper bound on the number of processes that have a given key:
+ * an effective user id for PROCFS_PROCINDEX_KEY_UID or the interned id of
+ * a command name for PROCFS_PROCINDEX_KEY_COMM. Returns -1 if the index
+ * cannot be used for the key.
+ */
+int
+procfs_procindex_key_count(procfs_procindex_key_t key, uint32_t id) {
+    int count = -1;
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        if (procfs_procindex_usable_locked() && (key != PROCFS_PROCINDEX_KEY_COMM || procfs_procindex_uninterned_count == 0)) {
+            count = procfs_pidmap_count_union(procfs_procindex_key_map(key, id), NULL);
+        }
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+    return count;
+}
+
+/*
+ * Gets the ids of the processes that have a given key and are visible
+ * to a caller with given credentials, in increasing order. If creds is
+ * NULL, no access check is made. At most capacity ids are stored in the
+ * pids array. Returns the number of ids stored or -1 if the index cannot
+ * be used for the key. The candidates come from the map for the key, which for a user
+ * id also holds the processes for which it is only the real user id, so
+ * each one is checked against its entry.
+ */
+int
+procfs_procindex_key_pids(procfs_procindex_key_t key, uint32_t id, kauth_cred_t creds,
+                          pid_t *pids, int capacity) {
+    int count = -1;
+    if (procfs_procindex_mutex != NULL) {
+        lck_mtx_lock(procfs_procindex_mutex);
+        if (procfs_procindex_usable_locked() && (key != PROCFS_PROCINDEX_KEY_COMM || procfs_procindex_uninterned_count == 0)) {
+            // Compact the matching ids to the front of the array as we go.
+            int candidates = procfs_pidmap_get_union(procfs_procindex_key_map(key, id), NULL, 0, pids, capacity);
+            count = 0;
+            for (int i = 0; i < candidates; i++) {
+                boolean_t found;
+                int index = procfs_procindex_search(pids[i], &found);
+                if (found) {
+                    procfs_procindex_entry_t *entry = &procfs_procindex_entries[index];
+                    if (procfs_procindex_entry_has_key(entry, key, id)
+                            && (creds == NULL || procfs_check_can_access_ids(creds, entry->ppi_uid, entry->ppi_ruid,
+                                                                             entry->ppi_gid, entry->ppi_rgid) == 0)) {
+                        pids[count++] = pids[i];
+                    }
+                }
+            }
+        }
+        lck_mtx_unlock(procfs_procindex_mutex);
+    }
+    return count;
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Determines whether the index can be used, first rebuilding it from
+ * the process list if it has been marked unusable. Must be called with
+ * the index lock held.
+ */
+STATIC boolean_t
+procfs_procindex_usable_locked(void) {
+    if (!procfs_procindex_valid) {
+        procfs_procindex_seed_locked();
+        if (procfs_procindex_valid) {
+            procfs_procindex_rebuilds++;
+        }
+    }
+    return procfs_procindex_valid != 0;
+}
+
+/*
+ * Discards the content of the index and adds every existing process to
+ * it. The lifecycle hooks wait for the index lock, so no process can be
+ * created, change or exit unnoticed while this is in progress. If memory
+ * cannot be allocated, the index is left marked unusable. Must be called
+ * with the index lock held.
+ */
+STATIC void
+procfs_procindex_seed_locked(void) {
+    for (int i = 0; i < procfs_procindex_entry_count; i++) {
+        procfs_procindex_release_comm(&procfs_procindex_entries[i]);
+    }
+    procfs_procindex_entry_count = 0;
+    procfs_pidmap_clear(&procfs_procindex_all_pids);
+    procfs_pidmaps_clear(&procfs_procindex_uid_pids);
+    procfs_pidmaps_clear(&procfs_procindex_gid_pids);
+    procfs_pidmaps_clear(&procfs_procindex_comm_pids);
+    procfs_procindex_uninterned_count = 0;
+
+    if (procfs_procindex_entries == NULL) {
+        size_t size = PROCFS_PROCINDEX_INITIAL_CAPACITY * sizeof(procfs_procindex_entry_t);
+        procfs_procindex_entries = (procfs_procindex_entry_t *)OSMalloc((uint32_t)size, procfs_osmalloc_tag);
+        if (procfs_procindex_entries == NULL) {
+            return;
+        }
+        procfs_procindex_capacity = PROCFS_PROCINDEX_INITIAL_CAPACITY;
+    }
+
+    // Mark the index valid first, so that a failure to add a process
+    // while seeding marks it invalid again.
+    procfs_procindex_valid = 1;
+    proc_iterate(PROC_ALLPROCLIST, procfs_procindex_seed_proc, NULL, NULL, NULL);
+}
+
+/*
+ * Function used to iterate the process list to seed the index. Called
+ * with the index lock held.
+ */
+STATIC int
+procfs_procindex_seed_proc(proc_t p, __unused void *arg) {
+    procfs_procindex_insert_locked(p, TRUE);
+    return PROC_RETURNED;
+}
+
+/*
+ * Adds or replaces the entry for a process. If add is FALSE, the
+ * entry is only replaced if it exists. A process that is exiting is
+ * never added. Its exit flag is set before the exit hook is called,
+ * so if it is clear here, the exit hook has not yet removed the
+ * process and will do so after we release the lock. Must be called
+ * with the index lock held.
+ */
+STATIC void
+procfs_procindex_insert_locked(proc_t p, boolean_t add) {
+    if (!procfs_procindex_valid || (p->p_lflag & P_LEXIT) != 0) {
+        return;
+    }
+
+    boolean_t found;
+    int index = procfs_procindex_search(p->p_pid, &found);
+    if (found) {
+        // Move the process to the maps for its new ids and command
+        // name if they have changed.
+        procfs_procindex_entry_t *entry = &procfs_procindex_entries[index];
+        procfs_procindex_entry_t new_entry;
+        procfs_procindex_fill_entry(p, &new_entry);
+        if (entry->ppi_uid != new_entry.ppi_uid || entry->ppi_ruid != new_entry.ppi_ruid
+                || entry->ppi_gid != new_entry.ppi_gid || entry->ppi_rgid != new_entry.ppi_rgid
+                || entry->ppi_comm_id != new_entry.ppi_comm_id) {
+            procfs_procindex_unmap_ids(entry);
+            procfs_procindex_release_comm(entry);
+            *entry = new_entry;
+            if (procfs_procindex_map_ids(entry) != 0) {
+                procfs_procindex_valid = 0;
+            }
+        } else {
+            // The new entry has its own reference to the name.
+            procfs_procindex_release_comm(entry);
+            *entry = new_entry;
+        }
+        return;
+    }
+    if (!add) {
+        return;
+    }
+
+    // Grow the index if it is full. If that or adding the process
+    // to the maps fails, stop using the index.
+    if (procfs_procindex_entry_count == procfs_procindex_capacity) {
+        int new_capacity = 2 * procfs_procindex_capacity;
+        size_t old_size = procfs_procindex_capacity * sizeof(procfs_procindex_entry_t);
+        size_t new_size = new_capacity * sizeof(procfs_procindex_entry_t);
+        procfs_procindex_entry_t *new_entries = (procfs_procindex_entry_t *)OSMalloc((uint32_t)new_size, procfs_osmalloc_tag);
+        if (new_entries == NULL) {
+            procfs_procindex_valid = 0;
+            return;
+        }
+        bcopy(procfs_procindex_entries, new_entries, old_size);
+        OSFree(procfs_procindex_entries, (uint32_t)old_size, procfs_osmalloc_tag);
+        procfs_procindex_entries = new_entries;
+        procfs_procindex_capacity = new_capacity;
+    }
+
+    int move_count = procfs_procindex_entry_count - index;
+    if (move_count > 0) {
+        memmove(&procfs_procindex_entries[index + 1], &procfs_procindex_entries[index],
+                move_count * sizeof(procfs_procindex_entry_t));
+    }
+    procfs_procindex_fill_entry(p, &procfs_procindex_entries[index]);
+    procfs_procindex_entry_count++;
+    if (procfs_pidmap_add(&procfs_procindex_all_pids, p->p_pid) != 0
+            || procfs_procindex_map_ids(&procfs_procindex_entries[index]) != 0) {
+        procfs_procindex_valid = 0;
+    }
+}
+
+/*
+ * Finds the position of a process id in the index. If it is present,
+ * sets *found to TRUE and returns its index. Otherwise, sets *found to
+ * FALSE and returns the index at which it would be inserted. Must be
+ * called with the index lock held.
+ */
+STATIC int
+procfs_procindex_search(pid_t pid, boolean_t *found) {
+    int low = 0;
+    int high = procfs_procindex_entry_count;
+    while (low < high) {
+        int mid = low + (high - low)/2;
+        pid_t mid_pid = procfs_procindex_entries[mid].ppi_pid;
+        if (mid_pid == pid) {
+            *found = TRUE;
+            return mid;
+        } else if (mid_pid < pid) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *found = FALSE;
+    return low;
+}
+
+/*
+ * Populates an index entry from a process, interning its command name.
+ * The entry holds a reference to the name, which must be released with
+ * procfs_procindex_release_comm(). Must be called with the index lock held.
+ */
+STATIC void
+procfs_procindex_fill_entry(proc_t p, procfs_procindex_entry_t *entry) {
+    entry->ppi_pid = p->p_pid;
+    entry->ppi_ppid = p->p_ppid;
+    entry->ppi_uniqueid = p->p_uniqueid;
+    entry->ppi_start_time = (uint64_t)p->p_start.tv_sec * USEC_PER_SEC + p->p_start.tv_usec;
+    entry->ppi_uid = p->p_uid;
+    entry->ppi_ruid = p->p_ruid;
+    entry->ppi_gid = p->p_gid;
+    entry->ppi_rgid = p->p_rgid;
+    strlcpy(entry->ppi_comm, p->p_comm, MAXCOMLEN + 1);
+    if (procfs_comm_intern(entry->ppi_comm, &entry->ppi_comm_id) != 0) {
+        entry->ppi_comm_id = 0;
+    }
+}
+
+/*
+ * Releases the reference that an index entry holds to its command name.
+ * Must be called with the index lock held.
+ */
+STATIC void
+procfs_procindex_release_comm(procfs_procindex_entry_t *entry) {
+    if (entry->ppi_comm_id != 0) {
+        procfs_comm_release(entry->ppi_comm_id);
+        entry->ppi_comm_id = 0;
+    }
+}
+
+/*
+ * Adds a process to the maps for its effective and real user ids, its
+ * effective and real group ids and its command name. Returns 0 on success or ENOMEM if
+ * memory could not be allocated. Must be called with the index lock held.
+ */
+STATIC int
+procfs_procindex_map_ids(procfs_procindex_entry_t *entry) {
+    pid_t pid = entry->ppi_pid;
+    int error = procfs_pidmaps_add(&procfs_procindex_uid_pids, entry->ppi_uid, pid);
+    if (error == 0) {
+        error = procfs_pidmaps_add(&procfs_procindex_uid_pids, entry->ppi_ruid, pid);
+    }
+    if (error == 0) {
+        error = procfs_pidmaps_add(&procfs_procindex_gid_pids, entry->ppi_gid, pid);
+    }
+    if (error == 0) {
+        error = procfs_pidmaps_add(&procfs_procindex_gid_pids, entry->ppi_rgid, pid);
+    }
+    if (error == 0 && entry->ppi_comm_id != 0) {
+        error = procfs_pidmaps_add(&procfs_procindex_comm_pids, entry->ppi_comm_id, pid);
+    } else if (error == 0 && entry->ppi_comm[0] != (char)0) {
+        procfs_procindex_uninterned_count++;
+    }
+    return error;
+}
+
+/*
+ * Removes a process from the maps for its user and group ids and its
+ * command name. Must be called with the index lock held.
+ */
+STATIC void
+procfs_procindex_unmap_ids(procfs_procindex_entry_t *entry) {
+    pid_t pid = entry->ppi_pid;
+    procfs_pidmaps_remove(&procfs_procindex_uid_pids, entry->ppi_uid, pid);
+    procfs_pidmaps_remove(&procfs_procindex_uid_pids, entry->ppi_ruid, pid);
+    procfs_pidmaps_remove(&procfs_procindex_gid_pids, entry->ppi_gid, pid);
+    procfs_pidmaps_remove(&procfs_procindex_gid_pids, entry->ppi_rgid, pid);
+    if (entry->ppi_comm_id != 0) {
+        procfs_pidmaps_remove(&procfs_procindex_comm_pids, entry->ppi_comm_id, pid);
+    } else if (entry->ppi_comm[0] != (char)0) {
+        procfs_procindex_uninterned_count--;
+    }
+}
+
+/*
+ * Determines whether an index entry has a given key. Must be called with
+ * the index lock held.
+ */
+STATIC boolean_t
+procfs_procindex_entry_has_key(const procfs_procindex_entry_t *entry, procfs_procindex_key_t key, uint32_t id) {
+    switch (key) {
+    case PROCFS_PROCINDEX_KEY_UID:
+        return entry->ppi_uid == id;
+
+    case PROCFS_PROCINDEX_KEY_COMM:
+        return entry->ppi_comm_id == id;
+    }
+    return FALSE;
+}
+
+/*
+ * Gets the map that holds the processes that may have a given key, or
+ * NULL if there are none. Must be called with the index lock held.
+ */
+STATIC procfs_pidmap_t *
+procfs_procindex_key_map(procfs_procindex_key_t key, uint32_t id) {
+    switch (key) {
+    case PROCFS_PROCINDEX_KEY_UID:
+        return procfs_pidmaps_find(&procfs_procindex_uid_pids, id);
+
+    case PROCFS_PROCINDEX_KEY_COMM:
+        return id == 0 ? NULL : procfs_pidmaps_find(&procfs_procindex_comm_pids, id);
+    }
+    return NULL;
+}
+
+/*
+ * Gets the two maps whose union is the set of processes that are visible
+ * to a caller with given credentials. If creds is NULL, that is the map
+ * of all processes. Either map may be NULL. Must be called with the index
+ * lock held.
+ */
+STATIC void
+procfs_procindex_visible_maps(kauth_cred_t creds, const procfs_pidmap_t **map1p,
+                              const procfs_pidmap_t **map2p) {
+    if (creds == NULL) {
+        *map1p = &procfs_procindex_all_pids;
+        *map2p = NULL;
+    } else {
+        posix_cred_t posix_creds = &creds->cr_posix;
+        *map1p = procfs_pidmaps_find(&procfs_procindex_uid_pids, posix_creds->cr_uid);
+        *map2p = procfs_pidmaps_find(&procfs_procindex_gid_pids, posix_creds->cr_groups[0]);
+    }
+}
@@ -0,0 +1,55 @@
+//
+//  procfs_procindex.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_procindex_h
+#define procfs_procindex_h
+
+#include <sys/kauth.h>
+#include <sys/kernel_types.h>
+#include <sys/param.h>
+
+/*
+ * The information about a process that is held in the process index.
+ */
+typedef struct procfs_procindex_entry {
+    pid_t       ppi_pid;                    // Process id.
+    pid_t       ppi_ppid;                   // Parent process id.
+    uint64_t    ppi_uniqueid;               // Process unique id, never reused.
+    uint64_t    ppi_start_time;             // Start time, microseconds since the epoch.
+    uid_t       ppi_uid;                    // Effective user id.
+    uid_t       ppi_ruid;                   // Real user id.
+    gid_t       ppi_gid;                    // Effective group id.
+    gid_t       ppi_rgid;                   // Real group id.
+    char        ppi_comm[MAXCOMLEN + 1];    // Command name.
+    uint32_t    ppi_comm_id;                // Interned id of the command name, 0 if not interned.
+} procfs_procindex_entry_t;
+
+/*
+ * The keys by which the processes in the index can be looked up.
+ */
+typedef enum {
+    PROCFS_PROCINDEX_KEY_UID,   // Effective user id.
+    PROCFS_PROCINDEX_KEY_COMM,  // Interned id of the command name.
+} procfs_procindex_key_t;
+
+struct procfs_proctable;
+
+extern void procfs_procindex_init(void);
+extern void procfs_procindex_add(proc_t p);
+extern void procfs_procindex_update(proc_t p);
+extern void procfs_procindex_remove(proc_t p);
+extern int procfs_procindex_lookup(pid_t pid, procfs_procindex_entry_t *entryp);
+extern int procfs_procindex_count(void);
+extern int procfs_procindex_visible_count(kauth_cred_t creds);
+extern int procfs_procindex_visible_pids(kauth_cred_t creds, pid_t start_pid, pid_t *pids, int capacity);
+extern int procfs_procindex_fill_table(struct procfs_proctable *table, int capacity);
+extern int procfs_procindex_key_count(procfs_procindex_key_t key, uint32_t id);
+extern int procfs_procindex_key_pids(procfs_procindex_key_t key, uint32_t id, kauth_cred_t creds,
+                                     pid_t *pids, int capacity);
+
+#endif /* procfs_procindex_h */
@@ -0,0 +1,364 @@
+//
+//  procfs_proctable.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// A snapshot of the process table that is shared by the operations that
+// need more than the process index can give them cheaply. Listing the
+// byname directory always uses it, because it needs the command name of
+// every process. Counting and listing processes (procfs_get_process_count()
+// and procfs_get_pids()) use it only if the process index is unusable.
+// It is copied from the process index (see procfs_procindex.c), or built
+// by walking the process list if the index cannot be used. Sharing it
+// means that many readers arriving together do not each make the same
+// copy.
+//
+// A table is reused while it is current. A table is never current once
+// a process has exec'ed or changed its ids since it was built, because
+// the ids are used for access checks. Otherwise, it is current for the
+// minimum rebuild interval that the caller asks for, which comes from
+// the "snapinterval" mount option of the mount being read and is zero
+// by default. After that, it remains current as long as no process has
+// forked or exited, up to PROCFS_PROCTABLE_MAX_AGE_SECS seconds, which
+// limits how long a change of ids can go unnoticed if the kernel does
+// not call the setugid hook. Raising the minimum interval trades
+// freshness for fewer rebuilds on busy systems, but only delays the
+// appearance of new processes and the disappearance of old ones.
+//
+// Only one thread builds a new table at a time. Threads that need a
+// table while one is being built wait for it instead of building their
+// own.
+//
+// Counts of rebuilds, reuses and coalesced requests are published under
+// vfs.procfs.proctable.
+//
+
+#include <kern/clock.h>
+#include <kern/locks.h>
+#include <libkern/libkern.h>
+#include <libkern/OSAtomic.h>
+#include <libkern/OSMalloc.h>
+#include <sys/proc_internal.h>
+#include <sys/sysctl.h>
+#include "procfsnode.h"
+#include "procfs_procindex.h"
+#include "procfs_proctable.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The longest time for which a table is used, in seconds, if the
+// process generation has not changed.
+#define PROCFS_PROCTABLE_MAX_AGE_SECS 1
+
+// The number of extra entries in a table, to allow for processes
+// that are created while the table is being built.
+#define PROCFS_PROCTABLE_SLACK 32
+
+// Rounds a size up to a multiple of 8 bytes.
+#define PROCFS_PROCTABLE_ROUND(size) (((size) + 7) & ~(size_t)7)
+
+/*
+ * Structure used to keep track of table construction.
+ */
+struct procfs_proctable_build_data {
+    procfs_proctable_t  *table;     // The table being built.
+    int                 capacity;   // The number of entries that the table can hold.
+    boolean_t           overflow;   // Set if there were more processes than space.
+};
+
+#pragma mark -
+#pragma mark Local Data
+
+// The current table, or NULL if there is none. The cache holds a
+// reference to it.
+STATIC procfs_proctable_t *procfs_proctable_current;
+
+// Whether a table is being built. Also the channel on which threads
+// wait for the build to complete.
+STATIC boolean_t procfs_proctable_building;
+
+// Lock that protects all of the above.
+STATIC lck_grp_t *procfs_proctable_lck_grp;
+STATIC lck_mtx_t *procfs_proctable_mutex;
+
+// The process generation, which is advanced whenever a process forks,
+// execs, exits or changes its ids, and the id generation, which is
+// only advanced when a process execs or changes its ids. Updated
+// atomically, without the lock, because they are advanced from the
+// process lifecycle hooks.
+STATIC volatile SInt64 procfs_proctable_process_generation;
+STATIC volatile SInt64 procfs_proctable_ids_generation;
+
+// Statistics.
+STATIC uint64_t procfs_proctable_rebuilds;
+STATIC uint64_t procfs_proctable_reuses;
+STATIC uint64_t procfs_proctable_coalesced;
+STATIC uint64_t procfs_proctable_overflows;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC uint64_t procfs_proctable_uptime_ns(void);
+STATIC boolean_t procfs_proctable_is_current(procfs_proctable_t *table, uint64_t interval_ns, uint64_t now);
+STATIC procfs_proctable_t *procfs_proctable_build(void);
+STATIC procfs_proctable_t *procfs_proctable_alloc(int capacity);
+STATIC int procfs_proctable_add_proc(proc_t p, struct procfs_proctable_build_data *data);
+
+#pragma mark -
+#pragma mark Statistics
+
+SYSCTL_NODE(_vfs_procfs, OID_AUTO, proctable, CTLFLAG_RW | CTLFLAG_LOCKED, 0, "shared process table");
+SYSCTL_QUAD(_vfs_procfs_proctable, OID_AUTO, rebuilds, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_proctable_rebuilds, "tables built");
+SYSCTL_QUAD(_vfs_procfs_proctable, OID_AUTO, reuses, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_proctable_reuses, "requests satisfied by the current table");
+SYSCTL_QUAD(_vfs_procfs_proctable, OID_AUTO, coalesced, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_proctable_coalesced, "requests that waited for another thread's build");
+SYSCTL_QUAD(_vfs_procfs_proctable, OID_AUTO, overflows, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_proctable_overflows, "tables that filled up while being built");
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the lock for the process table. Called once when the
+ * file system is initialized.
+ */
+void
+procfs_proctable_init(void) {
+    procfs_proctable_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.proctable_locks", LCK_GRP_ATTR_NULL);
+    procfs_proctable_mutex = lck_mtx_alloc_init(procfs_proctable_lck_grp, LCK_ATTR_NULL);
+}
+
+/*
+ * Advances the process generation, so that the current table is not
+ * used again once the caller's minimum rebuild interval has passed. If
+ * "ids_changed" is TRUE, because a process has exec'ed or changed its
+ * ids, also advances the id generation, so that the current table is
+ * not used again at all. Called from the process lifecycle hooks.
+ */
+void
+procfs_proctable_invalidate(boolean_t ids_changed) {
+    if (ids_changed) {
+        OSIncrementAtomic64(&procfs_proctable_ids_generation);
+    }
+    OSIncrementAtomic64(&procfs_proctable_process_generation);
+}
+
+#pragma mark -
+#pragma mark Table Access
+
+/*
+ * Gets a reference to a current process table, building a new one if
+ * necessary. A table that was built less than "min_interval_ms"
+ * milliseconds ago is used even if processes have been created or
+ * have exited since. The interval is capped at
+ * PROCFS_MAX_SNAPSHOT_INTERVAL_MS. If another thread is already building
+ * a table, waits for it to finish and uses its table. Returns NULL if
+ * memory could not be allocated. The reference must be released by
+ * calling procfs_proctable_release().
+ */
+procfs_proctable_t *
+procfs_proctable_acquire(uint32_t min_interval_ms) {
+    uint64_t interval_ns = (uint64_t)MIN(min_interval_ms, PROCFS_MAX_SNAPSHOT_INTERVAL_MS) * NSEC_PER_MSEC;
+    procfs_proctable_t *table = NULL;
+    boolean_t waited = FALSE;
+
+    lck_mtx_lock(procfs_proctable_mutex);
+    for (;;) {
+        procfs_proctable_t *current = procfs_proctable_current;
+        if (current != NULL && (waited || procfs_proctable_is_current(current, interval_ns, procfs_proctable_uptime_ns()))) {
+            // Either the table is current or it was built while we were
+            // waiting, which is as fresh as we could get by building our own.
+            OSIncrementAtomic(&current->ppt_refcount);
+            if (waited) {
+                procfs_proctable_coalesced++;
+            } else {
+                procfs_proctable_reuses++;
+            }
+            table = current;
+            break;
+        }
+
+        if (!procfs_proctable_building) {
+            // Build a new table, without holding the lock.
+            procfs_proctable_building = TRUE;
+            lck_mtx_unlock(procfs_proctable_mutex);
+            table = procfs_proctable_build();
+            lck_mtx_lock(procfs_proctable_mutex);
+
+            // Install the new table and wake up any threads that are
+            // waiting for it. The cache and the caller each hold a reference.
+            procfs_proctable_t *old_table = procfs_proctable_current;
+            if (table != NULL) {
+                table->ppt_refcount = 2;
+                procfs_proctable_current = table;
+                procfs_proctable_rebuilds++;
+            }
+            procfs_proctable_building = FALSE;
+            wakeup(&procfs_proctable_building);
+            lck_mtx_unlock(procfs_proctable_mutex);
+
+            if (table != NULL && old_table != NULL) {
+                procfs_proctable_release(old_table);
+            }
+            return table;
+        }
+
+        // Wait for the thread that is building a table to finish.
+        msleep(&procfs_proctable_building, procfs_proctable_mutex, PZERO, "procfs_proctable", NULL);
+        waited = TRUE;
+    }
+    lck_mtx_unlock(procfs_proctable_mutex);
+
+    return table;
+}
+
+/*
+ * Releases a reference to a process table, freeing it if it was
+ * the last reference.
+ */
+void
+procfs_proctable_release(procfs_proctable_t *table) {
+    if (OSDecrementAtomic(&table->ppt_refcount) == 1) {
+        OSFree(table, table->ppt_size, procfs_osmalloc_tag);
+    }
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Gets the system uptime in nanoseconds.
+ */
+STATIC uint64_t
+procfs_proctable_uptime_ns(void) {
+    uint64_t now;
+    uint64_t now_ns;
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now, &now_ns);
+    return now_ns;
+}
+
+/*
+ * Determines whether a table can still be used by a caller that accepts
+ * a given minimum interval between rebuilds. Must be called with the
+ * table lock held.
+ */
+STATIC boolean_t
+procfs_proctable_is_current(procfs_proctable_t *table, uint64_t interval_ns, uint64_t now) {
+    if (table->ppt_ids_generation != (uint64_t)procfs_proctable_ids_generation) {
+        return FALSE;
+    }
+    uint64_t age = now - table->ppt_build_time;
+    if (age < interval_ns) {
+        return TRUE;
+    }
+    return table->ppt_generation == (uint64_t)procfs_proctable_process_generation
+            && age < (uint64_t)PROCFS_PROCTABLE_MAX_AGE_SECS * NSEC_PER_SEC;
+}
+
+/*
+ * Builds a new process table with a reference count of zero. The table
+ * is copied from the process index if it is usable. Otherwise, it is
+ * built by walking the process list. In either case, it is sized from
+ * the current process count, with some room for processes that are
+ * created while it is being built. If it still fills up, it is built
+ * again with more space. Returns NULL if memory could not be allocated.
+ */
+STATIC procfs_proctable_t *
+procfs_proctable_build(void) {
+    struct procfs_proctable_build_data data;
+    int index_count = procfs_procindex_count();
+    int capacity = (index_count >= 0 ? index_count : nprocs) + PROCFS_PROCTABLE_SLACK;
+    for (;;) {
+        uint64_t ids_generation = (uint64_t)procfs_proctable_ids_generation;
+        uint64_t generation = (uint64_t)procfs_proctable_process_generation;
+        procfs_proctable_t *table = procfs_proctable_alloc(capacity);
+        if (table == NULL) {
+            return NULL;
+        }
+
+        int error = procfs_procindex_fill_table(table, capacity);
+        if (error == ENOTSUP) {
+            data.table = table;
+            data.capacity = capacity;
+            data.overflow = FALSE;
+            proc_iterate(PROC_ALLPROCLIST, (int (*)(proc_t, void *))&procfs_proctable_add_proc, &data, NULL, NULL);
+            error = data.overflow ? ENOSPC : 0;
+        }
+        if (error == 0) {
+            table->ppt_generation = generation;
+            table->ppt_ids_generation = ids_generation;
+            table->ppt_build_time = procfs_proctable_uptime_ns();
+            return table;
+        }
+
+        OSIncrementAtomic64((volatile SInt64 *)&procfs_proctable_overflows);
+        OSFree(table, table->ppt_size, procfs_osmalloc_tag);
+        capacity *= 2;
+    }
+}
+
+/*
+ * Allocates an empty table with space for a given number of processes.
+ * The table header and all of the arrays are in a single allocation.
+ */
+STATIC procfs_proctable_t *
+procfs_proctable_alloc(int capacity) {
+    size_t header_size = PROCFS_PROCTABLE_ROUND(sizeof(procfs_proctable_t));
+    size_t pid_size = PROCFS_PROCTABLE_ROUND(capacity * sizeof(pid_t));
+    size_t id_size = PROCFS_PROCTABLE_ROUND(capacity * sizeof(uid_t));
+    size_t comm_size = PROCFS_PROCTABLE_ROUND(capacity * (MAXCOMLEN + 1));
+    size_t size = header_size + 2 * pid_size + 4 * id_size + comm_size;
+
+    char *memory = (char *)OSMalloc((uint32_t)size, procfs_osmalloc_tag);
+    if (memory == NULL) {
+        return NULL;
+    }
+
+    procfs_proctable_t *table = (procfs_proctable_t *)memory;
+    bzero(table, sizeof(procfs_proctable_t));
+    table->ppt_size = (uint32_t)size;
+    char *next = memory + header_size;
+    table->ppt_pid = (pid_t *)next;
+    next += pid_size;
+    table->ppt_ppid = (pid_t *)next;
+    next += pid_size;
+    table->ppt_uid = (uid_t *)next;
+    next += id_size;
+    table->ppt_ruid = (uid_t *)next;
+    next += id_size;
+    table->ppt_gid = (gid_t *)next;
+    next += id_size;
+    table->ppt_rgid = (gid_t *)next;
+    next += id_size;
+    table->ppt_comm = (char (*)[MAXCOMLEN + 1])next;
+    return table;
+}
+
+/*
+ * Function used to iterate the process list to add each process to
+ * a table. Stops the iteration if the table is full.
+ */
+STATIC int
+procfs_proctable_add_proc(proc_t p, struct procfs_proctable_build_data *data) {
+    procfs_proctable_t *table = data->table;
+    int index = table->ppt_count;
+    if (index == data->capacity) {
+        data->overflow = TRUE;
+        return PROC_RETURNED_DONE;
+    }
+
+    table->ppt_pid[index] = p->p_pid;
+    table->ppt_ppid[index] = p->p_ppid;
+    table->ppt_uid[index] = p->p_uid;
+    table->ppt_ruid[index] = p->p_ruid;
+    table->ppt_gid[index] = p->p_gid;
+    table->ppt_rgid[index] = p->p_rgid;
+    strlcpy(table->ppt_comm[index], p->p_comm, MAXCOMLEN + 1);
+    table->ppt_count++;
+    return PROC_RETURNED;
+}
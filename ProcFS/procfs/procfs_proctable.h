@@ -0,0 +1,45 @@
+//
+//  procfs_proctable.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_proctable_h
+#define procfs_proctable_h
+
+#include <sys/kernel_types.h>
+#include <sys/param.h>
+
+/*
+ * A snapshot of the process table, shared by all callers that need
+ * to enumerate processes. The fields of each process are held in
+ * separate arrays, so that a scan that only needs some of them (such
+ * as the ids used for access checks) touches as little memory as
+ * possible. Entry i of every array refers to the same process.
+ * A table is immutable once it has been built and is freed when the
+ * last reference to it is released.
+ */
+typedef struct procfs_proctable {
+    SInt32      ppt_refcount;           // Number of references. Updated atomically.
+    int         ppt_count;              // Number of processes in the table.
+    uint32_t    ppt_size;               // Size of the allocation holding the table.
+    uint64_t    ppt_generation;         // Process generation when the table was built.
+    uint64_t    ppt_ids_generation;     // Process id generation when the table was built.
+    uint64_t    ppt_build_time;         // Uptime when the table was built, in nanoseconds.
+    pid_t       *ppt_pid;               // Process ids.
+    pid_t       *ppt_ppid;              // Parent process ids.
+    uid_t       *ppt_uid;               // Effective user ids.
+    uid_t       *ppt_ruid;              // Real user ids.
+    gid_t       *ppt_gid;               // Effective group ids.
+    gid_t       *ppt_rgid;              // Real group ids.
+    char        (*ppt_comm)[MAXCOMLEN + 1]; // Command names.
+} procfs_proctable_t;
+
+extern void procfs_proctable_init(void);
+extern void procfs_proctable_invalidate(boolean_t ids_changed);
+extern procfs_proctable_t *procfs_proctable_acquire(uint32_t min_interval_ms);
+extern void procfs_proctable_release(procfs_proctable_t *table);
+
+#endif /* procfs_proctable_h */
@@ -0,0 +1,281 @@
+//
+//  procfs_proctree.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Implements the "children" directory and the "descendants" file in each
+// process directory. The "children" directory holds a link to each visible
+// child of the process and the "descendants" file contains a record for each
+// visible process in the subtree below it, so that a tool that needs the
+// process tree below a process does not have to read the parent process id
+// of every process on the system to rebuild it.
+//
+// Both are built from the kernel's list of the children of each process,
+// which proc_childrenwalk() walks, so the cost is proportional to the size
+// of the subtree rather than to the number of processes.
+//
+
+#include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
+#include <sys/proc_internal.h>
+#include "procfs.h"
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// Extra space allowed for children that are created while
+// the children of a process are being listed.
+#define PROCFS_PROCTREE_SLACK 8
+
+// The number of descendants to allow for at first.
+#define PROCFS_PROCTREE_INITIAL_CAPACITY 64
+
+// State for collecting the ids of the children of a process.
+typedef struct procfs_proctree_children {
+    kauth_cred_t    ptc_creds;      // Credentials for the access check, NULL for none.
+    pid_t           *ptc_pids;      // Where to store process ids.
+    int             ptc_count;      // Number of ids stored.
+    int             ptc_capacity;   // Number of ids for which there is space.
+    boolean_t       ptc_overflow;   // Whether there was not enough space.
+} procfs_proctree_children_t;
+
+// A process found while walking the subtree below a process.
+typedef struct procfs_proctree_node {
+    procfs_descendant_t ptn_record;     // The record for the process.
+    boolean_t           ptn_visible;    // Whether the caller can see the process.
+} procfs_proctree_node_t;
+
+// State for a breadth-first walk of the subtree below a process. The
+// nodes array is both the result and the queue of processes whose
+// children have yet to be added.
+typedef struct procfs_proctree_walk {
+    kauth_cred_t            ptw_creds;          // Credentials for the access check, NULL for none.
+    procfs_proctree_node_t  *ptw_nodes;         // The processes found so far.
+    int                     ptw_count;          // Number of processes found.
+    int                     ptw_capacity;       // Number of processes for which there is space.
+    int                     ptw_visible_count;  // Number of found processes that are visible.
+    uint32_t                ptw_depth;          // Depth of the children being added.
+    int                     ptw_error;          // Error that stopped the walk, or 0.
+} procfs_proctree_walk_t;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_proctree_collect_child(proc_t p, void *arg);
+STATIC int procfs_proctree_walk(pid_t pid, kauth_cred_t creds, procfs_proctree_walk_t *walk);
+STATIC void procfs_proctree_free_walk(procfs_proctree_walk_t *walk);
+STATIC int procfs_proctree_add_node(proc_t p, void *arg);
+
+#pragma mark -
+#pragma mark Children Directory
+
+/*
+ * Gets the ids of the visible children of the process that a "children"
+ * directory belongs to, in order of process id.
+ */
+void
+procfs_children_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                          pid_t **pidpp, int *pid_count, uint32_t *sizep) {
+    *pidpp = NULL;
+    *pid_count = 0;
+    *sizep = 0;
+
+    proc_t p = proc_find(dir_pnp->node_id.nodeid_pid);
+    if (p == PROC_NULL) {
+        return;
+    }
+
+    // Walk the children, starting again with more
+    // space if there are more than we allowed for.
+    int capacity = p->p_childrencnt + PROCFS_PROCTREE_SLACK;
+    for (;;) {
+        uint32_t size;
+        pid_t *pids = procfs_alloc_pids(capacity, &size);
+        if (pids == NULL) {
+            break;
+        }
+
+        procfs_proctree_children_t children;
+        bzero(&children, sizeof(children));
+        children.ptc_creds = creds;
+        children.ptc_pids = pids;
+        children.ptc_capacity = (int)(size/sizeof(pid_t));
+        proc_childrenwalk(p, procfs_proctree_collect_child, &children);
+        if (!children.ptc_overflow) {
+            qsort(pids, children.ptc_count, sizeof(pid_t), procfs_compare_pids);
+            *pidpp = pids;
+            *pid_count = children.ptc_count;
+            *sizep = size;
+            break;
+        }
+        procfs_release_pids(pids, size);
+        capacity *= 2;
+    }
+    proc_rele(p);
+}
+
+/*
+ * Determines whether a process is a child of the process that
+ * a "children" directory belongs to.
+ */
+boolean_t
+procfs_children_match_proc(procfsnode_t *dir_pnp, proc_t p) {
+    return p->p_ppid == dir_pnp->node_id.nodeid_pid;
+}
+
+#pragma mark -
+#pragma mark Descendants File
+
+/*
+ * Reads the content of the "descendants" file for a process, which is a
+ * procfs_descendant_t for each visible process in the subtree below it.
+ */
+int
+procfs_read_descendants_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    procfs_proctree_walk_t walk;
+    int error = procfs_proctree_walk(pnp->node_id.nodeid_pid, procfs_get_access_check_creds(pnp, ctx), &walk);
+    if (error == 0 && walk.ptw_visible_count > 0) {
+        uint32_t size = walk.ptw_visible_count * (uint32_t)sizeof(procfs_descendant_t);
+        procfs_descendant_t *records = (procfs_descendant_t *)OSMalloc(size, procfs_osmalloc_tag);
+        if (records == NULL) {
+            error = ENOMEM;
+        } else {
+            int count = 0;
+            for (int i = 0; i < walk.ptw_count; i++) {
+                if (walk.ptw_nodes[i].ptn_visible) {
+                    records[count++] = walk.ptw_nodes[i].ptn_record;
+                }
+            }
+            error = procfs_copy_data((char *)records, (int)size, uio);
+            OSFree(records, size, procfs_osmalloc_tag);
+        }
+    }
+    procfs_proctree_free_walk(&walk);
+    return error;
+}
+
+/*
+ * Gets the size of the "descendants" file for a process.
+ */
+size_t
+procfs_descendants_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    procfs_proctree_walk_t walk;
+    size_t size = 0;
+    if (procfs_proctree_walk(pnp->node_id.nodeid_pid, procfs_get_size_check_creds(pnp, creds), &walk) == 0) {
+        size = walk.ptw_visible_count * sizeof(procfs_descendant_t);
+    }
+    procfs_proctree_free_walk(&walk);
+    return size;
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Function used to walk the children of a process to store the id of
+ * each visible child. Stops the walk if there is no more space.
+ */
+STATIC int
+procfs_proctree_collect_child(proc_t p, void *arg) {
+    procfs_proctree_children_t *children = (procfs_proctree_children_t *)arg;
+    if (children->ptc_creds != NULL && procfs_check_can_access_process(children->ptc_creds, p) != 0) {
+        return PROC_RETURNED;
+    }
+    if (children->ptc_count == children->ptc_capacity) {
+        children->ptc_overflow = TRUE;
+        return PROC_RETURNED_DONE;
+    }
+    children->ptc_pids[children->ptc_count++] = p->p_pid;
+    return PROC_RETURNED;
+}
+
+/*
+ * Finds every process in the subtree below a process, breadth first. Each
+ * process that is found is in turn looked up and its children added. The
+ * unique id of a process is checked when it is looked up, so that the
+ * children of a different process that has reused its id are not added.
+ * Returns 0 on success, ESRCH if the process does not exist or ENOMEM if
+ * memory could not be allocated. The walk state must always be released
+ * with procfs_proctree_free_walk().
+ */
+STATIC int
+procfs_proctree_walk(pid_t pid, kauth_cred_t creds, procfs_proctree_walk_t *walk) {
+    bzero(walk, sizeof(procfs_proctree_walk_t));
+    walk->ptw_creds = creds;
+
+    proc_t p = proc_find(pid);
+    if (p == PROC_NULL) {
+        return ESRCH;
+    }
+    walk->ptw_depth = 1;
+    proc_childrenwalk(p, procfs_proctree_add_node, walk);
+    proc_rele(p);
+
+    for (int i = 0; i < walk->ptw_count && walk->ptw_error == 0; i++) {
+        procfs_descendant_t *record = &walk->ptw_nodes[i].ptn_record;
+        p = proc_find(record->pde_pid);
+        if (p == PROC_NULL) {
+            // Process has exited.
+            continue;
+        }
+        if (p->p_uniqueid == record->pde_uniqueid) {
+            // Adding nodes may move the array, so record is not used after this.
+            walk->ptw_depth = record->pde_depth + 1;
+            proc_childrenwalk(p, procfs_proctree_add_node, walk);
+        }
+        proc_rele(p);
+    }
+    return walk->ptw_error;
+}
+
+/*
+ * Releases the memory for the state of a walk of a subtree.
+ */
+STATIC void
+procfs_proctree_free_walk(procfs_proctree_walk_t *walk) {
+    if (walk->ptw_nodes != NULL) {
+        OSFree(walk->ptw_nodes, walk->ptw_capacity * (uint32_t)sizeof(procfs_proctree_node_t), procfs_osmalloc_tag);
+        walk->ptw_nodes = NULL;
+    }
+}
+
+/*
+ * Function used to walk the children of a process to add each of them to
+ * the walk of a subtree, growing the array of nodes if it is full. This is
+ * called without the process list locked, so it can allocate memory.
+ */
+STATIC int
+procfs_proctree_add_node(proc_t p, void *arg) {
+    procfs_proctree_walk_t *walk = (procfs_proctree_walk_t *)arg;
+    if (walk->ptw_count == walk->ptw_capacity) {
+        int new_capacity = walk->ptw_capacity == 0 ? PROCFS_PROCTREE_INITIAL_CAPACITY : 2 * walk->ptw_capacity;
+        uint32_t new_size = new_capacity * (uint32_t)sizeof(procfs_proctree_node_t);
+        procfs_proctree_node_t *new_nodes = (procfs_proctree_node_t *)OSMalloc(new_size, procfs_osmalloc_tag);
+        if (new_nodes == NULL) {
+            walk->ptw_error = ENOMEM;
+            return PROC_RETURNED_DONE;
+        }
+        if (walk->ptw_nodes != NULL) {
+            bcopy(walk->ptw_nodes, new_nodes, walk->ptw_count * sizeof(procfs_proctree_node_t));
+            OSFree(walk->ptw_nodes, walk->ptw_capacity * (uint32_t)sizeof(procfs_proctree_node_t), procfs_osmalloc_tag);
+        }
+        walk->ptw_nodes = new_nodes;
+        walk->ptw_capacity = new_capacity;
+    }
+
+    procfs_proctree_node_t *node = &walk->ptw_nodes[walk->ptw_count++];
+    bzero(node, sizeof(procfs_proctree_node_t));
+    node->ptn_record.pde_uniqueid = p->p_uniqueid;
+    node->ptn_record.pde_pid = p->p_pid;
+    node->ptn_record.pde_ppid = p->p_ppid;
+    node->ptn_record.pde_depth = walk->ptw_depth;
+    node->ptn_visible = walk->ptw_creds == NULL || procfs_check_can_access_process(walk->ptw_creds, p) == 0;
+    if (node->ptn_visible) {
+        walk->ptw_visible_count++;
+    }
+    return PROC_RETURNED;
+}
@@ -0,0 +1,411 @@
+//
+//  procfs_select.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Implements the filtered process views in the /proc/select directory.
+// The name of each directory below "select" is a filter of the form
+// "key=value", such as "uid=501" or "comm=launchd". The directory holds
+// a link to each visible process that matches the filter and a file,
+// "info", that contains a struct proc_bsdinfo for each of them, so that
+// a caller that wants only a few processes does not have to list and
+// read every process to find them.
+//
+// The filter is applied while the process list is walked, by the filter
+// function of proc_iterate(), which is called for each process with the
+// process list locked. Only the processes that match are returned to the
+// callout, so the work done for each process that does not match is just
+// a comparison.
+//
+// Filter values are held in the object id of the filter directory and of
+// the nodes below it: the key is in the upper bits and the value in the
+// lower 32 bits. Command names do not fit, so the value for a command name
+// is its id in the interned name table (see procfs_comm.c). Looking up a
+// filter interns its name and each node for the filter holds a reference
+// to it, so the id keeps referring to the same name for as long as the node
+// exists. The nodes are reclaimed when they are no longer in use, which
+// releases the name.
+//
+
+#include <libkern/libkern.h>
+#include <libkern/OSMalloc.h>
+#include <sys/proc_info.h>
+#include <sys/proc_internal.h>
+#include "procfsnode.h"
+#include "procfs_comm.h"
+#include "procfs_data.h"
+#include "procfs_procindex.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The keys that a filter can use.
+typedef enum {
+    PROCFS_SELECT_KEY_UID = 1,  // Effective user id.
+    PROCFS_SELECT_KEY_RUID,     // Real user id.
+    PROCFS_SELECT_KEY_GID,      // Effective group id.
+    PROCFS_SELECT_KEY_PGID,     // Process group id.
+    PROCFS_SELECT_KEY_PPID,     // Parent process id.
+    PROCFS_SELECT_KEY_COMM,     // Command name.
+} procfs_select_key_t;
+
+// The name of each key, as used in a filter.
+STATIC const struct {
+    const char          *psk_name;
+    procfs_select_key_t psk_key;
+} procfs_select_keys[] = {
+    { "uid",    PROCFS_SELECT_KEY_UID },
+    { "ruid",   PROCFS_SELECT_KEY_RUID },
+    { "gid",    PROCFS_SELECT_KEY_GID },
+    { "pgid",   PROCFS_SELECT_KEY_PGID },
+    { "ppid",   PROCFS_SELECT_KEY_PPID },
+    { "comm",   PROCFS_SELECT_KEY_COMM },
+};
+#define PROCFS_SELECT_KEY_COUNT (sizeof(procfs_select_keys)/sizeof(procfs_select_keys[0]))
+
+// Builds the object id for a filter from its key and value.
+#define PROCFS_SELECT_OBJECTID(key, value) (((uint64_t)(key) << 32) | (uint32_t)(value))
+
+// Extra space allowed for processes that are created while the
+// process list is being walked.
+#define PROCFS_SELECT_SLACK 32
+
+// A filter, decoded from an object id.
+typedef struct procfs_select_filter {
+    procfs_select_key_t psf_key;                    // The key.
+    uint32_t            psf_value;                  // The value for all keys except PROCFS_SELECT_KEY_COMM.
+    char                psf_comm[MAXCOMLEN + 1];    // The value for PROCFS_SELECT_KEY_COMM.
+} procfs_select_filter_t;
+
+// State for a walk of the process list that collects either the
+// ids or the information of the matching processes.
+typedef struct procfs_select_collect {
+    kauth_cred_t        psc_creds;      // Credentials for the access check, NULL for none.
+    pid_t               *psc_pids;      // Where to store process ids, or NULL.
+    struct proc_bsdinfo *psc_infos;     // Where to store process information, or NULL.
+    int                 psc_count;      // Number of entries stored.
+    int                 psc_capacity;   // Number of entries for which there is space.
+    boolean_t           psc_overflow;   // Whether there was not enough space.
+} procfs_select_collect_t;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_select_get_filter(uint64_t objectid, procfs_select_filter_t *filter);
+STATIC boolean_t procfs_select_matches(procfs_select_filter_t *filter, proc_t p);
+STATIC int procfs_select_initial_capacity(void);
+STATIC void procfs_select_collect(procfs_select_filter_t *filter, procfs_select_collect_t *collect);
+STATIC int procfs_select_filter_proc(proc_t p, void *arg);
+STATIC int procfs_select_collect_proc(proc_t p, void *arg);
+STATIC int procfs_select_compare_infos(const void *p1, const void *p2);
+
+#pragma mark -
+#pragma mark External References
+
+extern int proc_pidbsdinfo(proc_t p, struct proc_bsdinfo *pinfo, int zombie);
+
+#pragma mark -
+#pragma mark Filter Name Parsing
+
+/*
+ * Parses the name of a directory in the select directory, which must be
+ * a key name followed by '=' and a value. The value for "comm" is a
+ * command name and the value for every other key is a decimal number
+ * with no leading zeros. On success, the object id is set to a value
+ * that encodes the key and the value. Returns ENOSPC or ENOMEM if the
+ * command name of a "comm" filter could not be interned.
+ */
+int
+procfs_parse_select_name(const char *name, uint64_t *objectidp) {
+    const char *value = name;
+    while (*value != (char)0 && *value != '=') {
+        value++;
+    }
+    if (*value != '=') {
+        return ENOENT;
+    }
+
+    size_t key_len = value - name;
+    value++;
+    int i;
+    for (i = 0; i < PROCFS_SELECT_KEY_COUNT; i++) {
+        const char *key_name = procfs_select_keys[i].psk_name;
+        if (strlen(key_name) == key_len && strncmp(key_name, name, key_len) == 0) {
+            break;
+        }
+    }
+    if (i == PROCFS_SELECT_KEY_COUNT) {
+        // Unknown or empty key.
+        return ENOENT;
+    }
+
+    procfs_select_key_t key = procfs_select_keys[i].psk_key;
+    uint32_t id;
+    if (key == PROCFS_SELECT_KEY_COMM) {
+        // The reference is released with procfs_select_hold_objectid().
+        int error = procfs_comm_intern(value, &id);
+        if (error != 0) {
+            return error == EINVAL ? ENOENT : error;
+        }
+    } else {
+        uint64_t number;
+        uint64_t limit = key == PROCFS_SELECT_KEY_PGID || key == PROCFS_SELECT_KEY_PPID ? PID_MAX : UINT_MAX;
+        if (procfs_parse_decimal(value, limit, &number) != 0) {
+            return ENOENT;
+        }
+        id = (uint32_t)number;
+    }
+
+    *objectidp = PROCFS_SELECT_OBJECTID(key, id);
+    return 0;
+}
+
+/*
+ * Takes or releases a reference to the command name of a node for a
+ * "comm" filter. The object ids of other filters need no reference.
+ */
+boolean_t
+procfs_select_hold_objectid(uint64_t objectid, boolean_t hold) {
+    if ((objectid >> 32) != PROCFS_SELECT_KEY_COMM) {
+        return FALSE;
+    }
+    if (hold) {
+        return procfs_comm_retain((uint32_t)objectid) == 0;
+    }
+    procfs_comm_release((uint32_t)objectid);
+    return FALSE;
+}
+
+#pragma mark -
+#pragma mark Process Links
+
+/*
+ * Gets the ids of the processes that match the filter of a select
+ * directory and that are visible with given credentials, in order of
+ * process id. The filter is applied in a single walk of the process list.
+ */
+void
+procfs_select_list_pids(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                        pid_t **pidpp, int *pid_count, uint32_t *sizep) {
+    *pidpp = NULL;
+    *pid_count = 0;
+    *sizep = 0;
+
+    procfs_select_filter_t filter;
+    if (procfs_select_get_filter(dir_pnp->node_id.nodeid_objectid, &filter) != 0) {
+        return;
+    }
+
+    // Walk the process list, starting again with more space if
+    // the list fills up.
+    int capacity = procfs_select_initial_capacity();
+    for (;;) {
+        uint32_t size;
+        pid_t *pids = procfs_alloc_pids(capacity, &size);
+        if (pids == NULL) {
+            return;
+        }
+
+        procfs_select_collect_t collect;
+        bzero(&collect, sizeof(collect));
+        collect.psc_creds = creds;
+        collect.psc_pids = pids;
+        collect.psc_capacity = (int)(size/sizeof(pid_t));
+        procfs_select_collect(&filter, &collect);
+        if (!collect.psc_overflow) {
+            qsort(pids, collect.psc_count, sizeof(pid_t), procfs_compare_pids);
+            *pidpp = pids;
+            *pid_count = collect.psc_count;
+            *sizep = size;
+            return;
+        }
+        procfs_release_pids(pids, size);
+        capacity *= 2;
+    }
+}
+
+/*
+ * Determines whether a process matches the filter of a select directory.
+ */
+boolean_t
+procfs_select_match_proc(procfsnode_t *dir_pnp, proc_t p) {
+    procfs_select_filter_t filter;
+    return procfs_select_get_filter(dir_pnp->node_id.nodeid_objectid, &filter) == 0
+            && procfs_select_matches(&filter, p);
+}
+
+#pragma mark -
+#pragma mark Info File Data
+
+/*
+ * Reads the content of the "info" file in a select directory, which is
+ * a struct proc_bsdinfo for each visible process that matches the filter,
+ * in order of process id. The information is fetched while the process
+ * list is walked, so each process is only looked at once.
+ */
+int
+procfs_read_select_info_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    procfs_select_filter_t filter;
+    if (procfs_select_get_filter(pnp->node_id.nodeid_objectid, &filter) != 0) {
+        return 0;
+    }
+
+    kauth_cred_t creds = procfs_get_access_check_creds(pnp, ctx);
+    int capacity = procfs_select_initial_capacity();
+    for (;;) {
+        uint32_t size = capacity * (uint32_t)sizeof(struct proc_bsdinfo);
+        struct proc_bsdinfo *infos = (struct proc_bsdinfo *)OSMalloc(size, procfs_osmalloc_tag);
+        if (infos == NULL) {
+            return ENOMEM;
+        }
+
+        procfs_select_collect_t collect;
+        bzero(&collect, sizeof(collect));
+        collect.psc_creds = creds;
+        collect.psc_infos = infos;
+        collect.psc_capacity = capacity;
+        procfs_select_collect(&filter, &collect);
+        if (!collect.psc_overflow) {
+            qsort(infos, collect.psc_count, sizeof(struct proc_bsdinfo), procfs_select_compare_infos);
+            int error = procfs_copy_data((char *)infos, collect.psc_count * (int)sizeof(struct proc_bsdinfo), uio);
+            OSFree(infos, size, procfs_osmalloc_tag);
+            return error;
+        }
+        OSFree(infos, size, procfs_osmalloc_tag);
+        capacity *= 2;
+    }
+}
+
+/*
+ * Gets the size of the "info" file in a select directory.
+ */
+size_t
+procfs_select_info_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    pid_t *pid_list;
+    int pid_count;
+    uint32_t pid_list_size;
+    procfs_select_list_pids(pnp, procfs_get_size_check_creds(pnp, creds), &pid_list, &pid_count, &pid_list_size);
+    procfs_release_pids(pid_list, pid_list_size);
+    return pid_count * sizeof(struct proc_bsdinfo);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Decodes the filter from the object id of a select directory or of
+ * a node below it. Returns 0 on success or ENOENT if the object id
+ * does not encode a valid filter.
+ */
+STATIC int
+procfs_select_get_filter(uint64_t objectid, procfs_select_filter_t *filter) {
+    uint64_t key = objectid >> 32;
+    if (key < PROCFS_SELECT_KEY_UID || key > PROCFS_SELECT_KEY_COMM) {
+        return ENOENT;
+    }
+    filter->psf_key = (procfs_select_key_t)key;
+    filter->psf_value = (uint32_t)objectid;
+    filter->psf_comm[0] = (char)0;
+    if (filter->psf_key == PROCFS_SELECT_KEY_COMM) {
+        return procfs_comm_name(filter->psf_value, filter->psf_comm);
+    }
+    return 0;
+}
+
+/*
+ * Determines whether a process matches a filter. This only reads fields
+ * of the proc structure, so it can be called with the process list locked.
+ */
+STATIC boolean_t
+procfs_select_matches(procfs_select_filter_t *filter, proc_t p) {
+    switch (filter->psf_key) {
+    case PROCFS_SELECT_KEY_UID:
+        return p->p_uid == filter->psf_value;
+
+    case PROCFS_SELECT_KEY_RUID:
+        return p->p_ruid == filter->psf_value;
+
+    case PROCFS_SELECT_KEY_GID:
+        return p->p_gid == filter->psf_value;
+
+    case PROCFS_SELECT_KEY_PGID:
+        return p->p_pgrpid == (pid_t)filter->psf_value;
+
+    case PROCFS_SELECT_KEY_PPID:
+        return p->p_ppid == (pid_t)filter->psf_value;
+
+    case PROCFS_SELECT_KEY_COMM:
+        return strncmp(p->p_comm, filter->psf_comm, MAXCOMLEN + 1) == 0;
+    }
+    return FALSE;
+}
+
+/*
+ * Gets the number of entries to allow for when collecting processes,
+ * which is enough for every process, with some room for processes that
+ * are created while the process list is being walked.
+ */
+STATIC int
+procfs_select_initial_capacity(void) {
+    int index_count = procfs_procindex_count();
+    return (index_count >= 0 ? index_count : nprocs) + PROCFS_SELECT_SLACK;
+}
+
+/*
+ * Walks the process list once, storing the ids or the information of the
+ * processes that match a filter and that are visible with the credentials
+ * in the collection state. Sets the psc_overflow field if there was not
+ * enough space for all of them.
+ */
+STATIC void
+procfs_select_collect(procfs_select_filter_t *filter, procfs_select_collect_t *collect) {
+    proc_iterate(PROC_ALLPROCLIST, procfs_select_collect_proc, collect, procfs_select_filter_proc, filter);
+}
+
+/*
+ * Filter function for proc_iterate(). Called with the process list
+ * locked, so it must not block.
+ */
+STATIC int
+procfs_select_filter_proc(proc_t p, void *arg) {
+    return procfs_select_matches((procfs_select_filter_t *)arg, p);
+}
+
+/*
+ * Function used to iterate the process list to store each process
+ * that matches a filter. Stops the iteration if there is no more space.
+ */
+STATIC int
+procfs_select_collect_proc(proc_t p, void *arg) {
+    procfs_select_collect_t *collect = (procfs_select_collect_t *)arg;
+    if (collect->psc_creds != NULL && procfs_check_can_access_process(collect->psc_creds, p) != 0) {
+        return PROC_RETURNED;
+    }
+    if (collect->psc_count == collect->psc_capacity) {
+        collect->psc_overflow = TRUE;
+        return PROC_RETURNED_DONE;
+    }
+
+    if (collect->psc_infos != NULL) {
+        struct proc_bsdinfo *info = &collect->psc_infos[collect->psc_count];
+        bzero(info, sizeof(struct proc_bsdinfo));
+        if (proc_pidbsdinfo(p, info, FALSE) != 0) {
+            // Process is exiting.
+            return PROC_RETURNED;
+        }
+    } else {
+        collect->psc_pids[collect->psc_count] = p->p_pid;
+    }
+    collect->psc_count++;
+    return PROC_RETURNED;
+}
+
+// Orders process information records by process id.
+STATIC int
+procfs_select_compare_infos(const void *p1, const void *p2) {
+    uint32_t pid1 = ((const struct proc_bsdinfo *)p1)->pbi_pid;
+    uint32_t pid2 = ((const struct proc_bsdinfo *)p2)->pbi_pid;
+    return pid1 < pid2 ? -1 : pid1 > pid2 ? 1 : 0;
+}
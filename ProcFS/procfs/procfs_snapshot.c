@@ -0,0 +1,480 @@
+//
+//  procfs_snapshot.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Management of snapshots of the content of procfs files. A snapshot
+// is created by running a file's read function once into a kernel
+// buffer. Snapshots are used in two ways:
+//
+// - To satisfy reads. A read at offset 0 takes a new snapshot for the
+//   open file that it is made through and reads at other offsets are
+//   served from that file's existing snapshot, so a file that is read
+//   in several chunks, or with pread(2), is always consistent. Seeking
+//   back to the start of the file and reading again gets a new sample.
+//   Each open file has its own snapshot, so two threads or descriptors
+//   of one process that read the same file do not disturb each other.
+//   The snapshot is released when the file is closed. The open file is
+//   passed down by the kernel's vnode file operations (see
+//   procfs_fileops.h), so a read that is not made through one, such as
+//   a read from within the kernel, always gets a new snapshot.
+// - To back memory mappings. The snapshot is taken when the first
+//   mapping is created and the pages of the mapped file are filled
+//   from it by VNOP_PAGEIN, so all mappings of the file share the same
+//   pages. This snapshot is held in pageable memory. Because the pages
+//   belong to the vnode, a file whose content depends on which processes
+//   the caller can see can only be mapped by callers that see the same
+//   processes as the one that created the snapshot until it is unmapped.
+//
+
+#include <kern/locks.h>
+#include <libkern/OSAtomic.h>
+#include <libkern/OSMalloc.h>
+#include <mach/vm_param.h>
+#include <sys/ubc.h>
+#include <sys/uio.h>
+#include <vm/vm_kern.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_snapshot.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// Minimum size of the buffer used for a snapshot that is not pageable.
+#define MIN_SNAPSHOT_SIZE 64
+
+#pragma mark -
+#pragma mark Local Data
+
+// Lock that protects the node_map_snapshot, node_mapped and
+// node_read_snapshots fields of all procfsnode_t structures.
+STATIC lck_grp_t *procfs_snapshot_lck_grp;
+STATIC lck_mtx_t *procfs_snapshot_mutex;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC procfs_read_snapshot_t *procfs_find_read_snapshot(procfsnode_t *pnp, struct fileglob *fg);
+STATIC boolean_t procfs_snapshot_map_view_matches(procfsnode_t *pnp, kauth_cred_t creds);
+STATIC void procfs_snapshot_free_memory(vm_offset_t data, vm_size_t size, boolean_t pageable);
+
+#pragma mark -
+#pragma mark Initialization
+
+/*
+ * Allocates the lock used to protect snapshot state. Called
+ * once when the file system is initialized.
+ */
+void
+procfs_snapshot_init(void) {
+    procfs_snapshot_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.snapshot_locks", LCK_GRP_ATTR_NULL);
+    procfs_snapshot_mutex = lck_mtx_alloc_init(procfs_snapshot_lck_grp, LCK_ATTR_NULL);
+}
+
+#pragma mark -
+#pragma mark Snapshot Creation and Release
+
+/*
+ * Creates a snapshot of the content of a file node by calling its
+ * read function. The node's size attribute is used as the initial
+ * buffer size. If the content does not fit, the buffer size is doubled
+ * and the content is regenerated until it does. If "pageable" is TRUE,
+ * the data is placed in page-aligned, pageable memory. On success, the
+ * snapshot is returned in *snapp with a reference count of 1. The caller
+ * must eventually call procfs_snapshot_release() to release it.
+ */
+int
+procfs_snapshot_create(procfsnode_t *pnp, vfs_context_t ctx, boolean_t pageable, procfs_snapshot_t **snapp) {
+    procfs_read_data_fn read_data_fn = pnp->node_structure_node->psn_read_data_fn;
+    if (read_data_fn == NULL) {
+        return EINVAL;
+    }
+
+    procfs_snapshot_t *snap = (procfs_snapshot_t *)OSMalloc(sizeof(procfs_snapshot_t), procfs_osmalloc_tag);
+    if (snap == NULL) {
+        return ENOMEM;
+    }
+
+    // Allow one byte more than the expected size, so that content
+    // of exactly that size does not look as if it was truncated.
+    int error = 0;
+    vm_size_t alloc_size = procfs_get_node_size_attr(pnp, vfs_context_ucred(ctx)) + 1;
+    alloc_size = pageable ? round_page(alloc_size) : max(alloc_size, MIN_SNAPSHOT_SIZE);
+
+    for (;;) {
+        vm_offset_t data;
+        if (pageable) {
+            if (kmem_alloc_pageable(kernel_map, &data, alloc_size, VM_KERN_MEMORY_FILE) != KERN_SUCCESS) {
+                data = 0;
+            }
+        } else {
+            data = (vm_offset_t)OSMalloc((uint32_t)alloc_size, procfs_osmalloc_tag);
+        }
+        if (data == 0) {
+            error = ENOMEM;
+            break;
+        }
+
+        uio_t uio = uio_create(1, 0, UIO_SYSSPACE, UIO_READ);
+        if (uio == NULL) {
+            procfs_snapshot_free_memory(data, alloc_size, pageable);
+            error = ENOMEM;
+            break;
+        }
+        uio_addiov(uio, CAST_USER_ADDR_T(data), alloc_size);
+        error = read_data_fn(pnp, uio, ctx);
+        user_ssize_t resid = uio_resid(uio);
+        uio_free(uio);
+
+        if (error == 0 && resid > 0) {
+            // Everything fitted. We are done.
+            snap->ps_data = data;
+            snap->ps_size = alloc_size - resid;
+            snap->ps_alloc_size = alloc_size;
+            snap->ps_pageable = pageable;
+            snap->ps_refcount = 1;
+            break;
+        }
+
+        // Either there was an error or the buffer was filled,
+        // in which case there may be more data. Try again with
+        // a larger buffer.
+        procfs_snapshot_free_memory(data, alloc_size, pageable);
+        if (error != 0) {
+            break;
+        }
+        alloc_size *= 2;
+    }
+
+    if (error == 0) {
+        *snapp = snap;
+    } else {
+        OSFree(snap, sizeof(procfs_snapshot_t), procfs_osmalloc_tag);
+    }
+    return error;
+}
+
+/*
+ * Releases a reference to a snapshot. The snapshot and the memory
+ * that holds its data are freed when the last reference is released.
+ */
+void
+procfs_snapshot_release(procfs_snapshot_t *snap) {
+    if (OSDecrementAtomic(&snap->ps_refcount) == 1) {
+        procfs_snapshot_free_memory(snap->ps_data, snap->ps_alloc_size, snap->ps_pageable);
+        OSFree(snap, sizeof(procfs_snapshot_t), procfs_osmalloc_tag);
+    }
+}
+
+#pragma mark -
+#pragma mark Read Support
+
+/*
+ * Reads the content of a node. A read at offset 0 takes a new snapshot
+ * of the node's content for the open file "fg" that the read is made
+ * through. A read at any other offset uses that file's current snapshot,
+ * which is created if it does not exist. A read that is not made through
+ * an open file ("fg" is NULL) uses a new snapshot that is not kept.
+ */
+int
+procfs_snapshot_read(procfsnode_t *pnp, struct fileglob *fg, uio_t uio, vfs_context_t ctx) {
+    procfs_snapshot_t *snap = NULL;
+
+    if (fg == NULL) {
+        int error = procfs_snapshot_create(pnp, ctx, FALSE, &snap);
+        if (error == 0) {
+            error = procfs_copy_data((char *)snap->ps_data, (int)snap->ps_size, uio);
+            procfs_snapshot_release(snap);
+        }
+        return error;
+    }
+
+    if (uio_offset(uio) != 0) {
+        lck_mtx_lock(procfs_snapshot_mutex);
+        procfs_read_snapshot_t *rsnap = procfs_find_read_snapshot(pnp, fg);
+        if (rsnap != NULL) {
+            snap = rsnap->prs_snapshot;
+            OSIncrementAtomic(&snap->ps_refcount);
+        }
+        lck_mtx_unlock(procfs_snapshot_mutex);
+    }
+
+    if (snap == NULL) {
+        // Take a new snapshot without holding the lock, since it may take
+        // some time. The initial reference belongs to the read snapshot
+        // entry for the open file.
+        int error = procfs_snapshot_create(pnp, ctx, FALSE, &snap);
+        if (error != 0) {
+            return error;
+        }
+
+        procfs_read_snapshot_t *new_rsnap = (procfs_read_snapshot_t *)OSMalloc(sizeof(procfs_read_snapshot_t), procfs_osmalloc_tag);
+        if (new_rsnap == NULL) {
+            procfs_snapshot_release(snap);
+            return ENOMEM;
+        }
+
+        procfs_snapshot_t *old_snap = NULL;
+        lck_mtx_lock(procfs_snapshot_mutex);
+        procfs_read_snapshot_t *rsnap = procfs_find_read_snapshot(pnp, fg);
+        if (rsnap == NULL) {
+            new_rsnap->prs_fglob = fg;
+            LIST_INSERT_HEAD(&pnp->node_read_snapshots, new_rsnap, prs_link);
+            rsnap = new_rsnap;
+            new_rsnap = NULL;
+        } else {
+            old_snap = rsnap->prs_snapshot;
+        }
+        rsnap->prs_snapshot = snap;
+        OSIncrementAtomic(&snap->ps_refcount);      // For this read.
+        lck_mtx_unlock(procfs_snapshot_mutex);
+
+        if (new_rsnap != NULL) {
+            OSFree(new_rsnap, sizeof(procfs_read_snapshot_t), procfs_osmalloc_tag);
+        }
+        if (old_snap != NULL) {
+            procfs_snapshot_release(old_snap);
+        }
+    }
+
+    // Copy out the data without holding the lock, since it may fault.
+    int error = procfs_copy_data((char *)snap->ps_data, (int)snap->ps_size, uio);
+    procfs_snapshot_release(snap);
+
+    return error;
+}
+
+/*
+ * Releases the read snapshot of an open file that is being closed,
+ * if it has one.
+ */
+void
+procfs_snapshot_close(procfsnode_t *pnp, struct fileglob *fg) {
+    lck_mtx_lock(procfs_snapshot_mutex);
+    procfs_read_snapshot_t *rsnap = procfs_find_read_snapshot(pnp, fg);
+    if (rsnap != NULL) {
+        LIST_REMOVE(rsnap, prs_link);
+    }
+    lck_mtx_unlock(procfs_snapshot_mutex);
+
+    // Release outside the lock, because freeing memory may block.
+    if (rsnap != NULL) {
+        procfs_snapshot_release(rsnap->prs_snapshot);
+        OSFree(rsnap, sizeof(procfs_read_snapshot_t), procfs_osmalloc_tag);
+    }
+}
+
+/*
+ * Releases all of a node's read snapshots. Called when the node
+ * is no longer in use.
+ */
+void
+procfs_snapshot_release_reads(procfsnode_t *pnp) {
+    procfs_read_snapshot_t *rsnap;
+
+    lck_mtx_lock(procfs_snapshot_mutex);
+    while ((rsnap = LIST_FIRST(&pnp->node_read_snapshots)) != NULL) {
+        LIST_REMOVE(rsnap, prs_link);
+
+        // Release outside the lock, because freeing memory may block.
+        lck_mtx_unlock(procfs_snapshot_mutex);
+        procfs_snapshot_release(rsnap->prs_snapshot);
+        OSFree(rsnap, sizeof(procfs_read_snapshot_t), procfs_osmalloc_tag);
+        lck_mtx_lock(procfs_snapshot_mutex);
+    }
+    lck_mtx_unlock(procfs_snapshot_mutex);
+}
+
+#pragma mark -
+#pragma mark Memory Mapping Support
+
+/*
+ * Prepares a node to be memory mapped. If the node is not already
+ * mapped, a new snapshot of its content is taken and any pages left
+ * over from an earlier mapping are discarded. If it is already mapped,
+ * the new mapping shares the existing snapshot, provided that the caller
+ * would see the same content as the caller that created it. Otherwise,
+ * returns EACCES.
+ */
+int
+procfs_snapshot_map(procfsnode_t *pnp, vfs_context_t ctx) {
+    vnode_t vp = procfsnode_to_vnode(pnp);
+    kauth_cred_t creds = procfs_get_access_check_creds(pnp, ctx);
+
+    lck_mtx_lock(procfs_snapshot_mutex);
+    boolean_t mapped = pnp->node_mapped;
+    boolean_t matches = !mapped || procfs_snapshot_map_view_matches(pnp, creds);
+    lck_mtx_unlock(procfs_snapshot_mutex);
+    if (mapped) {
+        return matches ? 0 : EACCES;
+    }
+
+    // Generate the snapshot without holding the lock, since it may
+    // take some time.
+    procfs_snapshot_t *snap;
+    int error = procfs_snapshot_create(pnp, ctx, TRUE, &snap);
+    if (error != 0) {
+        return error;
+    }
+
+    // Install the new snapshot, unless another thread got there first.
+    procfs_snapshot_t *old_snap = NULL;
+    size_t size = snap->ps_size;
+    lck_mtx_lock(procfs_snapshot_mutex);
+    if (pnp->node_mapped) {
+        old_snap = snap;
+        snap = NULL;
+        if (!procfs_snapshot_map_view_matches(pnp, creds)) {
+            error = EACCES;
+        }
+    } else {
+        old_snap = pnp->node_map_snapshot;
+        pnp->node_map_snapshot = snap;
+        pnp->node_mapped = TRUE;
+        pnp->node_map_filtered = creds != NULL;
+        pnp->node_map_uid = creds != NULL ? kauth_cred_getuid(creds) : 0;
+        pnp->node_map_gid = creds != NULL ? kauth_cred_getgid(creds) : 0;
+    }
+    lck_mtx_unlock(procfs_snapshot_mutex);
+
+    if (old_snap != NULL) {
+        procfs_snapshot_release(old_snap);
+    }
+
+    // Discard cached pages from any earlier mapping and set the
+    // file size to that of the new snapshot. This must be done
+    // without holding the snapshot lock, because it may wait for
+    // a pagein to complete.
+    if (snap != NULL) {
+        ubc_setsize(vp, 0);
+        ubc_setsize(vp, size);
+    }
+    return error;
+}
+
+/*
+ * Called when the last mapping of a node has been removed. The
+ * snapshot is released. The next mapping will take a new one.
+ */
+void
+procfs_snapshot_unmap(procfsnode_t *pnp) {
+    lck_mtx_lock(procfs_snapshot_mutex);
+    procfs_snapshot_t *snap = pnp->node_map_snapshot;
+    pnp->node_map_snapshot = NULL;
+    pnp->node_mapped = FALSE;
+    pnp->node_map_filtered = FALSE;
+    lck_mtx_unlock(procfs_snapshot_mutex);
+
+    if (snap != NULL) {
+        procfs_snapshot_release(snap);
+    }
+}
+
+/*
+ * Fills the pages of a UPL from the node's mapping snapshot. Any part of
+ * the range that is beyond the end of the snapshot is zero-filled. Unless
+ * the UPL_NOCOMMIT flag is set, the pages are committed on success and
+ * aborted on failure.
+ */
+int
+procfs_snapshot_pagein(procfsnode_t *pnp, upl_t upl, upl_offset_t upl_offset,
+                       off_t f_offset, size_t size, int flags) {
+    int error = 0;
+    vm_offset_t ioaddr;
+
+    if (upl == NULL) {
+        return EINVAL;
+    }
+
+    if (ubc_upl_map(upl, &ioaddr) != KERN_SUCCESS) {
+        error = ENOMEM;
+    } else {
+        char *dest = (char *)ioaddr + upl_offset;
+        size_t copy_size = 0;
+
+        lck_mtx_lock(procfs_snapshot_mutex);
+        procfs_snapshot_t *snap = pnp->node_map_snapshot;
+        if (snap == NULL) {
+            error = ENXIO;
+        } else if (f_offset < (off_t)snap->ps_size) {
+            copy_size = min(size, snap->ps_size - (size_t)f_offset);
+            bcopy((char *)snap->ps_data + f_offset, dest, copy_size);
+        }
+        lck_mtx_unlock(procfs_snapshot_mutex);
+
+        if (copy_size < size) {
+            bzero(dest + copy_size, size - copy_size);
+        }
+        ubc_upl_unmap(upl);
+    }
+
+    if ((flags & UPL_NOCOMMIT) == 0) {
+        if (error == 0) {
+            ubc_upl_commit_range(upl, upl_offset, (upl_size_t)size,
+                                 UPL_COMMIT_CLEAR_DIRTY | UPL_COMMIT_FREE_ON_EMPTY);
+        } else {
+            ubc_upl_abort_range(upl, upl_offset, (upl_size_t)size,
+                                UPL_ABORT_ERROR | UPL_ABORT_FREE_ON_EMPTY);
+        }
+    }
+    return error;
+}
+
+/*
+ * Releases all of the snapshots that are still attached to a node.
+ * Called when the node's vnode is reclaimed.
+ */
+void
+procfs_snapshot_release_all(procfsnode_t *pnp) {
+    procfs_snapshot_release_reads(pnp);
+    procfs_snapshot_unmap(pnp);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Finds the read snapshot for a given open file in a node's list. Must
+ * be called with the snapshot lock held.
+ */
+STATIC procfs_read_snapshot_t *
+procfs_find_read_snapshot(procfsnode_t *pnp, struct fileglob *fg) {
+    procfs_read_snapshot_t *rsnap;
+    LIST_FOREACH(rsnap, &pnp->node_read_snapshots, prs_link) {
+        if (rsnap->prs_fglob == fg) {
+            return rsnap;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Determines whether a caller with given access check credentials sees
+ * the same content as the mapping snapshot of a node. Visibility depends
+ * only on the effective user id and group id (see
+ * procfs_check_can_access_ids()), so callers that share them see the same
+ * processes. NULL credentials see every process. Must be called with the
+ * snapshot lock held.
+ */
+STATIC boolean_t
+procfs_snapshot_map_view_matches(procfsnode_t *pnp, kauth_cred_t creds) {
+    if (creds == NULL || !pnp->node_map_filtered) {
+        return creds == NULL && !pnp->node_map_filtered;
+    }
+    return kauth_cred_getuid(creds) == pnp->node_map_uid && kauth_cred_getgid(creds) == pnp->node_map_gid;
+}
+
+/*
+ * Frees the memory that holds the data for a snapshot.
+ */
+STATIC void
+procfs_snapshot_free_memory(vm_offset_t data, vm_size_t size, boolean_t pageable) {
+    if (pageable) {
+        kmem_free(kernel_map, data, size);
+    } else {
+        OSFree((void *)data, (uint32_t)size, procfs_osmalloc_tag);
+    }
+}
@@ -0,0 +1,60 @@
+//
+//  procfs_snapshot.h
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+//
+
+#ifndef procfs_snapshot_h
+#define procfs_snapshot_h
+
+#include <libkern/OSTypes.h>
+#include <sys/kernel_types.h>
+#include <sys/queue.h>
+#include <mach/memory_object_types.h>
+
+typedef struct procfsnode procfsnode_t;
+struct fileglob;
+
+/*
+ * A snapshot of the content of a procfs file, generated by calling
+ * the file's read function once. The data for snapshots that back
+ * memory mappings is held in pageable kernel memory.
+ */
+typedef struct procfs_snapshot {
+    vm_offset_t     ps_data;            // Address of the data.
+    size_t          ps_size;            // Size of the valid data.
+    vm_size_t       ps_alloc_size;      // Size of the allocated memory.
+    boolean_t       ps_pageable;        // Whether the memory is pageable (and page-aligned).
+    SInt32          ps_refcount;        // Reference count. The snapshot is freed when it reaches zero.
+} procfs_snapshot_t;
+
+/*
+ * The snapshot used to satisfy reads of a node through one open
+ * file. A procfsnode_t has a list of these, one for each open file
+ * through which it is being read.
+ */
+typedef struct procfs_read_snapshot {
+    LIST_ENTRY(procfs_read_snapshot) prs_link;     // Link in the owning node's list.
+    struct fileglob                 *prs_fglob;     // The open file. Used only as a key.
+    procfs_snapshot_t               *prs_snapshot;  // The content seen through the file.
+} procfs_read_snapshot_t;
+
+extern void procfs_snapshot_init(void);
+extern int procfs_snapshot_create(procfsnode_t *pnp, vfs_context_t ctx, boolean_t pageable, procfs_snapshot_t **snapp);
+extern void procfs_snapshot_release(procfs_snapshot_t *snap);
+
+// Support for reading procfs files.
+extern int procfs_snapshot_read(procfsnode_t *pnp, struct fileglob *fg, uio_t uio, vfs_context_t ctx);
+extern void procfs_snapshot_close(procfsnode_t *pnp, struct fileglob *fg);
+extern void procfs_snapshot_release_reads(procfsnode_t *pnp);
+
+// Support for memory mapping of procfs files.
+extern int procfs_snapshot_map(procfsnode_t *pnp, vfs_context_t ctx);
+extern void procfs_snapshot_unmap(procfsnode_t *pnp);
+extern int procfs_snapshot_pagein(procfsnode_t *pnp, upl_t upl, upl_offset_t upl_offset,
+                                  off_t f_offset, size_t size, int flags);
+extern void procfs_snapshot_release_all(procfsnode_t *pnp);
+
+#endif /* procfs_snapshot_h */
@@ -0,0 +1,157 @@
+//
+//  procfs_sockets.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Generates the content of the /proc/sockets file, which has one
+// record for every file descriptor that refers to a socket in every
+// process that is visible to the caller. The file is built in a single
+// pass over the process list and the file table of each process, so
+// that finding the owner of a port does not require a read of every
+// /proc/N/fd/M/socket file.
+//
+
+#include <libkern/libkern.h>
+#include <sys/file_internal.h>
+#include <sys/proc_info.h>
+#include <sys/proc_internal.h>
+#include <sys/uio_internal.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_sockets_count(proc_t p);
+STATIC boolean_t procfs_sockets_is_socket(proc_t p, int fd);
+
+#pragma mark -
+#pragma mark Sockets File Data
+
+/*
+ * Reads the content of the sockets file. Records are written directly
+ * to the uio, in order of process and then file descriptor, skipping
+ * those that end before the uio's offset.
+ */
+int
+procfs_read_sockets_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    int pid_count;
+    uint32_t pid_list_size;
+    pid_t *pid_list;
+    procfs_get_pids(&pid_list, &pid_count, &pid_list_size, procfs_get_access_check_creds(pnp, ctx));
+
+    procfs_socket_t *record = (procfs_socket_t *)OSMalloc(sizeof(procfs_socket_t), procfs_osmalloc_tag);
+    if (record == NULL) {
+        procfs_release_pids(pid_list, pid_list_size);
+        return ENOMEM;
+    }
+
+    int error = 0;
+    off_t offset = 0;
+    for (int i = 0; i < pid_count && error == 0 && uio_resid(uio) > 0; i++) {
+        proc_t p = proc_find(pid_list[i]);
+        if (p == NULL) {
+            // Process disappeared.
+            continue;
+        }
+
+        struct filedesc *fdp = p->p_fd;
+        for (int fd = 0; fd < fdp->fd_nfiles && error == 0 && uio_resid(uio) > 0; fd++) {
+            if (!procfs_sockets_is_socket(p, fd)) {
+                continue;
+            }
+
+            // Get the socket. This fails if the descriptor was closed
+            // or reused since we checked it.
+            struct fileproc *fp;
+            socket_t so;
+            if (fp_getfsock(p, fd, &fp, &so) != 0) {
+                continue;
+            }
+
+            bzero(record, sizeof(procfs_socket_t));
+            record->pso_pid = pid_list[i];
+            record->pso_fd = fd;
+            int fill_error = fill_socketinfo(so, &record->pso_info);
+            fp_drop(p, fd, fp, FALSE);
+            if (fill_error != 0) {
+                continue;
+            }
+
+            error = procfs_copyout_record(record, sizeof(procfs_socket_t), &offset, uio);
+        }
+        proc_rele(p);
+    }
+
+    OSFree(record, sizeof(procfs_socket_t), procfs_osmalloc_tag);
+    procfs_release_pids(pid_list, pid_list_size);
+    return error;
+}
+
+/*
+ * Gets the size of the sockets file, based on the number of
+ * socket descriptors in the processes that are currently visible.
+ * The processes are chosen in the same way as when the file is read.
+ */
+size_t
+procfs_sockets_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    int pid_count;
+    uint32_t pid_list_size;
+    pid_t *pid_list;
+    procfs_get_pids(&pid_list, &pid_count, &pid_list_size, procfs_get_size_check_creds(pnp, creds));
+
+    size_t count = 0;
+    for (int i = 0; i < pid_count; i++) {
+        proc_t p = proc_find(pid_list[i]);
+        if (p != NULL) {
+            count += procfs_sockets_count(p);
+            proc_rele(p);
+        }
+    }
+    procfs_release_pids(pid_list, pid_list_size);
+
+    return count * sizeof(procfs_socket_t);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Counts the file descriptors of a process that refer to sockets.
+ */
+STATIC int
+procfs_sockets_count(proc_t p) {
+    int count = 0;
+    struct filedesc *fdp = p->p_fd;
+    proc_fdlock_spin(p);
+    for (int fd = 0; fd < fdp->fd_nfiles; fd++) {
+        struct fileproc *fp = fdp->fd_ofiles[fd];
+        if (fp != NULL && !(fdp->fd_ofileflags[fd] & UF_RESERVED)
+                && FILEGLOB_DTYPE(fp->f_fglob) == DTYPE_SOCKET) {
+            count++;
+        }
+    }
+    proc_fdunlock(p);
+    return count;
+}
+
+/*
+ * Determines whether a file descriptor of a process refers to a socket.
+ * This is a cheap check that allows descriptors of other types to be
+ * skipped without taking a reference on them.
+ */
+STATIC boolean_t
+procfs_sockets_is_socket(proc_t p, int fd) {
+    struct filedesc *fdp = p->p_fd;
+    boolean_t is_socket = FALSE;
+    proc_fdlock_spin(p);
+    if (fd < fdp->fd_nfiles) {
+        struct fileproc *fp = fdp->fd_ofiles[fd];
+        is_socket = fp != NULL && !(fdp->fd_ofileflags[fd] & UF_RESERVED)
+                && FILEGLOB_DTYPE(fp->f_fglob) == DTYPE_SOCKET;
+    }
+    proc_fdunlock(p);
+    return is_socket;
+}
@@ -8,25 +8,88 @@
 /*
  * Utility functions for procfs.
  */
+#include <kern/locks.h>
+#include <libkern/libkern.h>
+#include <libkern/OSAtomic.h>
 #include <libkern/OSMalloc.h>
 #include <mach/task.h>
 #include <mach/thread_act.h>
+#include <sys/filedesc.h>
 #include <sys/ucred.h>
 #include <sys/proc.h>
 #include <sys/proc_internal.h>
+#include <sys/sysctl.h>
+#include <sys/uio.h>
 #include "procfsnode.h"
+#include "procfs_procindex.h"
+#include "procfs_proctable.h"
 #include "procfs_subr.h"
 
 #pragma mark -
-#pragma mark External References.
+#pragma mark Local Definitions
 
-extern thread_t convert_port_to_thread(ipc_port_t port);
+// The number of free process id lists that are kept for reuse.
+#define PROCFS_PIDLIST_POOL_SIZE 4
+
+// The size in bytes to which process id lists are rounded up.
+#define PROCFS_PIDLIST_ROUND_SIZE 1024
+
+// Layout of a file id. From the least significant bit, there are 10
+// bits for the base node id, 17 bits for the process id plus one (so
+// that zero means no process) and 36 bits for the object id. The top
+// bit is set if the object id was too large to fit, in which case the
+// object id field holds a hash of it and the file id cannot be decoded.
+#define PROCFS_FILEID_BASE_BITS     10
+#define PROCFS_FILEID_PID_BITS      17
+#define PROCFS_FILEID_OBJECT_BITS   36
+#define PROCFS_FILEID_PID_SHIFT     PROCFS_FILEID_BASE_BITS
+#define PROCFS_FILEID_OBJECT_SHIFT  (PROCFS_FILEID_PID_SHIFT + PROCFS_FILEID_PID_BITS)
+#define PROCFS_FILEID_FIELD_MASK(bits) ((1ULL << (bits)) - 1)
+#define PROCFS_FILEID_HASHED        (1ULL << 63)
+
+/*
+ * A free process id list, or an empty pool slot if ppb_pids is NULL.
+ */
+typedef struct procfs_pidlist_buffer {
+    pid_t       *ppb_pids;  // The list.
+    uint32_t    ppb_size;   // Size of the list in bytes.
+} procfs_pidlist_buffer_t;
 
 #pragma mark -
-#pragma mark Function Prototypes.
+#pragma mark Local Data
+
+// The pool of free process id lists and the lock that protects it.
+STATIC procfs_pidlist_buffer_t procfs_pidlist_pool[PROCFS_PIDLIST_POOL_SIZE];
+STATIC lck_grp_t *procfs_pidlist_lck_grp;
+STATIC lck_mtx_t *procfs_pidlist_mutex;
 
-struct procfs_pidlist_data;
-STATIC int procfs_get_pid(proc_t p, struct procfs_pidlist_data *data);
+// Statistics.
+STATIC uint64_t procfs_pidlist_reuses;
+STATIC uint64_t procfs_pidlist_allocations;
+STATIC uint64_t procfs_pidlist_overflows;
+
+SYSCTL_NODE(_vfs_procfs, OID_AUTO, pidlist, CTLFLAG_RW | CTLFLAG_LOCKED, 0, "process id lists");
+SYSCTL_QUAD(_vfs_procfs_pidlist, OID_AUTO, reuses, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_pidlist_reuses, "lists taken from the pool");
+SYSCTL_QUAD(_vfs_procfs_pidlist, OID_AUTO, allocations, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_pidlist_allocations, "lists allocated because the pool had none large enough");
+SYSCTL_QUAD(_vfs_procfs_pidlist, OID_AUTO, overflows, CTLFLAG_RD | CTLFLAG_LOCKED,
+            &procfs_pidlist_overflows, "lists that filled up while being built");
+
+#pragma mark -
+#pragma mark External References.
+
+extern thread_t convert_port_to_thread(ipc_port_t port);
+
+/*
+ * Allocates the lock for the pool of process id lists. Called
+ * once when the file system is initialized.
+ */
+void
+procfs_pidlist_init(void) {
+    procfs_pidlist_lck_grp = lck_grp_alloc_init("com.kadmas.procfs.pidlist_locks", LCK_GRP_ATTR_NULL);
+    procfs_pidlist_mutex = lck_mtx_alloc_init(procfs_pidlist_lck_grp, LCK_ATTR_NULL);
+}
 
 /*
  * Given a vnode that corresponds to a procfsnode_t, returns the corresponding
@@ -39,11 +102,10 @@ int
 procfs_get_process_info(vnode_t vp, pid_t *pidp, proc_t *procp) {
     procfsnode_t *procfs_node = vnode_to_procfsnode(vp);
     procfs_structure_node_t *snode = procfs_node->node_structure_node;
-    procfs_structure_node_type_t node_type = snode->psn_node_type;
     
     pid_t pid = procfsnode_to_pid(procfs_node);
     proc_t p = pid == PRNODE_NO_PID ? NULL : proc_find(pid); // Process for the vnode, if there is one.
-    if (p == NULL && procfs_node_type_has_pid(node_type)) {
+    if (p == NULL && procfs_node_has_pid(snode)) {
         // Process must have gone -- return an error
         return ENOENT;
     }
@@ -54,13 +116,38 @@ procfs_get_process_info(vnode_t vp, pid_t *pidp, proc_t *procp) {
 }
 
 /*
- * Returns whether a node of a given type must have an
- * associated process id.
+ * Returns whether a node created from a given structure node
+ * must have an associated process id.
  */
 boolean_t
-procfs_node_type_has_pid(procfs_structure_node_type_t node_type) {
-    return node_type != PROCFS_ROOT && node_type != PROCFS_CURPROC
-                    && node_type != PROCFS_DIR;
+procfs_node_has_pid(procfs_structure_node_t *snode) {
+    return (snode->psn_flags & PSN_FLAG_PROCESS) != 0;
+}
+
+/*
+ * Gets the credentials that should be used to decide which processes
+ * are visible through a given node. Returns NULL if no access check is
+ * required because the caller is root or the file system was mounted
+ * with the "noprocperms" option.
+ */
+kauth_cred_t
+procfs_get_access_check_creds(procfsnode_t *pnp, vfs_context_t ctx) {
+    boolean_t suser = vfs_context_suser(ctx) == 0;
+    procfs_mount_t *pmp = vfs_mp_to_procfs_mp(vnode_mount(procfsnode_to_vnode(pnp)));
+    return !suser && procfs_should_access_check(pmp) ? vfs_context_ucred(ctx) : NULL;
+}
+
+/*
+ * Gets the credentials that should be used to decide which processes
+ * are counted in the size of a given node. This is the same rule as
+ * procfs_get_access_check_creds(), so that the size of a node agrees
+ * with what a read of the node returns.
+ */
+kauth_cred_t
+procfs_get_size_check_creds(procfsnode_t *pnp, kauth_cred_t creds) {
+    boolean_t is_suser = suser(creds, NULL) == 0;
+    procfs_mount_t *pmp = vfs_mp_to_procfs_mp(vnode_mount(procfsnode_to_vnode(pnp)));
+    return !is_suser && procfs_should_access_check(pmp) ? creds : NULL;
 }
 
 /*
@@ -68,9 +155,8 @@ procfs_node_type_has_pid(procfs_structure_node_type_t node_type) {
  * a unique and reproducible file id for a node that doesn't have any
  * persistent storage, so we synthesize one based on the base node id
  * from the file system structure, the owning process id if there is one
- * and the owning object id (which is a thread or a file descriptor). 
- * This may not be unique because we can only include part of the object id. 
- * It should, however, be good enough.
+ * and the owning object id (which is a thread or a file descriptor).
+ * See procfs_get_fileid() for the layout.
  */
 uint64_t
 procfs_get_node_fileid(procfsnode_t *pnp) {
@@ -80,19 +166,48 @@ procfs_get_node_fileid(procfsnode_t *pnp) {
 
 /*
  * Constructs a file id for a given process id, object id and structure node
- * base id. This may not be unique because we can only include part of the object
- * id. It should, however, be good enough.
+ * base id. Each value has its own field, so file ids are unique and can be
+ * converted back to the node id by procfs_get_node_id_for_fileid(). The only
+ * exception is an object id that needs more than 36 bits, such as a large
+ * file id in an openers query. In that case, the file id includes a hash of
+ * the object id and is marked as not decodable.
  */
 uint64_t
 procfs_get_fileid(pid_t pid, uint64_t objectid, procfs_base_node_id_t base_id) {
-    uint64_t id = base_id;
+    uint64_t id = base_id & PROCFS_FILEID_FIELD_MASK(PROCFS_FILEID_BASE_BITS);
     if (pid != PRNODE_NO_PID) {
-        id |= pid << 8;
+        id |= ((uint64_t)pid + 1) << PROCFS_FILEID_PID_SHIFT;
+    }
+    if (objectid > PROCFS_FILEID_FIELD_MASK(PROCFS_FILEID_OBJECT_BITS)) {
+        objectid = (objectid * 0x9E3779B97F4A7C15ULL) >> (64 - PROCFS_FILEID_OBJECT_BITS);
+        id |= PROCFS_FILEID_HASHED;
     }
-    id |= objectid << 24;
+    id |= objectid << PROCFS_FILEID_OBJECT_SHIFT;
     return id;
 }
 
+/*
+ * Converts a file id created by procfs_get_fileid() back to the
+ * node id that it was created from. Returns 0 on success or ENOENT
+ * if the file id is not valid or cannot be decoded.
+ */
+int
+procfs_get_node_id_for_fileid(uint64_t fileid, procfsnode_id_t *node_idp) {
+    if ((fileid & PROCFS_FILEID_HASHED) != 0) {
+        return ENOENT;
+    }
+    
+    uint64_t base_id = fileid & PROCFS_FILEID_FIELD_MASK(PROCFS_FILEID_BASE_BITS);
+    uint64_t pid_field = (fileid >> PROCFS_FILEID_PID_SHIFT) & PROCFS_FILEID_FIELD_MASK(PROCFS_FILEID_PID_BITS);
+    if (base_id == 0 || pid_field > PID_MAX + 1) {
+        return ENOENT;
+    }
+    node_idp->nodeid_base_id = (procfs_base_node_id_t)base_id;
+    node_idp->nodeid_pid = pid_field == 0 ? PRNODE_NO_PID : (pid_t)(pid_field - 1);
+    node_idp->nodeid_objectid = fileid >> PROCFS_FILEID_OBJECT_SHIFT;
+    return 0;
+}
+
 /*
  * Attempts to convert a string to a positive integer. Returns
  * the value, or -1 if the string does not start with an integer
@@ -115,78 +230,235 @@ procfs_atoi(const char *p, const char **end_ptr) {
 }
 
 /*
- * Structure used to keep track of pid collection.
+ * Parses a string that must consist only of a decimal number, with no
+ * sign and no leading zeros, that is no larger than a given limit. This
+ * is the form of every numeric file name, so each node has only one name.
+ * Returns 0 on success or ENOENT if the string is not valid.
+ */
+int
+procfs_parse_decimal(const char *p, uint64_t limit, uint64_t *valuep) {
+    uint64_t value = 0;
+    const char *next = p;
+    char c;
+
+    if (*next == (char)0 || (*next == '0' && next[1] != (char)0)) {
+        return ENOENT;
+    }
+    while ((c = *next++) != (char)0) {
+        if (c < '0' || c > '9' || value > (limit - (uint64_t)(c - '0'))/10) {
+            // Not a digit, or too large.
+            return ENOENT;
+        }
+        value = value * 10 + c - '0';
+    }
+    *valuep = value;
+    return 0;
+}
+
+/*
+ * Orders process ids. For use with qsort().
  */
-struct procfs_pidlist_data {
-    kauth_cred_t creds;     // Credential to use for access check, or NULL
-    pid_t       *next_pid;  // Where to put the next process id.
-};
+int
+procfs_compare_pids(const void *p1, const void *p2) {
+    pid_t pid1 = *(const pid_t *)p1;
+    pid_t pid2 = *(const pid_t *)p2;
+    return pid1 < pid2 ? -1 : pid1 > pid2 ? 1 : 0;
+}
 
 /*
- * Function used to iterate the process list to collect
- * process ids. If the procfs_pidlist_data structure has
- * credentials, the process id id added only if it should
- * be accessible to an entity with those credentials.
+ * Copies out the part of a record that is at or after the uio offset,
+ * for files whose content is generated one record at a time. *offsetp
+ * is the offset of the record in the file and is advanced past it,
+ * whether or not any of it was copied. The uio may be filled before
+ * the end of the record is reached. Returns 0 or the error from uiomove().
  */
-STATIC int
-procfs_get_pid(proc_t p, struct procfs_pidlist_data *data) {
-    kauth_cred_t creds = data->creds;
-    if (creds == NULL || procfs_check_can_access_process(creds, p) == 0) {
-        *data->next_pid++ = p->p_pid;
+int
+procfs_copyout_record(const void *record, size_t size, off_t *offsetp, uio_t uio) {
+    int error = 0;
+    off_t uio_off = uio_offset(uio);
+    if (*offsetp + (off_t)size > uio_off) {
+        size_t skip = uio_off > *offsetp ? (size_t)(uio_off - *offsetp) : 0;
+        size_t copy_size = min(size - skip, (size_t)uio_resid(uio));
+        error = uiomove((const char *)record + skip, (int)copy_size, uio);
     }
-    return PROC_RETURNED;
+    *offsetp += size;
+    return error;
 }
 
 /*
  * Gets a list of all of the running processes in the system that
  * can be seen by a process with given credentials. If the creds
  * argument is NULL, no access check is made and the process ids
- * of all active processes are returned.
+ * of all active processes are returned. The list is taken from the
+ * process index, in order of process id, and is built again with more
+ * space if processes are created while it is being built. If the index
+ * cannot be used, the list is built from the shared process table.
  * This function allocates memory for the list of pids and
  * returns it in the location pointed to by pidpp and the
  * number of valid entries in *pid_count. The total size of the
  * allocated memory is returned in *sizep. The caller must
  * call procfs_release_pids() to free the memory, passing in
- * the values that it received from this function. 
+ * the values that it received from this function. If memory
+ * cannot be allocated, an empty list is returned.
  */
 void
 procfs_get_pids(pid_t **pidpp, int *pid_count, uint32_t *sizep, kauth_cred_t creds) {
-    uint32_t size = nprocs * sizeof(pid_t);
+    // Get the list from the process index, if it is usable. There is
+    // room for one more process than the count, so a full list means that
+    // processes were created after the count was taken and there may be
+    // more. In that case, build it again with twice the space.
+    int capacity = procfs_procindex_visible_count(creds);
+    while (capacity >= 0) {
+        uint32_t size;
+        pid_t *pidp = procfs_alloc_pids(capacity + 1, &size);
+        if (pidp == NULL) {
+            break;
+        }
+        int list_capacity = (int)(size/sizeof(pid_t));
+        int count = procfs_procindex_visible_pids(creds, 0, pidp, list_capacity);
+        if (count >= 0 && count < list_capacity) {
+            *pidpp = pidp;
+            *sizep = size;
+            *pid_count = count;
+            return;
+        }
+        procfs_release_pids(pidp, size);
+        if (count < 0) {
+            // The index is no longer usable.
+            break;
+        }
+        OSIncrementAtomic64((volatile SInt64 *)&procfs_pidlist_overflows);
+        capacity = 2 * list_capacity;
+    }
+
+    *pidpp = NULL;
+    *sizep = 0;
+    *pid_count = 0;
+    procfs_proctable_t *table = procfs_proctable_acquire(0);
+    if (table == NULL) {
+        return;
+    }
+
+    uint32_t size;
+    pid_t *pidp = procfs_alloc_pids(table->ppt_count, &size);
+    if (pidp != NULL) {
+        int count = 0;
+        for (int i = 0; i < table->ppt_count; i++) {
+            if (creds == NULL || procfs_check_can_access_ids(creds, table->ppt_uid[i], table->ppt_ruid[i],
+                                                             table->ppt_gid[i], table->ppt_rgid[i]) == 0) {
+                pidp[count++] = table->ppt_pid[i];
+            }
+        }
+        *pidpp = pidp;
+        *sizep = size;
+        *pid_count = count;
+    }
+    procfs_proctable_release(table);
+}
+
+/*
+ * Allocates space for a list of at least a given number of process
+ * ids. The space is taken from the pool of free lists if there is one
+ * that is large enough. Otherwise, it is allocated. The size of the
+ * space is returned in *sizep. Returns NULL if no memory is available.
+ * The space must be freed by calling procfs_release_pids().
+ */
+pid_t *
+procfs_alloc_pids(int capacity, uint32_t *sizep) {
+    uint32_t min_size = (uint32_t)(max(capacity, 1) * sizeof(pid_t));
+
+    lck_mtx_lock(procfs_pidlist_mutex);
+    for (int i = 0; i < PROCFS_PIDLIST_POOL_SIZE; i++) {
+        procfs_pidlist_buffer_t *buffer = &procfs_pidlist_pool[i];
+        if (buffer->ppb_pids != NULL && buffer->ppb_size >= min_size) {
+            pid_t *pidp = buffer->ppb_pids;
+            *sizep = buffer->ppb_size;
+            buffer->ppb_pids = NULL;
+            buffer->ppb_size = 0;
+            procfs_pidlist_reuses++;
+            lck_mtx_unlock(procfs_pidlist_mutex);
+            return pidp;
+        }
+    }
+    procfs_pidlist_allocations++;
+    lck_mtx_unlock(procfs_pidlist_mutex);
+
+    // Round the size up, so that the list can be reused for a
+    // somewhat larger number of processes.
+    uint32_t size = roundup(min_size, PROCFS_PIDLIST_ROUND_SIZE);
     pid_t *pidp = (pid_t *)OSMalloc(size, procfs_osmalloc_tag);
-    
-    struct procfs_pidlist_data data;
-    data.creds = creds;
-    data.next_pid = pidp;
-    
-    proc_iterate(PROC_ALLPROCLIST, (int (*)(proc_t, void *))&procfs_get_pid, &data, NULL, NULL);
-    *pidpp = pidp;
-    *sizep = size;
-    *pid_count = (int)(data.next_pid - pidp);
+    *sizep = pidp == NULL ? 0 : size;
+    return pidp;
 }
 
 /*
  * Frees a list of process id obtained from an earlier
- * invocation of procfs_get_pids().
+ * invocation of procfs_get_pids() or procfs_alloc_pids().
+ * The space is returned to the pool if there is room for it.
+ * Otherwise, it replaces a smaller list in the pool, or is
+ * freed.
  */
 void
 procfs_release_pids(pid_t *pidp, uint32_t size) {
-    OSFree(pidp, size, procfs_osmalloc_tag);
+    if (pidp == NULL) {
+        return;
+    }
+
+    lck_mtx_lock(procfs_pidlist_mutex);
+    procfs_pidlist_buffer_t *smallest = NULL;
+    for (int i = 0; i < PROCFS_PIDLIST_POOL_SIZE; i++) {
+        procfs_pidlist_buffer_t *buffer = &procfs_pidlist_pool[i];
+        if (smallest == NULL || buffer->ppb_size < smallest->ppb_size) {
+            smallest = buffer;
+        }
+    }
+    if (smallest->ppb_size < size) {
+        pid_t *free_pids = smallest->ppb_pids;
+        uint32_t free_size = smallest->ppb_size;
+        smallest->ppb_pids = pidp;
+        smallest->ppb_size = size;
+        pidp = free_pids;
+        size = free_size;
+    }
+    lck_mtx_unlock(procfs_pidlist_mutex);
+
+    if (pidp != NULL) {
+        OSFree(pidp, size, procfs_osmalloc_tag);
+    }
 }
 
 /*
  * Gets the number of active processes that are visible to a
- * process with given credentials.
+ * process with given credentials. If creds is NULL, all processes
+ * are counted. The processes are counted in the process index or,
+ * if it cannot be used, in the shared process table.
  */
 int
 procfs_get_process_count(kauth_cred_t creds) {
-    pid_t *pidp;
-    int process_count;
-    uint32_t size;
-    
-    boolean_t is_suser = suser(creds, NULL) == 0;
-    procfs_get_pids(&pidp, &process_count, &size, is_suser ? NULL : creds);
-    procfs_release_pids(pidp, size);
-    
+    boolean_t is_suser = creds == NULL || suser(creds, NULL) == 0;
+    int process_count = procfs_procindex_visible_count(is_suser ? NULL : creds);
+    if (process_count >= 0) {
+        return process_count;
+    }
+
+    procfs_proctable_t *table = procfs_proctable_acquire(0);
+    if (table == NULL) {
+        return 0;
+    }
+
+    process_count = 0;
+    if (is_suser) {
+        process_count = table->ppt_count;
+    } else {
+        for (int i = 0; i < table->ppt_count; i++) {
+            if (procfs_check_can_access_ids(creds, table->ppt_uid[i], table->ppt_ruid[i],
+                                            table->ppt_gid[i], table->ppt_rgid[i]) == 0) {
+                process_count++;
+            }
+        }
+    }
+    procfs_proctable_release(table);
+
     return process_count;
 }
 
@@ -274,6 +546,24 @@ procfs_get_task_thread_count(task_t task) {
     return thread_count;
 }
 
+/*
+ * Gets the number of open file descriptors in a given process.
+ */
+int
+procfs_get_process_fd_count(proc_t p) {
+    int count = 0;
+    struct filedesc *fdp = p->p_fd;
+    proc_fdlock_spin(p);
+    for (int i = 0; i < fdp->fd_nfiles; i++) {
+        struct fileproc *fp = fdp->fd_ofiles[i];
+        if (fp != NULL && !(fdp->fd_ofileflags[i] & UF_RESERVED)) {
+            count++;
+        }
+    }
+    proc_fdunlock(p);
+    return count;
+}
+
 /*
  * Determines whether an entity with given credentials can
  * access a given process. The determination is based on the 
@@ -282,19 +572,30 @@ procfs_get_task_thread_count(task_t task) {
  */
 int
 procfs_check_can_access_process(kauth_cred_t creds, proc_t p) {
+    return procfs_check_can_access_ids(creds, p->p_uid, p->p_ruid, p->p_gid, p->p_rgid);
+}
+
+/*
+ * Determines whether an entity with given credentials can access
+ * a process with given effective and real user and group ids. Used
+ * when the process itself may no longer exist. Returns 0 if access
+ * is allowed and EACCES otherwise.
+ */
+int
+procfs_check_can_access_ids(kauth_cred_t creds, uid_t uid, uid_t ruid, gid_t gid, gid_t rgid) {
     posix_cred_t posix_creds = &creds->cr_posix;
     
     // Allow access if the effective user id matches the
     // effective or real user id of the process.
     uid_t cred_euid = posix_creds->cr_uid;
-    if (cred_euid == p->p_uid || cred_euid == p->p_ruid) {
+    if (cred_euid == uid || cred_euid == ruid) {
         return 0;
     }
     
     // Also allow access if the effective group id matches
     // the effective or saved group id of the process.
     gid_t cred_egid = posix_creds->cr_groups[0];
-    if (cred_egid == p->p_gid || cred_egid == p->p_rgid) {
+    if (cred_egid == gid || cred_egid == rgid) {
         return 0;
     }
     return EACCES;
@@ -310,7 +611,16 @@ procfs_check_can_access_process(kauth_cred_t creds, proc_t p) {
  */
 int
 procfs_check_can_access_proc_pid(kauth_cred_t creds, pid_t pid) {
-    int error = ESRCH;
+    // Use the process index if possible, to avoid a proc_find().
+    procfs_procindex_entry_t entry;
+    int error = procfs_procindex_lookup(pid, &entry);
+    if (error == 0) {
+        return procfs_check_can_access_ids(creds, entry.ppi_uid, entry.ppi_ruid, entry.ppi_gid, entry.ppi_rgid);
+    } else if (error != ENOTSUP) {
+        return error;
+    }
+
+    error = ESRCH;
     proc_t p = proc_find(pid);
     if (p != NULL) {
         error = procfs_check_can_access_process(creds, p);
@@ -11,18 +11,28 @@
 
 #include <sys/kernel_types.h>
 
-extern boolean_t procfs_node_type_has_pid(procfs_structure_node_type_t node_type);
+extern boolean_t procfs_node_has_pid(procfs_structure_node_t *snode);
+extern kauth_cred_t procfs_get_access_check_creds(procfsnode_t *pnp, vfs_context_t ctx);
+extern kauth_cred_t procfs_get_size_check_creds(procfsnode_t *pnp, kauth_cred_t creds);
 extern int procfs_get_process_info(vnode_t vp, pid_t *pidp, proc_t *procp);
 extern uint64_t procfs_get_node_fileid(procfsnode_t *pnp);
 extern uint64_t procfs_get_fileid(pid_t pid, uint64_t objectid, procfs_base_node_id_t base_id);
+extern int procfs_get_node_id_for_fileid(uint64_t fileid, procfsnode_id_t *node_idp);
 extern int procfs_atoi(const char *p, const char **end_ptr);
+extern int procfs_parse_decimal(const char *p, uint64_t limit, uint64_t *valuep);
+extern int procfs_compare_pids(const void *p1, const void *p2);
+extern int procfs_copyout_record(const void *record, size_t size, off_t *offsetp, uio_t uio);
+extern void procfs_pidlist_init(void);
 extern void procfs_get_pids(pid_t **pidpp, int *pid_count, uint32_t *sizep, kauth_cred_t creds);
+extern pid_t *procfs_alloc_pids(int capacity, uint32_t *sizep);
 extern void procfs_release_pids(pid_t *pidp, uint32_t size);
 extern int procfs_get_thread_ids_for_task(task_t task, uint64_t **thread_ids, int *thread_count);
 extern void procfs_release_thread_ids(uint64_t *thread_ids, int thread_count);
 extern int procfs_check_can_access_process(kauth_cred_t creds, proc_t p);
+extern int procfs_check_can_access_ids(kauth_cred_t creds, uid_t uid, uid_t ruid, gid_t gid, gid_t rgid);
 extern int procfs_check_can_access_proc_pid(kauth_cred_t creds, pid_t pid);
 extern int procfs_get_process_count(kauth_cred_t creds);
 extern int procfs_get_task_thread_count(task_t task);
+extern int procfs_get_process_fd_count(proc_t p);
 
 #endif /* procfs_subr_h */
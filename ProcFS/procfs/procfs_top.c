@@ -0,0 +1,264 @@
+//
+//  procfs_top.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Generates the content of the files in the /proc/top directories, which
+// list the visible processes with the largest CPU time, resident size or
+// disk I/O. The processes are ranked in a single pass over the process
+// list, keeping the best so far in a heap that is no larger than the
+// number of processes requested, so the time taken grows with the number
+// of processes but the memory used and the data copied out do not.
+//
+
+#include <libkern/libkern.h>
+#include <sys/proc_info.h>
+#include <sys/proc_internal.h>
+#include <sys/resource.h>
+#include <sys/uio_internal.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The values by which processes can be ranked.
+typedef enum {
+    PROCFS_TOP_KEY_CPU,     // Total CPU time.
+    PROCFS_TOP_KEY_RSS,     // Resident size.
+    PROCFS_TOP_KEY_IO,      // Bytes read from and written to disk.
+} procfs_top_key_t;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_top_read(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx, procfs_top_key_t key);
+STATIC boolean_t procfs_top_ranks_before(const procfs_top_entry_t *entry1, const procfs_top_entry_t *entry2);
+STATIC void procfs_top_heap_add(procfs_top_entry_t *heap, int *countp, int capacity, const procfs_top_entry_t *entry);
+STATIC void procfs_top_heap_sift_down(procfs_top_entry_t *heap, int index, int count);
+STATIC void procfs_top_heap_sort(procfs_top_entry_t *heap, int count);
+
+#pragma mark -
+#pragma mark External References
+
+extern int proc_pidtaskinfo(proc_t p, struct proc_taskinfo *tinfo);
+extern void gather_rusage_info(proc_t p, rusage_info_current *ru, int flavor);
+
+#pragma mark -
+#pragma mark Top File Name Parsing
+
+/*
+ * Parses the name of a file in one of the top directories, which must
+ * be a decimal number from 1 to PROCFS_TOP_MAX_COUNT with no leading
+ * zeros. On success, the object id is set to that number.
+ */
+int
+procfs_parse_top_name(const char *name, uint64_t *objectidp) {
+    uint64_t count;
+    if (procfs_parse_decimal(name, PROCFS_TOP_MAX_COUNT, &count) != 0 || count == 0) {
+        return ENOENT;
+    }
+    *objectidp = count;
+    return 0;
+}
+
+#pragma mark -
+#pragma mark Top File Data
+
+/*
+ * Reads the content of a file in the "cpu" directory.
+ */
+int
+procfs_read_top_cpu_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    return procfs_top_read(pnp, uio, ctx, PROCFS_TOP_KEY_CPU);
+}
+
+/*
+ * Reads the content of a file in the "rss" directory.
+ */
+int
+procfs_read_top_rss_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    return procfs_top_read(pnp, uio, ctx, PROCFS_TOP_KEY_RSS);
+}
+
+/*
+ * Reads the content of a file in the "io" directory.
+ */
+int
+procfs_read_top_io_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    return procfs_top_read(pnp, uio, ctx, PROCFS_TOP_KEY_IO);
+}
+
+/*
+ * Gets the size of a top file, which is the smaller of the number of
+ * processes requested and the number that are currently visible.
+ */
+size_t
+procfs_top_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    int count = MIN((int)pnp->node_id.nodeid_objectid, procfs_get_process_count(procfs_get_size_check_creds(pnp, creds)));
+    return count * sizeof(procfs_top_entry_t);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Ranks the visible processes by a given value and writes a record for
+ * each of the highest ranked, up to the number given by the node's
+ * object id. Only the task info or the resource usage, whichever holds
+ * the value used for ranking, is fetched for every process. The other
+ * is only fetched if the process gets into the heap. A process whose
+ * task info cannot be fetched is exiting and is left out.
+ */
+STATIC int
+procfs_top_read(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx, procfs_top_key_t key) {
+    int capacity = (int)pnp->node_id.nodeid_objectid;
+    size_t heap_size = capacity * sizeof(procfs_top_entry_t);
+    procfs_top_entry_t *heap = (procfs_top_entry_t *)OSMalloc((uint32_t)heap_size, procfs_osmalloc_tag);
+    if (heap == NULL) {
+        return ENOMEM;
+    }
+
+    int pid_count;
+    uint32_t pid_list_size;
+    pid_t *pid_list;
+    procfs_get_pids(&pid_list, &pid_count, &pid_list_size, procfs_get_access_check_creds(pnp, ctx));
+
+    int count = 0;
+    for (int i = 0; i < pid_count; i++) {
+        proc_t p = proc_find(pid_list[i]);
+        if (p == NULL) {
+            // Process disappeared.
+            continue;
+        }
+
+        // Fetch only what is needed to rank the process.
+        struct proc_taskinfo taskinfo;
+        rusage_info_current rusage;
+        boolean_t have_taskinfo = key != PROCFS_TOP_KEY_IO;
+        procfs_top_entry_t entry;
+        bzero(&entry, sizeof(entry));
+        entry.pte_pid = p->p_pid;
+        if (have_taskinfo) {
+            if (proc_pidtaskinfo(p, &taskinfo) != 0) {
+                // Process is exiting.
+                proc_rele(p);
+                continue;
+            }
+            entry.pte_cpu_time = taskinfo.pti_total_user + taskinfo.pti_total_system;
+            entry.pte_resident_size = taskinfo.pti_resident_size;
+            entry.pte_value = key == PROCFS_TOP_KEY_CPU ? entry.pte_cpu_time : entry.pte_resident_size;
+        } else {
+            gather_rusage_info(p, &rusage, RUSAGE_INFO_CURRENT);
+            entry.pte_diskio_bytes = rusage.ri_diskio_bytesread + rusage.ri_diskio_byteswritten;
+            entry.pte_value = entry.pte_diskio_bytes;
+        }
+
+        // The root of a full heap is the lowest ranked process so far.
+        if (count < capacity || procfs_top_ranks_before(&entry, &heap[0])) {
+            if (have_taskinfo) {
+                gather_rusage_info(p, &rusage, RUSAGE_INFO_CURRENT);
+                entry.pte_diskio_bytes = rusage.ri_diskio_bytesread + rusage.ri_diskio_byteswritten;
+            } else if (proc_pidtaskinfo(p, &taskinfo) == 0) {
+                entry.pte_cpu_time = taskinfo.pti_total_user + taskinfo.pti_total_system;
+                entry.pte_resident_size = taskinfo.pti_resident_size;
+            } else {
+                // Process is exiting.
+                proc_rele(p);
+                continue;
+            }
+            entry.pte_ppid = p->p_ppid;
+            entry.pte_uid = p->p_uid;
+            entry.pte_threads = taskinfo.pti_threadnum;
+            strlcpy(entry.pte_comm, p->p_comm, sizeof(entry.pte_comm));
+            procfs_top_heap_add(heap, &count, capacity, &entry);
+        }
+        proc_rele(p);
+    }
+    procfs_release_pids(pid_list, pid_list_size);
+
+    procfs_top_heap_sort(heap, count);
+    int error = procfs_copy_data((char *)heap, count * (int)sizeof(procfs_top_entry_t), uio);
+    OSFree(heap, (uint32_t)heap_size, procfs_osmalloc_tag);
+
+    return error;
+}
+
+/*
+ * Determines whether one entry ranks above another, which is the case
+ * if it has a larger value or the same value and a smaller process id.
+ */
+STATIC boolean_t
+procfs_top_ranks_before(const procfs_top_entry_t *entry1, const procfs_top_entry_t *entry2) {
+    return entry1->pte_value > entry2->pte_value
+            || (entry1->pte_value == entry2->pte_value && entry1->pte_pid < entry2->pte_pid);
+}
+
+/*
+ * Adds an entry to a heap in which every entry ranks below its children,
+ * so that the root is the lowest ranked entry. If the heap is full, the
+ * entry replaces the root, so it must rank above the root.
+ */
+STATIC void
+procfs_top_heap_add(procfs_top_entry_t *heap, int *countp, int capacity, const procfs_top_entry_t *entry) {
+    if (*countp == capacity) {
+        heap[0] = *entry;
+        procfs_top_heap_sift_down(heap, 0, *countp);
+        return;
+    }
+
+    int index = (*countp)++;
+    heap[index] = *entry;
+    while (index > 0) {
+        int parent = (index - 1)/2;
+        if (!procfs_top_ranks_before(&heap[parent], &heap[index])) {
+            break;
+        }
+        procfs_top_entry_t temp = heap[parent];
+        heap[parent] = heap[index];
+        heap[index] = temp;
+        index = parent;
+    }
+}
+
+/*
+ * Moves the entry at a given index of a heap down until it ranks
+ * below both of its children.
+ */
+STATIC void
+procfs_top_heap_sift_down(procfs_top_entry_t *heap, int index, int count) {
+    for (;;) {
+        int lowest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < count && procfs_top_ranks_before(&heap[lowest], &heap[left])) {
+            lowest = left;
+        }
+        if (right < count && procfs_top_ranks_before(&heap[lowest], &heap[right])) {
+            lowest = right;
+        }
+        if (lowest == index) {
+            break;
+        }
+        procfs_top_entry_t temp = heap[lowest];
+        heap[lowest] = heap[index];
+        heap[index] = temp;
+        index = lowest;
+    }
+}
+
+/*
+ * Sorts a heap into order of decreasing rank by repeatedly moving the
+ * lowest ranked entry to the end.
+ */
+STATIC void
+procfs_top_heap_sort(procfs_top_entry_t *heap, int count) {
+    for (int end = count - 1; end > 0; end--) {
+        procfs_top_entry_t temp = heap[0];
+        heap[0] = heap[end];
+        heap[end] = temp;
+        procfs_top_heap_sift_down(heap, 0, end);
+    }
+}
@@ -0,0 +1,210 @@
+//
+//  procfs_totals.c
+//  ProcFS
+//
+//  Created by Kim Topley on 10/18/26.
+//
+// Generates the content of the files in the /proc/totals directory,
+// which total the resident size, CPU time and thread count of the visible
+// processes, grouped by user id, command name or process group. A record
+// is made for each process in a single pass over the process list, then
+// the records are sorted by key and those with the same key are merged,
+// so only one record for each group is copied out. Finding the groups
+// costs as much as reading the file, so the size of a file is an upper
+// bound, which is what it would be if every visible process were in a
+// group of its own.
+//
+
+#include <libkern/libkern.h>
+#include <sys/proc_info.h>
+#include <sys/proc_internal.h>
+#include <sys/uio_internal.h>
+#include "procfsnode.h"
+#include "procfs_data.h"
+#include "procfs_subr.h"
+
+#pragma mark -
+#pragma mark Local Definitions
+
+// The keys by which processes can be grouped.
+typedef enum {
+    PROCFS_TOTALS_KEY_UID,      // Effective user id.
+    PROCFS_TOTALS_KEY_COMM,     // Command name.
+    PROCFS_TOTALS_KEY_PGRP,     // Process group id.
+} procfs_totals_key_t;
+
+#pragma mark -
+#pragma mark Local Function Prototypes
+
+STATIC int procfs_totals_read(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx, procfs_totals_key_t key);
+STATIC int procfs_totals_collect(kauth_cred_t creds, procfs_totals_key_t key,
+                                 procfs_totals_t **totalsp, int *countp, uint32_t *sizep);
+STATIC int procfs_totals_compare_ids(const void *p1, const void *p2);
+STATIC int procfs_totals_compare_comms(const void *p1, const void *p2);
+
+#pragma mark -
+#pragma mark External References
+
+extern int proc_pidtaskinfo(proc_t p, struct proc_taskinfo *tinfo);
+
+#pragma mark -
+#pragma mark Totals File Data
+
+/*
+ * Reads the content of the "uid" file.
+ */
+int
+procfs_read_totals_uid_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    return procfs_totals_read(pnp, uio, ctx, PROCFS_TOTALS_KEY_UID);
+}
+
+/*
+ * Reads the content of the "comm" file.
+ */
+int
+procfs_read_totals_comm_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    return procfs_totals_read(pnp, uio, ctx, PROCFS_TOTALS_KEY_COMM);
+}
+
+/*
+ * Reads the content of the "pgrp" file.
+ */
+int
+procfs_read_totals_pgrp_data(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx) {
+    return procfs_totals_read(pnp, uio, ctx, PROCFS_TOTALS_KEY_PGRP);
+}
+
+/*
+ * Gets the size of a totals file. There can be no more groups than
+ * there are visible processes, so that is used as the number of records.
+ */
+size_t
+procfs_totals_node_size(procfsnode_t *pnp, kauth_cred_t creds) {
+    return procfs_get_process_count(procfs_get_size_check_creds(pnp, creds)) * sizeof(procfs_totals_t);
+}
+
+#pragma mark -
+#pragma mark Helper Functions
+
+/*
+ * Reads the content of a totals file, which has one record for each
+ * group of visible processes with the same key.
+ */
+STATIC int
+procfs_totals_read(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx, procfs_totals_key_t key) {
+    procfs_totals_t *totals;
+    int count;
+    uint32_t size;
+    int error = procfs_totals_collect(procfs_get_access_check_creds(pnp, ctx), key, &totals, &count, &size);
+    if (error == 0 && totals != NULL) {
+        error = procfs_copy_data((char *)totals, count * (int)sizeof(procfs_totals_t), uio);
+        OSFree(totals, size, procfs_osmalloc_tag);
+    }
+    return error;
+}
+
+/*
+ * Groups the processes that are visible with given credentials by a
+ * given key and totals the resident size, CPU time and thread count of
+ * each group. On success, *totalsp is set to an array of groups sorted by
+ * key, or NULL if there are no processes, *countp to the number of groups
+ * and *sizep to the size of the allocation, which the caller must free.
+ */
+STATIC int
+procfs_totals_collect(kauth_cred_t creds, procfs_totals_key_t key,
+                      procfs_totals_t **totalsp, int *countp, uint32_t *sizep) {
+    *totalsp = NULL;
+    *countp = 0;
+    *sizep = 0;
+
+    int pid_count;
+    uint32_t pid_list_size;
+    pid_t *pid_list;
+    procfs_get_pids(&pid_list, &pid_count, &pid_list_size, creds);
+    if (pid_count == 0) {
+        procfs_release_pids(pid_list, pid_list_size);
+        return 0;
+    }
+
+    // Start with one record for each process.
+    uint32_t size = pid_count * (uint32_t)sizeof(procfs_totals_t);
+    procfs_totals_t *totals = (procfs_totals_t *)OSMalloc(size, procfs_osmalloc_tag);
+    if (totals == NULL) {
+        procfs_release_pids(pid_list, pid_list_size);
+        return ENOMEM;
+    }
+
+    int count = 0;
+    for (int i = 0; i < pid_count; i++) {
+        proc_t p = proc_find(pid_list[i]);
+        if (p == NULL) {
+            // Process disappeared.
+            continue;
+        }
+
+        procfs_totals_t *record = &totals[count++];
+        bzero(record, sizeof(procfs_totals_t));
+        switch (key) {
+        case PROCFS_TOTALS_KEY_UID:
+            record->pto_id = p->p_uid;
+            break;
+
+        case PROCFS_TOTALS_KEY_COMM:
+            strlcpy(record->pto_comm, p->p_comm, sizeof(record->pto_comm));
+            break;
+
+        case PROCFS_TOTALS_KEY_PGRP:
+            record->pto_id = p->p_pgrpid;
+            break;
+        }
+        record->pto_process_count = 1;
+
+        struct proc_taskinfo taskinfo;
+        if (proc_pidtaskinfo(p, &taskinfo) == 0) {
+            record->pto_resident_size = taskinfo.pti_resident_size;
+            record->pto_cpu_time = taskinfo.pti_total_user + taskinfo.pti_total_system;
+            record->pto_thread_count = taskinfo.pti_threadnum;
+        }
+        proc_rele(p);
+    }
+    procfs_release_pids(pid_list, pid_list_size);
+
+    // Sort the records by key, then merge each run of records
+    // with the same key into the first record of the run.
+    int (*compare)(const void *, const void *) = key == PROCFS_TOTALS_KEY_COMM
+            ? procfs_totals_compare_comms : procfs_totals_compare_ids;
+    qsort(totals, count, sizeof(procfs_totals_t), compare);
+    int group_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (group_count > 0 && compare(&totals[group_count - 1], &totals[i]) == 0) {
+            procfs_totals_t *group = &totals[group_count - 1];
+            group->pto_process_count += totals[i].pto_process_count;
+            group->pto_thread_count += totals[i].pto_thread_count;
+            group->pto_resident_size += totals[i].pto_resident_size;
+            group->pto_cpu_time += totals[i].pto_cpu_time;
+        } else {
+            totals[group_count++] = totals[i];
+        }
+    }
+
+    *totalsp = totals;
+    *countp = group_count;
+    *sizep = size;
+    return 0;
+}
+
+// Orders totals records by user id or process group id.
+STATIC int
+procfs_totals_compare_ids(const void *p1, const void *p2) {
+    uint32_t id1 = ((const procfs_totals_t *)p1)->pto_id;
+    uint32_t id2 = ((const procfs_totals_t *)p2)->pto_id;
+    return id1 < id2 ? -1 : id1 > id2 ? 1 : 0;
+}
+
+// Orders totals records by command name.
+STATIC int
+procfs_totals_compare_comms(const void *p1, const void *p2) {
+    const procfs_totals_t *totals1 = (const procfs_totals_t *)p1;
+    const procfs_totals_t *totals2 = (const procfs_totals_t *)p2;
+    return strncmp(totals1->pto_comm, totals2->pto_comm, sizeof(totals1->pto_comm));
+}
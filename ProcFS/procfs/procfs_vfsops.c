@@ -12,6 +12,16 @@
 #include <sys/vnode.h>
 #include "procfs.h"
 #include "procfsnode.h"
+#include "procfs_comm.h"
+#include "procfs_data.h"
+#include "procfs_events.h"
+#include "procfs_notify.h"
+#include "procfs_parallel.h"
+#include "procfs_pathcache.h"
+#include "procfs_procindex.h"
+#include "procfs_proctable.h"
+#include "procfs_snapshot.h"
+#include "procfs_subr.h"
 
 #pragma mark Local Definitions
 
@@ -39,6 +49,9 @@ extern struct vnodeopv_desc *procfs_vnodeops_list[];
 // vnodes.
 extern int (**procfs_vnodeop_p)(void *);
 
+// Gets the vnode for a node other than the root, given its file id.
+extern int procfs_vnode_for_fileid(mount_t mp, uint64_t fileid, vnode_t *vpp, vfs_context_t ctx);
+
 #pragma mark -
 #pragma mark Function Prototypes
 
@@ -47,6 +60,7 @@ STATIC int procfs_mount(struct mount *mp, vnode_t devvp, user_addr_t data, vfs_c
 STATIC int procfs_unmount(struct mount *mp, int mntflags, vfs_context_t context);
 STATIC int procfs_root(struct mount *mp, struct vnode **vpp, vfs_context_t context);
 STATIC int procfs_getattr(struct mount *mp, struct vfs_attr *fsap, vfs_context_t context);
+STATIC int procfs_vget(struct mount *mp, ino64_t ino, struct vnode **vpp, vfs_context_t context);
 
 STATIC void populate_statfs_info(struct mount *mp, struct vfsstatfs *statfsp);
 STATIC void populate_vfs_attr(struct mount *mp, struct vfs_attr *fsap);
@@ -68,7 +82,7 @@ struct vfsops procfs_vfsops = {
     NULL,               // quotactl
     &procfs_getattr,    // getattr (for statfs(2) system call)
     NULL,               // sync
-    NULL,               // vget
+    &procfs_vget,       // vget
     NULL,               // fhtovp
     NULL,               // vptofh
     &procfs_init,       // init
@@ -83,6 +97,9 @@ struct vfsops procfs_vfsops = {
 /* Tag used for memory allocation. */
 OSMallocTag procfs_osmalloc_tag;
 
+/* Node for the vfs.procfs sysctls. */
+SYSCTL_NODE(_vfs, OID_AUTO, procfs, CTLFLAG_RW | CTLFLAG_LOCKED, 0, "procfs file system");
+
 #pragma mark -
 #pragma mark Static Data
 
@@ -113,6 +130,28 @@ procfs_init(__unused struct vfsconf *vfsconf) {
         
         // Initialize procfsnode data.
         procfsnode_start_init();
+        
+        // Initialize snapshot support and the cursors for streamed files.
+        procfs_snapshot_init();
+        procfs_map_init();
+        
+        // Initialize the table of interned command names, which must be
+        // ready before the process index is seeded.
+        procfs_comm_init();
+        
+        // Initialize the vnode path cache, the pool of process id
+        // lists, the process index and the shared process table.
+        procfs_pathcache_init();
+        procfs_pidlist_init();
+        procfs_procindex_init();
+        procfs_proctable_init();
+        
+        // Initialize parallel generation of files that cover every process.
+        procfs_parallel_init();
+        
+        // Initialize kqueue notifications and the process event stream.
+        procfs_notify_init();
+        procfs_events_init();
     }
     return 0;
 }
@@ -131,8 +170,14 @@ procfs_mount(struct mount *mp, __unused vnode_t devvp, user_addr_t data, __unuse
     procfs_mount_t *procfs_mp = vfs_mp_to_procfs_mp(mp);
     if (procfs_mp == NULL) {
         // First mount. Get the mount options from user space.
+        // Older versions of mount_procfs pass only the options, so
+        // copy in the rest of the structure only if it is there.
         procfs_mount_args_t mount_args;
-        int error = copyin(data, &mount_args, sizeof(mount_args));
+        bzero(&mount_args, sizeof(mount_args));
+        int error = copyin(data, &mount_args.mnt_options, sizeof(mount_args.mnt_options));
+        if (error == 0 && (mount_args.mnt_options & PROCFS_MOPT_EXTENDED_ARGS) != 0) {
+            error = copyin(data, &mount_args, sizeof(mount_args));
+        }
         if (error != 0) {
             printf("procfs: failed to copyin mount options");
             return error;
@@ -152,8 +197,9 @@ procfs_mount(struct mount *mp, __unused vnode_t devvp, user_addr_t data, __unuse
         vfs_setfsprivate(mp, procfs_mp);
         
         // Install procfs-specific flags and augment the generic mount flags.
-        procfs_mp->pmnt_flags = mount_args.mnt_options;
-        vfs_setflags(mp, MNT_RDONLY|MNT_NOSUID|MNT_NOEXEC|MNT_NODEV|MNT_NOATIME|MNT_LOCAL);
+        procfs_mp->pmnt_flags = mount_args.mnt_options & ~PROCFS_MOPT_EXTENDED_ARGS;
+        procfs_mp->pmnt_snapshot_interval_ms = MIN(mount_args.mnt_snapshot_interval_ms, PROCFS_MAX_SNAPSHOT_INTERVAL_MS);
+        vfs_setflags(mp, MNT_RDONLY|MNT_NOSUID|MNT_NOEXEC|MNT_NODEV|MNT_NOATIME|MNT_LOCAL|MNT_DOVOLFS);
         
         // Increment the mounted instance count so that each mount of the file system
         // has a unique name as seen by the mount(1) command.
@@ -187,6 +233,7 @@ procfs_unmount(struct mount *mp, __unused int mntflags, __unused vfs_context_t c
         
         // Flush out cached vnodes.
         vflush(mp, NULLVP, FORCECLOSE);
+        procfs_pathcache_invalidate();
         
         vfs_setfsprivate(mp, NULL);
         OSFree(procfs_mp, sizeof(procfs_mount_t), procfs_osmalloc_tag);
@@ -219,6 +266,21 @@ procfs_root(struct mount *mp, vnode_t *vpp, __unused vfs_context_t context) {
     return error;
 }
 
+/*
+ * Implementation of the VFS_VGET() function for the procfs file system.
+ * Gets the vnode for the node with a given file id, which is decoded to
+ * get the node's structure node, process id and object id (see
+ * procfs_get_fileid()). This allows nodes to be reached through /.vol
+ * without walking their paths.
+ */
+STATIC int
+procfs_vget(struct mount *mp, ino64_t ino, vnode_t *vpp, vfs_context_t context) {
+    if (ino == procfs_get_fileid(PRNODE_NO_PID, PRNODE_NO_OBJECTID, PROCFS_ROOT_NODE_BASE_ID)) {
+        return procfs_root(mp, vpp, context);
+    }
+    return procfs_vnode_for_fileid(mp, (uint64_t)ino, vpp, context);
+}
+
 /*
  * Implementation of the VFS_GETATTR() function for the procfs file system.
  * The vfs_attr structure is populated with values that have meaning for 
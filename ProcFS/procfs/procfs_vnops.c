@@ -8,15 +8,24 @@
 #include <libkern/libkern.h>
 #include <sys/dirent.h>
 #include <sys/kauth.h>
+#include <sys/mman.h>
 #include <sys/proc.h>
 #include <sys/proc_internal.h>
 #include <sys/filedesc.h>
 #include <sys/stat.h>
+#include <sys/ubc.h>
 #include <sys/user.h>
 #include <sys/vnode.h>
+#include <sys/vnode_internal.h>
 #include "procfs.h"
 #include "procfsnode.h"
 #include "procfs_data.h"
+#include "procfs_events.h"
+#include "procfs_fileops.h"
+#include "procfs_notify.h"
+#include "procfs_procindex.h"
+#include "procfs_proctable.h"
+#include "procfs_snapshot.h"
 #include "procfs_subr.h"
 
 #pragma mark -
@@ -40,12 +49,18 @@
 // Vnode Operations Function Descriptor
 #define VOPFUNC int (*)(void *)
 
+// Number of process ids fetched from the process index at a time when
+// listing the processes in the root directory.
+#define PROCFS_READDIR_PID_BATCH_SIZE 64
+
 // Structure used to hold the values needed to create a new vnode
 // corresponding to a procfsnode_t.
 STATIC typedef struct {
-    // Parent vnode.
+    // Parent vnode, or NULLVP if it is not known.
     vnode_t vca_parentvp;
     
+    // The mount on which the vnode is created.
+    mount_t vca_mp;
 } procfs_vnode_create_args;
 
 // Size of a buffer large enough to hold the string form of a pid_t
@@ -72,11 +87,21 @@ STATIC int procfs_vnop_open(struct vnop_open_args *ap);
 STATIC int procfs_vnop_close(struct vnop_close_args *ap);
 STATIC int procfs_vnop_access(struct vnop_access_args *ap);
 STATIC int procfs_vnop_inactive(struct vnop_inactive_args *ap);
+STATIC int procfs_vnop_mmap(struct vnop_mmap_args *ap);
+STATIC int procfs_vnop_mnomap(struct vnop_mnomap_args *ap);
+STATIC int procfs_vnop_pagein(struct vnop_pagein_args *ap);
+STATIC int procfs_vnop_pageout(struct vnop_pageout_args *ap);
+STATIC int procfs_vnop_select(struct vnop_select_args *ap);
+STATIC int procfs_vnop_monitor(struct vnop_monitor_args *ap);
+STATIC int procfs_vnop_ioctl(struct vnop_ioctl_args *ap);
 
 STATIC inline int procfs_calc_dirent_size(const char *name);
 STATIC int procfs_copyout_dirent(int type, uint64_t file_id, const char *name, uio_t uio, int *sizep);
 STATIC int procfs_create_vnode(procfs_vnode_create_args *cap, procfsnode_t *pnp, vnode_t *vpp);
+STATIC boolean_t procfs_is_open_fd(proc_t p, int fd);
+STATIC boolean_t procfs_is_process_thread(proc_t p, uint64_t thread_id);
 STATIC void procfs_construct_process_dir_name(proc_t p, char *buffer);
+STATIC void procfs_construct_process_dir_name_from_table(procfs_proctable_t *table, int index, char *buffer);
 
 
 // Entries for the vnode operations that this file system supports.
@@ -95,9 +120,10 @@ struct vnodeopv_entry_desc procfs_vnodeop_entries[] = {
     { &vnop_setattr_desc,   (VOPFUNC)vn_default_error },        /* setattr */
     { &vnop_read_desc,      (VOPFUNC)procfs_vnop_read },        /* read */
     { &vnop_write_desc,     (VOPFUNC)vn_default_error },        /* write */
-    { &vnop_ioctl_desc,     (VOPFUNC)vn_default_error },        /* ioctl */
-    { &vnop_select_desc,    (VOPFUNC)vn_default_error },        /* select */
-    { &vnop_mmap_desc,      (VOPFUNC)vn_default_error },        /* mmap */
+    { &vnop_ioctl_desc,     (VOPFUNC)procfs_vnop_ioctl },       /* ioctl */
+    { &vnop_select_desc,    (VOPFUNC)procfs_vnop_select },      /* select */
+    { &vnop_mmap_desc,      (VOPFUNC)procfs_vnop_mmap },        /* mmap */
+    { &vnop_mnomap_desc,    (VOPFUNC)procfs_vnop_mnomap },      /* mnomap */
     { &vnop_fsync_desc,     (VOPFUNC)vn_default_error },        /* fsync */
     { &vnop_remove_desc,    (VOPFUNC)vn_default_error },        /* remove */
     { &vnop_link_desc,      (VOPFUNC)vn_default_error },        /* link */
@@ -113,12 +139,13 @@ struct vnodeopv_entry_desc procfs_vnodeop_entries[] = {
     { &vnop_pathconf_desc,  (VOPFUNC)vn_default_error },        /* pathconf */
     { &vnop_advlock_desc,   (VOPFUNC)vn_default_error },        /* advlock */
     { &vnop_bwrite_desc,    (VOPFUNC)vn_default_error },        /* bwrite */
-    { &vnop_pagein_desc,    (VOPFUNC)vn_default_error },        /* Pagein */
-    { &vnop_pageout_desc,   (VOPFUNC)vn_default_error },        /* Pageout */
+    { &vnop_pagein_desc,    (VOPFUNC)procfs_vnop_pagein },      /* Pagein */
+    { &vnop_pageout_desc,   (VOPFUNC)procfs_vnop_pageout },     /* Pageout */
     { &vnop_copyfile_desc,  (VOPFUNC)vn_default_error },        /* Copyfile */
     { &vnop_blktooff_desc,  (VOPFUNC)vn_default_error },        /* blktooff */
     { &vnop_offtoblk_desc,  (VOPFUNC)vn_default_error },        /* offtoblk */
     { &vnop_blockmap_desc,  (VOPFUNC)vn_default_error },        /* blockmap */
+    { &vnop_monitor_desc,   (VOPFUNC)procfs_vnop_monitor },     /* monitor */
     { NULL,                 (VOPFUNC)NULL }
 };
 
@@ -149,24 +176,54 @@ struct vnodeopv_desc *procfs_vnodeops_list[] = {
  * Vnode operations that don't require us to do anything.
  */
 STATIC int
-procfs_vnop_open(__unused struct vnop_open_args *ap) {
+procfs_vnop_access(__unused struct vnop_access_args *ap) {
     return 0;
 }
 
-
+/*
+ * Opens a node. The only nodes that need any work are streams, which
+ * start delivering records to the opening process from this point.
+ */
 STATIC int
-procfs_vnop_access(__unused struct vnop_access_args *ap) {
+procfs_vnop_open(struct vnop_open_args *ap) {
+    procfsnode_t *pnp = vnode_to_procfsnode(ap->a_vp);
+    if (pnp->node_structure_node->psn_flags & PSN_FLAG_STREAM) {
+        procfs_events_open(pnp, ap->a_context);
+    }
     return 0;
 }
 
+/*
+ * Nothing to do, because the state of the open file that is being
+ * closed is released by procfs_file_close(), which knows which open
+ * file it is. Anything left behind by a file that was opened from within
+ * the kernel is released by procfs_vnop_inactive.
+ */
 STATIC
 int procfs_vnop_close(__unused struct vnop_close_args *ap) {
     return 0;
 }
 
+/*
+ * Releases any read snapshots or stream positions that are still
+ * held, since nobody has the file open any more. Everything else
+ * is done in procfs_vnop_reclaim.
+ */
 STATIC
-int procfs_vnop_inactive(__unused struct vnop_inactive_args *ap) {
-    // We do everything in procfs_vnop_reclaim.
+int procfs_vnop_inactive(struct vnop_inactive_args *ap) {
+    procfsnode_t *pnp = vnode_to_procfsnode(ap->a_vp);
+    if (pnp->node_structure_node->psn_flags & PSN_FLAG_STREAM) {
+        procfs_events_release_readers(pnp);
+    } else {
+        procfs_snapshot_release_reads(pnp);
+    }
+    
+    // A node that holds a reference to its object id, such as an
+    // interned command name, is reclaimed as soon as it is no longer
+    // in use, so that the reference is not kept by an idle vnode.
+    if (pnp->node_objectid_held) {
+        vnode_recycle(ap->a_vp);
+    }
     return 0;
 }
 
@@ -234,6 +291,7 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap) {
         vnode_t target_vnode;
         procfs_vnode_create_args create_args;
         create_args.vca_parentvp = NULLVP;
+        create_args.vca_mp = vnode_mount(dvp);
         error = procfsnode_find(mp, parent_node_id,
                                 dir_pnp->node_structure_node->psn_parent,
                                 &target_procfsnode,
@@ -256,6 +314,7 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap) {
         procfs_structure_node_t *dir_snode = dir_pnp->node_structure_node;
         procfs_structure_node_t *match_node;
         procfsnode_id_t match_node_id;
+        boolean_t parsed_name = FALSE;
         proc_t target_proc = NULL;
         TAILQ_FOREACH(match_node, &dir_snode->psn_children, psn_next) {
             assert(error == 0);
@@ -268,6 +327,44 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap) {
                 match_node_id.nodeid_pid = dir_pnp->node_id.nodeid_pid;
                 match_node_id.nodeid_objectid = dir_pnp->node_id.nodeid_objectid;
                 break;
+            } else if (node_type == PROCFS_QUERY_FILE || node_type == PROCFS_QUERY_DIR) {
+                // The name is a query. It is valid if the structure node can
+                // parse it, in which case the parsed value becomes the object id.
+                uint64_t objectid;
+                error = match_node->psn_parse_name_fn(name, &objectid);
+                if (error == 0) {
+                    match_node_id.nodeid_base_id = match_node->psn_base_node_id;
+                    match_node_id.nodeid_pid = dir_pnp->node_id.nodeid_pid;
+                    match_node_id.nodeid_objectid = objectid;
+                    parsed_name = TRUE;
+                }
+                break;
+            } else if (node_type == PROCFS_PROCLINK) {
+                // Entries in this directory are links named with a process id.
+                // The process must exist, must be visible to the caller and must
+                // be one that the directory links to.
+                const char *endp;
+                int id = procfs_atoi(name, &endp);
+                if (id != -1 && *endp == (char)0) {
+                    target_proc = proc_find(id); // target_proc is released at loop end.
+                }
+                
+                boolean_t suser = vfs_context_suser(ap->a_context) == 0;
+                boolean_t check_access = !suser && procfs_should_access_check(mp);
+                if (target_proc == NULL
+                        || (check_access && procfs_check_can_access_process(ap->a_context->vc_ucred, target_proc) != 0)
+                        || !match_node->psn_match_proc_fn(dir_pnp, target_proc)) {
+                    error = ENOENT;
+                } else {
+                    // Construct the node id from the process id and an object id
+                    // that identifies the directory, which is needed to resolve
+                    // links in directories that are named by a query or that
+                    // belong to a process.
+                    match_node_id.nodeid_base_id = match_node->psn_base_node_id;
+                    match_node_id.nodeid_pid = id;
+                    match_node_id.nodeid_objectid = procfs_get_proclink_objectid(dir_pnp);
+                }
+                break;
             } else if (node_type == PROCFS_FD_DIR) {
                 // Entries in this directory must be numeric and must correspond to
                 // an open file descriptor in the process.
@@ -278,13 +375,7 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap) {
                     // Check whether it is a valid file descriptor.
                     target_proc = proc_find(dir_pnp->node_id.nodeid_pid);
                     if (target_proc != NULL) { // target_proc is released at loop end.
-                        struct filedesc *fdp = target_proc->p_fd;
-                        proc_fdlock_spin(target_proc);
-                        if (id < fdp->fd_nfiles) {
-                            struct fileproc *fp = fdp->fd_ofiles[id];
-                            valid = fp!= NULL && !(fdp->fd_ofileflags[id] & UF_RESERVED);
-                        }
-                        proc_fdunlock(target_proc);
+                        valid = procfs_is_open_fd(target_proc, id);
                     }
                 }
                 
@@ -319,6 +410,39 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap) {
                             PROCFS_PROCDIR || node_type == PROCFS_PROCNAME_DIR ? id : dir_pnp->node_id.nodeid_pid;
                     match_node_id.nodeid_objectid = node_type == PROCFS_THREADDIR ? id : dir_pnp->node_id.nodeid_objectid;
                     
+                    // Determine whether an access check is required for access to
+                    // the target process directory and its subdirectories. Do not
+                    // check if root or if the file system is mounted with
+                    // the "noprocperms" option.
+                    boolean_t suser = vfs_context_suser(ap->a_context) == 0;
+                    procfs_mount_t *pmp = vfs_mp_to_procfs_mp(vnode_mount(dvp));
+                    boolean_t check_access = !suser && procfs_should_access_check(pmp);
+                    kauth_cred_t creds = ap->a_context->vc_ucred;
+                    
+                    // For a process directory, the process index has everything that
+                    // we need to validate the name, so use it if possible, to avoid
+                    // a proc_find(). A thread directory needs the process itself.
+                    procfs_procindex_entry_t entry;
+                    int index_error = node_type == PROCFS_THREADDIR ? ENOTSUP
+                                    : procfs_procindex_lookup(match_node_id.nodeid_pid, &entry);
+                    if (index_error != ENOTSUP) {
+                        char name_buffer[PROCESS_NAME_SIZE];
+                        if (index_error != 0) {
+                            // No matching process.
+                            error = ENOENT;
+                        } else if (node_type == PROCFS_PROCNAME_DIR
+                                   && (snprintf(name_buffer, PROCESS_NAME_SIZE, "%d %s", entry.ppi_pid, entry.ppi_comm),
+                                       strcmp(name, name_buffer) != 0)) {
+                            // Mismatched.
+                            error = ENOENT;
+                        } else if (check_access && procfs_check_can_access_ids(creds, entry.ppi_uid, entry.ppi_ruid,
+                                                                               entry.ppi_gid, entry.ppi_rgid) != 0) {
+                            // Access not permitted - claim that the path does not exist.
+                            error = ENOENT;
+                        }
+                        break;
+                    }
+                    
                     // The pid must match an existing process.
                     target_proc = proc_find(match_node_id.nodeid_pid);
                     if (target_proc == NULL) {
@@ -340,44 +464,16 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap) {
                         }
                     }
                     
-                    // Determine whether an access check is required for access to
-                    // the target process directory and its subdirectories. Do not
-                    // check if root or if the file system is mounted with
-                    // the "noprocperms" option.
-                    boolean_t suser = vfs_context_suser(ap->a_context) == 0;
-                    procfs_mount_t *pmp = vfs_mp_to_procfs_mp(vnode_mount(dvp));
-                    boolean_t check_access = !suser && procfs_should_access_check(pmp);
-                    kauth_cred_t creds = ap->a_context->vc_ucred;
                     if (check_access && procfs_check_can_access_process(creds, target_proc) != 0) {
                         // Access not permitted - claim that the path does not exist.
                         error = ENOENT;
                         break;
                     } else {
                         // If we have a thread id, it must match a thread of the process.
-                        if (node_type == PROCFS_THREADDIR) {
-                            uint64_t *thread_ids;
-                            int thread_count;
-                            
-                            task_t task = proc_task(target_proc);
-                            int result =  procfs_get_thread_ids_for_task(task, &thread_ids, &thread_count);
-                            if (result == KERN_SUCCESS) {
-                                boolean_t found = FALSE;
-                                for (int i = 0; i < thread_count; i++) {
-                                    if (thread_ids[i] == match_node_id.nodeid_objectid) {
-                                        found = TRUE;
-                                        break;
-                                    }
-                                }
-                                procfs_release_thread_ids(thread_ids, thread_count);
-                                
-                                if (found == FALSE) {
-                                    error = ENOENT;
-                                    break;
-                                }
-                            } else {
-                                error = ENOENT;
-                                break;
-                            }
+                        if (node_type == PROCFS_THREADDIR
+                                && !procfs_is_process_thread(target_proc, match_node_id.nodeid_objectid)) {
+                            error = ENOENT;
+                            break;
                         }
                     }
                     break;
@@ -398,6 +494,7 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap) {
             vnode_t target_vnode;
             procfs_vnode_create_args create_args;
             create_args.vca_parentvp = dvp;
+            create_args.vca_mp = vnode_mount(dvp);
             error = procfsnode_find(mp, match_node_id,
                                     match_node,
                                     &target_procfsnode,
@@ -407,6 +504,12 @@ procfs_vnop_lookup(struct vnop_lookup_args *ap) {
             if (error == 0) {
                 *ap->a_vpp = target_vnode;
             }
+            
+            // The node holds its own reference to a parsed object id, so
+            // release the one that the parse function returned.
+            if (parsed_name && match_node->psn_hold_objectid_fn != NULL) {
+                match_node->psn_hold_objectid_fn(match_node_id.nodeid_objectid, FALSE);
+            }
         } else if (error == 0) {
             // No match
             error = ENOENT;
@@ -464,6 +567,13 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap) {
     boolean_t check_access = !suser && procfs_should_access_check(pmp);
     kauth_cred_t creds = ap->a_context->vc_ucred;
     
+    // Every entry that has a process id inherits it from the directory,
+    // so the access check for those entries is made once, here, rather
+    // than once for each entry.
+    pid_t dir_pid = dir_pnp->node_id.nodeid_pid;
+    boolean_t can_access_dir_pid = dir_pid == PRNODE_NO_PID || !check_access
+                    || procfs_check_can_access_proc_pid(creds, dir_pid) == 0;
+    
     procfs_structure_node_t *snode = TAILQ_FIRST(&dir_snode->psn_children);
     while (snode != NULL && uio_resid(uio) > 0) {
         // We inherit the parent directory's pid and thread id for
@@ -474,14 +584,15 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap) {
         procfs_base_node_id_t base_node_id = snode->psn_base_node_id;
         const char *name = snode->psn_name;
         
-        // If there is a process id associated with this node, perform
-        // an access check if required. Skip the entry if the user
-        // does not have permission to see it.
-        if (pid == PRNODE_NO_PID || !check_access || procfs_check_can_access_proc_pid(creds, pid) == 0) {
+        // If there is a process id associated with this node, skip the
+        // entry if the user does not have permission to see it.
+        if (can_access_dir_pid) {
             boolean_t procdir = FALSE;
             boolean_t procnamedir = FALSE;
             boolean_t threaddir = FALSE;
             boolean_t fddir = FALSE;
+            boolean_t querynode = FALSE;
+            boolean_t proclink = FALSE;
             int type = VREG;
             switch (snode->psn_node_type) {
             case PROCFS_ROOT: // Indicates structure error - skip it.
@@ -536,39 +647,120 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap) {
             case PROCFS_FD_DIR:
                 fddir = TRUE;
                 break;
+                    
+            case PROCFS_QUERY_FILE: // FALLTHRU
+            case PROCFS_QUERY_DIR:
+                querynode = TRUE;
+                break;
+                
+            case PROCFS_PROCLINK:
+                proclink = TRUE;
+                break;
             }
         
-            if (procdir || procnamedir) {
+            if (procdir) {
                 // An entry that represents the list of all processes.
-                // Iterate over all active processes and write entries for those that
-                // should appear after the start position, until we fill up the
-                // space or run out of processes. We don't include any processes that the
-                // caller does not have permission to access, unless the file system
-                // is mounted with the noprocperms option or the user is root.
+                // Iterate over all active processes in order of process id and write
+                // entries for those that should appear after the start position, until
+                // we fill up the space or run out of processes. We don't include any
+                // processes that the caller does not have permission to access, unless
+                // the file system is mounted with the noprocperms option or the user
+                // is root. The process ids are taken from the process index in batches,
+                // each starting after the last process id of the previous one, so no
+                // list of all processes is needed.
+                char name_buffer[PROCESS_NAME_SIZE];
+                pid_t pid_batch[PROCFS_READDIR_PID_BATCH_SIZE];
+                pid_t *pid_list = NULL;
+                uint32_t pid_list_size = 0;
+                pid_t next_pid = 0;
+                boolean_t done = FALSE;
+                while (!done) {
+                    pid_t *pids = pid_batch;
+                    int pid_count = procfs_procindex_visible_pids(check_access ? creds : NULL, next_pid,
+                                                                  pid_batch, PROCFS_READDIR_PID_BATCH_SIZE);
+                    if (pid_count < 0) {
+                        // The index is not usable, so get the whole list at once.
+                        procfs_get_pids(&pid_list, &pid_count, &pid_list_size, check_access ? creds : NULL);
+                        pids = pid_list;
+                        done = TRUE;
+                    } else if (pid_count < PROCFS_READDIR_PID_BATCH_SIZE) {
+                        done = TRUE;
+                    }
+                    
+                    // Process each process in turn. We only get back process ids for the
+                    // processes that the caller has permission to access.
+                    for (int i = 0; i < pid_count; i++) {
+                        // Use the process id as the name. Skip any process that was
+                        // already handled if the index became unusable part way through.
+                        pid_t this_pid = pids[i];
+                        if (this_pid < next_pid) {
+                            continue;
+                        }
+                        snprintf(name_buffer, PROCESS_NAME_SIZE, "%d", this_pid);
+                        int size = procfs_calc_dirent_size(name_buffer);
+                        
+                        // Copy out only if we are past the start offset.
+                        if (nextpos >= startpos) {
+                            error = procfs_copyout_dirent(VDIR, procfs_get_fileid(this_pid,
+                                                PRNODE_NO_OBJECTID, base_node_id), name_buffer, uio, &size);
+                            if (error != 0 || size == 0) {
+                                done = TRUE;
+                                break;
+                            }
+                            numentries++;
+                        }
+                        nextpos += size;
+                    }
+                    if (pid_count > 0 && !done) {
+                        next_pid = pids[pid_count - 1] + 1;
+                    }
+                }
+                
+                procfs_release_pids(pid_list, pid_list_size);
+                break;   // Exit from the outer loop.
+            } else if (proclink) {
+                // An entry that represents links to a set of processes, each named
+                // with its process id. The structure node supplies the list of the
+                // processes that this directory links to, in order of process id.
                 char name_buffer[PROCESS_NAME_SIZE];
+                pid_t *pid_list;
                 int pid_count;
                 uint32_t pid_list_size;
-                pid_t *pid_list;
-                procfs_get_pids(&pid_list, &pid_count, &pid_list_size, check_access ? creds : NULL);
-                
-                // Process each process in turn. We only get back process ids for the
-                // processes that the caller has permission to access.
+                snode->psn_list_pids_fn(dir_pnp, check_access ? creds : NULL, &pid_list, &pid_count, &pid_list_size);
                 for (int i = 0; i < pid_count; i++) {
                     pid_t this_pid = pid_list[i];
-                    if (procdir) {
-                        // Use the process id as the name.
-                        snprintf(name_buffer, PROCESS_NAME_SIZE, "%d", this_pid);
-                    } else {
-                        // Use the process id plus process command line, to create a
-                        // unqiue entry. Skip if the process has gone away.
-                        proc_t p = proc_find(this_pid);
-                        if (p == NULL) {
-                            // Process disappeared.
-                            continue;
+                    snprintf(name_buffer, PROCESS_NAME_SIZE, "%d", this_pid);
+                    int size = procfs_calc_dirent_size(name_buffer);
+                    
+                    // Copy out only if we are past the start offset.
+                    if (nextpos >= startpos) {
+                        error = procfs_copyout_dirent(DT_LNK, procfs_get_fileid(this_pid,
+                                            procfs_get_proclink_objectid(dir_pnp), base_node_id),
+                                                      name_buffer, uio, &size);
+                        if (error != 0 || size == 0) {
+                            break;
                         }
-                        procfs_construct_process_dir_name(p, name_buffer);
-                        proc_rele(p);
+                        numentries++;
+                    }
+                    nextpos += size;
+                }
+                
+                procfs_release_pids(pid_list, pid_list_size);
+                break;   // Exit from the outer loop.
+            } else if (procnamedir) {
+                // An entry that represents the list of all processes by name. This
+                // is the same as the case above, except that the name is made from
+                // the process id and command name, which are both taken from the
+                // shared process table.
+                char name_buffer[PROCESS_NAME_SIZE];
+                procfs_proctable_t *table = procfs_proctable_acquire(pmp->pmnt_snapshot_interval_ms);
+                for (int i = 0; table != NULL && i < table->ppt_count; i++) {
+                    if (check_access && procfs_check_can_access_ids(creds, table->ppt_uid[i], table->ppt_ruid[i],
+                                                        table->ppt_gid[i], table->ppt_rgid[i]) != 0) {
+                        continue;
                     }
+                    pid_t this_pid = table->ppt_pid[i];
+                    procfs_construct_process_dir_name_from_table(table, i, name_buffer);
                     int size = procfs_calc_dirent_size(name_buffer);
                     
                     // Copy out only if we are past the start offset.
@@ -583,7 +775,9 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap) {
                     nextpos += size;
                 }
                 
-                procfs_release_pids(pid_list, pid_list_size);
+                if (table != NULL) {
+                    procfs_proctable_release(table);
+                }
                 break;   // Exit from the outer loop.
             } else if (threaddir) {
                 // Iterate over all of the threads for the current process and write
@@ -663,6 +857,9 @@ procfs_vnop_readdir(struct vnop_readdir_args *ap) {
                 if (error != 0) {
                     break;
                 }
+            } else if (querynode) {
+                // Query nodes stand for names that are only valid when
+                // looked up, so there is nothing to list.
             } else {
                 // Copy out only if we have reached the end offset
                 // from the last call.
@@ -785,11 +982,13 @@ procfs_vnop_getattr(struct vnop_getattr_args *ap) {
         VATTR_RETURN(vap, va_mode, READ_EXECUTE_ALL & modemask);
         break;
         
-    case PROCFS_DIR:
+    case PROCFS_DIR:        // FALLTHRU
+    case PROCFS_QUERY_DIR:
         VATTR_RETURN(vap, va_mode, READ_EXECUTE_ALL & modemask);
         break;
         
-    case PROCFS_FILE:
+    case PROCFS_FILE:       // FALLTHRU
+    case PROCFS_QUERY_FILE:
         VATTR_RETURN(vap, va_mode, READ_EXECUTE_ALL & modemask);
         break;
         
@@ -806,7 +1005,8 @@ procfs_vnop_getattr(struct vnop_getattr_args *ap) {
         break;
         
     case PROCFS_CURPROC:        // Symbolic link to the calling process (FALLTHRU)
-    case PROCFS_PROCNAME_DIR:   // Symbolic link to a process directory
+    case PROCFS_PROCNAME_DIR:   // Symbolic link to a process directory (FALLTHRU)
+    case PROCFS_PROCLINK:       // Symbolic link to a process directory
         VATTR_RETURN(vap, va_mode, ALL_ACCESS_ALL);   // All access - target will determine actual access.
         break;
     }
@@ -855,9 +1055,9 @@ procfs_vnop_getattr(struct vnop_getattr_args *ap) {
 }
 
 /*
- * Reads the content of a symbolic link. Only the "curproc" entry
- * and nodes in the "byname" directory are symbolic links. The
- * specific data for each case is generated and returned here.
+ * Reads the content of a symbolic link. Only the "curproc" entry,
+ * nodes in the "byname" directory and process links are symbolic
+ * links. The specific data for each case is generated and returned here.
  */
 STATIC int
 procfs_vnop_readlink(struct vnop_readlink_args *ap) {
@@ -880,6 +1080,20 @@ procfs_vnop_readlink(struct vnop_readlink_args *ap) {
         char pid_buffer[PROCESS_NAME_SIZE];
         snprintf(pid_buffer, PROCESS_NAME_SIZE, "../%d", pid);
         error = uiomove(pid_buffer, (int)strlen(pid_buffer), ap->a_uio);
+    } else if (snode->psn_node_type == PROCFS_PROCLINK) {
+        // A link to a process directory from a directory that may be more
+        // than one level below the root. Create a target with one "../"
+        // for each level, such as "../../123", and copy it out to the
+        // caller's buffer.
+        pid_t pid = pnp->node_id.nodeid_pid;
+        char pid_buffer[PROCESS_NAME_SIZE];
+        size_t len = 0;
+        for (procfs_structure_node_t *ancestor = snode->psn_parent;
+                ancestor != NULL && ancestor->psn_node_type != PROCFS_ROOT; ancestor = ancestor->psn_parent) {
+            len += strlcpy(pid_buffer + len, "../", sizeof(pid_buffer) - len);
+        }
+        snprintf(pid_buffer + len, sizeof(pid_buffer) - len, "%d", pid);
+        error = uiomove(pid_buffer, (int)strlen(pid_buffer), ap->a_uio);
     } else {
         // Not valid for other node types.
         error = EINVAL;
@@ -888,25 +1102,107 @@ procfs_vnop_readlink(struct vnop_readlink_args *ap) {
 }
 
 /*
- * Reads a node's data. The read operation is delegated to a function
- * that's held in the node's procfs_structure_node_t. For nodes that
- * can't be read, the funtion is NULL and EINVAL will be returned,
- * except in the case of a directory, for which the error is EISDIR.
+ * Reads a node's data. Reads that are made through an open file are
+ * passed to procfs_file_read() by the kernel, so this is only called
+ * for reads from within the kernel, which have no open file.
  */
 STATIC int
 procfs_vnop_read(struct vnop_read_args *ap) {
+    return procfs_file_read(ap->a_vp, NULL, ap->a_uio, ap->a_ioflag, ap->a_context);
+}
+
+/*
+ * Prepares a file to be memory mapped. Only read-only mappings of
+ * readable files are allowed. The file content is generated once,
+ * when the first mapping is created, and is shared by all mappings
+ * until the last of them is removed.
+ */
+STATIC int
+procfs_vnop_mmap(struct vnop_mmap_args *ap) {
     vnode_t vp = ap->a_vp;
     procfsnode_t *pnp = vnode_to_procfsnode(vp);
     procfs_structure_node_t *snode = pnp->node_structure_node;
-    procfs_read_data_fn read_data_fn = snode->psn_read_data_fn;
     
-    int error = EINVAL;
-    if (procfs_is_directory_type(snode->psn_node_type)) {
-        error = EISDIR;
-    } else if (read_data_fn != NULL) {
-        error = read_data_fn(pnp, ap->a_uio, ap->a_context);
+    if (procfs_is_directory_type(snode->psn_node_type) || snode->psn_read_data_fn == NULL) {
+        return ENODEV;
     }
-    return error;
+    if (ap->a_fflags & PROT_WRITE) {
+        return EPERM;
+    }
+    return procfs_snapshot_map(pnp, ap->a_context);
+}
+
+/*
+ * Called when the last mapping of a file has been removed.
+ */
+STATIC int
+procfs_vnop_mnomap(struct vnop_mnomap_args *ap) {
+    procfs_snapshot_unmap(vnode_to_procfsnode(ap->a_vp));
+    return 0;
+}
+
+/*
+ * Fills pages of a memory-mapped file from the snapshot that
+ * was taken when the file was mapped.
+ */
+STATIC int
+procfs_vnop_pagein(struct vnop_pagein_args *ap) {
+    return procfs_snapshot_pagein(vnode_to_procfsnode(ap->a_vp), ap->a_pl, ap->a_pl_offset,
+                                  ap->a_f_offset, ap->a_size, ap->a_flags);
+}
+
+/*
+ * Procfs files can only be mapped read-only, so there should never
+ * be anything to page out. Release the pages and fail.
+ */
+STATIC int
+procfs_vnop_pageout(struct vnop_pageout_args *ap) {
+    if (ap->a_pl != NULL && (ap->a_flags & UPL_NOCOMMIT) == 0) {
+        ubc_upl_abort_range(ap->a_pl, ap->a_pl_offset, (upl_size_t)ap->a_size,
+                            UPL_ABORT_FREE_ON_EMPTY);
+    }
+    return EROFS;
+}
+
+/*
+ * Implements select(2) for a caller within the kernel. Selects that are
+ * made through an open file are passed to procfs_file_select() instead.
+ */
+STATIC int
+procfs_vnop_select(struct vnop_select_args *ap) {
+    return procfs_file_select(ap->a_vp, NULL, ap->a_which, ap->a_wql, ap->a_context);
+}
+
+/*
+ * Called when a kqueue EVFILT_VNODE filter starts or stops monitoring
+ * a node. Notifications are only generated while something is being
+ * monitored.
+ */
+STATIC int
+procfs_vnop_monitor(struct vnop_monitor_args *ap) {
+    procfsnode_t *pnp = vnode_to_procfsnode(ap->a_vp);
+    if (ap->a_flags & VNODE_MONITOR_BEGIN) {
+        procfs_notify_monitor(pnp, TRUE);
+    } else if (ap->a_flags & VNODE_MONITOR_END) {
+        procfs_notify_monitor(pnp, FALSE);
+    }
+    return 0;
+}
+
+/*
+ * Handles ioctl requests. The only request that is supported is the
+ * batch process query, which is only valid on the root directory.
+ * ioctl(2) is never passed to a directory vnode, so the request is made
+ * with fsctl(2) or ffsctl(2), which pass the command with its parameter
+ * length removed.
+ */
+STATIC int
+procfs_vnop_ioctl(struct vnop_ioctl_args *ap) {
+    procfsnode_t *pnp = vnode_to_procfsnode(ap->a_vp);
+    if (ap->a_command != IOCBASECMD(PROCFS_IOC_BATCH_QUERY) || pnp->node_structure_node->psn_node_type != PROCFS_ROOT) {
+        return ENOTTY;
+    }
+    return procfs_batch_query(pnp, (procfs_batch_query_t *)ap->a_data, ap->a_context);
 }
 
 /**
@@ -915,10 +1211,179 @@ procfs_vnop_read(struct vnop_read_args *ap) {
  */
 STATIC int
 procfs_vnop_reclaim(struct vnop_reclaim_args *ap) {
+    procfsnode_t *pnp = vnode_to_procfsnode(ap->a_vp);
+    if (pnp != NULL) {
+        procfs_snapshot_release_all(pnp);
+        if (pnp->node_structure_node->psn_read_stream_fn != NULL
+                && (pnp->node_structure_node->psn_flags & PSN_FLAG_STREAM) == 0) {
+            procfs_map_close(pnp, NULL);
+        }
+        procfs_notify_reclaim(pnp);
+    }
     procfsnode_reclaim(ap->a_vp);
     return 0;
 }
 
+#pragma mark -
+#pragma mark Open File Operations
+
+/*
+ * Determines whether a vnode belongs to procfs, in which case the
+ * kernel calls the other functions in this section instead of the
+ * corresponding vnode operations.
+ */
+boolean_t
+procfs_file_is_procfs(vnode_t vp) {
+    return vp->v_op == procfs_vnodeop_p;
+}
+
+/*
+ * Reads a node's data through an open file, or from within the kernel
+ * if "fg" is NULL. The data is generated by a function that's held
+ * in the node's procfs_structure_node_t. For nodes that can't be read,
+ * the funtion is NULL and EINVAL will be returned, except in the case of
+ * a directory, for which the error is EISDIR. The data is generated once
+ * when the file is read at offset 0 and reads at other offsets are served
+ * from that snapshot, so that a file read in pieces is consistent.
+ * Files that have a stream function are read directly, without a snapshot.
+ */
+int
+procfs_file_read(vnode_t vp, struct fileglob *fg, uio_t uio, int ioflag, vfs_context_t ctx) {
+    procfsnode_t *pnp = vnode_to_procfsnode(vp);
+    procfs_structure_node_t *snode = pnp->node_structure_node;
+    procfs_read_data_fn read_data_fn = snode->psn_read_data_fn;
+    
+    int error = EINVAL;
+    if (procfs_is_directory_type(snode->psn_node_type)) {
+        error = EISDIR;
+    } else if (snode->psn_read_stream_fn != NULL) {
+        error = snode->psn_read_stream_fn(pnp, fg, uio, ioflag, ctx);
+    } else if (read_data_fn != NULL) {
+        error = procfs_snapshot_read(pnp, fg, uio, ctx);
+    }
+    return error;
+}
+
+/*
+ * Implements select(2) for an open file, or for a caller within the
+ * kernel if "fg" is NULL. Stream files are readable when there is a
+ * record for the caller to read through the file. All other nodes are
+ * always ready, because their content is generated when they are read.
+ */
+int
+procfs_file_select(vnode_t vp, struct fileglob *fg, int which, void *wql, vfs_context_t ctx) {
+    procfsnode_t *pnp = vnode_to_procfsnode(vp);
+    if ((pnp->node_structure_node->psn_flags & PSN_FLAG_STREAM) && which == FREAD) {
+        return procfs_events_select(pnp, fg, wql, ctx);
+    }
+    return 1;
+}
+
+/*
+ * Called when the last reference to an open file is released, just
+ * before the vnode is closed. Releases the snapshot of the node's
+ * content that was being read through the file, or the file's
+ * position in a stream or map file.
+ */
+void
+procfs_file_close(vnode_t vp, struct fileglob *fg, vfs_context_t ctx) {
+    procfsnode_t *pnp = vnode_to_procfsnode(vp);
+    procfs_structure_node_t *snode = pnp->node_structure_node;
+    if (snode->psn_flags & PSN_FLAG_STREAM) {
+        procfs_events_close(pnp, fg, ctx);
+    } else if (snode->psn_read_stream_fn != NULL) {
+        // The only other files that are read without a snapshot
+        // are map files.
+        procfs_map_close(pnp, fg);
+    } else {
+        procfs_snapshot_close(pnp, fg);
+    }
+}
+
+#pragma mark -
+#pragma mark Vnode Lookup by File Id
+
+/*
+ * Gets the vnode for the node with a given file id, as returned in the
+ * va_fileid attribute, without looking up its path. This is used to
+ * implement VFS_VGET() for every node other than the root. The node
+ * must still exist and be visible to the caller, just as if it were
+ * looked up by name: its process, thread or file descriptor must still
+ * be present and, unless the caller is root or the file system is mounted
+ * with the "noprocperms" option, the caller must have access to the process.
+ * Nodes for "." and ".." have no file id of their own, query files and
+ * directories cannot be checked without their names and process links
+ * cannot be checked without the directory that they are in, so none of
+ * these can be reached in this way. On success, the vnode is returned with an iocount reference,
+ * which the caller must release with vnode_put().
+ */
+int
+procfs_vnode_for_fileid(mount_t mp, uint64_t fileid, vnode_t *vpp, vfs_context_t ctx) {
+    *vpp = NULLVP;
+    
+    procfsnode_id_t node_id;
+    int error = procfs_get_node_id_for_fileid(fileid, &node_id);
+    if (error != 0) {
+        return error;
+    }
+    
+    procfs_structure_node_t *snode = procfs_structure_node_for_id(node_id.nodeid_base_id);
+    if (snode == NULL) {
+        return ENOENT;
+    }
+    procfs_structure_node_type_t node_type = snode->psn_node_type;
+    if (node_type == PROCFS_ROOT || node_type == PROCFS_DIR_THIS
+            || node_type == PROCFS_DIR_PARENT || node_type == PROCFS_QUERY_FILE
+            || node_type == PROCFS_QUERY_DIR || node_type == PROCFS_PROCLINK) {
+        return ENOENT;
+    }
+    
+    // The node must have a process id if and only if its structure node
+    // is process-related. Only thread and file descriptor nodes have an
+    // object id.
+    boolean_t process_node = (snode->psn_flags & PSN_FLAG_PROCESS) != 0;
+    boolean_t thread_node = (snode->psn_flags & PSN_FLAG_THREAD) != 0;
+    boolean_t fd_node = node_type == PROCFS_FD_DIR
+            || (snode->psn_parent != NULL && snode->psn_parent->psn_node_type == PROCFS_FD_DIR);
+    uint64_t objectid = node_id.nodeid_objectid;
+    if (process_node != (node_id.nodeid_pid != PRNODE_NO_PID)
+            || (!thread_node && !fd_node && objectid != PRNODE_NO_OBJECTID)
+            || (fd_node && objectid > INT_MAX)) {
+        return ENOENT;
+    }
+    
+    if (process_node) {
+        proc_t p = proc_find(node_id.nodeid_pid);
+        if (p == NULL) {
+            return ENOENT;
+        }
+        
+        boolean_t suser = vfs_context_suser(ctx) == 0;
+        boolean_t check_access = !suser && procfs_should_access_check(vfs_mp_to_procfs_mp(mp));
+        if (check_access && procfs_check_can_access_process(vfs_context_ucred(ctx), p) != 0) {
+            // Access not permitted - claim that the node does not exist.
+            error = ENOENT;
+        } else if (thread_node && !procfs_is_process_thread(p, objectid)) {
+            error = ENOENT;
+        } else if (fd_node && !procfs_is_open_fd(p, (int)objectid)) {
+            error = ENOENT;
+        }
+        proc_rele(p);
+        if (error != 0) {
+            return error;
+        }
+    }
+    
+    // Look for the node in the cache, or create it if it is not there.
+    // The parent vnode is not known.
+    procfsnode_t *target_procfsnode;
+    procfs_vnode_create_args create_args;
+    create_args.vca_parentvp = NULLVP;
+    create_args.vca_mp = mp;
+    return procfsnode_find(vfs_mp_to_procfs_mp(mp), node_id, snode, &target_procfsnode, vpp,
+                           (create_vnode_func)&procfs_create_vnode, &create_args);
+}
+
 #pragma mark -
 #pragma mark Helper Functions
 
@@ -931,7 +1396,7 @@ procfs_create_vnode(procfs_vnode_create_args *cap, procfsnode_t *pnp, vnode_t *v
     struct vnode_fsparam vnode_create_params;
     
     memset(&vnode_create_params, 0, sizeof(vnode_create_params));
-    vnode_create_params.vnfs_mp = vnode_mount(cap->vca_parentvp);
+    vnode_create_params.vnfs_mp = cap->vca_mp;
     vnode_create_params.vnfs_vtype = vnode_type_for_structure_node_type(snode->psn_node_type);
     vnode_create_params.vnfs_str = "procfs vnode";
     vnode_create_params.vnfs_dvp = cap->vca_parentvp;
@@ -950,6 +1415,44 @@ procfs_create_vnode(procfs_vnode_create_args *cap, procfsnode_t *pnp, vnode_t *v
     return error;
 }
 
+/*
+ * Returns whether a given file descriptor is open in a process.
+ */
+STATIC boolean_t
+procfs_is_open_fd(proc_t p, int fd) {
+    boolean_t valid = FALSE;
+    struct filedesc *fdp = p->p_fd;
+    proc_fdlock_spin(p);
+    if (fd >= 0 && fd < fdp->fd_nfiles) {
+        struct fileproc *fp = fdp->fd_ofiles[fd];
+        valid = fp != NULL && !(fdp->fd_ofileflags[fd] & UF_RESERVED);
+    }
+    proc_fdunlock(p);
+    return valid;
+}
+
+/*
+ * Returns whether a thread with a given thread id belongs to a process.
+ */
+STATIC boolean_t
+procfs_is_process_thread(proc_t p, uint64_t thread_id) {
+    uint64_t *thread_ids;
+    int thread_count;
+    boolean_t found = FALSE;
+    
+    task_t task = proc_task(p);
+    if (procfs_get_thread_ids_for_task(task, &thread_ids, &thread_count) == KERN_SUCCESS) {
+        for (int i = 0; i < thread_count; i++) {
+            if (thread_ids[i] == thread_id) {
+                found = TRUE;
+                break;
+            }
+        }
+        procfs_release_thread_ids(thread_ids, thread_count);
+    }
+    return found;
+}
+
 /*
  * Constructs the name of the directory for a given process. This
  * is simply a matter of converting its process id to a decimal
@@ -962,3 +1465,14 @@ procfs_construct_process_dir_name(proc_t p, char *buffer) {
     strlcpy(buffer + len, p->p_comm, MAXCOMLEN + 1);
 }
 
+/*
+ * Constructs the name of the directory for the process at a given
+ * index in the shared process table. The result is the same as
+ * that of procfs_construct_process_dir_name().
+ */
+STATIC void
+procfs_construct_process_dir_name_from_table(procfs_proctable_t *table, int index, char *buffer) {
+    int len = snprintf(buffer, PROCESS_NAME_SIZE, "%d ", table->ppt_pid[index]);
+    strlcpy(buffer + len, table->ppt_comm[index], MAXCOMLEN + 1);
+}
+
@@ -54,6 +54,15 @@ STATIC lck_mtx_t *procfsnode_hash_mutex;
 #pragma mark Forward declaration of functions.
 STATIC void procfsnode_free_node(procfsnode_t *procfsnode);
 
+/*
+ * A vnode found by procfsnode_iterate(), together with its id, so
+ * that we can get an iocount on it after releasing the hash lock.
+ */
+typedef struct {
+    vnode_t     piv_vnode;
+    uint32_t    piv_vid;
+} procfsnode_iterate_vnode_t;
+
 #pragma mark -
 #pragma mark Initialization.
 
@@ -179,6 +188,9 @@ procfsnode_find(procfs_mount_t *pmp, procfsnode_id_t node_id, procfs_structure_n
                 target_procfsnode->node_mnt_id = mount_id;
                 target_procfsnode->node_id = node_id;
                 target_procfsnode->node_structure_node = snode;
+                if (snode->psn_hold_objectid_fn != NULL) {
+                    target_procfsnode->node_objectid_held = snode->psn_hold_objectid_fn(node_id.nodeid_objectid, TRUE);
+                }
                 
                 // Add the node to the node hash. We already know which bucket
                 // it belongs to.
@@ -332,13 +344,82 @@ procfsnode_reclaim(vnode_t vp) {
 }
 
 /*
-  * Removes a procfsnode_t from its owning hash bucket and
+ * Calls a function for the vnode of every node, on every mount, that
+ * matches a given predicate. The predicate is called with the node hash
+ * lock held, so it must not block. The function is called without the
+ * lock and with an iocount on the vnode, so it can do anything that
+ * requires a vnode reference. Nodes that do not yet have a vnode and
+ * vnodes that are reclaimed before the function is called are skipped.
+ */
+void
+procfsnode_iterate(procfsnode_match_fn match_fn, procfsnode_vnode_fn vnode_fn, void *arg) {
+    procfsnode_iterate_vnode_t *vnodes = NULL;
+    int alloc_count = 0;
+    int count;
+    
+    // Collect the matching vnodes. If there are more than we have room
+    // for, allocate a larger array and try again.
+    for (;;) {
+        count = 0;
+        lck_mtx_lock(procfsnode_hash_mutex);
+        if (procfsnode_hash_buckets != NULL) {
+            for (u_long bucket = 0; bucket <= procfsnode_hash_to_bucket_mask; bucket++) {
+                procfsnode_t *pnp;
+                LIST_FOREACH(pnp, &procfsnode_hash_buckets[bucket], node_hash) {
+                    if (pnp->node_vnode != NULL && match_fn(pnp, arg)) {
+                        if (count < alloc_count) {
+                            vnodes[count].piv_vnode = pnp->node_vnode;
+                            vnodes[count].piv_vid = vnode_vid(pnp->node_vnode);
+                        }
+                        count++;
+                    }
+                }
+            }
+        }
+        lck_mtx_unlock(procfsnode_hash_mutex);
+        
+        if (count <= alloc_count) {
+            break;
+        }
+        if (vnodes != NULL) {
+            OSFree(vnodes, alloc_count * sizeof(procfsnode_iterate_vnode_t), procfs_osmalloc_tag);
+        }
+        
+        // Allow for some growth before we try again.
+        alloc_count = count + count/2 + 1;
+        vnodes = (procfsnode_iterate_vnode_t *)OSMalloc(alloc_count * sizeof(procfsnode_iterate_vnode_t), procfs_osmalloc_tag);
+        if (vnodes == NULL) {
+            alloc_count = 0;
+            count = 0;
+            break;
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        vnode_t vp = vnodes[i].piv_vnode;
+        if (vnode_getwithvid(vp, vnodes[i].piv_vid) == 0) {
+            vnode_fn(vp, arg);
+            vnode_put(vp);
+        }
+    }
+    
+    if (vnodes != NULL) {
+        OSFree(vnodes, alloc_count * sizeof(procfsnode_iterate_vnode_t), procfs_osmalloc_tag);
+    }
+}
+
+/*
+  * Removes a procfsnode_t from its owning hash bucket, releases
+  * the reference that it holds to its object id, if any, and
   * releases its memory. This method must be called with the
   * hash table lock held.
   */
 STATIC void
 procfsnode_free_node(procfsnode_t *procfsnode) {
     LIST_REMOVE(procfsnode, node_hash);
+    if (procfsnode->node_objectid_held) {
+        procfsnode->node_structure_node->psn_hold_objectid_fn(procfsnode->node_id.nodeid_objectid, FALSE);
+    }
     OSFree(procfsnode, sizeof(procfsnode_t), procfs_osmalloc_tag);
 }
 
@@ -360,13 +441,37 @@ procfs_get_parent_node_id(procfsnode_t *pnp, procfsnode_id_t *return_idp) {
     // Set the fields of the return node_id from the base id of
     // the parent structure node, plus the process and thread ids
     // of the original node if the parent node is process- or
-    // thread-related.
+    // thread-related. A query directory also keeps its object id,
+    // which holds the parsed query.
     boolean_t pid_node = (parent_snode->psn_flags & PSN_FLAG_PROCESS) != 0;
-    boolean_t thread_node = (parent_snode->psn_flags & PSN_FLAG_THREAD) != 0;
+    boolean_t thread_node = (parent_snode->psn_flags & PSN_FLAG_THREAD) != 0
+            || parent_snode->psn_node_type == PROCFS_QUERY_DIR;
     
     return_idp->nodeid_base_id = parent_snode->psn_base_node_id;
     return_idp->nodeid_pid = pid_node ? pnp->node_id.nodeid_pid : PRNODE_NO_PID;
     return_idp->nodeid_objectid = thread_node ? pnp->node_id.nodeid_objectid : PRNODE_NO_OBJECTID;
+    if (pid_node && snode->psn_node_type == PROCFS_PROCLINK) {
+        // The process id of a link is that of its target. The
+        // directory's process id is in the object id.
+        return_idp->nodeid_pid = (int)pnp->node_id.nodeid_objectid;
+    }
+}
+
+/*
+ * Gets the object id for the links in a directory of process links.
+ * The process id of each link is that of the process that it links
+ * to, so the object id identifies the directory: it is the object id
+ * of the directory, which holds the parsed query for a directory below
+ * a query directory, or the directory's process id for a directory
+ * that belongs to a process, such as "/proc/N/children".
+ */
+uint64_t
+procfs_get_proclink_objectid(procfsnode_t *dir_pnp) {
+    procfs_structure_node_t *snode = dir_pnp->node_structure_node;
+    if (snode != NULL && (snode->psn_flags & PSN_FLAG_PROCESS) != 0) {
+        return dir_pnp->node_id.nodeid_pid;
+    }
+    return dir_pnp->node_id.nodeid_objectid;
 }
 
 
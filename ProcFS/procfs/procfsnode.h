@@ -11,6 +11,7 @@
 
 #if KERNEL 
 
+#include <libkern/OSTypes.h>
 #include <sys/vnode.h>
 #include "procfsstructure.h"
 
@@ -65,6 +66,38 @@ typedef struct procfsnode {
 
     // Pointer to the procfs_structure_node_t for this node.
     procfs_structure_node_t *node_structure_node;   // Set when allocated, never changes.
+    
+    // Whether the node holds a reference to what its object id refers to
+    // (see the psn_hold_objectid_fn field of procfs_structure_node_t).
+    // Set when allocated, never changes.
+    boolean_t               node_objectid_held;
+
+    // The content of the file that is seen through memory mappings, and
+    // whether the node is currently mapped. The snapshot is generated when
+    // the first mapping is created and is released when the last mapping
+    // is removed. Protected by the snapshot lock (see procfs_snapshot.c).
+    struct procfs_snapshot  *node_map_snapshot;
+    boolean_t               node_mapped;
+    
+    // Whether the mapped content was filtered by an access check and, if
+    // it was, the effective user and group ids that it was filtered for.
+    // All mappings share the same pages, so a mapping by a caller who would
+    // see different content is refused. Protected by the snapshot lock.
+    boolean_t               node_map_filtered;
+    uid_t                   node_map_uid;
+    gid_t                   node_map_gid;
+    
+    // The snapshots that are used to satisfy reads, one for each open
+    // file through which the node is being read. Protected by the
+    // snapshot lock.
+    LIST_HEAD(, procfs_read_snapshot) node_read_snapshots;
+    
+    // The number of kqueue filters that are monitoring this node, updated
+    // atomically, and a signature of the directory content when it was
+    // last checked for changes. The signature is protected by the notify
+    // lock (see procfs_notify.c).
+    SInt32                  node_monitor_count;
+    uint64_t                node_content_signature;
 } procfsnode_t;
 
 #pragma mark -
@@ -101,6 +134,13 @@ extern const procfsnode_id_t PROCFS_ROOT_NODE_ID;
 // Returns 0 on success or an error code (from errno.h) if not.
 typedef int (*create_vnode_func)(void *params, procfsnode_t *pnp, vnode_t *vpp);
 
+// Callback functions for procfsnode_iterate(). The match function selects
+// the nodes of interest and is called with the node hash locked, so it
+// must not block. The vnode function is called for the vnode of each
+// selected node, without the lock.
+typedef boolean_t (*procfsnode_match_fn)(procfsnode_t *pnp, void *arg);
+typedef void (*procfsnode_vnode_fn)(vnode_t vp, void *arg);
+
 // Public API
 extern void procfsnode_start_init(void);
 extern void procfsnode_complete_init(void);
@@ -112,6 +152,8 @@ extern int procfsnode_find(procfs_mount_t *pmp,
                            void *create_vnode_params);
 extern void procfsnode_reclaim(vnode_t vp);
 extern void procfs_get_parent_node_id(procfsnode_t *pnp, procfsnode_id_t *idp);
+extern uint64_t procfs_get_proclink_objectid(procfsnode_t *dir_pnp);
+extern void procfsnode_iterate(procfsnode_match_fn match_fn, procfsnode_vnode_fn vnode_fn, void *arg);
 
 #endif /* KERNEL */
 
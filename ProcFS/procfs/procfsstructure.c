@@ -9,10 +9,13 @@
 #include <kern/debug.h>
 #include <libkern/OSMalloc.h>
 #include <mach/boolean.h>
+#include <mach/vm_statistics.h>
 #include <sys/proc_info.h>
+#include <sys/resource.h>
 #include <sys/vnode.h>
 #include <string.h>
 #include "procfs_data.h"
+#include "procfs_events.h"
 #include "procfsstructure.h"
 
 /*
@@ -55,7 +58,32 @@ STATIC procfs_structure_node_t *add_file(procfs_structure_node_t *parent,
                                          size_t size,
                                          procfs_node_size_fn node_size_fn,
                                          procfs_read_data_fn node_read_data_fn);
+STATIC procfs_structure_node_t *add_stream_file(procfs_structure_node_t *parent,
+                                         const char *name,
+                                         procfs_base_node_id_t node_id,
+                                         uint16_t flags,
+                                         procfs_read_stream_fn node_read_stream_fn);
+STATIC procfs_structure_node_t *add_query_file(procfs_structure_node_t *parent,
+                                         const char *name,
+                                         procfs_base_node_id_t node_id,
+                                         uint16_t flags,
+                                         procfs_node_size_fn node_size_fn,
+                                         procfs_read_data_fn node_read_data_fn,
+                                         procfs_parse_name_fn node_parse_name_fn);
+STATIC procfs_structure_node_t *add_query_dir(procfs_structure_node_t *parent,
+                                         const char *name,
+                                         procfs_base_node_id_t node_id,
+                                         uint16_t flags,
+                                         procfs_parse_name_fn node_parse_name_fn,
+                                         procfs_hold_objectid_fn node_hold_objectid_fn);
+STATIC procfs_structure_node_t *add_proc_links(procfs_structure_node_t *parent,
+                                         const char *name,
+                                         procfs_base_node_id_t node_id,
+                                         uint16_t flags,
+                                         procfs_list_pids_fn node_list_pids_fn,
+                                         procfs_match_proc_fn node_match_proc_fn);
 STATIC void release_node(procfs_structure_node_t *node);
+STATIC procfs_structure_node_t *find_node(procfs_structure_node_t *node, procfs_base_node_id_t base_id);
 
 // Next node id. No need to lock this value because access
 // is guaranteed to be single-threaded. Start at 2 because the
@@ -99,6 +127,119 @@ procfs_structure_init(void) {
         procfs_structure_node_t *proc_by_name_dir = add_directory(root_node, "byname",
                         PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
         
+        // A directory of columnar snapshots of all visible processes. The name of each
+        // file in this directory selects the columns that it contains (e.g. "pid,ppid,rss").
+        procfs_structure_node_t *columns_dir = add_directory(root_node, "columns",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        
+        // A pseudo-entry below "columns" that matches any valid list of column names.
+        // NOTE: this must be the last child entry for the "columns" node.
+        add_query_file(columns_dir, "__Columns__", next_node_id++, 0,
+                       procfs_columns_node_size, procfs_read_columns_data, procfs_parse_columns_name);
+        
+        // A file that delivers a record for each process fork, exec and exit.
+        add_stream_file(root_node, "events", next_node_id++, PSN_FLAG_STREAM, procfs_events_read);
+        
+        // A file that lists the loaded images of all visible processes.
+        add_file(root_node, "images", next_node_id++, 0, 0, procfs_images_node_size, procfs_read_images_data);
+        
+        // A directory of files that report system-wide statistics.
+        procfs_structure_node_t *host_dir = add_directory(root_node, "host",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        add_file(host_dir, "cpuload", next_node_id++, 0, 0, procfs_cpuload_node_size, procfs_read_cpuload_data);
+        add_file(host_dir, "vmstat", next_node_id++, 0, sizeof(struct vm_statistics64), NULL, procfs_read_vmstat_data);
+        add_file(host_dir, "loadavg", next_node_id++, 0, sizeof(procfs_loadavg_t), NULL, procfs_read_loadavg_data);
+        add_file(host_dir, "mempressure", next_node_id++, 0, sizeof(procfs_mempressure_t), NULL, procfs_read_mempressure_data);
+        
+        // A file that lists the sockets that are open in all visible processes.
+        add_file(root_node, "sockets", next_node_id++, 0, 0, procfs_sockets_node_size, procfs_read_sockets_data);
+        
+        // A directory of files that list the processes that have a file open. The name
+        // of each file in this directory is the file id of the open file (e.g. "12345").
+        procfs_structure_node_t *openers_dir = add_directory(root_node, "openers",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        
+        // A pseudo-entry below "openers" that matches any valid file id.
+        // NOTE: this must be the last child entry for the "openers" node.
+        add_query_file(openers_dir, "__Openers__", next_node_id++, 0,
+                       procfs_openers_node_size, procfs_read_openers_data, procfs_parse_openers_name);
+        
+        // A directory of files that list the visible processes with the largest CPU time,
+        // resident size or disk I/O. The name of each file in the "cpu", "rss" and "io"
+        // directories is the number of processes to list (e.g. "top/cpu/20").
+        procfs_structure_node_t *top_dir = add_directory(root_node, "top",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        procfs_structure_node_t *top_cpu_dir = add_directory(top_dir, "cpu",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        procfs_structure_node_t *top_rss_dir = add_directory(top_dir, "rss",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        procfs_structure_node_t *top_io_dir = add_directory(top_dir, "io",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        
+        // Pseudo-entries below "cpu", "rss" and "io" that match any valid process count.
+        // NOTE: each of these must be the last child entry for its parent node.
+        add_query_file(top_cpu_dir, "__Top__", next_node_id++, 0,
+                       procfs_top_node_size, procfs_read_top_cpu_data, procfs_parse_top_name);
+        add_query_file(top_rss_dir, "__Top__", next_node_id++, 0,
+                       procfs_top_node_size, procfs_read_top_rss_data, procfs_parse_top_name);
+        add_query_file(top_io_dir, "__Top__", next_node_id++, 0,
+                       procfs_top_node_size, procfs_read_top_io_data, procfs_parse_top_name);
+        
+        // A directory of files that total the resource usage of the visible processes,
+        // grouped by user id, command name or process group.
+        procfs_structure_node_t *totals_dir = add_directory(root_node, "totals",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        add_file(totals_dir, "uid", next_node_id++, 0, 0, procfs_totals_node_size, procfs_read_totals_uid_data);
+        add_file(totals_dir, "comm", next_node_id++, 0, 0, procfs_totals_node_size, procfs_read_totals_comm_data);
+        add_file(totals_dir, "pgrp", next_node_id++, 0, 0, procfs_totals_node_size, procfs_read_totals_pgrp_data);
+        
+        // A directory of filtered views of the visible processes. The name of each
+        // directory below "select" is a filter (e.g. "uid=501" or "comm=launchd") and
+        // the directory contains links to, and the information for, the processes
+        // that match it.
+        procfs_structure_node_t *select_dir = add_directory(root_node, "select",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        
+        // A pseudo-entry below "select" that matches any valid filter.
+        // NOTE: this must be the last child entry for the "select" node.
+        procfs_structure_node_t *one_select_dir = add_query_dir(select_dir, "__Select__",
+                        next_node_id++, 0, procfs_parse_select_name, procfs_select_hold_objectid);
+        add_file(one_select_dir, "info", next_node_id++, 0, 0, procfs_select_info_node_size, procfs_read_select_info_data);
+        
+        // A pseudo-entry below each filter directory that is replaced by links to the
+        // matching processes.
+        // NOTE: this must be the last child entry for the filter directory.
+        add_proc_links(one_select_dir, "__Selected__", next_node_id++, PSN_FLAG_PROCESS,
+                       procfs_select_list_pids, procfs_select_match_proc);
+        
+        // Directories that index the visible processes by command name, effective user id
+        // and process group id. The name of each directory below them is a key (e.g.
+        // "bycomm/launchd", "byuid/501" or "bypgrp/1") and the directory contains links
+        // to the processes with that key, which are found from an index rather than by
+        // walking the process list.
+        // NOTE: the query directory and the links must be the last child entries of the
+        // "bycomm", "byuid" and "bypgrp" nodes and of the key directories.
+        procfs_structure_node_t *by_comm_dir = add_directory(root_node, "bycomm",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        procfs_structure_node_t *one_comm_dir = add_query_dir(by_comm_dir, "__Comm__",
+                        next_node_id++, 0, procfs_parse_bycomm_name, procfs_bycomm_hold_objectid);
+        add_proc_links(one_comm_dir, "__Comm_Link__", next_node_id++, PSN_FLAG_PROCESS,
+                       procfs_bycomm_list_pids, procfs_bycomm_match_proc);
+        
+        procfs_structure_node_t *by_uid_dir = add_directory(root_node, "byuid",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        procfs_structure_node_t *one_uid_dir = add_query_dir(by_uid_dir, "__Uid__",
+                        next_node_id++, 0, procfs_parse_byuid_name, NULL);
+        add_proc_links(one_uid_dir, "__Uid_Link__", next_node_id++, PSN_FLAG_PROCESS,
+                       procfs_byuid_list_pids, procfs_byuid_match_proc);
+        
+        procfs_structure_node_t *by_pgrp_dir = add_directory(root_node, "bypgrp",
+                        PROCFS_DIR, next_node_id++, 0, 0, NULL, NULL);
+        procfs_structure_node_t *one_pgrp_dir = add_query_dir(by_pgrp_dir, "__Pgrp__",
+                        next_node_id++, 0, procfs_parse_bypgrp_name, NULL);
+        add_proc_links(one_pgrp_dir, "__Pgrp_Link__", next_node_id++, PSN_FLAG_PROCESS,
+                       procfs_bypgrp_list_pids, procfs_bypgrp_match_proc);
+        
         // A pseudo-entry below "byname" that is replaced by nodes for all of the visible processes.
         // NOTE: this must be the last child entry for the "byname" node.
         add_directory(proc_by_name_dir, "__Process_N__",
@@ -129,6 +270,16 @@ procfs_structure_init(void) {
         procfs_structure_node_t *one_thread_dir = add_directory(threads_dir, "__Thread__",
                       PROCFS_THREADDIR, next_node_id++, PSN_FLAG_PROCESS | PSN_FLAG_THREAD, 0, procfs_thread_node_size, NULL);
         
+        // A directory below the node for a process that holds links to the children of that process.
+        procfs_structure_node_t *children_dir = add_directory(one_proc_dir, "children",
+                       PROCFS_DIR, next_node_id++, PSN_FLAG_PROCESS, 0, NULL, NULL);
+        
+        // A pseudo-entry below the "children" node that is replaced by links to the
+        // children of the current process.
+        // NOTE: this must be the last child entry for the "children" node.
+        add_proc_links(children_dir, "__Child__", next_node_id++, PSN_FLAG_PROCESS,
+                       procfs_children_list_pids, procfs_children_match_proc);
+        
         // --- Per-proccess sub-directories and files.
         
         // Files that returns the process's pid, parent pid, process group id,
@@ -140,6 +291,17 @@ procfs_structure_init(void) {
         add_file(one_proc_dir, "tty", next_node_id++, PSN_FLAG_PROCESS, 0, NULL, procfs_read_tty_data);
         add_file(one_proc_dir, "info", next_node_id++, PSN_FLAG_PROCESS, sizeof(struct proc_bsdinfo), NULL, procfs_read_proc_info);
         add_file(one_proc_dir, "taskinfo", next_node_id++, PSN_FLAG_PROCESS, sizeof(struct proc_taskinfo), NULL, procfs_read_task_info);
+        add_file(one_proc_dir, "rusage", next_node_id++, PSN_FLAG_PROCESS, sizeof(rusage_info_current), NULL, procfs_read_rusage_data);
+        
+        // File that lists the process's VM regions. This can be very large, so it is
+        // generated as it is read.
+        add_stream_file(one_proc_dir, "map", next_node_id++, PSN_FLAG_PROCESS, procfs_read_map_data);
+        
+        // File that lists the Mach-O images that the process has loaded.
+        add_file(one_proc_dir, "images", next_node_id++, PSN_FLAG_PROCESS, 0, procfs_images_node_size, procfs_read_images_data);
+        
+        // File that lists every process in the subtree below the process.
+        add_file(one_proc_dir, "descendants", next_node_id++, PSN_FLAG_PROCESS, 0, procfs_descendants_node_size, procfs_read_descendants_data);
         
         // --- Per thread files.
         add_file(one_thread_dir, "info", next_node_id++, PSN_FLAG_PROCESS | PSN_FLAG_THREAD, sizeof(struct proc_taskinfo), NULL, procfs_read_thread_info);
@@ -164,6 +326,13 @@ procfs_structure_free() {
     }
 }
 
+// Gets the structure node with a given base node id, or NULL if there
+// is none. Used to map a file id back to the node that it came from.
+procfs_structure_node_t *
+procfs_structure_node_for_id(procfs_base_node_id_t base_id) {
+    return root_node == NULL ? NULL : find_node(root_node, base_id);
+}
+
 // Gets the vnode type that is appropriate for a given structure node type.
 enum vtype
 vnode_type_for_structure_node_type(procfs_structure_node_type_t snode_type) {
@@ -175,12 +344,15 @@ vnode_type_for_structure_node_type(procfs_structure_node_type_t snode_type) {
     case PROCFS_DIR_THIS:   // FALLTHRU
     case PROCFS_DIR_PARENT: // FALLTHRU
     case PROCFS_FD_DIR:     // FALLTHRU
+    case PROCFS_QUERY_DIR:
         return VDIR;
         
-    case PROCFS_FILE:
+    case PROCFS_FILE:       // FALLTHRU
+    case PROCFS_QUERY_FILE:
         return VREG;
             
     case PROCFS_PROCNAME_DIR:   // FALLTHRU
+    case PROCFS_PROCLINK:       // FALLTHRU
     case PROCFS_CURPROC:
         return VLNK;
     }
@@ -211,6 +383,7 @@ add_node(procfs_structure_node_t *parent,
         panic("Unable to allocate memory for procfs_structure_node_t");
     }
     
+    assert(node_id <= PROCFS_MAX_BASE_NODE_ID);
     bzero(node, sizeof(procfs_structure_node_t));
     node->psn_node_type = type;
     strlcpy(node->psn_name, name, sizeof(node->psn_name));
@@ -228,6 +401,10 @@ add_node(procfs_structure_node_t *parent,
         
         // Propagate the PSN_FLAG_PROCESS and PSN_FLAG_THREAD flags downward.
         node->psn_flags |= (parent->psn_flags & (PSN_FLAG_PROCESS | PSN_FLAG_THREAD));
+        
+        // Nodes below a query directory inherit its object id, so they
+        // must hold it in the same way.
+        node->psn_hold_objectid_fn = parent->psn_hold_objectid_fn;
     }
     return node;
 }
@@ -274,6 +451,79 @@ add_file(procfs_structure_node_t *parent,
     return add_node(parent, name, PROCFS_FILE, node_id, flags, size, node_size_fn, node_read_data_fn);
 }
 
+/*
+ * Adds a file whose content is read directly from its source
+ * instead of from a snapshot. The size of such a file is always
+ * reported as zero.
+ */
+STATIC procfs_structure_node_t *
+add_stream_file(procfs_structure_node_t *parent,
+                const char *name,
+                procfs_base_node_id_t node_id,
+                uint16_t flags,
+                procfs_read_stream_fn node_read_stream_fn) {
+    procfs_structure_node_t *snode = add_node(parent, name, PROCFS_FILE, node_id, flags, 0, NULL, NULL);
+    snode->psn_read_stream_fn = node_read_stream_fn;
+    return snode;
+}
+
+/*
+ * Adds a query file to the file system structure. A query file stands
+ * for all of the names that its parse function accepts, so it must be
+ * the last child of its parent.
+ */
+STATIC procfs_structure_node_t *
+add_query_file(procfs_structure_node_t *parent,
+               const char *name,
+               procfs_base_node_id_t node_id,
+               uint16_t flags,
+               procfs_node_size_fn node_size_fn,
+               procfs_read_data_fn node_read_data_fn,
+               procfs_parse_name_fn node_parse_name_fn) {
+    procfs_structure_node_t *snode = add_node(parent, name, PROCFS_QUERY_FILE, node_id, flags, 0, node_size_fn, node_read_data_fn);
+    snode->psn_parse_name_fn = node_parse_name_fn;
+    return snode;
+}
+
+/*
+ * Adds a query directory to the file system structure. Like a query
+ * file, a query directory stands for all of the names that its parse
+ * function accepts, so it must be the last child of its parent. If the
+ * parsed object id needs a reference, "node_hold_objectid_fn" takes and
+ * releases it. The children that are added to the directory inherit it.
+ */
+STATIC procfs_structure_node_t *
+add_query_dir(procfs_structure_node_t *parent,
+              const char *name,
+              procfs_base_node_id_t node_id,
+              uint16_t flags,
+              procfs_parse_name_fn node_parse_name_fn,
+              procfs_hold_objectid_fn node_hold_objectid_fn) {
+    procfs_structure_node_t *snode = add_directory(parent, name, PROCFS_QUERY_DIR, node_id, flags, 0, NULL, NULL);
+    snode->psn_parse_name_fn = node_parse_name_fn;
+    snode->psn_hold_objectid_fn = node_hold_objectid_fn;
+    return snode;
+}
+
+/*
+ * Adds a node that stands for links to a set of processes. The node
+ * is replaced by a link for each process that its list function
+ * returns, so it must be the last child of its parent. The size of
+ * the parent directory includes one entry for each of those processes.
+ */
+STATIC procfs_structure_node_t *
+add_proc_links(procfs_structure_node_t *parent,
+               const char *name,
+               procfs_base_node_id_t node_id,
+               uint16_t flags,
+               procfs_list_pids_fn node_list_pids_fn,
+               procfs_match_proc_fn node_match_proc_fn) {
+    procfs_structure_node_t *snode = add_node(parent, name, PROCFS_PROCLINK, node_id, flags, 0, procfs_proclink_node_size, NULL);
+    snode->psn_list_pids_fn = node_list_pids_fn;
+    snode->psn_match_proc_fn = node_match_proc_fn;
+    return snode;
+}
+
 #pragma mark -
 #pragma mark Clean up of Structure Nodes
 
@@ -300,3 +550,23 @@ release_node(procfs_structure_node_t *snode) {
     // Free this node's memory.
     OSFree(snode, sizeof(procfs_structure_node_t), procfs_osmalloc_tag);
 }
+
+/*
+ * Searches a node and its descendents for the node with a given
+ * base node id. Returns NULL if there is no such node.
+ */
+STATIC procfs_structure_node_t *
+find_node(procfs_structure_node_t *snode, procfs_base_node_id_t base_id) {
+    if (snode->psn_base_node_id == base_id) {
+        return snode;
+    }
+    
+    procfs_structure_node_t *child;
+    TAILQ_FOREACH(child, &snode->psn_children, psn_next) {
+        procfs_structure_node_t *match = find_node(child, base_id);
+        if (match != NULL) {
+            return match;
+        }
+    }
+    return NULL;
+}
@@ -15,6 +15,7 @@
 
 enum vtype;
 typedef struct procfsnode procfsnode_t;
+struct fileglob;
 
 /*
  * Definitions for the data structures that determine the
@@ -43,11 +44,15 @@ typedef enum {
     PROCFS_CURPROC,         // The symlink to the current process.
     PROCFS_PROCNAME_DIR,    // The directory for a process labeled with its command line
     PROCFS_FD_DIR,          // The directory for a file descriptor for a process.
+    PROCFS_QUERY_FILE,      // A file whose name is a query, parsed when it is looked up.
+    PROCFS_QUERY_DIR,       // A directory whose name is a query, parsed when it is looked up.
+    PROCFS_PROCLINK,        // A symbolic link to the directory for a process, labeled with its process id.
 } procfs_structure_node_type_t;
 
 // Returns whether a given node type represents a directory.
 static inline boolean_t procfs_is_directory_type(procfs_structure_node_type_t type) {
-    return type != PROCFS_FILE && type != PROCFS_CURPROC;
+    return type != PROCFS_FILE && type != PROCFS_CURPROC && type != PROCFS_QUERY_FILE
+            && type != PROCFS_PROCLINK;
 }
 
 // Type for the base node id field of a structure node.
@@ -56,6 +61,10 @@ typedef uint16_t procfs_base_node_id_t;
 // Root node id value.
 #define PROCFS_ROOT_NODE_BASE_ID ((procfs_base_node_id_t)1)
 
+// Largest base node id. Base node ids are encoded in the file ids of
+// nodes (see procfs_get_fileid()), which leaves room for this many.
+#define PROCFS_MAX_BASE_NODE_ID ((procfs_base_node_id_t)1023)
+
 // Largest name of a structure node.
 #define MAX_STRUCT_NODE_NAME_LEN 16
 
@@ -65,6 +74,38 @@ typedef size_t (*procfs_node_size_fn)(procfsnode_t *pnp, kauth_cred_t creds);
 // Type of a function that reads the data for a procfs node.
 typedef int (*procfs_read_data_fn)(procfsnode_t *pnp, uio_t uio, vfs_context_t ctx);
 
+// Type of a function that reads the content of a node directly from its
+// source, without taking a snapshot. "fg" is the open file that the read is
+// made through, or NULL if it is not made through one, and "ioflag" is the
+// IO_XXX flags for the read.
+typedef int (*procfs_read_stream_fn)(procfsnode_t *pnp, struct fileglob *fg, uio_t uio, int ioflag, vfs_context_t ctx);
+
+// Type of a function that converts the name of a PROCFS_QUERY_FILE node
+// to the object id for the node. Returns 0 on success, ENOENT if the
+// name is not valid or another error if the object id could not be
+// created. If the node has a psn_hold_objectid_fn function, the object
+// id is returned with a reference, which the caller must release.
+typedef int (*procfs_parse_name_fn)(const char *name, uint64_t *objectidp);
+
+// Type of a function that takes ("hold" is TRUE) or releases ("hold" is
+// FALSE) a reference to whatever the object id of a node refers to, so that
+// the object id keeps its meaning while the node exists. When taking a
+// reference, returns TRUE if one was taken. Called with the node hash lock
+// held, so it must not block.
+typedef boolean_t (*procfs_hold_objectid_fn)(uint64_t objectid, boolean_t hold);
+
+// Type of a function that gets the ids of the processes that a PROCFS_PROCLINK
+// node links to from the directory "dir_pnp", in increasing order. If creds is
+// not NULL, only the processes that are visible to those credentials are
+// included. The list is allocated with procfs_alloc_pids() and must be released
+// with procfs_release_pids().
+typedef void (*procfs_list_pids_fn)(procfsnode_t *dir_pnp, kauth_cred_t creds,
+                                    pid_t **pidpp, int *pid_count, uint32_t *sizep);
+
+// Type of a function that determines whether a PROCFS_PROCLINK node links
+// to a given process from the directory "dir_pnp".
+typedef boolean_t (*procfs_match_proc_fn)(procfsnode_t *dir_pnp, proc_t p);
+
 /*
  * An entry in the procfs file system layout. All fields of this
  * structure are set on creation and do not change, so no locking
@@ -81,11 +122,34 @@ typedef int (*procfs_read_data_fn)(procfsnode_t *pnp, uio_t uio, vfs_context_t c
  *
  * The psn_base_node_id field is a unique value that becomes part of the
  * full id of any procfsnode_t that is created from this structure node.
+ *
+ * Nodes of type PROCFS_QUERY_FILE and PROCFS_QUERY_DIR do not appear in
+ * directory listings. Instead, any name that the node's psn_parse_name_fn
+ * function accepts can be looked up in the parent directory. The parsed name
+ * becomes the object id of the resulting node and is inherited by the nodes
+ * below a PROCFS_QUERY_DIR node. If the object id refers to something that
+ * must stay alive while it is in use, such as an interned command name, the
+ * node has a psn_hold_objectid_fn function, which is inherited by the nodes
+ * below it and is used to take a reference for each procfsnode_t that has
+ * the object id.
+ *
+ * A node of type PROCFS_PROCLINK stands for a set of symbolic links, one for
+ * each process that its psn_list_pids_fn function lists, named with the process
+ * id and linking to the directory for that process in the root of the file
+ * system. A name can be looked up if it is the id of a visible process that the
+ * psn_match_proc_fn function accepts.
  * 
  * The PSN_FLAG_PROCESS and PSN_FLAG_THREAD flag values of a node are propagated
  * to all descendent nodes, so it is always possible to determine whether a
  * node is process- and/or thread-related just by examining the psn_flags
  * field of its procfs_structure_node.
+ *
+ * A file that has a psn_read_stream_fn function instead of a psn_read_data_fn
+ * function is read directly from its source, rather than from a snapshot of
+ * its content, because the content is unbounded or too large to hold in memory.
+ * Such files cannot be memory mapped. A file with the PSN_FLAG_STREAM flag is
+ * a stream of records in which each process that opens the file has its own
+ * position, so it is told when the file is opened and closed.
  */
 typedef struct procfs_structure_node {
     procfs_structure_node_type_t        psn_node_type;
@@ -112,11 +176,28 @@ typedef struct procfs_structure_node {
     
     // Reads the file content.
     procfs_read_data_fn                 psn_read_data_fn;
+    
+    // Reads the file content without a snapshot. NULL if psn_read_data_fn is set.
+    procfs_read_stream_fn               psn_read_stream_fn;
+    
+    // Parses the name of a PROCFS_QUERY_FILE or PROCFS_QUERY_DIR node. NULL for
+    // all other node types.
+    procfs_parse_name_fn                psn_parse_name_fn;
+    
+    // Holds the object id of a node below a PROCFS_QUERY_DIR node, if
+    // it needs a reference. NULL for all other nodes.
+    procfs_hold_objectid_fn             psn_hold_objectid_fn;
+    
+    // List and match the processes of a PROCFS_PROCLINK node. NULL for all
+    // other node types.
+    procfs_list_pids_fn                 psn_list_pids_fn;
+    procfs_match_proc_fn                psn_match_proc_fn;
 } procfs_structure_node_t;
 
 // Bit values for the psn_flags field.
 #define PSN_FLAG_PROCESS    (1 << 0)
 #define PSN_FLAG_THREAD     (1 << 1)
+#define PSN_FLAG_STREAM     (1 << 2)    // Content is a stream of records with a position per process. Not propagated.
 
 #pragma mark -
 #pragma mark Global Definitions
@@ -132,6 +213,9 @@ extern void procfs_structure_init(void);
 // while unmounting the last instance of the file system.
 extern void procfs_structure_free(void);
 
+// Gets the structure node with a given base node id, or NULL if there is none.
+extern procfs_structure_node_t *procfs_structure_node_for_id(procfs_base_node_id_t base_id);
+
 // Gets the vnode type that is appropriate for a given structure node type.
 extern enum vtype vnode_type_for_structure_node_type(procfs_structure_node_type_t);
 